@@ -0,0 +1,161 @@
+#include "bench_common.hpp"
+#include "af_packet_port.hpp"
+#include "traffic_generator.hpp"
+#include "internet_protocol.hpp"
+#include "checksum.hpp"
+#include "logger.hpp"
+#include <fstream>
+
+/* the router between two veth pairs, every packet through the kernel:
+
+     afb_gen ==veth== afb_rt0 [router] afb_rt1 ==veth== afb_sink
+
+   generated traffic leaves afb_gen's send ring, the router reads it from afb_rt0's
+   receive ring, forwards it out of afb_rt1 (the FIB's routes name that interface) and
+   afb_sink's receive ring must get every packet with its TTL one lower and the header
+   checksum still valid. one thread drives all four rings, so the rate is the whole
+   loop's, with the router's share of the time reported on its own. needs root for the
+   veth pairs, the benchmark is skipped without them */
+
+constexpr size_t TABLE_PREFIXES = 100000;
+constexpr size_t PACKETS = 1 << 20;
+constexpr size_t BURST = 32;
+constexpr size_t IN_FLIGHT = 8192;          // generated but not seen at the sink yet
+constexpr uint64_t STALL_NS = 2000000000;   // nothing arrives for this long: packets were lost
+const char* const GENERATOR = "afb_gen";
+const char* const ROUTER_IN = "afb_rt0";
+const char* const ROUTER_OUT = "afb_rt1";
+const char* const SINK = "afb_sink";
+
+static bool run(const std::string& command) {
+    return std::system((command + " > /dev/null 2>&1").c_str()) == 0;
+}
+
+// a veth pair, up, without IPv6 so the kernel sends no neighbour discovery of its own
+static bool addVethPair(const char* first, const char* second) {
+    if (!run(std::string("ip link add ") + first + " type veth peer name " + second)) {
+        return false;
+    }
+    for (const char* name : {first, second}) {
+        std::ofstream(std::string("/proc/sys/net/ipv6/conf/") + name + "/disable_ipv6") << "1";
+        if (!run(std::string("ip link set ") + name + " up")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void removeVethPairs() {
+    run(std::string("ip link del ") + GENERATOR);
+    run(std::string("ip link del ") + ROUTER_OUT);
+}
+
+struct LoopResult {
+    uint64_t sent = 0;
+    uint64_t delivered = 0;
+    uint64_t bad = 0;               // wrong TTL or header checksum at the sink
+    uint64_t elapsed_ns = 0;
+    uint64_t router_ns = 0;
+};
+
+static LoopResult forwardLoop(InternetProtocol& ip, TrafficGenerator& generator, AfPacketPort& gen, AfPacketPort& in,
+                              AfPacketPort& out, AfPacketPort& sink) {
+    AfPacketEgress egress(ip.adjacencies());
+    egress.addPort(out);
+    VerdictCounter counter;
+    VerdictTee both(egress, counter);
+    std::vector<uint8_t> scratch(generator.maxPacketSize());
+    PacketView packets[BURST];
+    LoopResult result;
+    uint64_t start = benchNowNs(), last_arrival = start;
+
+    while (result.delivered < PACKETS) {
+        // keep the rings fed, IN_FLIGHT ahead of the sink at most
+        for (size_t i = 0; i < BURST && result.sent < PACKETS && result.sent - result.delivered < IN_FLIGHT; i++) {
+            size_t length = generator.next(scratch.data(), scratch.size());
+            result.sent += gen.send(PacketView(scratch.data(), length));
+        }
+        gen.flush();
+
+        uint64_t router_start = benchNowNs();
+        while (size_t count = in.receive(packets, BURST)) {
+            ip.forwardPackets(packets, count, both);
+        }
+        egress.flush();
+        result.router_ns += benchNowNs() - router_start;
+
+        while (size_t count = sink.receive(packets, BURST)) {
+            for (size_t i = 0; i < count; i++) {
+                IPv4HeaderView header(packets[i]);
+                result.bad += header.ttl() != 63 || internetChecksum(packets[i].data(), IPv4_HEADER_SIZE) != 0;
+            }
+            result.delivered += count;
+            last_arrival = benchNowNs();
+        }
+        if (benchNowNs() - last_arrival > STALL_NS) {
+            break;
+        }
+    }
+    result.elapsed_ns = benchNowNs() - start;
+    return result;
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== AF_PACKET ports over veth (%zu FIB prefixes) ===\n", TABLE_PREFIXES);
+    removeVethPairs();
+    if (!addVethPair(GENERATOR, ROUTER_IN) || !addVethPair(ROUTER_OUT, SINK)) {
+        removeVethPairs();
+        std::printf("  cannot create veth pairs (needs root)\n");
+        std::printf("ports forward kernel traffic: skipped\n");
+        return 0;
+    }
+
+    InternetProtocol ip;
+    for (const auto& p : benchRandomPrefixes(TABLE_PREFIXES, 42)) {
+        ip.addRoute(benchIpString(p.network) + "/" + std::to_string(p.prefix_len), ROUTER_OUT);
+    }
+
+    AfPacketConfig config;
+    config.block_count = 16;
+    AfPacketPort gen, in, out, sink;
+    bool ok = gen.open(GENERATOR, config) && in.open(ROUTER_IN, config) && out.open(ROUTER_OUT, config) &&
+              sink.open(SINK, config);
+    if (!ok) {
+        removeVethPairs();
+        std::printf("ports forward kernel traffic: FAILED (ports did not open)\n");
+        return 0;
+    }
+    out.setPeerMac(sink.mac());
+
+    for (uint16_t size : {64, 0}) {
+        TrafficProfile profile;
+        profile.flows = 10000;
+        if (size) {
+            profile.sizes = {{size, 1}};
+        }
+        TrafficGenerator generator(profile, ip.routePrefixes());
+        LoopResult result = forwardLoop(ip, generator, gen, in, out, sink);
+        std::printf("--- %s ---\n", size ? "64 byte packets" : "IMIX");
+        benchReport("generate -> router -> sink", result.delivered, result.elapsed_ns);
+        benchReport("router: receive + forward + send", result.delivered, result.router_ns);
+        std::printf("  %llu sent, %llu delivered, %llu with a wrong TTL or checksum\n",
+                    static_cast<unsigned long long>(result.sent), static_cast<unsigned long long>(result.delivered),
+                    static_cast<unsigned long long>(result.bad));
+        ok &= result.sent == PACKETS && result.delivered == PACKETS && result.bad == 0;
+    }
+    const AfPacketStats& in_stats = in.stats();
+    const AfPacketStats& out_stats = out.stats();
+    std::printf("  router ports: %llu received (%llu non-IP, %llu kernel drops), %llu sent (%llu ring full)\n",
+                static_cast<unsigned long long>(in_stats.rx_packets), static_cast<unsigned long long>(in_stats.rx_non_ip),
+                static_cast<unsigned long long>(in_stats.rx_kernel_drops),
+                static_cast<unsigned long long>(out_stats.tx_packets), static_cast<unsigned long long>(out_stats.tx_ring_full));
+
+    gen.close();
+    in.close();
+    out.close();
+    sink.close();
+    removeVethPairs();
+    std::printf("ports forward kernel traffic: %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
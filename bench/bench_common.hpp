@@ -0,0 +1,174 @@
+#pragma once
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "adjacency_table.hpp"
+#include "ipv6_address.hpp"
+
+/* shared helpers for the micro benchmarks in bench/.
+   each benchmark is a standalone binary built by `make bench` */
+
+struct BenchPrefix {
+    uint32_t network;
+    uint8_t prefix_len;
+};
+
+inline uint64_t benchNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* random prefixes with a length mix roughly shaped like a full internet table:
+   mostly /24, a wide band of /16-/23, a few short aggregates and some host routes */
+inline std::vector<BenchPrefix> benchRandomPrefixes(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<BenchPrefix> prefixes;
+    prefixes.reserve(count);
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t roll = rng() % 100;
+        uint8_t len;
+        if (roll < 58)      len = 24;
+        else if (roll < 93) len = 16 + rng() % 8;
+        else if (roll < 97) len = 8 + rng() % 8;
+        else                len = 25 + rng() % 8;
+
+        uint32_t mask = (0xFFFFFFFF << (32 - len));
+        prefixes.push_back({static_cast<uint32_t>(rng()) & mask, len});
+    }
+    return prefixes;
+}
+
+/* destinations for lookups: half inside installed prefixes, half uniformly random */
+inline std::vector<uint32_t> benchDestinations(const std::vector<BenchPrefix>& prefixes,
+                                               size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> dsts(count);
+    for (size_t i = 0; i < count; i++) {
+        if ((i & 1) && !prefixes.empty()) {
+            const BenchPrefix& p = prefixes[rng() % prefixes.size()];
+            uint32_t host_bits = (p.prefix_len == 32) ? 0 : (0xFFFFFFFF >> p.prefix_len);
+            dsts[i] = p.network | (static_cast<uint32_t>(rng()) & host_bits);
+        } else {
+            dsts[i] = static_cast<uint32_t>(rng());
+        }
+    }
+    return dsts;
+}
+
+// dotted quad of a host order address, for the string based route and packet builder APIs
+inline std::string benchIpString(uint32_t address) {
+    struct in_addr in = {htonl(address)};
+    return inet_ntoa(in);
+}
+
+/* benchmarks that verify lookups announce each prefix through interface "p<len>" with
+   the prefix itself as next hop, so a returned adjacency identifies the matched prefix */
+inline std::string benchInterface(uint8_t prefix_len) {
+    return "p" + std::to_string(prefix_len);
+}
+
+// prefix length of the route the adjacency was announced for, -1 for no route and
+// -2 when that route does not contain dst
+inline int benchMatchedLength(const AdjacencyTable& adjacencies, AdjacencyHandle handle, uint32_t dst) {
+    if (handle == NO_ADJACENCY) {
+        return -1;
+    }
+    int len = std::atoi(adjacencies.interfaceOf(handle).c_str() + 1);
+    uint32_t mask = (len == 0) ? 0 : (0xFFFFFFFF << (32 - len));
+    return ((dst & mask) == adjacencies.get(handle).next_hop) ? len : -2;
+}
+
+struct BenchPrefix6 {
+    IPv6Address network;
+    uint8_t prefix_len;
+};
+
+inline IPv6Address benchRandomAddress6(std::mt19937& rng) {
+    IPv6Address address;
+    for (int i = 0; i < 16; i += 4) {
+        uint32_t word = rng();
+        std::memcpy(address.bytes + i, &word, sizeof(word));
+    }
+    return address;
+}
+
+// random bits below prefix_len replaced by the ones of network
+inline IPv6Address benchAddressIn6(const IPv6Address& network, uint8_t prefix_len, std::mt19937& rng) {
+    IPv6Address address = benchRandomAddress6(rng);
+    for (int bit = 0; bit < prefix_len; bit++) {
+        uint8_t mask = static_cast<uint8_t>(0x80 >> (bit % 8));
+        address.bytes[bit / 8] = (address.bytes[bit / 8] & ~mask) | (network.bytes[bit / 8] & mask);
+    }
+    return address;
+}
+
+/* IPv6 prefixes shaped like a global table: registry allocations (/29-/32) inside
+   2000::/3 and, nested inside them, mostly /48 sites and /33-/47 aggregates with a
+   few longer prefixes, host routes and short covering prefixes */
+inline std::vector<BenchPrefix6> benchRandomPrefixes6(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    IPv6Address global = {};
+    global.bytes[0] = 0x20;
+    std::vector<BenchPrefix6> prefixes;
+    prefixes.reserve(count);
+
+    size_t allocations = std::max<size_t>(1, count / 8);
+    for (size_t i = 0; i < allocations && i < count; i++) {
+        uint8_t len = 29 + rng() % 4;
+        prefixes.push_back({benchAddressIn6(global, 3, rng).masked(len), len});
+    }
+    while (prefixes.size() < count) {
+        const BenchPrefix6& parent = prefixes[rng() % allocations];
+        uint32_t roll = rng() % 100;
+        uint8_t len;
+        if (roll < 55)      len = 48;
+        else if (roll < 93) len = 33 + rng() % 15;
+        else if (roll < 96) len = 49 + rng() % 16;
+        else if (roll < 97) len = 128;
+        else                len = 19 + rng() % 10;
+        // shorter than the allocation: a covering aggregate of it
+        prefixes.push_back({benchAddressIn6(parent.network, std::min(len, parent.prefix_len), rng).masked(len), len});
+    }
+    return prefixes;
+}
+
+// half inside installed prefixes, half anywhere in 2000::/3
+inline std::vector<IPv6Address> benchDestinations6(const std::vector<BenchPrefix6>& prefixes,
+                                                   size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    IPv6Address global = {};
+    global.bytes[0] = 0x20;
+    std::vector<IPv6Address> dsts(count);
+    for (size_t i = 0; i < count; i++) {
+        if ((i & 1) && !prefixes.empty()) {
+            const BenchPrefix6& p = prefixes[rng() % prefixes.size()];
+            dsts[i] = benchAddressIn6(p.network, p.prefix_len, rng);
+        } else {
+            dsts[i] = benchAddressIn6(global, 3, rng);
+        }
+    }
+    return dsts;
+}
+
+// IPv6 form of benchMatchedLength, the prefix is announced as its own next hop
+inline int benchMatchedLength6(const AdjacencyTable& adjacencies, AdjacencyHandle handle, const IPv6Address& dst) {
+    if (handle == NO_ADJACENCY) {
+        return -1;
+    }
+    const Adjacency6& adjacency = adjacencies.get6(handle);
+    int len = std::atoi(adjacencies.interfaceName(adjacency.interface_id).c_str() + 1);
+    return (dst.masked(static_cast<uint8_t>(len)) == adjacency.next_hop) ? len : -2;
+}
+
+inline void benchReport(const char* name, uint64_t ops, uint64_t elapsed_ns) {
+    double ns_per_op = static_cast<double>(elapsed_ns) / ops;
+    std::printf("  %-34s %10.2f ns/op %10.2f Mops/s\n", name, ns_per_op, 1000.0 / ns_per_op);
+}
@@ -0,0 +1,222 @@
+#include "bench_common.hpp"
+#include "packet_builders.hpp"
+#include "checksum.hpp"
+#include "logger.hpp"
+#include <atomic>
+#include <new>
+
+/* the IPv4 packet builders: build() into a fresh vector, the pooled build that goes
+   through buildInto() with the addresses parsed per packet or resolved once, buildInto()
+   into a reused buffer, and a PacketTemplate stamped per packet, patched field by field
+   or with every field set by the stamp. every path must produce the bytes build() does,
+   with valid checksums, and global operator new is counted to show the buffer paths do
+   not allocate */
+
+constexpr size_t CHECKED_CASES = 30000;
+constexpr size_t PACKETS = 1 << 21;
+constexpr size_t POOL_BUFFERS = 256;
+constexpr size_t MAX_PAYLOAD = 1400;
+constexpr size_t TIMED_PAYLOADS[] = {64, 1024};
+
+static std::atomic<uint64_t> heap_allocations{0};
+
+void* operator new(size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// the per-packet fields a template rewrites
+struct Fields {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t identification;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint32_t seq;
+};
+
+static Fields randomFields(std::mt19937& rng) {
+    return {static_cast<uint32_t>(rng()), static_cast<uint32_t>(rng()), static_cast<uint16_t>(rng()),
+            static_cast<uint16_t>(rng()), static_cast<uint16_t>(rng()), static_cast<uint32_t>(rng())};
+}
+
+struct Builders {
+    ICMPPacketBuilder icmp;
+    TCPPacketBuilder tcp;
+    UDPPacketBuilder udp;
+
+    void setPayload(const std::string& payload) {
+        icmp.icmp_payload = tcp.tcp_payload = udp.udp_payload = payload;
+    }
+
+    // ICMP takes the source port as its echo identifier and the sequence's low half
+    void setFields(const Fields& f) {
+        std::string src = benchIpString(f.src_ip), dst = benchIpString(f.dst_ip);
+        icmp.ipv4_src_ip = tcp.ipv4_src_ip = udp.ipv4_src_ip = src;
+        icmp.ipv4_dst_ip = tcp.ipv4_dst_ip = udp.ipv4_dst_ip = dst;
+        icmp.ipv4_identification = tcp.ipv4_identification = udp.ipv4_identification = f.identification;
+        icmp.icmp_id = f.src_port;
+        icmp.icmp_seq = static_cast<uint16_t>(f.seq);
+        tcp.tcp_src_port = udp.udp_src_port = f.src_port;
+        tcp.tcp_dst_port = udp.udp_dst_port = f.dst_port;
+        tcp.tcp_seq = f.seq;
+    }
+
+    std::vector<uint8_t> build(size_t kind) const {
+        return kind == 0 ? icmp.build() : kind == 1 ? tcp.build() : udp.build();
+    }
+    size_t buildInto(size_t kind, uint8_t* out, size_t capacity) const {
+        return kind == 0 ? icmp.buildInto(out, capacity) : kind == 1 ? tcp.buildInto(out, capacity) : udp.buildInto(out, capacity);
+    }
+    bool resolve(size_t kind) {
+        return kind == 0 ? icmp.resolveAddresses() : kind == 1 ? tcp.resolveAddresses() : udp.resolveAddresses();
+    }
+    bool assign(size_t kind, PacketTemplate& tmpl) const {
+        return kind == 0 ? tmpl.assign(icmp) : kind == 1 ? tmpl.assign(tcp) : tmpl.assign(udp);
+    }
+};
+
+// header checksum and L4 checksum (over the pseudo-header for TCP and UDP) both verify
+static bool checksumsValid(const uint8_t* packet, size_t length) {
+    IPv4HeaderView header(PacketView(packet, length));
+    const uint8_t* segment = packet + IPv4_HEADER_SIZE;
+    size_t segment_length = length - IPv4_HEADER_SIZE;
+    uint32_t pseudo_sum = header.protocol() == PROTOCOL_ICMP
+                              ? 0 : pseudoHeaderSum(header.srcIp(), header.dstIp(), header.protocol(), segment_length);
+    return internetChecksum(packet, IPv4_HEADER_SIZE) == 0 &&
+           checksumFold(checksumAdd(pseudo_sum, segment, segment_length)) == 0xFFFF;
+}
+
+static void applyFields(const PacketTemplate& tmpl, uint8_t* packet, const Fields& f) {
+    tmpl.setIdentification(packet, f.identification);
+    tmpl.setSrcIp(packet, f.src_ip);
+    tmpl.setDstIp(packet, f.dst_ip);
+    tmpl.setSrcPort(packet, f.src_port);
+    tmpl.setDstPort(packet, f.dst_port);
+    tmpl.setSequence(packet, f.seq);
+    tmpl.setEcho(packet, f.src_port, static_cast<uint16_t>(f.seq));
+}
+
+static bool checkBuilders() {
+    std::mt19937 rng(17);
+    std::vector<uint8_t> out(IPv4_HEADER_SIZE + TCP_HEADER_SIZE + MAX_PAYLOAD), stamped(out.size());
+    size_t mismatches = 0, bad_checksums = 0, template_mismatches = 0;
+    for (size_t c = 0; c < CHECKED_CASES; c++) {
+        size_t kind = c % 3;
+        std::string payload(rng() % (MAX_PAYLOAD + 1), '\0');
+        for (auto& byte : payload) {
+            byte = static_cast<char>(rng());
+        }
+        Builders builders;
+        builders.setPayload(payload);
+        builders.tcp.tcp_flags = static_cast<uint8_t>(rng());
+        builders.udp.ipv4_ttl = builders.tcp.ipv4_ttl = static_cast<uint8_t>(rng());
+
+        // a template from the builder as it is, then the same builder with new fields
+        PacketTemplate tmpl;
+        bool assigned = builders.assign(kind, tmpl);
+        Fields fields = randomFields(rng);
+        builders.setFields(fields);
+
+        std::vector<uint8_t> expected = builders.build(kind);
+        size_t parsed = builders.buildInto(kind, out.data(), out.size());
+        mismatches += parsed != expected.size() || std::memcmp(out.data(), expected.data(), parsed) != 0;
+        builders.resolve(kind);
+        size_t resolved = builders.buildInto(kind, out.data(), out.size());
+        mismatches += resolved != expected.size() || std::memcmp(out.data(), expected.data(), resolved) != 0;
+        bad_checksums += !checksumsValid(out.data(), resolved);
+
+        size_t length = tmpl.stamp(stamped.data(), stamped.size());
+        applyFields(tmpl, stamped.data(), fields);
+        template_mismatches += !assigned || length != expected.size() ||
+                               std::memcmp(stamped.data(), expected.data(), length) != 0;
+        // and all fields in one stamp
+        PacketFields all = {fields.identification, fields.src_ip, fields.dst_ip, fields.src_port, fields.dst_port, fields.seq};
+        length = tmpl.stamp(stamped.data(), stamped.size(), all);
+        template_mismatches += length != expected.size() || std::memcmp(stamped.data(), expected.data(), length) != 0;
+    }
+    std::printf("  %zu random ICMP/TCP/UDP packets: %zu buildInto mismatches against build(), %zu bad checksums, "
+                "%zu template mismatches\n", CHECKED_CASES, mismatches, bad_checksums, template_mismatches);
+
+    // too small a buffer is refused, not overrun
+    UDPPacketBuilder udp;
+    bool refused = udp.buildInto(out.data(), udp.size() - 1) == 0;
+    std::printf("  buffer one byte short: %s\n", refused ? "refused" : "NOT REFUSED");
+    return mismatches == 0 && bad_checksums == 0 && template_mismatches == 0 && refused;
+}
+
+template <typename Run>
+static void timed(const char* name, Run run, uint64_t& sink) {
+    uint64_t allocations = heap_allocations.load();
+    uint64_t start = benchNowNs();
+    for (size_t i = 0; i < PACKETS; i++) {
+        sink += run(i);
+    }
+    benchReport(name, PACKETS, benchNowNs() - start);
+    std::printf("      %.3f heap allocations/packet\n",
+                static_cast<double>(heap_allocations.load() - allocations) / PACKETS);
+}
+
+static void runTimings(size_t payload_size, uint64_t& sink) {
+    std::printf("--- UDP, %zu byte payload ---\n", payload_size);
+    UDPPacketBuilder udp;
+    udp.ipv4_dst_ip = "203.0.113.9";
+    udp.udp_payload = std::string(payload_size, 'x');
+    PacketPool pool(POOL_BUFFERS);
+    std::vector<uint8_t> out(udp.size());
+
+    timed("build() into a vector", [&](size_t i) {
+        udp.udp_src_port = static_cast<uint16_t>(i);
+        return udp.build()[IPv4_HEADER_SIZE + UDP_CHECKSUM_OFFSET];
+    }, sink);
+    timed("build(pool), addresses parsed", [&](size_t i) {
+        udp.udp_src_port = static_cast<uint16_t>(i);
+        return udp.build(pool)->data()[IPv4_HEADER_SIZE + UDP_CHECKSUM_OFFSET];
+    }, sink);
+    udp.resolveAddresses();
+    timed("build(pool), addresses resolved", [&](size_t i) {
+        udp.udp_src_port = static_cast<uint16_t>(i);
+        return udp.build(pool)->data()[IPv4_HEADER_SIZE + UDP_CHECKSUM_OFFSET];
+    }, sink);
+    timed("buildInto, addresses resolved", [&](size_t i) {
+        udp.udp_src_port = static_cast<uint16_t>(i);
+        udp.buildInto(out.data(), out.size());
+        return out[IPv4_HEADER_SIZE + UDP_CHECKSUM_OFFSET];
+    }, sink);
+
+    PacketTemplate tmpl;
+    tmpl.assign(udp);
+    timed("template, port + ID + dst patched", [&](size_t i) {
+        tmpl.stamp(out.data(), out.size());
+        tmpl.setSrcPort(out.data(), static_cast<uint16_t>(i));
+        tmpl.setIdentification(out.data(), static_cast<uint16_t>(i >> 3));
+        tmpl.setDstIp(out.data(), 0xCB007100 + (i & 0xFF));
+        return out[IPv4_HEADER_SIZE + UDP_CHECKSUM_OFFSET];
+    }, sink);
+    timed("template, every field in one stamp", [&](size_t i) {
+        PacketFields fields = {static_cast<uint16_t>(i >> 3), 0xC0A80164, static_cast<uint32_t>(0xCB007100 + (i & 0xFF)),
+                               static_cast<uint16_t>(i), 53, 0};
+        tmpl.stamp(out.data(), out.size(), fields);
+        return out[IPv4_HEADER_SIZE + UDP_CHECKSUM_OFFSET];
+    }, sink);
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== IPv4 packet builders ===\n");
+    bool ok = checkBuilders();
+
+    uint64_t sink = 0;
+    for (size_t payload_size : TIMED_PAYLOADS) {
+        runTimings(payload_size, sink);
+    }
+    std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink));
+    std::printf("buffer builds and templates match build(): %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
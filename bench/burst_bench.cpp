@@ -0,0 +1,150 @@
+#include "bench_common.hpp"
+#include "internet_protocol.hpp"
+#include "packet_builders.hpp"
+#include "logger.hpp"
+
+/* burst processing: the same packet trace forwarded one packet per call and through
+   processBurst at several burst sizes. packets are prebuilt small TCP/UDP packets, one
+   in ten IPv6, with a few expired and truncated ones mixed in, so the numbers are the
+   cost of the forwarding pipeline itself. every burst must reach the per-packet
+   verdicts, and its output batches must cover exactly the forwarded packets */
+
+constexpr size_t TABLE_PREFIXES = 900000;
+constexpr size_t TABLE_PREFIXES6 = 50000;
+constexpr size_t PACKETS = 1 << 22;
+constexpr size_t DISTINCT_PACKETS = 1 << 16;
+
+static std::vector<std::vector<uint8_t>> makePackets(const std::vector<BenchPrefix>& prefixes,
+                                                     const std::vector<BenchPrefix6>& prefixes6) {
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, DISTINCT_PACKETS, 3);
+    std::vector<IPv6Address> dsts6 = benchDestinations6(prefixes6, DISTINCT_PACKETS, 4);
+    std::mt19937 rng(9);
+    std::vector<std::vector<uint8_t>> packets;
+    for (size_t i = 0; i < DISTINCT_PACKETS; i++) {
+        uint16_t port = static_cast<uint16_t>(1024 + rng() % 60000);
+        uint8_t ttl = (i % 97 == 0) ? 0 : 64;
+        if (i % 10 == 9) {
+            UDPv6PacketBuilder builder;
+            builder.ipv6_src_ip = "2001:db8:1::100";
+            builder.ipv6_dst_ip = dsts6[i].toString();
+            builder.ipv6_hop_limit = ttl;
+            builder.udp_src_port = port;
+            builder.udp_dst_port = 53;
+            builder.udp_payload = "query";
+            packets.push_back(builder.build());
+        } else if (i % 3 == 0) {
+            TCPPacketBuilder builder;
+            builder.ipv4_src_ip = "192.168.1.100";
+            builder.ipv4_dst_ip = benchIpString(dsts[i]);
+            builder.ipv4_ttl = ttl;
+            builder.tcp_src_port = port;
+            builder.tcp_dst_port = 443;
+            builder.tcp_flags = TCP_ACK;
+            packets.push_back(builder.build());
+        } else {
+            UDPPacketBuilder builder;
+            builder.ipv4_src_ip = "192.168.1.100";
+            builder.ipv4_dst_ip = benchIpString(dsts[i]);
+            builder.ipv4_ttl = ttl;
+            builder.udp_src_port = port;
+            builder.udp_dst_port = 53;
+            builder.udp_payload = "query";
+            packets.push_back(builder.build());
+        }
+        if (i % 211 == 0) {
+            packets.back().resize(12);      // truncated header
+        }
+    }
+    return packets;
+}
+
+static bool sameVerdict(const ForwardingVerdict& a, const ForwardingVerdict& b) {
+    return a.drop_reason == b.drop_reason && a.adjacency == b.adjacency && a.interface_id == b.interface_id &&
+           a.next_hop == b.next_hop;
+}
+
+// output batches hold every forwarded packet exactly once, on its own interface, in arrival order
+static bool batchesConsistent(const BurstResult& result) {
+    size_t seen = 0;
+    for (size_t b = 0; b < result.output_count; b++) {
+        const OutputBatch& batch = result.outputs[b];
+        const uint8_t* packets = result.batchPackets(b);
+        for (size_t i = 0; i < batch.count; i++) {
+            const ForwardingVerdict& verdict = result.verdicts[packets[i]];
+            if (!verdict.forwarded() || verdict.interface_id != batch.interface_id ||
+                (i > 0 && packets[i] <= packets[i - 1])) {
+                return false;
+            }
+        }
+        seen += batch.count;
+    }
+    for (size_t i = 0; i < result.droppedCount(); i++) {
+        if (result.verdicts[result.dropped()[i]].forwarded()) {
+            return false;
+        }
+    }
+    return seen == result.forwarded;
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== Burst processing (%zu packets, %zu + %zu prefixes) ===\n",
+                PACKETS, TABLE_PREFIXES, TABLE_PREFIXES6);
+
+    InternetProtocol ip;
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    for (const auto& p : prefixes) {
+        ip.addRoute(benchIpString(p.network) + "/" + std::to_string(p.prefix_len), benchInterface(p.prefix_len));
+    }
+    std::vector<BenchPrefix6> prefixes6 = benchRandomPrefixes6(TABLE_PREFIXES6, 43);
+    for (const auto& p : prefixes6) {
+        ip.addRoute6(p.network.toString() + "/" + std::to_string(p.prefix_len), benchInterface(p.prefix_len));
+    }
+
+    std::vector<std::vector<uint8_t>> packets = makePackets(prefixes, prefixes6);
+    std::mt19937 rng(77);
+    std::vector<PacketView> trace(PACKETS);
+    for (auto& view : trace) {
+        view = packets[rng() % DISTINCT_PACKETS];
+    }
+
+    std::vector<ForwardingVerdict> expected(PACKETS);
+    uint64_t start = benchNowNs();
+    for (size_t i = 0; i < PACKETS; i++) {
+        expected[i] = ip.forwardPacket(trace[i]);
+    }
+    benchReport("forwardPacket (burst of one)", PACKETS, benchNowNs() - start);
+
+    bool consistent = true;
+    BurstResult result;
+    std::vector<ForwardingVerdict> verdicts(PACKETS);
+    for (size_t burst : {size_t(4), size_t(8), size_t(16), size_t(32), size_t(64)}) {
+        size_t batches = 0;
+        start = benchNowNs();
+        for (size_t n = 0; n < PACKETS; n += burst) {
+            ip.processBurst(&trace[n], burst, result);
+            batches += result.output_count;
+            std::copy(result.verdicts, result.verdicts + result.count, &verdicts[n]);
+        }
+        uint64_t elapsed = benchNowNs() - start;
+
+        size_t mismatches = 0;
+        for (size_t i = 0; i < PACKETS; i++) {
+            mismatches += !sameVerdict(verdicts[i], expected[i]);
+        }
+        // second, untimed pass over the output batches
+        for (size_t n = 0; n < PACKETS; n += burst) {
+            ip.processBurst(&trace[n], burst, result);
+            consistent &= batchesConsistent(result);
+        }
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "processBurst, burst of %zu", burst);
+        benchReport(name, PACKETS, elapsed);
+        std::printf("      %.1f output batches per burst, %zu mismatches\n",
+                    static_cast<double>(batches) * burst / PACKETS, mismatches);
+        consistent &= mismatches == 0;
+    }
+    std::printf("bursts reach the per-packet verdicts: %s\n", consistent ? "ok" : "FAILED");
+    return 0;
+}
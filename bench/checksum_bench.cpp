@@ -0,0 +1,108 @@
+#include "bench_common.hpp"
+#include "checksum.hpp"
+
+/* the checksum engine across payload sizes from a bare IPv4 header to a jumbo frame:
+   the byte-at-a-time loop the protocols used to carry, each kernel this CPU runs, and
+   copy-then-sum against the fused copy-and-checksum. every kernel's sum and copy must
+   match the byte loop at random lengths and alignments */
+
+constexpr size_t SIZES[] = {20, 40, 64, 128, 256, 576, 1500, 4096, 9000};
+constexpr size_t MAX_SIZE = 9000;
+constexpr size_t CHECKED_CASES = 20000;
+constexpr size_t BYTES_PER_RUN = size_t(1) << 27;
+
+// the loop ICMP, TCP, UDP and the IPv4 builder each had a copy of
+static uint16_t byteLoopSum(const uint8_t* data, size_t length) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < length; i += 2) {
+        if (i + 1 < length) {
+            sum += (data[i] << 8) + data[i + 1];
+        } else {
+            sum += data[i] << 8;
+        }
+    }
+    return checksumFold(sum);
+}
+
+static bool checkKernels(const std::vector<const ChecksumKernel*>& kernels) {
+    std::mt19937 rng(9);
+    std::vector<uint8_t> src(MAX_SIZE + 64), dst(MAX_SIZE + 64);
+    for (auto& byte : src) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    size_t mismatches = 0;
+    for (size_t c = 0; c < CHECKED_CASES; c++) {
+        // the all-ones buffer makes every carry path fold
+        if (c == CHECKED_CASES / 2) {
+            std::fill(src.begin(), src.end(), 0xFF);
+        }
+        size_t length = (c < 256) ? c : rng() % (MAX_SIZE + 1);
+        size_t offset = rng() % 64;
+        uint16_t expected = byteLoopSum(src.data() + offset, length);
+        for (const ChecksumKernel* kernel : kernels) {
+            std::fill(dst.begin(), dst.end(), 0);
+            size_t dst_offset = rng() % 64;
+            bool ok = kernel->sum(src.data() + offset, length) == expected &&
+                      kernel->copySum(dst.data() + dst_offset, src.data() + offset, length) == expected &&
+                      std::memcmp(dst.data() + dst_offset, src.data() + offset, length) == 0;
+            mismatches += !ok;
+        }
+    }
+    std::printf("  %zu lengths 0..%zu at random alignments: %zu mismatches against the byte loop\n",
+                CHECKED_CASES, MAX_SIZE, mismatches);
+    return mismatches == 0;
+}
+
+template <typename Run>
+static double nsPerCall(size_t size, Run run) {
+    size_t calls = std::max<size_t>(BYTES_PER_RUN / size, 1);
+    for (size_t i = 0; i < calls / 8; i++) {
+        run();      // warm up caches, branch predictors and the clock
+    }
+    uint64_t start = benchNowNs();
+    for (size_t i = 0; i < calls; i++) {
+        run();
+    }
+    return static_cast<double>(benchNowNs() - start) / calls;
+}
+
+int main() {
+    std::vector<const ChecksumKernel*> kernels = checksumKernels();
+    std::printf("=== Internet checksum engine (selected: %s) ===\n", checksumKernel().name);
+    bool ok = checkKernels(kernels);
+
+    std::vector<uint8_t> src(MAX_SIZE), dst(MAX_SIZE);
+    std::mt19937 rng(3);
+    for (auto& byte : src) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    uint64_t sink = 0;
+
+    std::printf("  %-6s %14s", "bytes", "byte loop");
+    for (const ChecksumKernel* kernel : kernels) {
+        std::printf(" %14s", kernel->name);
+    }
+    std::printf(" %14s %14s   (ns per call, GB/s)\n", "memcpy+sum", "fused copy");
+    for (size_t size : SIZES) {
+        std::vector<double> results;
+        results.push_back(nsPerCall(size, [&]() { sink += byteLoopSum(src.data(), size); }));
+        for (const ChecksumKernel* kernel : kernels) {
+            results.push_back(nsPerCall(size, [&]() { sink += kernel->sum(src.data(), size); }));
+        }
+        const ChecksumKernel& selected = checksumKernel();
+        results.push_back(nsPerCall(size, [&]() {
+            std::memcpy(dst.data(), src.data(), size);
+            sink += selected.sum(dst.data(), size) + dst[size / 2];
+        }));
+        results.push_back(nsPerCall(size, [&]() { sink += selected.copySum(dst.data(), src.data(), size); }));
+
+        std::printf("  %-6zu", size);
+        for (double ns : results) {
+            std::printf(" %7.1f %6.2f", ns, size / ns);
+        }
+        std::printf("\n");
+    }
+    std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink));
+    std::printf("kernels match the byte loop: %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "bench_common.hpp"
+#include "route_replay.hpp"
+#include "logger.hpp"
+#include <cstdio>
+#include <fstream>
+#include <unordered_set>
+
+/* route churn: loads a full table one announce at a time, then replays a file of
+   mixed announce/withdraw events and reports sustained updates per second. the FIB
+   is checked against a brute-force longest prefix match over the surviving prefixes */
+
+constexpr size_t TABLE_PREFIXES = 900000;
+constexpr size_t CHURN_EVENTS = 1000000;
+constexpr const char* CHURN_FILE = "bench_churn_events.txt";
+
+static uint64_t key(uint32_t network, uint8_t prefix_len) {
+    return (static_cast<uint64_t>(network) << 8) | prefix_len;
+}
+
+static void printStats(const char* name, const ReplayStats& stats) {
+    std::printf("  %-12s %8zu announces %8zu withdraws %10.2f ms %12.0f updates/s\n",
+                name, stats.announces, stats.withdraws, stats.elapsed_ns / 1e6, stats.updatesPerSecond());
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== Route churn replay (%zu prefixes, %zu events) ===\n", TABLE_PREFIXES, CHURN_EVENTS);
+
+    std::vector<BenchPrefix> table_prefixes = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    std::vector<BenchPrefix> installed;
+    std::unordered_set<uint64_t> reference;
+
+    RouteReplay initial;
+    for (const auto& p : table_prefixes) {
+        initial.add({true, p.prefix_len, p.network, p.network, 1, benchInterface(p.prefix_len)});
+        if (reference.insert(key(p.network, p.prefix_len)).second) {
+            installed.push_back(p);
+        }
+    }
+
+    // churn: withdraw an installed prefix, re-announce one, or announce a new one
+    std::mt19937 rng(5);
+    std::vector<BenchPrefix> fresh = benchRandomPrefixes(CHURN_EVENTS, 77);
+    std::ofstream out(CHURN_FILE);
+    for (size_t i = 0; i < CHURN_EVENTS; i++) {
+        uint32_t roll = rng() % 3;
+        if (roll == 0 && !installed.empty()) {
+            size_t pick = rng() % installed.size();
+            BenchPrefix p = installed[pick];
+            installed[pick] = installed.back();
+            installed.pop_back();
+            reference.erase(key(p.network, p.prefix_len));
+            out << "W " << RoutingTable::ipToString(p.network) << "/" << int(p.prefix_len) << "\n";
+        } else {
+            BenchPrefix p = (roll == 1 && !installed.empty()) ? installed[rng() % installed.size()] : fresh[i];
+            if (reference.insert(key(p.network, p.prefix_len)).second) {
+                installed.push_back(p);
+            }
+            out << "A " << RoutingTable::ipToString(p.network) << "/" << int(p.prefix_len)
+                << " " << benchInterface(p.prefix_len) << " " << RoutingTable::ipToString(p.network)
+                << " " << (rng() % 4) << "\n";
+        }
+    }
+    out.close();
+
+    RouteReplay churn;
+    if (!churn.load(CHURN_FILE)) {
+        return 1;
+    }
+    std::remove(CHURN_FILE);
+
+    RoutingTable table;
+    printStats("table load", initial.run(table));
+    printStats("churn", churn.run(table));
+    table.reclaim();
+
+    // verify against brute force LPM over the prefixes that should be left
+    std::vector<uint32_t> dsts = benchDestinations(installed, 1 << 18, 9);
+    std::vector<AdjacencyHandle> results(dsts.size());
+    table.lookupRoutes(dsts.data(), results.data(), dsts.size());
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < dsts.size(); i++) {
+        int expected_len = -1;
+        for (int len = 32; len >= 0; len--) {
+            uint32_t mask = LpmTable::prefixMask(static_cast<uint8_t>(len));
+            if (reference.count(key(dsts[i] & mask, static_cast<uint8_t>(len)))) {
+                expected_len = len;
+                break;
+            }
+        }
+        mismatches += (benchMatchedLength(table.adjacencies(), results[i], dsts[i]) != expected_len);
+    }
+
+    std::printf("  routes: %zu (expected %zu), tbl8 groups: %zu, lookup mismatches: %zu of %zu\n",
+                table.size(), reference.size(), table.lpm().tbl8GroupsUsed(), mismatches, dsts.size());
+    return 0;
+}
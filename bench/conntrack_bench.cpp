@@ -0,0 +1,453 @@
+#include "bench_common.hpp"
+#include "conntrack.hpp"
+#include "internet_protocol.hpp"
+#include "forwarding_workers.hpp"
+#include "packet_builders.hpp"
+#include "icmp.hpp"
+#include "tcp.hpp"
+#include "logger.hpp"
+#include <map>
+
+/* connection tracking: the hierarchical timer wheel against a model of what must fire
+   when, under random scheduling, cancelling, re-arming from the callbacks and jumps of
+   time from a tick to days. then the tracker's states, classes, per-direction counters
+   and timeouts on hand-made packet sequences. last ten million connections at once:
+   memory, opening them, the handshake, steady-state packets either way, and expiring
+   them all, against what one full scan of the table costs */
+
+constexpr uint64_t SECOND_NS = 1000000000;
+constexpr uint64_t START_NS = 1000 * SECOND_NS;
+constexpr size_t SLOT = 64;                     // bytes per packet in the arenas
+constexpr size_t WHEEL_ENTRIES = 20000;
+constexpr size_t WHEEL_ROUNDS = 4000;
+constexpr size_t BENCH_CONNECTIONS = 10000000;
+constexpr size_t CHUNK = 1 << 20;               // packets stamped ahead of each timed run
+constexpr size_t STEADY_PACKETS = 1 << 23;
+
+// a tick count spread evenly over magnitudes, 1 to about 2^bits
+static uint64_t logUniform(std::mt19937_64& rng, size_t bits) {
+    size_t magnitude = rng() % bits;
+    return (uint64_t(1) << magnitude) + rng() % (uint64_t(1) << magnitude);
+}
+
+static bool checkWheel() {
+    constexpr uint64_t TICK = 1000;
+    HierarchicalTimerWheel wheel(WHEEL_ENTRIES, TICK);
+    std::mt19937_64 rng(1);
+    std::vector<uint64_t> due(WHEEL_ENTRIES, 0);   // model: tick the timer is due, 0 when not armed
+    uint64_t now = 1000;
+    wheel.advance(now * TICK, [](uint32_t) {});
+    size_t fired_total = 0, rearmed = 0, early = 0, late = 0, out_of_order = 0, missed = 0, lost = 0;
+
+    auto arm = [&](uint32_t entry, uint64_t ticks) {
+        uint64_t at = now + ticks;
+        wheel.schedule(entry, at * TICK + rng() % TICK);
+        due[entry] = at;
+    };
+    for (size_t round = 0; round < WHEEL_ROUNDS; round++) {
+        for (size_t op = 0; op < 200; op++) {
+            uint32_t entry = static_cast<uint32_t>(rng() % WHEEL_ENTRIES);
+            if (rng() % 4 == 0) {
+                wheel.cancel(entry);
+                due[entry] = 0;
+            } else {
+                arm(entry, logUniform(rng, 23));
+            }
+        }
+        uint64_t next = now + logUniform(rng, round % 10 == 0 ? 24 : 12);
+        uint64_t last_due = 0;
+        wheel.advance(next * TICK, [&](uint32_t entry) {
+            fired_total++;
+            early += due[entry] == 0 || due[entry] >= next;
+            late += due[entry] < now;
+            out_of_order += due[entry] < last_due;
+            last_due = std::max(last_due, due[entry]);
+            uint64_t fired = due[entry];
+            due[entry] = 0;
+            /* a third go back on the wheel from the callback, after the tick firing, many
+               of them into the time still being passed */
+            if (rng() % 3 == 0) {
+                uint64_t at = fired + 1 + logUniform(rng, 20);
+                wheel.schedule(entry, at * TICK);
+                due[entry] = at;
+                rearmed++;
+            }
+        });
+        now = next;
+        size_t armed = 0;
+        for (uint64_t at : due) {
+            missed += at != 0 && at < now;
+            armed += at != 0;
+        }
+        lost += armed != wheel.size();
+    }
+    bool ok = early + late + out_of_order + missed + lost == 0;
+    std::printf("  %zu rounds on %zu timers, deadlines up to 2^23 ticks, time jumping up to 2^24: %zu fired "
+                "(%zu re-armed by the callback), %zu early, %zu late, %zu out of order, %zu missed\n",
+                WHEEL_ROUNDS, WHEEL_ENTRIES, fired_total, rearmed, early, late, out_of_order, missed + lost);
+    std::printf("hierarchical timer wheel fires every timer on its tick: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// packets of one conversation, either way
+class Conversation {
+public:
+    Conversation(uint32_t client_ip, uint32_t server_ip, uint16_t client_port, uint16_t server_port)
+        : client(client_ip), server(server_ip), client_port(client_port), server_port(server_port) {}
+
+    PacketView tcp(bool from_client, uint8_t flags) {
+        TCPPacketBuilder builder;
+        builder.tcp_flags = flags;
+        return stamp(builder, from_client);
+    }
+    PacketView udp(bool from_client) {
+        UDPPacketBuilder builder;
+        return stamp(builder, from_client);
+    }
+    PacketView echo(bool from_client, uint8_t type) {
+        ICMPPacketBuilder builder;
+        builder.icmp_type = type;
+        PacketTemplate packet;
+        packet.assign(builder);
+        PacketFields fields = {1, from_client ? client : server, from_client ? server : client, client_port, 0, 1};
+        return store(buffer, packet.stamp(buffer, sizeof(buffer), fields));
+    }
+    // an ICMP error about a packet, from a router on the way
+    PacketView error(PacketView original) {
+        size_t length = ICMP::buildError(ICMP_DEST_UNREACH, 1, 0, original, 0xC0A80101, error_buffer, sizeof(error_buffer));
+        return store(error_buffer, length);
+    }
+
+private:
+    uint32_t client, server;
+    uint16_t client_port, server_port;
+    uint8_t buffer[256];
+    uint8_t error_buffer[ICMP_ERROR_MAX_SIZE];
+
+    template <typename Builder>
+    PacketView stamp(const Builder& builder, bool from_client) {
+        PacketTemplate packet;
+        packet.assign(builder);
+        PacketFields fields = from_client ? PacketFields{1, client, server, client_port, server_port, 1}
+                                          : PacketFields{1, server, client, server_port, client_port, 1};
+        return store(buffer, packet.stamp(buffer, sizeof(buffer), fields));
+    }
+    static PacketView store(const uint8_t* data, size_t length) { return PacketView(data, length); }
+};
+
+struct Expect {
+    const char* what;
+    bool ok;
+};
+
+static bool checkStates() {
+    ConntrackConfig config;
+    config.max_connections = 1000;
+    ConnectionTracker tracker(config);
+    std::vector<Expect> checks;
+    uint64_t now = START_NS;
+    // a packet's result and the state its connection was left in, before later packets move it on
+    struct Step {
+        ConntrackResult result;
+        bool has_state;
+        ConnState state;
+        bool is(ConnState expected) const { return has_state && state == expected; }
+    };
+    auto step = [&](PacketView packet, uint64_t at) {
+        Step s = {tracker.track(packet, at), false, ConnState::TCP_CLOSE};
+        if (s.result.connection != ConnectionTracker::NONE) {
+            s.has_state = true;
+            s.state = tracker.connection(s.result.connection).state;
+        }
+        return s;
+    };
+
+    // the three-way handshake, data, and a close with FINs both ways
+    Conversation web(0x0A000001, 0x5DB8D822, 40000, 443);
+    Step syn = step(web.tcp(true, TCP_SYN), now);
+    Step synack = step(web.tcp(false, TCP_SYN | TCP_ACK), now);
+    Step ack = step(web.tcp(true, TCP_ACK), now);
+    checks.push_back({"SYN opens, NEW, SYN sent", syn.result.status == ConnStatus::NEW && !syn.result.reply &&
+                                                    syn.is(ConnState::TCP_SYN_SENT)});
+    checks.push_back({"SYN-ACK is the reply, ESTABLISHED class, SYN received",
+                      synack.result.connection == syn.result.connection && synack.result.reply &&
+                      synack.result.status == ConnStatus::ESTABLISHED && synack.is(ConnState::TCP_SYN_RECV)});
+    checks.push_back({"ACK completes the handshake", !ack.result.reply && ack.is(ConnState::TCP_ESTABLISHED)});
+    for (int i = 0; i < 5; i++) {
+        tracker.track(web.tcp(i % 2 == 0, TCP_ACK), now + i * SECOND_NS);
+    }
+    const Connection& conn = tracker.connection(syn.result.connection);
+    checks.push_back({"packets counted by direction", conn.packets[0] == 5 && conn.packets[1] == 3 &&
+                                                      conn.bytes[0] == 5 * 40 && conn.bytes[1] == 3 * 40});
+    Step fin = step(web.tcp(false, TCP_FIN | TCP_ACK), now + 5 * SECOND_NS);
+    Step fin2 = step(web.tcp(true, TCP_FIN | TCP_ACK), now + 5 * SECOND_NS);
+    checks.push_back({"FIN one way, then both", fin.is(ConnState::TCP_FIN_WAIT) && fin2.is(ConnState::TCP_TIME_WAIT)});
+    Step reopen = step(web.tcp(true, TCP_SYN), now + 6 * SECOND_NS);
+    checks.push_back({"a SYN on the closed ports opens anew", reopen.result.status == ConnStatus::NEW &&
+                                                              reopen.is(ConnState::TCP_SYN_SENT) &&
+                                                              tracker.stats().created == 2});
+    Step rst = step(web.tcp(false, TCP_RST | TCP_ACK), now + 6 * SECOND_NS);
+    checks.push_back({"RST closes", rst.is(ConnState::TCP_CLOSE)});
+
+    // what cannot open a connection or is not a segment at all
+    Conversation scan(0x0A000002, 0x5DB8D822, 40001, 22);
+    checks.push_back({"SYN-ACK, RST and SYN+FIN of no connection are invalid",
+                      tracker.track(scan.tcp(false, TCP_SYN | TCP_ACK), now).status == ConnStatus::INVALID &&
+                      tracker.track(scan.tcp(true, TCP_RST), now).status == ConnStatus::INVALID &&
+                      tracker.track(scan.tcp(true, TCP_SYN | TCP_FIN), now).status == ConnStatus::INVALID &&
+                      tracker.track(scan.tcp(true, TCP_FIN), now).status == ConnStatus::INVALID});
+    Step picked = step(scan.tcp(true, TCP_ACK), now);
+    checks.push_back({"an ACK mid-stream is picked up as established", picked.result.status == ConnStatus::NEW &&
+                                                                       picked.is(ConnState::TCP_ESTABLISHED)});
+    ConntrackConfig strict = config;
+    strict.pickup = false;
+    ConnectionTracker strict_tracker(strict);
+    checks.push_back({"not without pickup", strict_tracker.track(scan.tcp(true, TCP_ACK), now).status ==
+                                            ConnStatus::INVALID});
+
+    // UDP and ping
+    Conversation dns(0x0A000003, 0x08080808, 5353, 53);
+    Step query = step(dns.udp(true), now);
+    Step answer = step(dns.udp(false), now);
+    checks.push_back({"UDP unreplied, then replied", query.result.status == ConnStatus::NEW &&
+                                                     query.is(ConnState::UDP_UNREPLIED) && answer.result.reply &&
+                                                     answer.result.status == ConnStatus::ESTABLISHED &&
+                                                     answer.is(ConnState::UDP_REPLIED)});
+    Conversation ping(0x0A000004, 0x01010101, 77, 0);
+    checks.push_back({"an echo reply nobody asked for is invalid",
+                      tracker.track(ping.echo(false, ICMP_ECHO_REPLY), now).status == ConnStatus::INVALID});
+    Step request = step(ping.echo(true, ICMP_ECHO_REQUEST), now);
+    Step pong = step(ping.echo(false, ICMP_ECHO_REPLY), now);
+    checks.push_back({"echo request and its reply", request.is(ConnState::ICMP_UNREPLIED) &&
+                                                    pong.result.connection == request.result.connection &&
+                                                    pong.result.reply && pong.is(ConnState::ICMP_REPLIED)});
+
+    // ICMP errors quoting tracked and untracked packets, fragments
+    ConntrackResult related = tracker.track(dns.error(dns.udp(true)), now);
+    Conversation stranger(0x0A000009, 0x08080404, 6000, 53);
+    checks.push_back({"an error about a tracked packet is related, one about anything else invalid",
+                      related.status == ConnStatus::RELATED && related.connection == query.result.connection &&
+                      related.reply && tracker.track(stranger.error(stranger.udp(true)), now).status ==
+                      ConnStatus::INVALID});
+    PacketView piece = dns.udp(true);
+    uint8_t fragment[256];
+    std::memcpy(fragment, piece.data(), piece.size());
+    fragment[6] = 0x20;
+    checks.push_back({"fragments are untracked", tracker.track(PacketView(fragment, piece.size()), now).status ==
+                                                 ConnStatus::UNTRACKED});
+
+    // timeouts: RST 10 s, unanswered ping 30 s, replied UDP 120 s, established 5 days
+    size_t before = tracker.stats().active;
+    tracker.expire(now + 17 * SECOND_NS);
+    size_t after_rst = tracker.stats().active;
+    tracker.expire(now + 32 * SECOND_NS);
+    size_t after_ping = tracker.stats().active;
+    tracker.expire(now + 122 * SECOND_NS);
+    size_t after_udp = tracker.stats().active;
+    tracker.track(scan.tcp(false, TCP_ACK), now + 86400 * SECOND_NS);
+    tracker.expire(now + 432001 * SECOND_NS);
+    size_t touched = tracker.stats().active;
+    tracker.expire(now + (86400 + 432001) * SECOND_NS);
+    checks.push_back({"timeouts by state: RST, ping, UDP, established only after 5 idle days",
+                      before == 4 && after_rst == 3 && after_ping == 2 && after_udp == 1 && touched == 1 &&
+                      tracker.stats().active == 0 && tracker.stats().expired == 4});
+
+    // a full table refuses new connections, expiry makes room
+    ConntrackConfig small = config;
+    small.max_connections = 100;
+    ConnectionTracker small_tracker(small);
+    size_t refused = 0;
+    for (uint16_t port = 0; port < 120; port++) {
+        Conversation flow(0x0A000005, 0x08080808, static_cast<uint16_t>(1000 + port), 53);
+        refused += small_tracker.track(flow.udp(true), now).status == ConnStatus::INVALID;
+    }
+    Conversation late_flow(0x0A000006, 0x08080808, 999, 53);
+    bool room = small_tracker.track(late_flow.udp(true), now + 31 * SECOND_NS).status == ConnStatus::NEW;
+    checks.push_back({"a full table refuses, expiry makes room", refused == 20 && small_tracker.stats().full == 20 &&
+                                                                 room && small_tracker.stats().active == 1});
+
+    // in the pipeline only forwarded packets reach the tracker: a bad header checksum, TTL 1 or no route open nothing
+    InternetProtocol ip;
+    ip.addRoute("93.184.0.0/16", "eth1");
+    ip.enableConnectionTracking(config);
+    VerdictCounter counter;
+    Conversation routed(0x0A000007, 0x5DB8D822, 40002, 443);
+    Conversation unrouted(0x0A000007, 0x08080808, 40003, 443);
+    uint8_t corrupt[256];
+    PacketView syn_packet = routed.tcp(true, TCP_SYN);
+    std::memcpy(corrupt, syn_packet.data(), syn_packet.size());
+    corrupt[10] ^= 0xFF;
+    TCPPacketBuilder last_hop;
+    last_hop.tcp_flags = TCP_SYN;
+    last_hop.ipv4_ttl = 1;
+    PacketTemplate last_hop_packet;
+    last_hop_packet.assign(last_hop);
+    uint8_t expiring[256];
+    size_t expiring_length = last_hop_packet.stamp(expiring, sizeof(expiring),
+                                                   PacketFields{1, 0x0A000007, 0x5DB8D822, 40004, 443, 1});
+    PacketView dropped[3] = {PacketView(corrupt, syn_packet.size()), unrouted.tcp(true, TCP_SYN),
+                             PacketView(expiring, expiring_length)};
+    ip.forwardPackets(dropped, 3, counter);
+    size_t after_drops = ip.conntrackStats()->created;
+    PacketView good = routed.tcp(true, TCP_SYN);
+    ip.forwardPackets(&good, 1, counter);
+    checks.push_back({"dropped packets open no connections, forwarded ones do",
+                      counter.dropped(DropReason::BAD_CHECKSUM) == 1 && counter.dropped(DropReason::NO_ROUTE) == 1 &&
+                      counter.dropped(DropReason::TTL_EXPIRED) == 1 && after_drops == 0 &&
+                      ip.conntrackStats()->created == 1 && ip.conntrackStats()->untracked == 0});
+
+    // the workers must hand both directions of a connection to the one tracker
+    WorkerConfig sharding;
+    sharding.workers = 8;
+    ForwardingWorkers workers(ip, sharding);
+    size_t split = 0;
+    for (uint16_t port = 0; port < 1000; port++) {
+        Conversation flow(0x0A000000 + port * 7919u, 0x5DB80000 + port * 104729u, static_cast<uint16_t>(20000 + port), 443);
+        split += workers.workerFor(flow.tcp(true, TCP_ACK)) != workers.workerFor(flow.tcp(false, TCP_ACK));
+        split += workers.workerFor(flow.udp(true)) != workers.workerFor(flow.udp(false));
+    }
+    checks.push_back({"the workers shard both directions of a flow to one worker", split == 0});
+
+    // and every worker's own tracker sees the whole handshake of the flows sharded to it
+    ip.addRoute("10.0.0.0/8", "eth0");
+    PacketPool pool(256);
+    bool started = workers.start();
+    for (uint16_t port = 0; port < 40; port++) {
+        Conversation flow(0x0A000000 + port * 7919u, 0x5DB80000 + port * 1031u, static_cast<uint16_t>(30000 + port), 443);
+        for (PacketView packet : {flow.tcp(true, TCP_SYN), flow.tcp(false, TCP_SYN | TCP_ACK), flow.tcp(true, TCP_ACK)}) {
+            workers.dispatch(pool.copyIn(packet.data(), packet.size()));
+        }
+    }
+    workers.stop();
+    size_t opened = 0, established = 0, tracking = 0;
+    for (size_t i = 0; i < workers.workerCount(); i++) {
+        if (const ConntrackStats* stats = workers.conntrackStats(i)) {
+            opened += stats->created;
+            established += stats->states[static_cast<size_t>(ConnState::TCP_ESTABLISHED)];
+            tracking += stats->created > 0;
+        }
+    }
+    checks.push_back({"workers track both directions of their flows in their own tables",
+                      started && opened == 40 && established == 40 && tracking > 1});
+
+    bool ok = true;
+    for (const Expect& check : checks) {
+        if (!check.ok) {
+            std::printf("  FAILED: %s\n", check.what);
+        }
+        ok = ok && check.ok;
+    }
+    std::printf("  %zu checks of states, classes, counters and timeouts\n", checks.size());
+    std::printf("connection states follow the packets: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static void benchTenMillion() {
+    ConntrackConfig config;
+    config.max_connections = BENCH_CONNECTIONS;
+    uint64_t start = benchNowNs();
+    ConnectionTracker tracker(config);
+    uint64_t setup_ns = benchNowNs() - start;
+    std::printf("\n%zu connections: %.0f MB allocated up front (%.1f bytes a connection), set up in %.0f ms\n",
+                tracker.capacity(), tracker.memoryBytes() / 1e6, static_cast<double>(tracker.memoryBytes()) /
+                tracker.capacity(), setup_ns / 1e6);
+
+    PacketTemplate templates[3];
+    const uint8_t flags[3] = {TCP_SYN, TCP_SYN | TCP_ACK, TCP_ACK};
+    for (size_t i = 0; i < 3; i++) {
+        TCPPacketBuilder builder;
+        builder.tcp_flags = flags[i];
+        templates[i].assign(builder);
+    }
+    std::mt19937 rng(7);
+    std::vector<uint32_t> servers(BENCH_CONNECTIONS);
+    for (uint32_t& server : servers) {
+        server = 0x20000000 + (rng() & 0x0FFFFFFF);
+    }
+    std::vector<uint8_t> arena(CHUNK * SLOT);
+    std::vector<PacketView> views(CHUNK);
+    std::vector<ConntrackResult> results(CHUNK);
+
+    /* runs packets of the connections in order through the tracker, stamped a chunk at a
+       time outside the timing. kind picks the template, reply the direction */
+    auto run = [&](const std::vector<uint32_t>& order, size_t kind, bool random_direction, uint64_t now_ns,
+                   size_t& unexpected) {
+        uint64_t total_ns = 0;
+        std::mt19937 directions(8);
+        for (size_t first = 0; first < order.size(); first += CHUNK) {
+            size_t count = std::min(CHUNK, order.size() - first);
+            for (size_t i = 0; i < count; i++) {
+                uint32_t id = order[first + i];
+                uint32_t client = 0x0A000000 + (id >> 6);
+                uint16_t client_port = static_cast<uint16_t>(1024 + (id & 63));
+                bool reply = random_direction ? (directions() & 1) : kind == 1;
+                PacketFields fields = reply ? PacketFields{1, servers[id], client, 443, client_port, 1}
+                                            : PacketFields{1, client, servers[id], client_port, 443, 1};
+                uint8_t* out = arena.data() + i * SLOT;
+                views[i] = PacketView(out, templates[kind].stamp(out, SLOT, fields));
+            }
+            uint64_t started = benchNowNs();
+            tracker.track(views.data(), count, now_ns, results.data());
+            total_ns += benchNowNs() - started;
+            for (size_t i = 0; i < count; i++) {
+                unexpected += results[i].connection == ConnectionTracker::NONE;
+            }
+        }
+        return total_ns;
+    };
+
+    std::vector<uint32_t> in_order(BENCH_CONNECTIONS);
+    for (uint32_t i = 0; i < BENCH_CONNECTIONS; i++) {
+        in_order[i] = i;
+    }
+    size_t unexpected = 0;
+    uint64_t ns = run(in_order, 0, false, START_NS, unexpected);
+    benchReport("open (SYN, new connection)", BENCH_CONNECTIONS, ns);
+    ns = run(in_order, 1, false, START_NS, unexpected) + run(in_order, 2, false, START_NS, unexpected);
+    benchReport("handshake (state change, timer re-armed)", 2 * BENCH_CONNECTIONS, ns);
+    ConntrackStats stats = tracker.stats();
+    std::printf("      %zu active, %zu established, %zu untracked or refused\n", stats.active,
+                stats.states[static_cast<size_t>(ConnState::TCP_ESTABLISHED)], unexpected);
+
+    // steady state: packets of random connections either way, nothing changes state
+    std::vector<uint32_t> trace(STEADY_PACKETS);
+    for (uint32_t& id : trace) {
+        id = rng() % BENCH_CONNECTIONS;
+    }
+    ns = run(trace, 2, true, START_NS + 100 * SECOND_NS, unexpected);
+    benchReport("steady state, 10M active, random", trace.size(), ns);
+    std::printf("      %.2f Mpps on one core\n", trace.size() / (ns / 1e9) / 1e6);
+
+    // what a periodic scan for idle connections would cost every time it ran
+    start = benchNowNs();
+    size_t idle = 0;
+    for (uint32_t id = 0; id < BENCH_CONNECTIONS; id++) {
+        idle += tracker.connection(id).last_seen < START_NS / SECOND_NS + 50;
+    }
+    uint64_t scan_ns = benchNowNs() - start;
+
+    // five idle days later: the timers of connections touched since go back on, then all expire
+    uint64_t established_ns = config.timeouts.tcp_established_ns;
+    start = benchNowNs();
+    tracker.expire(START_NS + established_ns + SECOND_NS);
+    uint64_t first_ns = benchNowNs() - start;
+    size_t left = tracker.stats().active;
+    start = benchNowNs();
+    tracker.expire(START_NS + established_ns + 200 * SECOND_NS);
+    uint64_t second_ns = benchNowNs() - start;
+    benchReport("expiry, per connection", BENCH_CONNECTIONS, first_ns + second_ns);
+    std::printf("      %zu expired on time, %zu re-armed for their later packets and expired after, %zu left\n",
+                BENCH_CONNECTIONS - left, left, tracker.stats().active);
+    std::printf("      one full scan of the table: %.1f ms (%zu idle), the wheel touches only what expires\n",
+                scan_ns / 1e6, idle);
+    std::printf("  (checksum %llu)\n", (unsigned long long)(tracker.stats().packets + tracker.stats().expired));
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== Connection tracking ===\n");
+    bool ok = checkWheel();
+    ok = checkStates() && ok;
+    benchTenMillion();
+    return ok ? 0 : 1;
+}
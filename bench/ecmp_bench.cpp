@@ -0,0 +1,145 @@
+#include "bench_common.hpp"
+#include "routing_table.hpp"
+#include "fib_snapshot.hpp"
+#include "forwarding_verdict.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cmath>
+
+/* ECMP: prefixes with 1, 2, 3, 4, 7 or 8 equal-cost uplinks plus a worse-metric backup.
+   measures lookup plus path selection against a plain lookup, and checks that the
+   backup is never used, that the flows to every group size spread evenly over its
+   members, that a flow keeps its path across unrelated route updates and that next-hop
+   groups survive a FIB snapshot */
+
+constexpr size_t TABLE_PREFIXES = 200000;
+constexpr size_t FLOWS = 1 << 20;
+constexpr uint32_t UPLINKS = 8;
+constexpr uint32_t PATH_COUNTS[] = {1, 2, 3, 4, 7, 8};
+constexpr size_t PATH_KINDS = sizeof(PATH_COUNTS) / sizeof(PATH_COUNTS[0]);
+constexpr double MAX_SHARE_DEVIATION = 0.005;   // about 4 sigma for the 2-way groups, which get 1/6 of FLOWS
+constexpr const char* SNAPSHOT_FILE = "bench_ecmp.snapshot";
+
+static std::string uplink(uint32_t index) {
+    return "up" + std::to_string(index);
+}
+
+static std::vector<FlowKey> makeFlows(const std::vector<BenchPrefix>& prefixes) {
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, FLOWS, 3);
+    std::mt19937 rng(4);
+    std::vector<FlowKey> flows(FLOWS);
+    for (size_t i = 0; i < FLOWS; i++) {
+        flows[i] = {static_cast<uint32_t>(rng()), dsts[i], static_cast<uint16_t>(rng()), 443, 6};
+    }
+    return flows;
+}
+
+static std::vector<AdjacencyHandle> selectPaths(const RoutingTable& table, const std::vector<FlowKey>& flows) {
+    std::vector<AdjacencyHandle> paths(flows.size());
+    for (size_t i = 0; i < flows.size(); i++) {
+        AdjacencyHandle handle = table.lookupRoute(flows[i].dst_ip);
+        paths[i] = (handle == NO_ADJACENCY) ? NO_ADJACENCY : table.adjacencies().select(handle, ecmpHash(flows[i]));
+    }
+    return paths;
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== ECMP (%zu prefixes, up to %u paths, %zu flows) ===\n", TABLE_PREFIXES, UPLINKS, FLOWS);
+
+    RoutingTable table;
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        const BenchPrefix& p = prefixes[i];
+        uint32_t paths = PATH_COUNTS[i % PATH_KINDS];
+        for (uint32_t k = 0; k < paths; k++) {
+            uint32_t up = (static_cast<uint32_t>(i) + k) % UPLINKS;
+            table.addRoute(p.network, p.prefix_len, uplink(up), 0x0A000001 + up, 10);
+        }
+        table.addRoute(p.network, p.prefix_len, "backup", 0x0A0000FE, 20);
+    }
+    std::printf("  routes: %zu, adjacencies: %zu, next-hop groups: %zu\n",
+                table.size(), table.adjacencies().size(), table.adjacencies().groupCount());
+
+    std::vector<FlowKey> flows = makeFlows(prefixes);
+    const AdjacencyTable& adjacencies = table.adjacencies();
+
+    uint64_t sink = 0;
+    uint64_t start = benchNowNs();
+    for (const FlowKey& flow : flows) {
+        sink += table.lookupRoute(flow.dst_ip);
+    }
+    benchReport("lookup only", flows.size(), benchNowNs() - start);
+
+    start = benchNowNs();
+    for (const FlowKey& flow : flows) {
+        sink += routeVerdict(adjacencies, table.lookupRoute(flow.dst_ip), flow.dst_ip, ecmpHash(flow)).interface_id;
+    }
+    benchReport("lookup + hash + path select", flows.size(), benchNowNs() - start);
+    std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink));
+
+    /* metric: the backup must never carry traffic while the equal-cost paths exist. the
+       share of each member position is counted per group size */
+    std::vector<AdjacencyHandle> paths = selectPaths(table, flows);
+    size_t backup_used = 0, routed = 0;
+    std::vector<std::vector<size_t>> position_flows(UPLINKS + 1);
+    for (size_t i = 0; i < flows.size(); i++) {
+        if (paths[i] == NO_ADJACENCY) {
+            continue;
+        }
+        routed++;
+        if (adjacencies.interfaceOf(paths[i]) == "backup") {
+            backup_used++;
+            continue;
+        }
+        std::vector<AdjacencyHandle> members = adjacencies.members(table.lookupRoute(flows[i].dst_ip));
+        std::vector<size_t>& positions = position_flows[members.size()];
+        positions.resize(members.size());
+        positions[std::find(members.begin(), members.end(), paths[i]) - members.begin()]++;
+    }
+    std::printf("  routed flows: %zu, over backup: %zu\n", routed, backup_used);
+    bool even = true;
+    for (uint32_t count : PATH_COUNTS) {
+        const std::vector<size_t>& positions = position_flows[count];
+        size_t group_flows = 0;
+        for (size_t flows_taken : positions) {
+            group_flows += flows_taken;
+        }
+        double worst = 0, least = 1, most = 0;
+        for (size_t flows_taken : positions) {
+            double share = group_flows ? static_cast<double>(flows_taken) / group_flows : 0;
+            worst = std::max(worst, std::abs(share - 1.0 / count));
+            least = std::min(least, share);
+            most = std::max(most, share);
+        }
+        std::printf("  %u-way: %zu flows, member shares %.2f%% to %.2f%% (even %.2f%%), deviation %.2f%%\n", count,
+                    group_flows, least * 100, most * 100, 100.0 / count, worst * 100);
+        even &= group_flows > 0 && positions.size() == count && worst <= MAX_SHARE_DEVIATION;
+    }
+    // unrelated updates (inside 198.18.0.0/15) must not move flows
+    for (size_t i = 0; i < 512; i++) {
+        table.replaceRoute(0xC6120000 + (static_cast<uint32_t>(i) << 8), 24, uplink(i % UPLINKS), 0x0A000001, 10);
+    }
+    std::vector<AdjacencyHandle> after = selectPaths(table, flows);
+    size_t moved = 0;
+    for (size_t i = 0; i < flows.size(); i++) {
+        moved += (paths[i] != after[i] && (flows[i].dst_ip & 0xFFFE0000) != 0xC6120000);
+    }
+    std::printf("  flows moved by unrelated updates: %zu\n", moved);
+
+    // groups are part of the snapshot, every flow must keep its path
+    RoutingTable mapped;
+    if (!FibSnapshot::save(table, SNAPSHOT_FILE) || !FibSnapshot::load(mapped, SNAPSHOT_FILE)) {
+        return 1;
+    }
+    std::vector<AdjacencyHandle> mapped_paths = selectPaths(mapped, flows);
+    size_t snapshot_mismatches = 0;
+    for (size_t i = 0; i < flows.size(); i++) {
+        snapshot_mismatches += (after[i] != mapped_paths[i]);
+    }
+    std::printf("  snapshot path mismatches: %zu\n", snapshot_mismatches);
+    std::remove(SNAPSHOT_FILE);
+    bool ok = even && backup_used == 0 && moved == 0 && snapshot_mismatches == 0;
+    std::printf("paths even for every group size, sticky, snapshot kept: %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include "bench_common.hpp"
+#include "fib_snapshot.hpp"
+#include "logger.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+/* startup cost of a full table: per-line addRoute with string CIDRs (the old way),
+   the bulk route file loader, and mapping a compiled FIB snapshot. last, snapshots with
+   corrupt records or sections past the end of the file must be refused without leaving
+   anything behind in the table, so the good file still loads into it afterwards */
+
+constexpr size_t TABLE_PREFIXES = 900000;
+constexpr const char* ROUTES_FILE = "bench_routes.txt";
+constexpr const char* SNAPSHOT_FILE = "bench_fib.snapshot";
+constexpr const char* CORRUPT_FILE = "bench_fib_corrupt.snapshot";
+
+static std::vector<uint8_t> readFile(const char* path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static bool loadBytes(RoutingTable& table, const std::vector<uint8_t>& bytes) {
+    std::ofstream(CORRUPT_FILE, std::ios::binary | std::ios::trunc)
+        .write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return FibSnapshot::load(table, CORRUPT_FILE);
+}
+
+// a small table with an ECMP group and a tbl8 group, broken one field at a time
+static bool checkCorruptSnapshots() {
+    RoutingTable source;
+    source.addRoute("10.0.0.0/8", "eth0", "10.0.0.1", 1);
+    source.addRoute("10.0.0.0/8", "eth1", "10.1.0.1", 1);
+    source.addRoute("10.1.2.0/25", "eth1", "10.1.0.1", 1);
+    source.addRoute("192.168.0.0/16", "eth2", "", 1);
+    if (!FibSnapshot::save(source, CORRUPT_FILE)) {
+        return false;
+    }
+    const std::vector<uint8_t> good = readFile(CORRUPT_FILE);
+    FibSnapshotHeader header;
+    std::memcpy(&header, good.data(), sizeof(header));
+    auto withHeader = [&](auto change) {
+        std::vector<uint8_t> bytes = good;
+        FibSnapshotHeader broken = header;
+        change(broken);
+        std::memcpy(bytes.data(), &broken, sizeof(broken));
+        return bytes;
+    };
+    auto withWord = [&](uint64_t offset, uint32_t value) {
+        std::vector<uint8_t> bytes = good;
+        std::memcpy(bytes.data() + offset, &value, sizeof(value));
+        return bytes;
+    };
+    uint64_t tbl24_10_1_2 = header.tbl24_offset + (0x0A0102u * sizeof(uint32_t));
+    uint32_t extended;
+    std::memcpy(&extended, good.data() + tbl24_10_1_2, sizeof(extended));
+
+    std::vector<std::pair<const char*, std::vector<uint8_t>>> corrupt;
+    corrupt.emplace_back("truncated", std::vector<uint8_t>(good.begin(), good.end() - 4096));
+    corrupt.emplace_back("routes past the end", withHeader([](FibSnapshotHeader& h) { h.routes_offset = h.file_size; }));
+    corrupt.emplace_back("tbl8 past the end", withHeader([](FibSnapshotHeader& h) { h.tbl8_groups += 1u << 20; }));
+    corrupt.emplace_back("interfaces past the end",
+                         withHeader([](FibSnapshotHeader& h) { h.interfaces_offset = UINT64_MAX - 4; }));
+    corrupt.emplace_back("tbl8 group out of range", withWord(tbl24_10_1_2, extended + header.tbl8_groups));
+    corrupt.emplace_back("adjacency out of range",
+                         withWord(header.tbl24_offset, LPM_ENTRY_VALID | header.adjacency_count));
+    corrupt.emplace_back("group out of range",
+                         withWord(header.tbl24_offset, LPM_ENTRY_VALID | NEXTHOP_GROUP_FLAG | header.group_count));
+    // the group has two members, the second, highest one moves past the adjacencies
+    corrupt.emplace_back("group member out of range",
+                         withWord(header.groups_offset + offsetof(NextHopGroup, members) + sizeof(AdjacencyHandle),
+                                  header.adjacency_count));
+    corrupt.emplace_back("group count out of range",
+                         withWord(header.groups_offset + offsetof(NextHopGroup, count), NEXTHOP_GROUP_MAX_MEMBERS + 1));
+    corrupt.emplace_back("route adjacency out of range",
+                         withWord(header.routes_offset + offsetof(RouteEntry, adjacency), header.adjacency_count));
+    corrupt.emplace_back("interface of an adjacency out of range",
+                         withWord(header.adjacencies_offset + offsetof(Adjacency, interface_id), header.interface_count));
+
+    // every attempt goes into the same table, which has to stay empty for the next one
+    RoutingTable table;
+    size_t accepted = 0;
+    for (const auto& [what, bytes] : corrupt) {
+        if (loadBytes(table, bytes)) {
+            std::printf("  corrupt snapshot accepted: %s\n", what);
+            accepted++;
+        }
+    }
+    bool retried = loadBytes(table, good) && table.size() == source.size() &&
+                   table.lookupRoute(0x0A010205) == source.lookupRoute(0x0A010205) &&
+                   table.lookupRoute(0x0A050505) == source.lookupRoute(0x0A050505);
+    std::remove(CORRUPT_FILE);
+    std::printf("  %zu corrupt snapshots, %zu accepted, good file loaded after them: %s\n", corrupt.size(), accepted,
+                retried ? "yes" : "no");
+    return accepted == 0 && retried;
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== FIB startup (%zu prefixes) ===\n", TABLE_PREFIXES);
+
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    {
+        std::ofstream out(ROUTES_FILE);
+        for (size_t i = 0; i < prefixes.size(); i++) {
+            out << RoutingTable::ipToString(prefixes[i].network) << "/" << int(prefixes[i].prefix_len)
+                << (i % 3 ? " eth0 10.0.0.1 " : " eth1 10.1.0.1 ") << (i % 5) << "\n";
+        }
+    }
+
+    uint64_t start = benchNowNs();
+    RoutingTable line_table;
+    {
+        std::ifstream in(ROUTES_FILE);
+        std::string line, cidr, interface, next_hop;
+        int metric;
+        while (std::getline(in, line)) {
+            std::istringstream tokens(line);
+            tokens >> cidr >> interface >> next_hop >> metric;
+            line_table.addRoute(cidr, interface, next_hop, metric);
+        }
+    }
+    std::printf("  %-28s %10.2f ms\n", "addRoute per line", (benchNowNs() - start) / 1e6);
+
+    start = benchNowNs();
+    RoutingTable bulk_table;
+    size_t loaded = bulk_table.loadRoutes(ROUTES_FILE);
+    std::printf("  %-28s %10.2f ms (%zu routes)\n", "bulk loadRoutes", (benchNowNs() - start) / 1e6, loaded);
+
+    start = benchNowNs();
+    if (!FibSnapshot::save(bulk_table, SNAPSHOT_FILE)) {
+        return 1;
+    }
+    std::printf("  %-28s %10.2f ms\n", "snapshot save", (benchNowNs() - start) / 1e6);
+
+    start = benchNowNs();
+    RoutingTable mapped_table;
+    if (!FibSnapshot::load(mapped_table, SNAPSHOT_FILE)) {
+        return 1;
+    }
+    std::printf("  %-28s %10.2f ms\n", "snapshot load (mmap)", (benchNowNs() - start) / 1e6);
+
+    // the mapped table must answer exactly like the one it was saved from
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, 1 << 20, 7);
+    std::vector<AdjacencyHandle> expected(dsts.size()), actual(dsts.size());
+    bulk_table.lookupRoutes(dsts.data(), expected.data(), dsts.size());
+    start = benchNowNs();
+    mapped_table.lookupRoutes(dsts.data(), actual.data(), dsts.size());
+    uint64_t first_touch_ns = benchNowNs() - start;
+
+    // handles survive the snapshot, so the adjacencies behind them must match too
+    const AdjacencyTable& bulk_adjacencies = bulk_table.adjacencies();
+    const AdjacencyTable& mapped_adjacencies = mapped_table.adjacencies();
+    size_t mismatches = 0;
+    for (size_t i = 0; i < dsts.size(); i++) {
+        if (expected[i] != actual[i]) {
+            mismatches++;
+            continue;
+        }
+        if (expected[i] == NO_ADJACENCY) {
+            continue;
+        }
+        // one hash in each sixteenth of the range reaches every member of any group
+        for (uint32_t part = 0; part < NEXTHOP_GROUP_MAX_MEMBERS; part++) {
+            uint32_t hash = part << 28;
+            AdjacencyHandle a = bulk_adjacencies.select(expected[i], hash);
+            AdjacencyHandle b = mapped_adjacencies.select(actual[i], hash);
+            if (bulk_adjacencies.interfaceOf(a) != mapped_adjacencies.interfaceOf(b) ||
+                bulk_adjacencies.get(a).next_hop != mapped_adjacencies.get(b).next_hop) {
+                mismatches++;
+                break;
+            }
+        }
+    }
+    std::printf("  first %zu lookups on mapped table: %.2f ms, mismatches: %zu\n",
+                dsts.size(), first_touch_ns / 1e6, mismatches);
+
+    // updates still work on the mapped table (RIB is rebuilt lazily here)
+    start = benchNowNs();
+    mapped_table.replaceRoute(prefixes[0].network, prefixes[0].prefix_len, "eth9");
+    bool removed = mapped_table.removeRoute(prefixes[1].network, prefixes[1].prefix_len);
+    std::printf("  first update after load: %.2f ms (withdraw %s), routes: %zu\n",
+                (benchNowNs() - start) / 1e6, removed ? "ok" : "failed", mapped_table.size());
+
+    std::remove(ROUTES_FILE);
+    std::remove(SNAPSHOT_FILE);
+
+    bool ok = checkCorruptSnapshots();
+    std::printf("corrupt snapshots refused, table left loadable: %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
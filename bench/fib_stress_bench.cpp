@@ -0,0 +1,127 @@
+#include "bench_common.hpp"
+#include "routing_table.hpp"
+#include "logger.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <unordered_set>
+
+/* concurrent FIB stress: reader threads run batched lookups without locks while a
+   writer keeps announcing and withdrawing routes. every result is checked against the
+   destination it was returned for, and throughput is reported with and without the
+   update load */
+
+constexpr size_t BASE_PREFIXES = 200000;
+constexpr uint64_t PHASE_NS = 2000000000ull;
+
+struct ReaderStats {
+    uint64_t lookups = 0;
+    uint64_t bad_results = 0;
+};
+
+static void readerLoop(RoutingTable& table, const std::vector<uint32_t>& dsts,
+                       const std::atomic<bool>& stop, ReaderStats& stats) {
+    RcuDomain& rcu = table.rcu();
+    int reader_id = rcu.registerReader();
+    const AdjacencyTable& adjacencies = table.adjacencies();
+    AdjacencyHandle results[LPM_MAX_BURST];
+    size_t offset = 0;
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        const uint32_t* burst = dsts.data() + offset;
+        table.lookupRoutes(burst, results, LPM_MAX_BURST);
+        for (size_t i = 0; i < LPM_MAX_BURST; i++) {
+            // odd destinations were drawn from installed prefixes, which are never withdrawn
+            bool must_match = (offset + i) & 1;
+            int len = benchMatchedLength(adjacencies, results[i], burst[i]);
+            if (len == -2 || (len == -1 && must_match)) {
+                stats.bad_results++;
+            }
+        }
+        stats.lookups += LPM_MAX_BURST;
+        offset = (offset + LPM_MAX_BURST) & (dsts.size() - 1);
+        rcu.quiescent(reader_id);
+    }
+
+    rcu.unregisterReader(reader_id);
+}
+
+static uint64_t prefixKey(const BenchPrefix& p) {
+    return (static_cast<uint64_t>(p.network) << 8) | p.prefix_len;
+}
+
+static void runPhase(const char* name, RoutingTable& table, const std::vector<uint32_t>& dsts,
+                     const std::unordered_set<uint64_t>& base, size_t reader_count, bool with_updates) {
+    std::atomic<bool> stop{false};
+    std::vector<ReaderStats> stats(reader_count);
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < reader_count; i++) {
+        readers.emplace_back(readerLoop, std::ref(table), std::cref(dsts), std::cref(stop), std::ref(stats[i]));
+    }
+
+    uint64_t updates = 0;
+    std::mt19937 rng(1234);
+    uint64_t start = benchNowNs();
+    if (with_updates) {
+        // control plane: announce churn prefixes, withdraw them again unless they are base prefixes
+        std::vector<BenchPrefix> churn = benchRandomPrefixes(1 << 16, 99);
+        while (benchNowNs() - start < PHASE_NS) {
+            const BenchPrefix& p = churn[rng() & (churn.size() - 1)];
+            if ((updates % 3) == 2 && !base.count(prefixKey(p))) {
+                table.removeRoute(p.network, p.prefix_len);
+            } else {
+                table.replaceRoute(p.network, p.prefix_len, benchInterface(p.prefix_len), p.network,
+                                   static_cast<int>(rng() % 4));
+            }
+            updates++;
+        }
+    } else {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(PHASE_NS));
+    }
+    stop.store(true);
+    for (auto& t : readers) {
+        t.join();
+    }
+    uint64_t elapsed = benchNowNs() - start;
+
+    uint64_t lookups = 0, bad = 0;
+    for (const auto& s : stats) {
+        lookups += s.lookups;
+        bad += s.bad_results;
+    }
+    std::printf("  %-22s %8.2f Mlookups/s total, %8.2f Mlookups/s per reader, %9.0f updates/s, %llu bad results\n",
+                name, lookups * 1000.0 / elapsed, lookups * 1000.0 / elapsed / reader_count,
+                updates * 1e9 / elapsed, static_cast<unsigned long long>(bad));
+}
+
+int main(int argc, char** argv) {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+
+    size_t reader_count = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 4;
+    if (reader_count == 0) {
+        reader_count = 1;
+    }
+
+    std::printf("=== Concurrent FIB stress (%zu readers, %zu base prefixes) ===\n",
+                reader_count, BASE_PREFIXES);
+
+    RoutingTable table;
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(BASE_PREFIXES, 42);
+    for (const auto& p : prefixes) {
+        table.addRoute(p.network, p.prefix_len, benchInterface(p.prefix_len), p.network);
+    }
+    std::unordered_set<uint64_t> base;
+    for (const auto& p : prefixes) {
+        base.insert(prefixKey(p));
+    }
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, 1 << 20, 7);
+
+    runPhase("lookups only", table, dsts, base, reader_count, false);
+    runPhase("lookups + updates", table, dsts, base, reader_count, true);
+
+    table.reclaim();
+    std::printf("  routes: %zu, tbl8 groups: %zu, generation: %llu, retired blocks pending: %zu\n",
+                table.size(), table.lpm().tbl8GroupsUsed(),
+                static_cast<unsigned long long>(table.generation()), table.rcu().pending());
+    return 0;
+}
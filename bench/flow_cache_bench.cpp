@@ -0,0 +1,121 @@
+#include "bench_common.hpp"
+#include "routing_table.hpp"
+#include "flow_cache.hpp"
+#include "logger.hpp"
+#include <cmath>
+
+/* microflow verdict cache: forwarding verdicts for a skewed mix of long-lived flows,
+   resolved straight from the FIB and through 5-tuple and destination keyed caches of
+   a fixed size. every cached verdict is checked against the FIB, and a route change
+   must invalidate the cached verdicts of the flows it covers */
+
+constexpr size_t TABLE_PREFIXES = 900000;
+constexpr size_t CACHE_ENTRIES = 1 << 16;
+constexpr size_t PACKETS = 1 << 22;
+
+static std::vector<FlowKey> makeFlows(const std::vector<BenchPrefix>& prefixes, size_t count, uint32_t seed) {
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, count, seed);
+    std::mt19937 rng(seed);
+    std::vector<FlowKey> flows(count);
+    for (size_t i = 0; i < count; i++) {
+        flows[i] = {static_cast<uint32_t>(rng()), dsts[i], static_cast<uint16_t>(rng()),
+                    static_cast<uint16_t>(rng() % 1024), static_cast<uint8_t>((i & 1) ? 6 : 17)};
+    }
+    return flows;
+}
+
+// packet sequence over the flows, a few flows carry most of the packets
+static std::vector<uint32_t> makeTrace(size_t flow_count, size_t packets, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<uint32_t> trace(packets);
+    for (auto& flow : trace) {
+        flow = static_cast<uint32_t>(flow_count * std::pow(uniform(rng), 4.0));
+    }
+    return trace;
+}
+
+static void runCache(const char* name, const RoutingTable& table, const std::vector<FlowKey>& flows,
+                     const std::vector<uint32_t>& trace, FlowCacheMode mode, bool measure_latency) {
+    FlowCache cache(CACHE_ENTRIES, mode, measure_latency);
+    const AdjacencyTable& adjacencies = table.adjacencies();
+    uint64_t generation = table.generation();
+    std::vector<AdjacencyHandle> results(trace.size());
+
+    uint64_t start = benchNowNs();
+    for (size_t i = 0; i < trace.size(); i++) {
+        const FlowKey& flow = flows[trace[i]];
+        results[i] = cache.lookup(flow, generation, [&]() {
+            return routeVerdict(adjacencies, table.lookupRoute(flow.dst_ip), flow.dst_ip, ecmpHash(flow));
+        }).adjacency;
+    }
+    uint64_t elapsed = benchNowNs() - start;
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < trace.size(); i++) {
+        mismatches += (results[i] != table.lookupRoute(flows[trace[i]].dst_ip));
+    }
+
+    const FlowCacheStats& stats = cache.stats();
+    benchReport(name, trace.size(), elapsed);
+    std::printf("      hit rate %6.2f%%, %llu evictions, %zu mismatches", stats.hitRate() * 100,
+                static_cast<unsigned long long>(stats.evictions), mismatches);
+    if (measure_latency) {
+        std::printf(", %.1f ns/hit, %.1f ns/miss", stats.averageHitNs(), stats.averageMissNs());
+    }
+    std::printf("\n");
+}
+
+static void runFlows(const RoutingTable& table, const std::vector<BenchPrefix>& prefixes, size_t flow_count) {
+    std::printf("%zu flows, %zu packets, %zu cache entries\n", flow_count, PACKETS, CACHE_ENTRIES);
+    std::vector<FlowKey> flows = makeFlows(prefixes, flow_count, 11);
+    std::vector<uint32_t> trace = makeTrace(flow_count, PACKETS, 13);
+
+    const AdjacencyTable& adjacencies = table.adjacencies();
+    uint64_t sink = 0;
+    uint64_t start = benchNowNs();
+    for (uint32_t index : trace) {
+        const FlowKey& flow = flows[index];
+        sink += routeVerdict(adjacencies, table.lookupRoute(flow.dst_ip), flow.dst_ip, ecmpHash(flow)).interface_id;
+    }
+    benchReport("uncached FIB lookup", trace.size(), benchNowNs() - start);
+
+    runCache("5-tuple cache", table, flows, trace, FlowCacheMode::FIVE_TUPLE, false);
+    runCache("destination cache", table, flows, trace, FlowCacheMode::DESTINATION, false);
+    runCache("5-tuple cache (timed)", table, flows, trace, FlowCacheMode::FIVE_TUPLE, true);
+    std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink));
+}
+
+// a cached flow must see a route change on its next packet
+static bool checkInvalidation(RoutingTable& table, const std::vector<BenchPrefix>& prefixes) {
+    FlowCache cache(CACHE_ENTRIES);
+    const BenchPrefix& p = prefixes[0];
+    FlowKey flow = {1, p.network, 1000, 80, 6};
+    auto resolve = [&]() {
+        return routeVerdict(table.adjacencies(), table.lookupRoute(flow.dst_ip), flow.dst_ip, ecmpHash(flow));
+    };
+
+    cache.lookup(flow, table.generation(), resolve);
+    table.replaceRoute(p.network, p.prefix_len, "changed", 0x0A000001);
+    ForwardingVerdict after = cache.lookup(flow, table.generation(), resolve);
+    return after.adjacency == table.lookupRoute(flow.dst_ip) &&
+           table.adjacencies().interfaceName(after.interface_id) == "changed" &&
+           cache.stats().stale == 1;
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== Flow verdict cache (%zu prefixes) ===\n", TABLE_PREFIXES);
+
+    RoutingTable table;
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    for (const auto& p : prefixes) {
+        table.addRoute(p.network, p.prefix_len, benchInterface(p.prefix_len), p.network);
+    }
+
+    for (size_t flow_count : {size_t(1) << 12, size_t(1) << 16, size_t(1) << 20}) {
+        runFlows(table, prefixes, flow_count);
+    }
+    std::printf("route change invalidates cached verdicts: %s\n", checkInvalidation(table, prefixes) ? "ok" : "FAILED");
+    return 0;
+}
@@ -0,0 +1,281 @@
+#include "bench_common.hpp"
+#include "fragment_reassembly.hpp"
+#include "internet_protocol.hpp"
+#include "packet_builders.hpp"
+#include "checksum.hpp"
+#include "logger.hpp"
+
+/* IPv4 fragment reassembly: datagrams cut into fragments, shuffled and interleaved,
+   must come out byte for byte as they went in. then the rate of in-order reassembly
+   and first-fragment passing, and a flood of fragments that never complete: memory has
+   to stay under the cap and the cost per fragment flat while the legitimate datagrams
+   mixed into it keep getting through */
+
+constexpr size_t DATAGRAMS = 200000;
+constexpr size_t FLOOD_FRAGMENTS = 4000000;
+constexpr size_t LEGIT_EVERY = 64;          // one legitimate fragment per this many flood fragments
+constexpr size_t BURST = 32;
+
+// the datagram cut into fragments carrying at most payload_per_fragment bytes each (a multiple of 8)
+static std::vector<std::vector<uint8_t>> fragment(const std::vector<uint8_t>& datagram, size_t payload_per_fragment) {
+    std::vector<std::vector<uint8_t>> fragments;
+    size_t header_length = (datagram[0] & 0x0F) * 4;
+    size_t payload = datagram.size() - header_length;
+    for (size_t offset = 0; offset < payload; offset += payload_per_fragment) {
+        size_t length = std::min(payload_per_fragment, payload - offset);
+        std::vector<uint8_t> piece(datagram.begin(), datagram.begin() + header_length);
+        piece.insert(piece.end(), datagram.begin() + header_length + offset,
+                     datagram.begin() + header_length + offset + length);
+        uint16_t flags = static_cast<uint16_t>((offset / 8) | (offset + length < payload ? 0x2000 : 0));
+        piece[2] = static_cast<uint8_t>(piece.size() >> 8);
+        piece[3] = static_cast<uint8_t>(piece.size());
+        piece[6] = static_cast<uint8_t>(flags >> 8);
+        piece[7] = static_cast<uint8_t>(flags);
+        uint16_t checksum = ipv4HeaderChecksum(piece.data(), header_length);
+        piece[10] = static_cast<uint8_t>(checksum >> 8);
+        piece[11] = static_cast<uint8_t>(checksum);
+        fragments.push_back(std::move(piece));
+    }
+    return fragments;
+}
+
+static std::vector<uint8_t> udpDatagram(uint16_t id, size_t payload, std::mt19937& rng) {
+    UDPPacketBuilder builder;
+    builder.ipv4_identification = id;
+    builder.ipv4_flags_fragment_offset = 0;
+    builder.udp_payload.resize(payload);
+    for (char& c : builder.udp_payload) {
+        c = static_cast<char>(rng());
+    }
+    return builder.build();
+}
+
+// the datagrams of a run and their fragments, in the order they are fed
+struct FragmentedTraffic {
+    std::vector<std::vector<uint8_t>> datagrams;
+    std::vector<std::vector<uint8_t>> fragments;
+    std::vector<PacketView> views;
+};
+
+/* count datagrams of 1000..8000 bytes over a 1500 byte MTU. with shuffle the fragments
+   of each datagram are in random order and window datagrams at a time are interleaved */
+static FragmentedTraffic makeTraffic(size_t count, bool shuffle, size_t window, uint32_t seed) {
+    std::mt19937 rng(seed);
+    FragmentedTraffic traffic;
+    for (size_t first = 0; first < count; first += window) {
+        std::vector<std::vector<uint8_t>> group;
+        for (size_t i = first; i < std::min(count, first + window); i++) {
+            traffic.datagrams.push_back(udpDatagram(static_cast<uint16_t>(i), 1000 + rng() % 7000, rng));
+            for (auto& piece : fragment(traffic.datagrams.back(), 1480)) {
+                group.push_back(std::move(piece));
+            }
+        }
+        if (shuffle) {
+            std::shuffle(group.begin(), group.end(), rng);
+        }
+        for (auto& piece : group) {
+            traffic.fragments.push_back(std::move(piece));
+        }
+    }
+    for (const auto& piece : traffic.fragments) {
+        traffic.views.push_back(PacketView(piece));
+    }
+    return traffic;
+}
+
+/* feeds the views through in bursts, calls check(view) for everything that comes out.
+   returns the ns spent in reassemble() */
+template <typename Check>
+static uint64_t feed(FragmentReassembler& reassembler, const std::vector<PacketView>& views, uint64_t now_ns,
+                     Check&& check) {
+    uint64_t spent = 0;
+    for (size_t first = 0; first < views.size();) {
+        size_t count = std::min(BURST, views.size() - first);
+        uint64_t start = benchNowNs();
+        size_t consumed = reassembler.reassemble(views.data() + first, count, now_ns);
+        spent += benchNowNs() - start;
+        for (size_t i = 0; i < reassembler.outputCount(); i++) {
+            check(reassembler.output()[i]);
+        }
+        first += consumed;
+    }
+    return spent;
+}
+
+static bool checkReassembly() {
+    FragmentedTraffic traffic = makeTraffic(20000, true, 16, 1);
+    FragmentReassembler reassembler;
+    size_t matched = 0, wrong = 0;
+    feed(reassembler, traffic.views, 0, [&](PacketView packet) {
+        IPv4HeaderView header(packet);
+        const std::vector<uint8_t>& original = traffic.datagrams[header.identification()];
+        bool same = packet.size() == original.size() && std::memcmp(packet.data(), original.data(), packet.size()) == 0;
+        matched += same;
+        wrong += !same;
+    });
+    ReassemblyStats stats = reassembler.stats();
+    std::printf("  %zu datagrams in %zu shuffled fragments: %zu reassembled byte-identical, %zu wrong, "
+                "%zu still held\n", traffic.datagrams.size(), traffic.fragments.size(), matched, wrong,
+                stats.buffers);
+    bool ok = matched == traffic.datagrams.size() && wrong == 0 && stats.datagrams == 0 && stats.buffers == 0;
+
+    // an overlap drops its datagram, a duplicate only itself
+    std::mt19937 rng(2);
+    std::vector<uint8_t> datagram = udpDatagram(7, 4000, rng);
+    auto pieces = fragment(datagram, 1480);
+    auto overlapping = fragment(datagram, 1488);
+    std::vector<PacketView> views = {pieces[0], overlapping[1], pieces[1], pieces[2]};
+    FragmentReassembler strict;
+    size_t out = 0;
+    feed(strict, views, 0, [&](PacketView) { out++; });
+    std::vector<PacketView> repeated = {pieces[1], pieces[1], pieces[0], pieces[2]};
+    size_t out_repeated = 0;
+    feed(strict, repeated, 0, [&](PacketView) { out_repeated++; });
+    stats = strict.stats();
+    std::printf("  overlap: %zu out (%llu overlapping), duplicate: %zu out (%llu duplicates)\n", out,
+                static_cast<unsigned long long>(stats.overlaps), out_repeated,
+                static_cast<unsigned long long>(stats.duplicates));
+    ok &= out == 0 && stats.overlaps == 1 && out_repeated == 1 && stats.duplicates == 1;
+
+    // half a datagram expires after the timeout and leaves nothing behind
+    FragmentReassembler timed;
+    std::vector<PacketView> half = {pieces[0], pieces[2]};
+    feed(timed, half, 1000, [](PacketView) {});
+    size_t held_before = timed.stats().buffers;
+    timed.expire(1000 + timed.config().timeout_ns + 2 * timed.config().tick_ns);
+    stats = timed.stats();
+    std::printf("  timeout: %zu fragments held, then %llu timed out, %zu held\n", held_before,
+                static_cast<unsigned long long>(stats.timeouts), stats.buffers);
+    ok &= held_before == 2 && stats.timeouts == 1 && stats.buffers == 0 && stats.datagrams == 0;
+    return ok;
+}
+
+// every datagram's first fragment comes out before any other piece of it, nothing is lost
+static bool checkFirstFragment() {
+    FragmentedTraffic traffic = makeTraffic(20000, true, 16, 3);
+    ReassemblyConfig config;
+    config.mode = ReassemblyMode::FIRST_FRAGMENT;
+    FragmentReassembler reassembler(config);
+    std::vector<uint8_t> first_seen(traffic.datagrams.size(), 0);
+    size_t out = 0, early = 0;
+    feed(reassembler, traffic.views, 0, [&](PacketView packet) {
+        IPv4HeaderView header(packet);
+        uint16_t id = header.identification();
+        if ((header.flagsFragmentOffset() & 0x1FFF) == 0) {
+            first_seen[id] = 1;
+        } else {
+            early += !first_seen[id];
+        }
+        out++;
+    });
+    ReassemblyStats stats = reassembler.stats();
+    std::printf("  first-fragment mode: %zu of %zu fragments out, %zu ahead of their first, %zu datagrams open\n",
+                out, traffic.fragments.size(), early, stats.datagrams);
+    return out == traffic.fragments.size() && early == 0 && stats.datagrams == 0;
+}
+
+static void benchRates() {
+    FragmentedTraffic traffic = makeTraffic(DATAGRAMS, false, 1, 4);
+    for (ReassemblyMode mode : {ReassemblyMode::FULL, ReassemblyMode::FIRST_FRAGMENT}) {
+        ReassemblyConfig config;
+        config.mode = mode;
+        FragmentReassembler reassembler(config);
+        uint64_t sink = 0;
+        uint64_t ns = feed(reassembler, traffic.views, 0, [&](PacketView packet) { sink += packet.size(); });
+        benchReport(mode == ReassemblyMode::FULL ? "reassemble, in order (per fragment)"
+                                                 : "first fragment pass (per fragment)",
+                    traffic.views.size(), ns);
+        std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink));
+    }
+    FragmentedTraffic shuffled = makeTraffic(DATAGRAMS, true, 64, 5);
+    FragmentReassembler reassembler;
+    uint64_t sink = 0;
+    uint64_t ns = feed(reassembler, shuffled.views, 0, [&](PacketView packet) { sink += packet.size(); });
+    benchReport("reassemble, 64 datagrams interleaved", shuffled.views.size(), ns);
+    std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink));
+}
+
+/* random first or middle fragments from random sources that never complete, with the
+   fragments of legitimate datagrams sprinkled in. the clock advances 1 us a burst */
+static bool benchFlood() {
+    std::mt19937 rng(6);
+    std::vector<uint8_t> template_fragment = fragment(udpDatagram(0, 3000, rng), 1480)[1];
+    std::vector<std::vector<uint8_t>> flood(4096, template_fragment);
+    for (auto& piece : flood) {
+        piece[4] = static_cast<uint8_t>(rng());
+        piece[5] = static_cast<uint8_t>(rng());
+        for (size_t i = 12; i < 16; i++) {
+            piece[i] = static_cast<uint8_t>(rng());
+        }
+    }
+    // datagrams average 3.5 fragments, all of them fit into the slots the flood leaves
+    FragmentedTraffic legit = makeTraffic(FLOOD_FRAGMENTS / LEGIT_EVERY / 5, false, 1, 7);
+
+    ReassemblyConfig config;
+    FragmentReassembler reassembler(config);
+    std::vector<PacketView> burst(BURST);
+    size_t legit_next = 0, delivered = 0, peak_memory = 0, peak_datagrams = 0;
+    uint64_t now = 0, ns = 0;
+    for (size_t sent = 0; sent < FLOOD_FRAGMENTS; sent += BURST) {
+        for (size_t i = 0; i < BURST; i++) {
+            if ((sent + i) % LEGIT_EVERY == 0 && legit_next < legit.views.size()) {
+                burst[i] = legit.views[legit_next++];
+            } else {
+                // a new identification each time, each flood fragment opens a datagram of its own
+                std::vector<uint8_t>& piece = flood[(sent + i) & 4095];
+                piece[4]++;
+                burst[i] = PacketView(piece);
+            }
+        }
+        now += 1000;
+        for (size_t first = 0; first < BURST;) {
+            uint64_t start = benchNowNs();
+            first += reassembler.reassemble(burst.data() + first, BURST - first, now);
+            ns += benchNowNs() - start;
+            delivered += reassembler.outputCount();
+        }
+        ReassemblyStats stats = reassembler.stats();
+        peak_memory = std::max(peak_memory, stats.memory);
+        peak_datagrams = std::max(peak_datagrams, stats.datagrams);
+    }
+    ReassemblyStats stats = reassembler.stats();
+    benchReport("fragment flood (per fragment)", FLOOD_FRAGMENTS, ns);
+    std::printf("  peak %zu bytes held (cap %zu), peak %zu datagrams (cap %zu), %llu evictions, %llu timeouts\n",
+                peak_memory, config.memory_limit, peak_datagrams, config.max_datagrams,
+                static_cast<unsigned long long>(stats.evictions), static_cast<unsigned long long>(stats.timeouts));
+    std::printf("  legitimate datagrams: %zu of %zu reassembled during the flood\n", delivered,
+                legit.datagrams.size());
+    return peak_memory <= config.memory_limit && peak_datagrams <= config.max_datagrams && stats.evictions > 0 &&
+           delivered == legit.datagrams.size();
+}
+
+// the pipeline with reassembly on sees the datagrams, not the fragments
+static bool checkPipeline() {
+    InternetProtocol ip;
+    ip.addRoute("192.168.1.0/24", "eth0");
+    ip.enableReassembly();
+    FragmentedTraffic traffic = makeTraffic(1000, true, 8, 8);
+    VerdictCounter counter;
+    ip.forwardPackets(traffic.views.data(), traffic.views.size(), counter);
+    std::printf("  pipeline: %zu fragments in, %llu packets forwarded\n", traffic.views.size(),
+                static_cast<unsigned long long>(counter.packets()));
+    uint64_t forwarded = 0;
+    for (size_t id = 0; id < counter.interfaceSlots(); id++) {
+        forwarded += counter.forwarded(static_cast<uint16_t>(id));
+    }
+    return counter.packets() == traffic.datagrams.size() && forwarded == traffic.datagrams.size();
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== IPv4 fragment reassembly ===\n");
+    bool ok = checkReassembly();
+    ok &= checkFirstFragment();
+    ok &= checkPipeline();
+    std::printf("--- rates ---\n");
+    benchRates();
+    std::printf("--- flood ---\n");
+    ok &= benchFlood();
+    std::printf("reassembly bounded and exact: %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
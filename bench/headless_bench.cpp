@@ -0,0 +1,84 @@
+#include "bench_common.hpp"
+#include "internet_protocol.hpp"
+#include "packet_printer.hpp"
+#include "packet_builders.hpp"
+#include "logger.hpp"
+#include <iostream>
+
+/* cost of printing: the same packets forwarded headless into a VerdictCounter and
+   through the PacketPrinter consumer (output discarded, logging at its production
+   level), both fed by forwardPackets. the counter must see what the printer printed */
+
+constexpr size_t TABLE_PREFIXES = 900000;
+constexpr size_t PACKETS = 1 << 22;
+constexpr size_t PRINTED_PACKETS = 1 << 16;
+constexpr size_t DISTINCT_PACKETS = 1 << 14;
+
+// discards everything, but still makes every consumer format its output
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== Headless forwarding vs printing (%zu prefixes) ===\n", TABLE_PREFIXES);
+
+    InternetProtocol ip;
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    for (const auto& p : prefixes) {
+        ip.addRoute(benchIpString(p.network) + "/" + std::to_string(p.prefix_len), benchInterface(p.prefix_len));
+    }
+
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, DISTINCT_PACKETS, 3);
+    std::vector<std::vector<uint8_t>> packets;
+    for (size_t i = 0; i < DISTINCT_PACKETS; i++) {
+        UDPPacketBuilder builder;
+        builder.ipv4_src_ip = "192.168.1.100";
+        builder.ipv4_dst_ip = benchIpString(dsts[i]);
+        builder.ipv4_ttl = (i % 50 == 0) ? 0 : 64;
+        builder.udp_src_port = static_cast<uint16_t>(1024 + i);
+        builder.udp_dst_port = 53;
+        builder.udp_payload = "query";
+        packets.push_back(builder.build());
+    }
+    std::mt19937 rng(77);
+    std::vector<PacketView> trace(PACKETS);
+    for (auto& view : trace) {
+        view = packets[rng() % DISTINCT_PACKETS];
+    }
+
+    VerdictCounter counter;
+    uint64_t start = benchNowNs();
+    ip.forwardPackets(trace.data(), trace.size(), counter);
+    benchReport("headless (VerdictCounter)", PACKETS, benchNowNs() - start);
+
+    NullBuffer null_buffer;
+    std::streambuf* console = std::cout.rdbuf(&null_buffer);
+    PacketPrinter printer(ip.adjacencies());
+    start = benchNowNs();
+    ip.forwardPackets(trace.data(), PRINTED_PACKETS, printer);
+    uint64_t printed_ns = benchNowNs() - start;
+    std::cout.rdbuf(console);
+    benchReport("printing (PacketPrinter)", PRINTED_PACKETS, printed_ns);
+
+    // the printed prefix of the trace again, counted, must match the full run's split on it
+    VerdictCounter check;
+    ip.forwardPackets(trace.data(), PRINTED_PACKETS, check);
+    uint64_t forwarded = 0;
+    for (size_t id = 0; id < check.interfaceSlots(); id++) {
+        forwarded += check.forwarded(static_cast<uint16_t>(id));
+    }
+    std::printf("      headless: %llu forwarded, %llu no route, %llu TTL expired of %llu\n",
+                static_cast<unsigned long long>(counter.packets() - counter.dropped(DropReason::NO_ROUTE) -
+                                                counter.dropped(DropReason::TTL_EXPIRED)),
+                static_cast<unsigned long long>(counter.dropped(DropReason::NO_ROUTE)),
+                static_cast<unsigned long long>(counter.dropped(DropReason::TTL_EXPIRED)),
+                static_cast<unsigned long long>(counter.packets()));
+    std::printf("records cover every packet: %s\n",
+                (counter.packets() == PACKETS && check.packets() == PRINTED_PACKETS &&
+                 forwarded + check.dropped(DropReason::NO_ROUTE) + check.dropped(DropReason::TTL_EXPIRED) ==
+                     PRINTED_PACKETS) ? "ok" : "FAILED");
+    return 0;
+}
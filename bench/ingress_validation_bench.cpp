@@ -0,0 +1,190 @@
+#include "bench_common.hpp"
+#include "internet_protocol.hpp"
+#include "packet_builders.hpp"
+#include "checksum.hpp"
+#include "logger.hpp"
+
+/* ingress validation: the vectorized 20-byte header checksum kernel against the scalar
+   sum on valid and corrupted headers, then the headless pipeline with the checks off,
+   at their defaults (lengths and header checksum) and with L4 checksums on. a known
+   share of the packets is corrupted, every check must drop exactly its share */
+
+constexpr size_t KERNEL_HEADERS = (1 << 20) + 3;     // not a multiple of 4, the scalar tail runs too
+constexpr size_t KERNEL_ROUNDS = 16;
+constexpr size_t TABLE_PREFIXES = 900000;
+constexpr size_t DISTINCT_PACKETS = 1 << 12;
+constexpr size_t PACKETS = 1 << 22;
+
+enum Corruption { CLEAN, HEADER_CHECKSUM, TOTAL_LENGTH, PAYLOAD_BYTE, CORRUPTIONS };
+
+static void storeHeaderChecksum(uint8_t* header) {
+    uint16_t checksum = ipv4HeaderChecksum(header, IPv4_HEADER_SIZE);
+    header[10] = static_cast<uint8_t>(checksum >> 8);
+    header[11] = static_cast<uint8_t>(checksum);
+}
+
+static bool checkKernel() {
+    std::mt19937 rng(11);
+    std::vector<uint8_t> storage(KERNEL_HEADERS * IPv4_HEADER_SIZE);
+    std::vector<const uint8_t*> headers(KERNEL_HEADERS);
+    for (size_t i = 0; i < KERNEL_HEADERS; i++) {
+        uint8_t* h = &storage[i * IPv4_HEADER_SIZE];
+        for (size_t b = 0; b < IPv4_HEADER_SIZE; b++) {
+            h[b] = static_cast<uint8_t>(rng());
+        }
+        h[0] = 0x45;
+        storeHeaderChecksum(h);
+        if (rng() % 2) {
+            h[rng() % IPv4_HEADER_SIZE] ^= static_cast<uint8_t>(1 << (rng() % 8));   // any single bit flip breaks it
+        }
+        headers[i] = h;
+    }
+
+    std::vector<uint8_t> ok(KERNEL_HEADERS);
+    size_t mismatches = 0, valid = 0;
+    ipv4Header20ChecksumsOk(headers.data(), KERNEL_HEADERS, ok.data());
+    for (size_t i = 0; i < KERNEL_HEADERS; i++) {
+        bool expected = internetChecksum(headers[i], IPv4_HEADER_SIZE) == 0;
+        mismatches += (ok[i] != 0) != expected;
+        valid += expected;
+    }
+    std::printf("  %zu headers (%zu valid): %zu kernel mismatches against the scalar sum\n",
+                KERNEL_HEADERS, valid, mismatches);
+
+    uint64_t sink = 0;
+    uint64_t start = benchNowNs();
+    for (size_t round = 0; round < KERNEL_ROUNDS; round++) {
+        ipv4Header20ChecksumsOk(headers.data(), KERNEL_HEADERS, ok.data());
+        sink += ok[round];
+    }
+    benchReport("20-byte kernel, bursts of all", KERNEL_HEADERS * KERNEL_ROUNDS, benchNowNs() - start);
+    start = benchNowNs();
+    for (size_t round = 0; round < KERNEL_ROUNDS; round++) {
+        for (size_t i = 0; i < KERNEL_HEADERS; i++) {
+            ok[i] = internetChecksum(headers[i], IPv4_HEADER_SIZE) == 0;
+        }
+        sink += ok[round];
+    }
+    benchReport("scalar internetChecksum", KERNEL_HEADERS * KERNEL_ROUNDS, benchNowNs() - start);
+    std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink));
+    return mismatches == 0;
+}
+
+static std::vector<uint8_t> buildPacket(uint32_t dst, size_t i) {
+    std::string src = "192.168.1.100";
+    uint16_t port = static_cast<uint16_t>(1024 + i);
+    switch (i % 3) {
+        case 0: {
+            UDPPacketBuilder udp;
+            udp.ipv4_src_ip = src;
+            udp.ipv4_dst_ip = benchIpString(dst);
+            udp.udp_src_port = port;
+            udp.udp_dst_port = 53;
+            udp.udp_payload = "DNS_QUERY_example.com_A";
+            return udp.build();
+        }
+        case 1: {
+            TCPPacketBuilder tcp;
+            tcp.ipv4_src_ip = src;
+            tcp.ipv4_dst_ip = benchIpString(dst);
+            tcp.tcp_src_port = port;
+            tcp.tcp_dst_port = 443;
+            tcp.tcp_flags = TCP_SYN;
+            tcp.tcp_payload = "";
+            return tcp.build();
+        }
+        default: {
+            ICMPPacketBuilder icmp;
+            icmp.ipv4_src_ip = src;
+            icmp.ipv4_dst_ip = benchIpString(dst);
+            icmp.icmp_seq = port;
+            return icmp.build();
+        }
+    }
+}
+
+static void corrupt(std::vector<uint8_t>& packet, Corruption corruption) {
+    switch (corruption) {
+        case HEADER_CHECKSUM:
+            packet[11] ^= 0x01;
+            break;
+        case TOTAL_LENGTH: {
+            // consistent header checksum, so only the length check can catch it
+            uint16_t total_length = static_cast<uint16_t>(packet.size() + 8);
+            packet[2] = static_cast<uint8_t>(total_length >> 8);
+            packet[3] = static_cast<uint8_t>(total_length);
+            storeHeaderChecksum(packet.data());
+            break;
+        }
+        case PAYLOAD_BYTE:
+            packet.back() ^= 0x10;
+            break;
+        default:
+            break;
+    }
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== IPv4 header checksum kernel ===\n");
+    bool ok = checkKernel();
+
+    std::printf("=== Ingress validation in the pipeline (%zu prefixes) ===\n", TABLE_PREFIXES);
+    InternetProtocol ip;
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    for (const auto& p : prefixes) {
+        ip.addRoute(benchIpString(p.network) + "/" + std::to_string(p.prefix_len), benchInterface(p.prefix_len));
+    }
+    ip.addRoute("0.0.0.0/0", "eth0", "10.0.0.1", 10);
+
+    // one packet in 16 corrupted, the kinds taking turns
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, DISTINCT_PACKETS, 3);
+    std::vector<std::vector<uint8_t>> packets;
+    std::vector<Corruption> kinds;
+    for (size_t i = 0; i < DISTINCT_PACKETS; i++) {
+        Corruption kind = (i % 16 == 0) ? static_cast<Corruption>(1 + (i / 16) % (CORRUPTIONS - 1)) : CLEAN;
+        packets.push_back(buildPacket(dsts[i], i));
+        corrupt(packets.back(), kind);
+        kinds.push_back(kind);
+    }
+    std::mt19937 rng(5);
+    std::vector<PacketView> trace(PACKETS);
+    uint64_t injected[CORRUPTIONS] = {};
+    for (auto& view : trace) {
+        size_t pick = rng() % DISTINCT_PACKETS;
+        view = packets[pick];
+        injected[kinds[pick]]++;
+    }
+
+    struct Setup {
+        const char* name;
+        IngressChecks checks;
+    };
+    IngressChecks l4;
+    l4.l4_checksum = true;
+    const Setup setups[] = {{"checks off", IngressChecks::none()}, {"lengths + header checksum", IngressChecks()},
+                            {"+ L4 checksums", l4}};
+    for (const Setup& setup : setups) {
+        ip.setIngressChecks(setup.checks);
+        VerdictCounter counter;
+        uint64_t start = benchNowNs();
+        ip.forwardPackets(trace.data(), trace.size(), counter);
+        benchReport(setup.name, PACKETS, benchNowNs() - start);
+
+        uint64_t bad_length = counter.dropped(DropReason::BAD_LENGTH);
+        uint64_t bad_checksum = counter.dropped(DropReason::BAD_CHECKSUM);
+        uint64_t bad_l4 = counter.dropped(DropReason::BAD_L4_CHECKSUM);
+        std::printf("      %llu bad length, %llu bad header checksum, %llu bad L4 checksum\n",
+                    static_cast<unsigned long long>(bad_length), static_cast<unsigned long long>(bad_checksum),
+                    static_cast<unsigned long long>(bad_l4));
+        ok &= bad_length == (setup.checks.lengths ? injected[TOTAL_LENGTH] : 0) &&
+              bad_checksum == (setup.checks.header_checksum ? injected[HEADER_CHECKSUM] : 0) &&
+              bad_l4 == (setup.checks.l4_checksum ? injected[PAYLOAD_BYTE] : 0);
+    }
+    std::printf("      injected: %llu bad length, %llu bad header checksum, %llu bad payload of %zu\n",
+                static_cast<unsigned long long>(injected[TOTAL_LENGTH]),
+                static_cast<unsigned long long>(injected[HEADER_CHECKSUM]),
+                static_cast<unsigned long long>(injected[PAYLOAD_BYTE]), PACKETS);
+    std::printf("checks drop exactly the corrupted packets: %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
@@ -0,0 +1,423 @@
+#include "bench_common.hpp"
+#include "ip_fragmentation.hpp"
+#include "fragment_reassembly.hpp"
+#include "internet_protocol.hpp"
+#include "icmp_errors.hpp"
+#include "pcap_capture_sink.hpp"
+#include "forwarding_workers.hpp"
+#include "packet_builders.hpp"
+#include "checksum.hpp"
+#include "logger.hpp"
+#include <thread>
+#include <unistd.h>
+
+/* egress fragmentation and the MTU check: datagrams of every size, with and without
+   options, cut for the usual MTUs must reassemble byte for byte into what went in, every
+   fragment within the MTU with a valid header and only the copied options after the
+   first. then jumbo frames crossing into a 1500 byte link, the fragment descriptors
+   alone and written out like a send ring would, against sending the frames whole and a
+   fragmenter that builds every fragment in a buffer of its own. last the pipeline: DF
+   clear leaves marked for fragmenting, DF set is dropped and answered with a rate
+   limited ICMP fragmentation needed that carries the MTU, the same in capture files and
+   on the forwarding workers as on the egress */
+
+constexpr size_t CHECK_DATAGRAMS = 20000;
+constexpr size_t JUMBO_PACKETS = 4096;
+constexpr size_t JUMBO_SIZE = 9000;
+constexpr uint32_t LINK_MTU = 1500;
+constexpr size_t ROUNDS = 50;
+constexpr size_t TX_SLOT = 2048;
+constexpr size_t TX_SLOTS = 4096;
+
+// router alert (copied), record route (not copied) and a NOP, 12 bytes of options
+static const uint8_t OPTIONS[] = {0x94, 0x04, 0x00, 0x00, 0x07, 0x07, 0x04, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+static std::vector<uint8_t> udpDatagram(uint16_t id, size_t payload, bool options, bool dont_fragment,
+                                        std::mt19937& rng) {
+    UDPPacketBuilder builder;
+    builder.ipv4_dst_ip = "10.1.2.3";
+    builder.ipv4_identification = id;
+    builder.ipv4_flags_fragment_offset = dont_fragment ? IPV4_DONT_FRAGMENT : 0;
+    builder.udp_payload.resize(payload);
+    for (char& c : builder.udp_payload) {
+        c = static_cast<char>(rng());
+    }
+    std::vector<uint8_t> packet = builder.build();
+    if (options) {
+        packet.insert(packet.begin() + IPv4_HEADER_SIZE, std::begin(OPTIONS), std::end(OPTIONS));
+        packet[0] = static_cast<uint8_t>(0x40 | ((IPv4_HEADER_SIZE + sizeof(OPTIONS)) / 4));
+    }
+    packet[2] = static_cast<uint8_t>(packet.size() >> 8);
+    packet[3] = static_cast<uint8_t>(packet.size());
+    uint16_t checksum = ipv4HeaderChecksum(packet.data(), (packet[0] & 0x0F) * 4);
+    packet[10] = static_cast<uint8_t>(checksum >> 8);
+    packet[11] = static_cast<uint8_t>(checksum);
+    return packet;
+}
+
+static bool headerValid(const uint8_t* header, size_t length) {
+    return ipv4HeaderChecksum(header, length) == ((header[10] << 8) | header[11]);
+}
+
+/* every datagram through fragmentIPv4, the fragments written out as packets and fed to
+   the reassembler in order */
+static bool checkFragments() {
+    std::mt19937 rng(1);
+    const uint32_t mtus[] = {576, 1280, 1500};
+    std::vector<IPv4Fragment> fragments(256);
+    std::vector<std::vector<uint8_t>> datagrams;
+    std::vector<std::vector<uint8_t>> pieces;
+    size_t too_big = 0, bad_header = 0, bad_split = 0, bad_options = 0;
+    for (size_t i = 0; i < CHECK_DATAGRAMS; i++) {
+        bool options = i % 2;
+        datagrams.push_back(udpDatagram(static_cast<uint16_t>(i), 100 + rng() % 8900, options, false, rng));
+        uint32_t mtu = mtus[i % 3];
+        size_t count = fragmentIPv4(datagrams.back(), mtu, fragments.data(), fragments.size());
+        for (size_t k = 0; k < count; k++) {
+            const IPv4Fragment& fragment = fragments[k];
+            std::vector<uint8_t> piece(fragment.size());
+            fragment.write(piece.data());
+            too_big += piece.size() > mtu;
+            bad_header += !headerValid(piece.data(), fragment.header_length);
+            bad_split += k + 1 < count && fragment.payload.size() % 8 != 0;
+            // later fragments carry the router alert alone, padded to 24 bytes
+            if (options && k > 0) {
+                bad_options += fragment.header_length != 24 || std::memcmp(piece.data() + 20, OPTIONS, 4) != 0;
+            } else if (options) {
+                bad_options += fragment.header_length != 32;
+            }
+            pieces.push_back(std::move(piece));
+        }
+    }
+    std::vector<PacketView> views(pieces.begin(), pieces.end());
+
+    FragmentReassembler reassembler;
+    size_t matched = 0, wrong = 0;
+    for (size_t first = 0; first < views.size();) {
+        first += reassembler.reassemble(views.data() + first, views.size() - first, 0);
+        for (size_t i = 0; i < reassembler.outputCount(); i++) {
+            PacketView packet = reassembler.output()[i];
+            const std::vector<uint8_t>& original = datagrams[IPv4HeaderView(packet).identification()];
+            bool same = packet.size() == original.size() && std::memcmp(packet.data(), original.data(), packet.size()) == 0;
+            matched += same;
+            wrong += !same;
+        }
+    }
+    std::printf("  %zu datagrams (half with options) over MTUs 576/1280/1500: %zu fragments, %zu over the MTU, "
+                "%zu bad headers, %zu split off 8 bytes, %zu with wrong options\n", datagrams.size(), pieces.size(),
+                too_big, bad_header, bad_split, bad_options);
+    std::printf("  reassembled %zu byte-identical, %zu wrong\n", matched, wrong);
+    bool ok = too_big == 0 && bad_header == 0 && bad_split == 0 && bad_options == 0 && matched == datagrams.size() &&
+              wrong == 0;
+
+    // DF set, too small an MTU, a fragment of a fragment
+    std::vector<uint8_t> df = udpDatagram(1, 3000, false, true, rng);
+    size_t df_count = fragmentIPv4(df, LINK_MTU, fragments.data(), fragments.size());
+    size_t tiny_count = fragmentIPv4(datagrams[1], 40, fragments.data(), fragments.size());
+    size_t count = fragmentIPv4(datagrams[0], 1500, fragments.data(), fragments.size());
+    bool nested_ok = count >= 3;
+    if (nested_ok) {
+        // the second of three or more fragments, cut again: offsets continue, MF stays on the last part
+        std::vector<uint8_t> second(fragments[1].size());
+        fragments[1].write(second.data());
+        uint16_t offset = ((second[6] << 8) | second[7]) & IPV4_FRAGMENT_OFFSET_MASK;
+        size_t parts = fragmentIPv4(second, 576, fragments.data(), fragments.size());
+        uint16_t first_word = static_cast<uint16_t>((fragments[0].header[6] << 8) | fragments[0].header[7]);
+        uint16_t last_word = static_cast<uint16_t>((fragments[parts - 1].header[6] << 8) | fragments[parts - 1].header[7]);
+        nested_ok = parts == 3 && (first_word & IPV4_FRAGMENT_OFFSET_MASK) == offset && (last_word & IPV4_MORE_FRAGMENTS);
+    }
+    std::printf("  DF set: %zu fragments, MTU 40: %zu fragments, a middle fragment cut again: %s\n", df_count,
+                tiny_count, nested_ok ? "offsets and MF kept" : "WRONG");
+    return ok && df_count == 0 && tiny_count == 0 && nested_ok;
+}
+
+struct JumboTraffic {
+    std::vector<std::vector<uint8_t>> packets;
+    std::vector<PacketView> views;
+    uint64_t bytes = 0;
+};
+
+static JumboTraffic jumboTraffic(bool dont_fragment_every_other) {
+    std::mt19937 rng(2);
+    JumboTraffic traffic;
+    for (size_t i = 0; i < JUMBO_PACKETS; i++) {
+        bool dont_fragment = dont_fragment_every_other && (i % 2);
+        traffic.packets.push_back(udpDatagram(static_cast<uint16_t>(i), JUMBO_SIZE - IPv4_HEADER_SIZE - UDP_HEADER_SIZE,
+                                              false, dont_fragment, rng));
+        traffic.bytes += traffic.packets.back().size();
+    }
+    traffic.views.assign(traffic.packets.begin(), traffic.packets.end());
+    return traffic;
+}
+
+static void reportRate(const char* name, uint64_t packets, uint64_t bytes, uint64_t ns, uint64_t sink) {
+    benchReport(name, packets, ns);
+    std::printf("  %34s %10.2f Gbit/s  (checksum %llu)\n", "", bytes * 8.0 / ns, static_cast<unsigned long long>(sink));
+}
+
+/* 9000 byte frames onto a 1500 byte link, per packet. the output is a ring of send slots
+   the size of an AF_PACKET frame that the fragments are written into */
+static void benchRates() {
+    JumboTraffic traffic = jumboTraffic(false);
+    std::vector<uint8_t> ring(TX_SLOTS * TX_SLOT);
+    std::vector<uint8_t> jumbo_ring(TX_SLOTS / 4 * (JUMBO_SIZE + 192));
+    uint64_t packets = traffic.views.size() * ROUNDS;
+    uint64_t bytes = traffic.bytes * ROUNDS;
+
+    IPv4Fragmenter fragmenter;
+    IPv4Fragment fragment;
+    uint64_t sink = 0;
+    uint64_t start = benchNowNs();
+    for (size_t round = 0; round < ROUNDS; round++) {
+        for (PacketView packet : traffic.views) {
+            fragmenter.start(packet, LINK_MTU);
+            while (fragmenter.next(fragment)) {
+                sink += fragment.header[10] + fragment.payload.size();
+            }
+        }
+    }
+    reportRate("fragment descriptors only", packets, bytes, benchNowNs() - start, sink);
+
+    sink = 0;
+    size_t slot = 0;
+    start = benchNowNs();
+    for (size_t round = 0; round < ROUNDS; round++) {
+        for (PacketView packet : traffic.views) {
+            fragmenter.start(packet, LINK_MTU);
+            while (fragmenter.next(fragment)) {
+                uint8_t* out = ring.data() + slot * TX_SLOT;
+                fragment.write(out);
+                InternetProtocol::decrementTtl(out);
+                sink += out[10];
+                slot = (slot + 1) % TX_SLOTS;
+            }
+        }
+    }
+    reportRate("fragments written to send slots", packets, bytes, benchNowNs() - start, sink);
+
+    // the same frames sent whole onto a jumbo link: the copy a fitting packet costs anyway
+    sink = 0;
+    slot = 0;
+    size_t jumbo_slots = jumbo_ring.size() / (JUMBO_SIZE + 192);
+    start = benchNowNs();
+    for (size_t round = 0; round < ROUNDS; round++) {
+        for (PacketView packet : traffic.views) {
+            uint8_t* out = jumbo_ring.data() + slot * (JUMBO_SIZE + 192);
+            std::memcpy(out, packet.data(), packet.size());
+            InternetProtocol::decrementTtl(out);
+            sink += out[10];
+            slot = (slot + 1) % jumbo_slots;
+        }
+    }
+    reportRate("whole frames to jumbo send slots", packets, bytes, benchNowNs() - start, sink);
+
+    // each fragment built in a buffer of its own first, then copied out
+    sink = 0;
+    slot = 0;
+    start = benchNowNs();
+    for (size_t round = 0; round < ROUNDS; round++) {
+        for (PacketView packet : traffic.views) {
+            size_t header_length = (packet.u8(0) & 0x0F) * 4;
+            size_t payload = packet.size() - header_length;
+            size_t chunk = (LINK_MTU - header_length) & ~size_t(7);
+            for (size_t offset = 0; offset < payload; offset += chunk) {
+                size_t length = std::min(chunk, payload - offset);
+                std::vector<uint8_t> piece(packet.data(), packet.data() + header_length);
+                piece.insert(piece.end(), packet.data() + header_length + offset,
+                             packet.data() + header_length + offset + length);
+                uint16_t word = static_cast<uint16_t>(offset / 8 | (offset + length < payload ? IPV4_MORE_FRAGMENTS : 0));
+                piece[2] = static_cast<uint8_t>(piece.size() >> 8);
+                piece[3] = static_cast<uint8_t>(piece.size());
+                piece[6] = static_cast<uint8_t>(word >> 8);
+                piece[7] = static_cast<uint8_t>(word);
+                piece[8]--;
+                uint16_t checksum = ipv4HeaderChecksum(piece.data(), header_length);
+                piece[10] = static_cast<uint8_t>(checksum >> 8);
+                piece[11] = static_cast<uint8_t>(checksum);
+                uint8_t* out = ring.data() + slot * TX_SLOT;
+                std::memcpy(out, piece.data(), piece.size());
+                sink += out[10];
+                slot = (slot + 1) % TX_SLOTS;
+            }
+        }
+    }
+    reportRate("naive: fragment buffers, then copy", packets, bytes, benchNowNs() - start, sink);
+}
+
+// collects the ICMP errors the pipeline sends, checks every one of them against its packet
+class ErrorChecker : public VerdictSink {
+public:
+    size_t errors = 0, wrong = 0, marked = 0, too_big = 0;
+
+    void consume(const VerdictRecord* records, const PacketView* packets, size_t count) override {
+        for (size_t i = 0; i < count; i++) {
+            const ForwardingVerdict& verdict = records[i].verdict;
+            PacketView packet = packets[i];
+            marked += verdict.forwarded() && (verdict.flags & VERDICT_FRAGMENT);
+            too_big += verdict.drop_reason == DropReason::FRAGMENTATION_NEEDED;
+            if (IPv4HeaderView(packet).protocol() != PROTOCOL_ICMP) {
+                continue;
+            }
+            errors++;
+            const uint8_t* bytes = packet.data();
+            bool ok = verdict.forwarded() && packet.size() == ICMP_ERROR_MAX_SIZE && headerValid(bytes, 20) &&
+                      internetChecksum(bytes + 20, packet.size() - 20) == 0 && bytes[20] == ICMP_DEST_UNREACH &&
+                      bytes[21] == ICMP_FRAGMENTATION_NEEDED && ((bytes[26] << 8) | bytes[27]) == LINK_MTU &&
+                      std::memcmp(bytes + 16, bytes + 28 + 12, 4) == 0;
+            wrong += !ok;
+        }
+    }
+};
+
+static bool checkPipeline() {
+    InternetProtocol ip;
+    ip.addRoute("10.0.0.0/8", "eth1");
+    ip.addRoute("192.168.0.0/16", "eth0");
+    IcmpErrorConfig config;
+    config.source_ip = 0xC0A80101;
+    config.rate = 1000;
+    config.burst = 100;
+    ip.enableIcmpErrors(config);
+    bool mtu_ok = ip.setInterfaceMtu("eth1", LINK_MTU) && !ip.setInterfaceMtu("eth1", 60);
+
+    JumboTraffic traffic = jumboTraffic(true);
+    ErrorChecker checker;
+    uint64_t start = benchNowNs();
+    for (size_t round = 0; round < 10; round++) {
+        ip.forwardPackets(traffic.views.data(), traffic.views.size(), checker);
+    }
+    double seconds = (benchNowNs() - start) / 1e9;
+    const IcmpErrorStats& stats = *ip.icmpErrorStats();
+    size_t packets = traffic.views.size() * 10;
+    std::printf("  pipeline: %zu jumbo packets, %zu marked for fragmenting, %zu fragmentation needed drops\n",
+                packets, checker.marked, checker.too_big);
+    std::printf("  ICMP: %zu errors (%zu wrong), %llu rate limited in %.1f ms (rate %u/s, burst %u)\n",
+                checker.errors, checker.wrong, static_cast<unsigned long long>(stats.rate_limited), seconds * 1e3,
+                config.rate, config.burst);
+    bool ok = mtu_ok && checker.marked == packets / 2 && checker.too_big == packets / 2 && checker.wrong == 0 &&
+              checker.errors == stats.sent && stats.sent > 0 && stats.sent <= config.burst + seconds * config.rate + 1 &&
+              stats.sent + stats.rate_limited == packets / 2;
+
+    // an MTU lifted again forwards everything whole
+    ip.setInterfaceMtu("eth1", 0);
+    ErrorChecker unlimited;
+    ip.forwardPackets(traffic.views.data(), traffic.views.size(), unlimited);
+    std::printf("  MTU lifted: %zu marked, %zu dropped\n", unlimited.marked, unlimited.too_big);
+    return ok && unlimited.marked == 0 && unlimited.too_big == 0 && !ip.adjacencies().mtuLimited();
+}
+
+/* the capture sink writes what the egress would send, the fragments and not the jumbo
+   frame, and the workers count the fragmented packets and answer the DF ones */
+static bool checkEveryPath() {
+    InternetProtocol ip;
+    ip.addRoute("10.0.0.0/8", "eth1");
+    ip.addRoute("192.168.0.0/16", "eth0");
+    IcmpErrorConfig config;
+    config.source_ip = 0xC0A80101;
+    config.rate = 1000;
+    config.burst = 100;
+    ip.enableIcmpErrors(config);
+    ip.setInterfaceMtu("eth1", LINK_MTU);
+    JumboTraffic traffic = jumboTraffic(true);
+    size_t half = traffic.views.size() / 2;
+
+    char directory_template[] = "/tmp/ip_fragmentation_bench_XXXXXX";
+    if (!mkdtemp(directory_template)) {
+        std::printf("cannot create a scratch directory\n");
+        return false;
+    }
+    std::string directory = directory_template;
+    PcapCaptureSink capture(ip.adjacencies(), directory);
+    ip.forwardPackets(traffic.views.data(), traffic.views.size(), capture);
+    bool ok = capture.flush();
+    PcapReader reader;
+    ok &= reader.open(directory + "/eth1.pcap");
+    size_t records = 0, oversized = 0;
+    PacketView packet;
+    uint64_t timestamp;
+    while (reader.next(packet, timestamp)) {
+        records++;
+        oversized += packet.size() > LINK_MTU;
+    }
+    reader.close();
+    std::printf("  capture: %llu packets written as %llu fragments, %zu records on eth1 (%zu over the MTU)\n",
+                static_cast<unsigned long long>(capture.fragmented()),
+                static_cast<unsigned long long>(capture.fragments()), records, oversized);
+    ok &= capture.fragmented() == half && records == capture.fragments() && records > half && oversized == 0;
+    for (const char* name : {"eth0", "eth1", "drop-fragmentation-needed"}) {
+        std::remove((directory + "/" + name + ".pcap").c_str());
+    }
+    rmdir(directory.c_str());
+
+    PacketPool pool(traffic.views.size(), PACKET_DEFAULT_HEADROOM + JUMBO_SIZE);
+    WorkerConfig worker_config;
+    worker_config.workers = 2;
+    worker_config.pin_cores = false;
+    ForwardingWorkers workers(ip, worker_config);
+    if (!workers.start()) {
+        return false;
+    }
+    uint64_t start = benchNowNs();
+    for (const PacketView& view : traffic.views) {
+        PacketHandle handle = pool.copyIn(view.data(), view.size());
+        while (!handle) {
+            std::this_thread::yield();
+            handle = pool.copyIn(view.data(), view.size());
+        }
+        workers.dispatch(std::move(handle));
+    }
+    workers.stop();
+    double seconds = (benchNowNs() - start) / 1e9;
+    WorkerStats total;
+    for (size_t i = 0; i < workers.workerCount(); i++) {
+        total.fragmented += workers.stats(i).fragmented;
+        total.too_big += workers.stats(i).too_big;
+        total.icmp_errors += workers.stats(i).icmp_errors;
+    }
+    std::printf("  workers: %llu forwarded in fragments, %llu over the MTU, %llu answered with ICMP\n",
+                static_cast<unsigned long long>(total.fragmented), static_cast<unsigned long long>(total.too_big),
+                static_cast<unsigned long long>(total.icmp_errors));
+    return ok && total.fragmented == half && total.too_big == half && total.icmp_errors > 0 &&
+           total.icmp_errors <= config.burst + seconds * config.rate + worker_config.workers;
+}
+
+// what the MTU check adds to processBurst for packets that fit
+static void benchMtuCheck() {
+    std::mt19937 rng(3);
+    std::vector<std::vector<uint8_t>> packets;
+    for (size_t i = 0; i < IP_MAX_BURST; i++) {
+        packets.push_back(udpDatagram(static_cast<uint16_t>(i), 64 + rng() % 1000, false, true, rng));
+    }
+    std::vector<PacketView> views(packets.begin(), packets.end());
+    for (bool limited : {false, true}) {
+        InternetProtocol ip;
+        ip.addRoute("10.0.0.0/8", "eth1");
+        if (limited) {
+            ip.setInterfaceMtu("eth1", LINK_MTU);
+        }
+        BurstResult result;
+        uint64_t sink = 0;
+        uint64_t start = benchNowNs();
+        for (size_t round = 0; round < 20000; round++) {
+            ip.processBurst(views.data(), views.size(), result);
+            sink += result.forwarded;
+        }
+        benchReport(limited ? "processBurst, 1500 byte MTU" : "processBurst, no MTU", 20000 * views.size(),
+                    benchNowNs() - start);
+        std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink));
+    }
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== IPv4 egress fragmentation ===\n");
+    bool ok = checkFragments();
+    ok &= checkPipeline();
+    ok &= checkEveryPath();
+    std::printf("--- 9000 byte frames onto a 1500 byte MTU ---\n");
+    benchRates();
+    std::printf("--- MTU check ---\n");
+    benchMtuCheck();
+    std::printf("fragments exact, MTU enforced: %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
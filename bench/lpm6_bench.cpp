@@ -0,0 +1,140 @@
+#include "bench_common.hpp"
+#include "routing_table.hpp"
+#include "logger.hpp"
+#include <map>
+#include <set>
+#include <tuple>
+#include <utility>
+
+/* IPv6 FIB: the 16-8-8-... stride trie against DIR-24-8 on an IPv4 table of the same
+   size, single and batched lookups through RoutingTable. v6 results are checked
+   against a hashed per-prefix-length reference, then again after withdrawing half the
+   table, which must also give trie nodes back */
+
+constexpr size_t TABLE_PREFIXES = 200000;
+constexpr size_t LOOKUPS = 1 << 20;
+constexpr size_t ROUNDS = 16;
+constexpr size_t VERIFY_LOOKUPS = 200000;
+
+// installed prefixes per length, longest match by probing every length present
+class ReferenceTable6 {
+public:
+    void add(const BenchPrefix6& p) { by_length[p.prefix_len].insert(key(p.network)); }
+    int longestMatch(const IPv6Address& dst) const {
+        for (auto it = by_length.rbegin(); it != by_length.rend(); ++it) {
+            if (it->second.count(key(dst.masked(it->first)))) {
+                return it->first;
+            }
+        }
+        return -1;
+    }
+
+private:
+    std::map<uint8_t, std::set<std::pair<uint64_t, uint64_t>>> by_length;
+    static std::pair<uint64_t, uint64_t> key(const IPv6Address& a) { return {a.high(), a.low()}; }
+};
+
+static size_t verify(const RoutingTable& table, const ReferenceTable6& reference,
+                     const std::vector<IPv6Address>& dsts) {
+    size_t mismatches = 0;
+    std::vector<AdjacencyHandle> batch(VERIFY_LOOKUPS);
+    table.lookupRoutes6(dsts.data(), batch.data(), VERIFY_LOOKUPS);
+    for (size_t i = 0; i < VERIFY_LOOKUPS; i++) {
+        AdjacencyHandle handle = table.lookupRoute6(dsts[i]);
+        mismatches += (handle != batch[i]) ||
+                      (benchMatchedLength6(table.adjacencies(), handle, dsts[i]) != reference.longestMatch(dsts[i]));
+    }
+    return mismatches;
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== IPv6 FIB (%zu prefixes, %zu lookups x %zu) ===\n", TABLE_PREFIXES, LOOKUPS, ROUNDS);
+
+    RoutingTable table;
+    std::vector<BenchPrefix> prefixes4 = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    for (const auto& p : prefixes4) {
+        table.addRoute(p.network, p.prefix_len, benchInterface(p.prefix_len), p.network);
+    }
+
+    std::vector<BenchPrefix6> prefixes6 = benchRandomPrefixes6(TABLE_PREFIXES, 42);
+    ReferenceTable6 reference;
+    uint64_t start = benchNowNs();
+    for (const auto& p : prefixes6) {
+        table.addRoute6(p.network, p.prefix_len, benchInterface(p.prefix_len), p.network);
+        reference.add(p);
+    }
+    uint64_t build_ns = benchNowNs() - start;
+    const Lpm6Table& lpm6 = table.lpm6();
+    std::printf("  v6 build: %.2f ms, %zu routes, trie nodes: %zu, memory: %.1f MiB (v4 DIR-24-8: %.1f MiB)\n",
+                build_ns / 1e6, table.size6(), lpm6.nodesUsed(), lpm6.memoryBytes() / (1024.0 * 1024.0),
+                table.lpm().memoryBytes() / (1024.0 * 1024.0));
+
+    std::vector<uint32_t> dsts4 = benchDestinations(prefixes4, LOOKUPS, 7);
+    std::vector<IPv6Address> dsts6 = benchDestinations6(prefixes6, LOOKUPS, 7);
+    std::printf("  verified %zu v6 lookups (single and batch), %zu mismatches\n",
+                VERIFY_LOOKUPS, verify(table, reference, dsts6));
+
+    uint64_t sink = 0;
+    start = benchNowNs();
+    for (size_t round = 0; round < ROUNDS; round++) {
+        for (uint32_t dst : dsts4) {
+            sink += table.lookupRoute(dst);
+        }
+    }
+    uint64_t v4_ns = benchNowNs() - start;
+    benchReport("IPv4 DIR-24-8 lookup", LOOKUPS * ROUNDS, v4_ns);
+
+    start = benchNowNs();
+    for (size_t round = 0; round < ROUNDS; round++) {
+        for (const IPv6Address& dst : dsts6) {
+            sink += table.lookupRoute6(dst);
+        }
+    }
+    uint64_t v6_ns = benchNowNs() - start;
+    benchReport("IPv6 trie lookup", LOOKUPS * ROUNDS, v6_ns);
+
+    std::vector<AdjacencyHandle> results(LOOKUPS);
+    start = benchNowNs();
+    for (size_t round = 0; round < ROUNDS; round++) {
+        table.lookupRoutes(dsts4.data(), results.data(), LOOKUPS);
+        sink += results[round];
+    }
+    uint64_t v4_batch_ns = benchNowNs() - start;
+    benchReport("IPv4 DIR-24-8 batch", LOOKUPS * ROUNDS, v4_batch_ns);
+
+    start = benchNowNs();
+    for (size_t round = 0; round < ROUNDS; round++) {
+        table.lookupRoutes6(dsts6.data(), results.data(), LOOKUPS);
+        sink += results[round];
+    }
+    uint64_t v6_batch_ns = benchNowNs() - start;
+    benchReport("IPv6 trie batch", LOOKUPS * ROUNDS, v6_batch_ns);
+    std::printf("  v6/v4 cost: %.2fx single, %.2fx batch  (checksum %llu)\n",
+                static_cast<double>(v6_ns) / v4_ns, static_cast<double>(v6_batch_ns) / v4_batch_ns,
+                static_cast<unsigned long long>(sink));
+
+    // withdraw every other prefix, lookups fall back to the covering routes
+    size_t nodes_before = lpm6.nodesUsed();
+    std::set<std::tuple<uint64_t, uint64_t, uint8_t>> withdrawn_keys;
+    size_t withdrawn = 0;
+    start = benchNowNs();
+    for (size_t i = 0; i < prefixes6.size(); i += 2) {
+        const BenchPrefix6& p = prefixes6[i];
+        withdrawn += table.removeRoute6(p.network, p.prefix_len);
+        withdrawn_keys.insert({p.network.high(), p.network.low(), p.prefix_len});
+    }
+    uint64_t withdraw_ns = benchNowNs() - start;
+
+    // duplicates of a withdrawn prefix went with it
+    ReferenceTable6 remaining;
+    for (const auto& p : prefixes6) {
+        if (!withdrawn_keys.count({p.network.high(), p.network.low(), p.prefix_len})) {
+            remaining.add(p);
+        }
+    }
+    std::printf("  withdrew %zu prefixes in %.2f ms, trie nodes %zu -> %zu, %zu mismatches\n",
+                withdrawn, withdraw_ns / 1e6, nodes_before, lpm6.nodesUsed(),
+                verify(table, remaining, dsts6));
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "bench_common.hpp"
+#include "routing_table.hpp"
+#include "logger.hpp"
+#include <algorithm>
+
+/* compares the DIR-24-8 LPM table against the linear vector scan RoutingTable
+   used before (sort by mask, first match wins) at different table sizes */
+
+struct LinearRoute {
+    uint32_t network;
+    uint32_t mask;
+    uint32_t value;
+};
+
+static uint32_t linearLookup(const std::vector<LinearRoute>& routes, uint32_t dst_ip) {
+    for (const auto& route : routes) {
+        if ((dst_ip & route.mask) == route.network) {
+            return route.value;
+        }
+    }
+    return LPM_NO_ROUTE;
+}
+
+static void runSize(size_t prefix_count) {
+    std::printf("\n%zu prefixes\n", prefix_count);
+
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(prefix_count, 42);
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, 1 << 20, 7);
+
+    std::vector<LinearRoute> linear;
+    linear.reserve(prefixes.size());
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        linear.push_back({prefixes[i].network, LpmTable::prefixMask(prefixes[i].prefix_len),
+                          static_cast<uint32_t>(i)});
+    }
+    std::stable_sort(linear.begin(), linear.end(),
+                     [](const LinearRoute& a, const LinearRoute& b) { return a.mask > b.mask; });
+
+    uint64_t start = benchNowNs();
+    LpmTable lpm;
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        lpm.add(prefixes[i].network, prefixes[i].prefix_len, static_cast<uint32_t>(i));
+    }
+    uint64_t build_ns = benchNowNs() - start;
+
+    RoutingTable table;
+    for (const auto& p : prefixes) {
+        table.addRoute(p.network, p.prefix_len, "eth0");
+    }
+
+    std::printf("  build: %.2f ms, tbl8 groups: %zu, memory: %.1f MiB\n",
+                build_ns / 1e6, lpm.tbl8GroupsUsed(), lpm.memoryBytes() / (1024.0 * 1024.0));
+
+    // both structures must agree on the matched prefix (values can differ on duplicates)
+    size_t mismatches = 0;
+    size_t verify_count = std::min<size_t>(dsts.size(), prefix_count > 100000 ? 2000 : 100000);
+    for (size_t i = 0; i < verify_count; i++) {
+        uint32_t a = linearLookup(linear, dsts[i]);
+        uint32_t b = lpm.lookup(dsts[i]);
+        if ((a == LPM_NO_ROUTE) != (b == LPM_NO_ROUTE)) {
+            mismatches++;
+        } else if (a != LPM_NO_ROUTE && (prefixes[a].network != prefixes[b].network ||
+                                         prefixes[a].prefix_len != prefixes[b].prefix_len)) {
+            mismatches++;
+        }
+    }
+    std::printf("  verified %zu lookups, %zu mismatches\n", verify_count, mismatches);
+
+    uint64_t sink = 0;
+    size_t linear_ops = std::max<size_t>(200, std::min<size_t>(1 << 20, (size_t(1) << 28) / prefix_count));
+    start = benchNowNs();
+    for (size_t i = 0; i < linear_ops; i++) {
+        sink += linearLookup(linear, dsts[i % dsts.size()]);
+    }
+    benchReport("vector scan", linear_ops, benchNowNs() - start);
+
+    size_t lpm_ops = size_t(1) << 24;
+    start = benchNowNs();
+    for (size_t i = 0; i < lpm_ops; i++) {
+        sink += lpm.lookup(dsts[i & (dsts.size() - 1)]);
+    }
+    benchReport("DIR-24-8", lpm_ops, benchNowNs() - start);
+
+    std::vector<uint32_t> batch_values(dsts.size());
+    lpm.lookupBatch(dsts.data(), batch_values.data(), dsts.size());
+    size_t batch_mismatches = 0;
+    for (size_t i = 0; i < dsts.size(); i++) {
+        batch_mismatches += (batch_values[i] != lpm.lookup(dsts[i]));
+    }
+    std::printf("  batch vs single lookup: %zu mismatches\n", batch_mismatches);
+
+    for (size_t burst : {size_t(32), size_t(64)}) {
+        start = benchNowNs();
+        for (size_t i = 0; i < lpm_ops; i += burst) {
+            size_t offset = i & (dsts.size() - 1);
+            lpm.lookupBatch(dsts.data() + offset, batch_values.data() + offset, burst);
+        }
+        uint64_t elapsed = benchNowNs() - start;
+        sink += batch_values[0];
+        char name[64];
+        std::snprintf(name, sizeof(name), "DIR-24-8 batch of %zu", burst);
+        benchReport(name, lpm_ops, elapsed);
+    }
+
+    size_t table_ops = size_t(1) << 22;
+    start = benchNowNs();
+    for (size_t i = 0; i < table_ops; i++) {
+        sink += table.lookupRoute(dsts[i & (dsts.size() - 1)]);
+    }
+    benchReport("RoutingTable::lookupRoute", table_ops, benchNowNs() - start);
+
+    std::vector<AdjacencyHandle> batch_routes(LPM_MAX_BURST);
+    start = benchNowNs();
+    for (size_t i = 0; i < table_ops; i += LPM_MAX_BURST) {
+        table.lookupRoutes(dsts.data() + (i & (dsts.size() - 1)), batch_routes.data(), LPM_MAX_BURST);
+        sink += batch_routes[0];
+    }
+    benchReport("RoutingTable::lookupRoutes (64)", table_ops, benchNowNs() - start);
+
+    std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink));
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+
+    std::printf("=== LPM lookup benchmark ===\n");
+    for (size_t count : {size_t(10), size_t(10000), size_t(900000)}) {
+        runSize(count);
+    }
+    return 0;
+}
@@ -0,0 +1,520 @@
+#include "bench_common.hpp"
+#include "nat.hpp"
+#include "internet_protocol.hpp"
+#include "packet_pool.hpp"
+#include "packet_builders.hpp"
+#include "checksum.hpp"
+#include "icmp.hpp"
+#include "tcp.hpp"
+#include "logger.hpp"
+#include <set>
+#include <thread>
+#include <tuple>
+
+/* source NAPT: TCP, UDP and ICMP echo flows translated out and their answers back in,
+   every rewritten packet's checksums recomputed from scratch and compared, pool ports
+   unique, answers from anyone but the session's remote refused, and the sessions going
+   away on the timeouts their protocol and TCP state call for. two cores then open
+   sessions at the same time in one table and resolve each other's. last the rates with
+   a million mappings: new connections (a SYN opening a session each) and translated
+   packets per second either way with all of them active */
+
+constexpr uint64_t SECOND_NS = 1000000000;
+constexpr uint64_t START_NS = 1000 * SECOND_NS;
+constexpr size_t SLOT = 64;                     // bytes per packet in the arenas
+constexpr size_t BURST = 32;
+constexpr size_t CHECK_FLOWS = 30000;
+constexpr size_t CORE_FLOWS = 100000;
+constexpr size_t BENCH_MAPPINGS = 1000000;
+constexpr size_t STEADY_PACKETS = 1 << 22;
+constexpr uint32_t POOL = 0xCB007100;           // 203.0.113.0
+
+struct Flow {
+    uint8_t protocol;
+    uint32_t inside_ip;
+    uint32_t remote_ip;
+    uint16_t inside_port;
+    uint16_t remote_port;
+    uint32_t external_ip = 0;
+    uint16_t external_port = 0;
+};
+
+// packets of a flow stamped from templates, either way
+class Stamper {
+public:
+    Stamper() {
+        for (uint8_t flags : {TCP_SYN, uint8_t(TCP_SYN | TCP_ACK), TCP_ACK, uint8_t(TCP_FIN | TCP_ACK), TCP_RST}) {
+            TCPPacketBuilder builder;
+            builder.tcp_flags = flags;
+            builder.tcp_payload = flags == TCP_ACK ? "GET / HTTP/1.1" : "";
+            tcp.emplace_back();
+            tcp.back().assign(builder);
+        }
+        UDPPacketBuilder udp_builder;
+        udp_builder.udp_payload = "DNS_QUERY_example.com_A";
+        udp.assign(udp_builder);
+        ICMPPacketBuilder echo;
+        echo.icmp_payload = "ping";
+        echo_request.assign(echo);
+        echo.icmp_type = ICMP_ECHO_REPLY;
+        echo_reply.assign(echo);
+    }
+
+    // the packet from the inside out, tcp_flags picks the TCP template
+    size_t outbound(const Flow& flow, uint8_t tcp_flags, uint8_t* out) const {
+        PacketFields fields = {1, flow.inside_ip, flow.remote_ip, flow.inside_port, flow.remote_port, 7};
+        return pick(flow.protocol, tcp_flags, true).stamp(out, SLOT, fields);
+    }
+
+    // the remote's answer to the flow's pool address and port
+    size_t inbound(const Flow& flow, uint8_t tcp_flags, uint8_t* out) const {
+        PacketFields fields = {2, flow.remote_ip, flow.external_ip, flow.remote_port, flow.external_port, 9};
+        if (flow.protocol == PROTOCOL_ICMP) {
+            fields.src_port = flow.external_port;
+        }
+        return pick(flow.protocol, tcp_flags, false).stamp(out, SLOT, fields);
+    }
+
+private:
+    std::vector<PacketTemplate> tcp;
+    PacketTemplate udp, echo_request, echo_reply;
+
+    const PacketTemplate& pick(uint8_t protocol, uint8_t tcp_flags, bool outbound) const {
+        if (protocol == PROTOCOL_UDP) {
+            return udp;
+        }
+        if (protocol == PROTOCOL_ICMP) {
+            return outbound ? echo_request : echo_reply;
+        }
+        switch (tcp_flags) {
+            case TCP_SYN: return tcp[0];
+            case TCP_SYN | TCP_ACK: return tcp[1];
+            case TCP_FIN | TCP_ACK: return tcp[3];
+            case TCP_RST: return tcp[4];
+        }
+        return tcp[2];
+    }
+};
+
+// both checksums summed over the whole packet again, what the incremental updates must match
+static bool checksumsValid(const uint8_t* packet) {
+    size_t header_length = static_cast<size_t>(packet[0] & 0x0F) * 4;
+    size_t length = load16(packet + 2) - header_length;
+    const uint8_t* l4 = packet + header_length;
+    if (internetChecksum(packet, header_length) != 0) {
+        return false;
+    }
+    uint8_t protocol = packet[9];
+    if (protocol == PROTOCOL_ICMP) {
+        return internetChecksum(l4, length) == 0;
+    }
+    if (protocol == PROTOCOL_UDP && load16(l4 + 6) == 0) {
+        return true;
+    }
+    uint32_t pseudo = pseudoHeaderSum(load32(packet + 12), load32(packet + 16), protocol, length);
+    return static_cast<uint16_t>(~checksumFold(checksumAdd(pseudo, l4, length))) == 0;
+}
+
+// the port of a packet's source or destination, the echo identifier for ICMP
+static uint16_t packetPort(const uint8_t* packet, bool source) {
+    const uint8_t* l4 = packet + (packet[0] & 0x0F) * 4;
+    if (packet[9] == PROTOCOL_ICMP) {
+        return load16(l4 + 4);
+    }
+    return load16(l4 + (source ? 0 : 2));
+}
+
+static std::vector<Flow> makeFlows(size_t count, uint32_t seed, uint32_t inside_base, bool tcp_only) {
+    std::mt19937 rng(seed);
+    static const uint16_t SERVICES[] = {80, 443, 53, 123, 8080, 22};
+    std::vector<Flow> flows(count);
+    for (size_t i = 0; i < count; i++) {
+        Flow& flow = flows[i];
+        flow.protocol = tcp_only ? PROTOCOL_TCP : (i % 3 == 0 ? PROTOCOL_TCP : i % 3 == 1 ? PROTOCOL_UDP : PROTOCOL_ICMP);
+        // distinct inside endpoints, the 5-tuples can never collide
+        flow.inside_ip = inside_base + static_cast<uint32_t>(i >> 4);
+        flow.inside_port = static_cast<uint16_t>(20000 + (i & 15) * 1000 + rng() % 1000);
+        flow.remote_ip = 0x08000000 + (rng() & 0x00FFFFFF);
+        flow.remote_port = flow.protocol == PROTOCOL_ICMP ? 0 : SERVICES[rng() % 6];
+    }
+    return flows;
+}
+
+static void translateAll(NatTranslator& nat, std::vector<uint8_t>& arena, size_t count, bool outbound,
+                         uint64_t now_ns, std::vector<uint8_t>& refused) {
+    refused.assign(count, 0);
+    NatPacket packets[BURST];
+    NatInbound inbound[BURST];
+    for (size_t start = 0; start < count; start += BURST) {
+        size_t burst = std::min(BURST, count - start);
+        for (size_t i = 0; i < burst; i++) {
+            uint8_t* data = arena.data() + (start + i) * SLOT;
+            packets[i] = {data, load16(data + 2)};
+        }
+        if (outbound) {
+            nat.translateOutbound(packets, burst, now_ns, refused.data() + start);
+        } else {
+            nat.translateInbound(packets, burst, now_ns, refused.data() + start, inbound);
+            nat.commitInbound(inbound, burst, now_ns);
+        }
+    }
+}
+
+static bool checkTranslation() {
+    NatConfig config;
+    config.external_ip = POOL;
+    config.external_count = 8;
+    auto table = std::make_shared<NatTable>(config);
+    NatTranslator nat(table, 0);
+    Stamper stamper;
+    std::vector<Flow> flows = makeFlows(CHECK_FLOWS, 1, 0x0A000000, false);
+    std::vector<uint8_t> arena(CHECK_FLOWS * SLOT), refused;
+    size_t bad = 0, udp_unsummed = 0;
+
+    // out: every flow opens a session, a tenth of the UDP ones sent without a checksum
+    for (size_t i = 0; i < flows.size(); i++) {
+        uint8_t* packet = arena.data() + i * SLOT;
+        stamper.outbound(flows[i], TCP_SYN, packet);
+        if (flows[i].protocol == PROTOCOL_UDP && i % 10 == 1) {
+            packet[26] = packet[27] = 0;
+        }
+    }
+    translateAll(nat, arena, flows.size(), true, START_NS, refused);
+    std::set<std::tuple<uint8_t, uint32_t, uint16_t>> used;
+    for (size_t i = 0; i < flows.size(); i++) {
+        Flow& flow = flows[i];
+        const uint8_t* packet = arena.data() + i * SLOT;
+        flow.external_ip = load32(packet + 12);
+        flow.external_port = packetPort(packet, true);
+        bool unsummed = flow.protocol == PROTOCOL_UDP && i % 10 == 1;
+        udp_unsummed += unsummed && load16(packet + 26) == 0;
+        bad += refused[i] || !table->inPool(flow.external_ip) || load32(packet + 16) != flow.remote_ip ||
+               packetPort(packet, false) != (flow.protocol == PROTOCOL_ICMP ? flow.external_port : flow.remote_port) ||
+               !checksumsValid(packet) || (flow.protocol == PROTOCOL_UDP && !unsummed && load16(packet + 26) == 0) ||
+               !used.insert({flow.protocol, flow.external_ip, flow.external_port}).second;
+    }
+
+    // the same flows again find their sessions
+    for (size_t i = 0; i < flows.size(); i++) {
+        stamper.outbound(flows[i], TCP_ACK, arena.data() + i * SLOT);
+    }
+    translateAll(nat, arena, flows.size(), true, START_NS + SECOND_NS / 2, refused);
+    for (size_t i = 0; i < flows.size(); i++) {
+        const uint8_t* packet = arena.data() + i * SLOT;
+        bad += refused[i] || load32(packet + 12) != flows[i].external_ip ||
+               packetPort(packet, true) != flows[i].external_port || !checksumsValid(packet);
+    }
+    NatStats stats = nat.stats();
+    std::printf("  %zu flows out (TCP, UDP, ping): %llu sessions, %zu packets with a bad translation, "
+                "%zu UDP without checksum kept so\n", flows.size(), (unsigned long long)stats.created, bad,
+                udp_unsummed);
+    bool ok = bad == 0 && stats.created == flows.size() && udp_unsummed == (flows.size() + 27) / 30;
+
+    // in: the answers reach the inside endpoints
+    size_t bad_in = 0;
+    for (size_t i = 0; i < flows.size(); i++) {
+        stamper.inbound(flows[i], TCP_SYN | TCP_ACK, arena.data() + i * SLOT);
+    }
+    translateAll(nat, arena, flows.size(), false, START_NS + SECOND_NS, refused);
+    for (size_t i = 0; i < flows.size(); i++) {
+        const Flow& flow = flows[i];
+        const uint8_t* packet = arena.data() + i * SLOT;
+        bad_in += refused[i] || load32(packet + 16) != flow.inside_ip || packetPort(packet, false) != flow.inside_port ||
+                  load32(packet + 12) != flow.remote_ip || !checksumsValid(packet);
+    }
+
+    // answers from another remote port, to ports nobody has, and odd packets out are refused
+    size_t let_in = 0;
+    for (size_t i = 0; i < flows.size(); i += 3) {
+        Flow spoofed = flows[i];
+        spoofed.remote_port++;
+        stamper.inbound(spoofed, TCP_ACK, arena.data());
+        spoofed = flows[i];
+        spoofed.external_port = 60000;
+        stamper.inbound(spoofed, TCP_ACK, arena.data() + SLOT);
+        translateAll(nat, arena, 2, false, START_NS + SECOND_NS, refused);
+        let_in += !refused[0] + !refused[1];
+    }
+    uint8_t* odd = arena.data();
+    stamper.outbound(flows[1], TCP_SYN, odd);
+    odd[9] = 47;                                    // GRE
+    stamper.outbound(flows[1], TCP_SYN, odd + SLOT);
+    odd[SLOT + 6] = 0x20;                           // MF, a fragment
+    stamper.outbound(flows[1], TCP_SYN, odd + 2 * SLOT);
+    odd[2 * SLOT + 12] = 203, odd[2 * SLOT + 13] = 0, odd[2 * SLOT + 14] = 113, odd[2 * SLOT + 15] = 1;
+    translateAll(nat, arena, 3, true, START_NS + SECOND_NS, refused);
+    bool odd_ok = refused[0] && refused[1] && !refused[2] && load32(odd + 2 * SLOT + 12) == POOL + 1;
+    std::printf("  %zu answers translated back wrong, %zu of %zu spoofed or unexpected let in, "
+                "GRE and fragments refused, pool sources untouched: %s\n", bad_in, let_in,
+                2 * ((flows.size() + 2) / 3), odd_ok ? "yes" : "no");
+    ok = ok && bad_in == 0 && let_in == 0 && odd_ok;
+
+    // TCP closing: a quarter reset, a quarter closed by FINs both ways, the rest established
+    size_t resets = 0, closes = 0, count = 0;
+    for (size_t i = 0; i < flows.size(); i += 3) {
+        if ((i / 3) % 4 == 0) {
+            stamper.outbound(flows[i], TCP_RST, arena.data() + count++ * SLOT);
+            resets++;
+        } else if ((i / 3) % 4 == 1) {
+            stamper.outbound(flows[i], TCP_FIN | TCP_ACK, arena.data() + count++ * SLOT);
+            closes++;
+        }
+    }
+    translateAll(nat, arena, count, true, START_NS + 2 * SECOND_NS, refused);
+    count = 0;
+    for (size_t i = 0; i < flows.size(); i += 3) {
+        if ((i / 3) % 4 == 1) {
+            stamper.inbound(flows[i], TCP_FIN | TCP_ACK, arena.data() + count++ * SLOT);
+        }
+    }
+    translateAll(nat, arena, count, false, START_NS + 2 * SECOND_NS, refused);
+
+    size_t tcp = (flows.size() + 2) / 3, udp = (flows.size() + 1) / 3, icmp = flows.size() / 3;
+    struct Step { uint64_t seconds; size_t active; const char* what; };
+    const Step steps[] = {
+        {15, flows.size() - resets, "reset TCP gone after 10 s"},
+        {70, flows.size() - resets - icmp, "ping gone after 60 s"},
+        {250, flows.size() - resets - icmp - closes, "TCP closed by FINs gone after 240 s"},
+        {310, tcp - resets - closes, "UDP gone after 300 s"},
+        {7200, tcp - resets - closes, "established TCP still there after 2 h"},
+        {7500, 0, "established TCP gone after 2 h 4 min"},
+    };
+    std::printf("  timeouts:");
+    for (const Step& step : steps) {
+        nat.expire(START_NS + step.seconds * SECOND_NS);
+        bool step_ok = nat.stats().active == step.active;
+        std::printf(" %s%s;", step.what, step_ok ? "" : " FAILED");
+        ok = ok && step_ok;
+    }
+    std::printf("\n");
+    ok = ok && udp + tcp + icmp == flows.size();
+
+    // a pool of 32 ports: the 33rd UDP flow is refused, expiry frees the ports for new ones
+    NatConfig small;
+    small.external_ip = POOL;
+    small.port_min = 1024;
+    small.port_max = 1055;
+    small.max_sessions = 64;
+    auto small_table = std::make_shared<NatTable>(small);
+    NatTranslator small_nat(small_table, 0);
+    std::vector<Flow> udp_flows = makeFlows(120, 2, 0x0A100000, false);
+    udp_flows.erase(std::remove_if(udp_flows.begin(), udp_flows.end(),
+                                   [](const Flow& flow) { return flow.protocol != PROTOCOL_UDP; }), udp_flows.end());
+    for (size_t i = 0; i < udp_flows.size(); i++) {
+        stamper.outbound(udp_flows[i], 0, arena.data() + i * SLOT);
+    }
+    translateAll(small_nat, arena, udp_flows.size(), true, START_NS, refused);
+    size_t exhausted = small_nat.stats().exhausted;
+    for (size_t i = 0; i < 8; i++) {
+        stamper.outbound(udp_flows[i + 32], 0, arena.data() + i * SLOT);
+    }
+    translateAll(small_nat, arena, 8, true, START_NS + 301 * SECOND_NS, refused);
+    size_t reused = 8 - std::count(refused.begin(), refused.end(), 1);
+    std::printf("  32 ports for %zu flows: %zu refused for want of a port, %zu of 8 got one once the first had expired\n",
+                udp_flows.size(), exhausted, reused);
+    ok = ok && exhausted == udp_flows.size() - 32 && reused == 8;
+
+    std::printf("translations exact, filtered and timed out by state: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+/* two cores open sessions in one table at the same time, then every answer is resolved
+   by the core that did not open its session, and ownerOf() names the one that did */
+static bool checkCores() {
+    NatConfig config;
+    config.external_ip = POOL;
+    config.external_count = 8;
+    config.cores = 2;
+    config.max_sessions = 1 << 18;
+    auto table = std::make_shared<NatTable>(config);
+    Stamper stamper;
+    std::vector<Flow> flows[2] = {makeFlows(CORE_FLOWS, 3, 0x0A000000, false),
+                                  makeFlows(CORE_FLOWS, 4, 0x0B000000, false)};
+    std::vector<uint8_t> arenas[2] = {std::vector<uint8_t>(CORE_FLOWS * SLOT), std::vector<uint8_t>(CORE_FLOWS * SLOT)};
+    size_t refused_out[2] = {0, 0};
+
+    std::thread threads[2];
+    for (size_t core = 0; core < 2; core++) {
+        threads[core] = std::thread([&, core]() {
+            NatTranslator nat(table, core);
+            std::vector<uint8_t> refused;
+            for (size_t i = 0; i < CORE_FLOWS; i++) {
+                stamper.outbound(flows[core][i], TCP_SYN, arenas[core].data() + i * SLOT);
+            }
+            translateAll(nat, arenas[core], CORE_FLOWS, true, START_NS, refused);
+            refused_out[core] = std::count(refused.begin(), refused.end(), 1);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    std::set<std::tuple<uint8_t, uint32_t, uint16_t>> used;
+    size_t duplicates = 0, wrong_owner = 0, bad_in = 0;
+    for (size_t core = 0; core < 2; core++) {
+        NatTranslator other(table, 1 - core);
+        std::vector<uint8_t> refused;
+        for (size_t i = 0; i < CORE_FLOWS; i++) {
+            Flow& flow = flows[core][i];
+            const uint8_t* packet = arenas[core].data() + i * SLOT;
+            flow.external_ip = load32(packet + 12);
+            flow.external_port = packetPort(packet, true);
+            duplicates += !used.insert({flow.protocol, flow.external_ip, flow.external_port}).second;
+            stamper.inbound(flow, TCP_SYN | TCP_ACK, arenas[core].data() + i * SLOT);
+            wrong_owner += table->ownerOf(PacketView(packet, load16(packet + 2))) != static_cast<int>(core);
+        }
+        translateAll(other, arenas[core], CORE_FLOWS, false, START_NS + SECOND_NS, refused);
+        for (size_t i = 0; i < CORE_FLOWS; i++) {
+            const uint8_t* packet = arenas[core].data() + i * SLOT;
+            bad_in += refused[i] || load32(packet + 16) != flows[core][i].inside_ip ||
+                      packetPort(packet, false) != flows[core][i].inside_port || !checksumsValid(packet);
+        }
+    }
+    NatStats stats = table->stats();
+    bool ok = refused_out[0] + refused_out[1] == 0 && duplicates == 0 && wrong_owner == 0 && bad_in == 0 &&
+              stats.created == 2 * CORE_FLOWS;
+    std::printf("  2 cores x %zu new flows at once: %llu sessions, %zu pool ports handed out twice, %zu answers "
+                "steered to the wrong core, %zu resolved wrong across cores\n", CORE_FLOWS,
+                (unsigned long long)stats.created, duplicates, wrong_owner, bad_in);
+    std::printf("cores share the table without stepping on each other: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static void benchRates() {
+    NatConfig config;
+    config.external_ip = POOL;
+    config.external_count = 32;
+    config.max_sessions = 1 << 20;
+    auto table = std::make_shared<NatTable>(config);
+    NatTranslator nat(table, 0);
+    Stamper stamper;
+    std::vector<Flow> flows = makeFlows(BENCH_MAPPINGS, 5, 0x0A000000, true);
+    std::vector<uint8_t> pristine(BENCH_MAPPINGS * SLOT), work(BENCH_MAPPINGS * SLOT), refused(BENCH_MAPPINGS);
+    NatPacket packets[BURST];
+    NatInbound inbound[BURST];
+
+    auto run = [&](size_t count, bool outbound, uint64_t now_ns) {
+        uint64_t start = benchNowNs();
+        for (size_t first = 0; first < count; first += BURST) {
+            size_t burst = std::min(BURST, count - first);
+            for (size_t i = 0; i < burst; i++) {
+                uint8_t* data = work.data() + (first + i) * SLOT;
+                packets[i] = {data, load16(data + 2)};
+            }
+            if (outbound) {
+                nat.translateOutbound(packets, burst, now_ns, refused.data() + first);
+            } else {
+                nat.translateInbound(packets, burst, now_ns, refused.data() + first, inbound);
+                nat.commitInbound(inbound, burst, now_ns);
+            }
+        }
+        return benchNowNs() - start;
+    };
+
+    std::printf("\n%zu TCP flows over a pool of %u addresses, one core:\n", flows.size(), config.external_count);
+    for (size_t i = 0; i < flows.size(); i++) {
+        stamper.outbound(flows[i], TCP_SYN, work.data() + i * SLOT);
+    }
+    uint64_t ns = run(flows.size(), true, START_NS);
+    benchReport("new connections (SYN opens a session)", flows.size(), ns);
+    std::printf("      %.2f M connections/s, %zu sessions active, %zu refused\n", flows.size() / (ns / 1e9) / 1e6,
+                table->stats().active, static_cast<size_t>(std::count(refused.begin(), refused.end(), 1)));
+    for (size_t i = 0; i < flows.size(); i++) {
+        const uint8_t* packet = work.data() + i * SLOT;
+        flows[i].external_ip = load32(packet + 12);
+        flows[i].external_port = packetPort(packet, true);
+    }
+
+    // steady state: uniformly random packets of the active flows, both ways
+    std::mt19937 rng(6);
+    std::vector<uint32_t> trace(STEADY_PACKETS);
+    for (uint32_t& flow : trace) {
+        flow = rng() % flows.size();
+    }
+    for (int outbound = 1; outbound >= 0; outbound--) {
+        for (size_t i = 0; i < flows.size(); i++) {
+            if (outbound) {
+                stamper.outbound(flows[i], TCP_ACK, pristine.data() + i * SLOT);
+            } else {
+                stamper.inbound(flows[i], TCP_ACK, pristine.data() + i * SLOT);
+            }
+        }
+        uint64_t total_ns = 0;
+        size_t mismatches = 0, refusals = 0;
+        for (size_t first = 0; first < trace.size(); first += flows.size()) {
+            size_t count = std::min(flows.size(), trace.size() - first);
+            for (size_t i = 0; i < count; i++) {
+                std::memcpy(work.data() + i * SLOT, pristine.data() + trace[first + i] * SLOT, SLOT);
+            }
+            total_ns += run(count, outbound, START_NS + SECOND_NS);
+            for (size_t i = 0; i < count; i++) {
+                const Flow& flow = flows[trace[first + i]];
+                const uint8_t* packet = work.data() + i * SLOT;
+                refusals += refused[i];
+                mismatches += !checksumsValid(packet) ||
+                              (outbound ? load32(packet + 12) != flow.external_ip
+                                        : load32(packet + 16) != flow.inside_ip);
+            }
+        }
+        benchReport(outbound ? "steady state out, 1M active mappings" : "steady state in, 1M active mappings",
+                    trace.size(), total_ns);
+        std::printf("      %.2f Mpps, %zu refused, %zu wrong translations or checksums\n",
+                    trace.size() / (total_ns / 1e9) / 1e6, refusals, mismatches);
+    }
+    NatStats stats = table->stats();
+    std::printf("  (checksum %llu)\n", (unsigned long long)(stats.outbound + stats.inbound + stats.created));
+}
+
+/* in the pipeline, inbound packets dropped after translation (here a header checksum
+   broken on the way) must not count on their session: a corrupt RST would otherwise put
+   a live mapping on the 10 s closed timeout, scaled down to milliseconds here */
+static bool checkPipeline() {
+    InternetProtocol ip;
+    ip.addRoute("10.0.0.0/8", "eth0");
+    ip.addRoute("8.0.0.0/8", "eth1");
+    NatConfig config;
+    config.external_ip = POOL;
+    config.outside_interface = static_cast<uint16_t>(ip.adjacencies().findInterface("eth1"));
+    config.tick_ns = 1000000;
+    config.timeouts.tcp_closed_ns = 10000000;
+    ip.enableNat(std::make_shared<NatTable>(config));
+    PacketPool pool(16);
+    Stamper stamper;
+    uint8_t bytes[SLOT];
+    auto forward = [&](size_t length) {
+        PacketHandle packet = pool.copyIn(bytes, length);
+        BurstResult result;
+        ip.forwardBurst(&packet, 1, result);
+        std::memcpy(bytes, packet->data(), packet->size());
+        return result.verdicts[0];
+    };
+
+    Flow flow = {PROTOCOL_TCP, 0x0A000005, 0x08080808, 40000, 443};
+    bool out_ok = forward(stamper.outbound(flow, TCP_SYN, bytes)).forwarded();
+    flow.external_ip = load32(bytes + 12);
+    flow.external_port = packetPort(bytes, true);
+    bool in_ok = forward(stamper.inbound(flow, TCP_SYN | TCP_ACK, bytes)).forwarded();
+    size_t length = stamper.inbound(flow, TCP_RST, bytes);
+    bytes[10] ^= 0xFF;
+    bool corrupt_dropped = forward(length).drop_reason == DropReason::BAD_CHECKSUM;
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    // any later burst runs the expiry
+    Flow other = {PROTOCOL_UDP, 0x0A000006, 0x08080404, 5000, 53};
+    forward(stamper.outbound(other, 0, bytes));
+    const NatStats& stats = *ip.natStats();
+    bool ok = out_ok && in_ok && corrupt_dropped && stats.inbound == 1 && stats.created == 2 && stats.active == 2;
+    std::printf("  through forwardBurst: %llu of 2 answers counted, %zu of 2 sessions left after a corrupt RST\n",
+                (unsigned long long)stats.inbound, stats.active);
+    std::printf("dropped inbound packets leave their sessions alone: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== NAT ===\n");
+    bool ok = checkTranslation();
+    ok = checkCores() && ok;
+    ok = checkPipeline() && ok;
+    benchRates();
+    return ok ? 0 : 1;
+}
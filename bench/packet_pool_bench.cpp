@@ -0,0 +1,163 @@
+#include "bench_common.hpp"
+#include "routing_table.hpp"
+#include "packet_builders.hpp"
+#include "packet_pool.hpp"
+#include "logger.hpp"
+#include <atomic>
+#include <new>
+#include <queue>
+#include <thread>
+
+/* pooled packet buffers against a std::vector per packet: every packet is received
+   into a buffer, gets a 14-byte outer header prepended, waits in a burst queue, is
+   parsed and routed, and is freed. global operator new is counted so the steady state
+   of the pooled path can be shown to do no heap allocation at all */
+
+constexpr size_t TABLE_PREFIXES = 900000;
+constexpr size_t PACKETS = 1 << 22;
+constexpr size_t BURST = 32;
+constexpr size_t TEMPLATES = 1024;
+constexpr size_t POOL_BUFFERS = 4096;
+constexpr size_t OUTER_HEADER_SIZE = 14;
+
+static std::atomic<uint64_t> heap_allocations{0};
+
+void* operator new(size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// UDP packets of assorted sizes towards destinations spread over the table
+static std::vector<std::vector<uint8_t>> makeTemplates(const std::vector<BenchPrefix>& prefixes) {
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, TEMPLATES, 7);
+    std::vector<std::vector<uint8_t>> templates;
+    for (size_t i = 0; i < TEMPLATES; i++) {
+        UDPPacketBuilder builder;
+        builder.ipv4_src_ip = "192.168.1.100";
+        builder.ipv4_dst_ip = benchIpString(dsts[i]);
+        builder.udp_src_port = static_cast<uint16_t>(1024 + i);
+        builder.udp_dst_port = 53;
+        builder.udp_payload = std::string(16 + (i * 37) % 1200, 'x');
+        templates.push_back(builder.build());
+    }
+    return templates;
+}
+
+static uint64_t routePacket(const RoutingTable& table, PacketView packet) {
+    IPv4HeaderView header(packet);
+    return header.valid() ? table.lookupRoute(header.dstIp()) : NO_ADJACENCY;
+}
+
+static void runPool(const RoutingTable& table, const std::vector<std::vector<uint8_t>>& templates) {
+    PacketPool pool(POOL_BUFFERS);
+    PacketHandle burst[BURST];
+    uint64_t sink = 0, failed = 0;
+
+    PacketPoolStats before = pool.stats();
+    uint64_t allocations = heap_allocations.load();
+    uint64_t start = benchNowNs();
+    for (size_t n = 0; n < PACKETS; n += BURST) {
+        for (size_t i = 0; i < BURST; i++) {
+            const std::vector<uint8_t>& bytes = templates[(n + i) % TEMPLATES];
+            burst[i] = pool.copyIn(bytes.data(), bytes.size());
+            if (uint8_t* outer = burst[i] ? burst[i]->prepend(OUTER_HEADER_SIZE) : nullptr) {
+                std::memset(outer, 0, OUTER_HEADER_SIZE);
+            } else {
+                failed++;
+            }
+        }
+        for (size_t i = 0; i < BURST; i++) {
+            sink += routePacket(table, burst[i].view().from(OUTER_HEADER_SIZE));
+            burst[i].reset();
+        }
+    }
+    uint64_t elapsed = benchNowNs() - start;
+    uint64_t heap = heap_allocations.load() - allocations;
+    PacketPoolStats after = pool.stats();
+
+    benchReport("pooled buffers", PACKETS, elapsed);
+    std::printf("      %.3f heap allocations/packet, %llu refills, %llu flushes, %llu exhausted, %llu failed"
+                " (checksum %llu)\n",
+                static_cast<double>(heap) / PACKETS,
+                static_cast<unsigned long long>(after.refills - before.refills),
+                static_cast<unsigned long long>(after.flushes - before.flushes),
+                static_cast<unsigned long long>(after.exhausted - before.exhausted),
+                static_cast<unsigned long long>(failed), static_cast<unsigned long long>(sink));
+}
+
+static void runVectors(const RoutingTable& table, const std::vector<std::vector<uint8_t>>& templates) {
+    std::queue<std::vector<uint8_t>> queue;
+    uint64_t sink = 0;
+
+    uint64_t allocations = heap_allocations.load();
+    uint64_t start = benchNowNs();
+    for (size_t n = 0; n < PACKETS; n += BURST) {
+        for (size_t i = 0; i < BURST; i++) {
+            std::vector<uint8_t> packet(templates[(n + i) % TEMPLATES]);
+            packet.insert(packet.begin(), OUTER_HEADER_SIZE, 0);
+            queue.push(std::move(packet));
+        }
+        while (!queue.empty()) {
+            sink += routePacket(table, PacketView(queue.front()).from(OUTER_HEADER_SIZE));
+            queue.pop();
+        }
+    }
+    uint64_t elapsed = benchNowNs() - start;
+    uint64_t heap = heap_allocations.load() - allocations;
+
+    benchReport("std::vector per packet", PACKETS, elapsed);
+    std::printf("      %.3f heap allocations/packet (checksum %llu)\n",
+                static_cast<double>(heap) / PACKETS, static_cast<unsigned long long>(sink));
+}
+
+/* buffers allocated on one thread and freed on another travel back through the shared
+   list; afterwards every buffer must be accounted for */
+static bool checkCrossThread(const std::vector<std::vector<uint8_t>>& templates) {
+    PacketPool pool(POOL_BUFFERS);
+    // half the pool per round, the rest may sit in the consumer's cache
+    std::vector<PacketHandle> handoff(POOL_BUFFERS / 2);
+    size_t produced = 0;
+
+    for (int round = 0; round < 16; round++) {
+        std::thread producer([&]() {
+            for (size_t i = 0; i < handoff.size(); i++) {
+                const std::vector<uint8_t>& bytes = templates[i % TEMPLATES];
+                handoff[i] = pool.copyIn(bytes.data(), bytes.size());
+            }
+            pool.flushCache();
+        });
+        producer.join();
+        for (PacketHandle& packet : handoff) {
+            produced += static_cast<bool>(packet);
+            PacketHandle mirror = packet.share();
+            packet.reset();
+        }
+    }
+    pool.flushCache();
+    PacketPoolStats stats = pool.stats();
+    return produced == 16 * handoff.size() && stats.inUse() == 0 && stats.exhausted == 0;
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== Packet buffers (%zu packets in bursts of %zu, %zu prefixes) ===\n",
+                PACKETS, BURST, TABLE_PREFIXES);
+
+    RoutingTable table;
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    for (const auto& p : prefixes) {
+        table.addRoute(p.network, p.prefix_len, benchInterface(p.prefix_len), p.network);
+    }
+    std::vector<std::vector<uint8_t>> templates = makeTemplates(prefixes);
+
+    runVectors(table, templates);
+    runPool(table, templates);
+    std::printf("cross-thread frees return every buffer: %s\n", checkCrossThread(templates) ? "ok" : "FAILED");
+    return 0;
+}
@@ -0,0 +1,366 @@
+#include "bench_common.hpp"
+#include "pcap_file.hpp"
+#include "pcap_capture_sink.hpp"
+#include "traffic_generator.hpp"
+#include "internet_protocol.hpp"
+#include "packet_builders.hpp"
+#include "logger.hpp"
+#include <unistd.h>
+
+/* pcap replay and capture. generated traffic is written with PcapWriter and must read
+   back from the mapped file packet for packet and timestamp for timestamp, then
+   hand-assembled pcapng and pcap files (both byte orders, Ethernet with VLAN tags and
+   padding, Linux cooked headers, a non-IP frame, timestamp resolutions and offsets)
+   must give the IP packets inside them. the capture sink's files must hold what the
+   verdict counters counted, and the pacer must hold a fixed rate and recorded timing.
+   timed: writing, reading alone, replaying into the headless pipeline against the same
+   packets forwarded from memory, and replaying with every packet captured */
+
+constexpr size_t TABLE_PREFIXES = 100000;
+constexpr size_t PACKETS = 1 << 18;
+constexpr size_t PACED_PACKETS = 50000;
+constexpr double PACED_RATE = 500000;       // packets per second
+constexpr size_t BURST = 32;
+constexpr uint64_t FIRST_TIMESTAMP_NS = 1700000000123456789ULL;
+constexpr uint64_t TIMESTAMP_STEP_NS = 1000;
+
+// a capture file assembled field by field in either byte order
+class CaptureBytes {
+public:
+    std::vector<uint8_t> bytes;
+    bool big_endian = false;
+
+    void u8(uint8_t value) { bytes.push_back(value); }
+    void u16(uint16_t value) {
+        for (int shift : big_endian ? std::vector<int>{8, 0} : std::vector<int>{0, 8}) {
+            bytes.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+    void u32(uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            bytes.push_back(static_cast<uint8_t>(value >> (big_endian ? 24 - 8 * i : 8 * i)));
+        }
+    }
+    void raw(const std::vector<uint8_t>& data) { bytes.insert(bytes.end(), data.begin(), data.end()); }
+    void pad4() {
+        while (bytes.size() % 4) {
+            bytes.push_back(0);
+        }
+    }
+    // a pcapng block around what body() adds, both length fields filled in
+    template <typename Body>
+    void block(uint32_t type, Body body) {
+        size_t start = bytes.size();
+        u32(type);
+        u32(0);
+        body();
+        pad4();
+        uint32_t length = static_cast<uint32_t>(bytes.size() - start + 4);
+        u32(length);
+        CaptureBytes patch;
+        patch.big_endian = big_endian;
+        patch.u32(length);
+        std::memcpy(bytes.data() + start + 4, patch.bytes.data(), 4);
+    }
+};
+
+struct ExpectedPacket {
+    std::vector<uint8_t> packet;
+    uint64_t timestamp_ns;
+};
+
+static std::vector<uint8_t> ethernetFrame(const std::vector<uint8_t>& packet, std::vector<uint16_t> ethertypes) {
+    std::vector<uint8_t> frame(12, 0xAA);
+    for (size_t i = 0; i < ethertypes.size(); i++) {
+        frame.push_back(static_cast<uint8_t>(ethertypes[i] >> 8));
+        frame.push_back(static_cast<uint8_t>(ethertypes[i]));
+        if (i + 1 < ethertypes.size()) {
+            frame.push_back(0x00);      // tag control information
+            frame.push_back(0x64);
+        }
+    }
+    frame.insert(frame.end(), packet.begin(), packet.end());
+    frame.resize(std::max<size_t>(frame.size(), 60), 0);     // minimum frame, padded
+    return frame;
+}
+
+static bool writeFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    bool ok = file && std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    if (file) {
+        std::fclose(file);
+    }
+    return ok;
+}
+
+static size_t compareCapture(const std::string& path, const std::vector<ExpectedPacket>& expected, size_t skipped) {
+    PcapReader reader;
+    if (!reader.open(path)) {
+        return expected.size() + 1;
+    }
+    size_t mismatches = 0, index = 0;
+    PacketView packet;
+    uint64_t timestamp;
+    while (reader.next(packet, timestamp)) {
+        mismatches += index >= expected.size() || packet.size() != expected[index].packet.size() ||
+                      std::memcmp(packet.data(), expected[index].packet.data(), packet.size()) != 0 ||
+                      timestamp != expected[index].timestamp_ns;
+        index++;
+    }
+    return mismatches + (index != expected.size()) + (reader.stats().skipped != skipped);
+}
+
+static bool checkFormats(const std::string& directory) {
+    UDPPacketBuilder udp;
+    udp.ipv4_dst_ip = "198.51.100.7";
+    udp.udp_payload = "tiny";               // 32 bytes, padded inside an Ethernet frame
+    TCPPacketBuilder tcp;
+    tcp.ipv4_dst_ip = "203.0.113.80";
+    tcp.tcp_payload = std::string(300, 't');
+    ICMPv6PacketBuilder ping6;
+    ping6.ipv6_dst_ip = "2001:db8::5";
+    std::vector<uint8_t> udp_packet = udp.build(), tcp_packet = tcp.build(), ping6_packet = ping6.build();
+    std::vector<uint8_t> arp(28, 0x01);
+
+    // pcapng: a big-endian section with an Ethernet and a raw interface, then a little-endian one
+    CaptureBytes ng;
+    ng.big_endian = true;
+    ng.block(0x0A0D0D0A, [&] { ng.u32(0x1A2B3C4D); ng.u16(1); ng.u16(0); ng.u32(0xFFFFFFFF); ng.u32(0xFFFFFFFF); });
+    ng.block(1, [&] { ng.u16(PCAP_LINKTYPE_ETHERNET); ng.u16(0); ng.u32(65535); });       // microseconds
+    ng.block(1, [&] {
+        ng.u16(PCAP_LINKTYPE_RAW); ng.u16(0); ng.u32(65535);
+        ng.u16(9); ng.u16(1); ng.u8(0x80 | 10); ng.pad4();        // 2^-10 s ticks
+        ng.u16(14); ng.u16(8); ng.u32(0); ng.u32(100);            // 100 s offset
+        ng.u16(0); ng.u16(0);
+    });
+    auto enhanced = [&](uint32_t interface, uint64_t ticks, const std::vector<uint8_t>& frame) {
+        ng.block(6, [&] {
+            ng.u32(interface); ng.u32(static_cast<uint32_t>(ticks >> 32)); ng.u32(static_cast<uint32_t>(ticks));
+            ng.u32(static_cast<uint32_t>(frame.size())); ng.u32(static_cast<uint32_t>(frame.size())); ng.raw(frame);
+        });
+    };
+    enhanced(0, 1700000000000001ULL, ethernetFrame(udp_packet, {0x0800}));
+    enhanced(0, 1700000000000002ULL, ethernetFrame(ping6_packet, {0x88A8, 0x8100, 0x86DD}));
+    enhanced(0, 1700000000000003ULL, ethernetFrame(arp, {0x0806}));
+    enhanced(1, 3 * 1024 + 512, tcp_packet);
+    std::vector<uint8_t> simple = ethernetFrame(udp_packet, {0x0800});
+    ng.block(3, [&] { ng.u32(static_cast<uint32_t>(simple.size())); ng.raw(simple); });    // interface 0, no timestamp
+    ng.block(5, [&] { ng.u32(0); });                                    // statistics, skipped over
+    ng.big_endian = false;
+    ng.block(0x0A0D0D0A, [&] { ng.u32(0x1A2B3C4D); ng.u16(1); ng.u16(0); ng.u32(0xFFFFFFFF); ng.u32(0xFFFFFFFF); });
+    ng.block(1, [&] { ng.u16(PCAP_LINKTYPE_LINUX_SLL2); ng.u16(0); ng.u32(65535); ng.u16(9); ng.u16(1); ng.u8(9); ng.pad4(); ng.u32(0); });
+    std::vector<uint8_t> sll2(20, 0);
+    sll2[0] = 0x08;                         // protocol 0x0800
+    sll2.insert(sll2.end(), tcp_packet.begin(), tcp_packet.end());
+    enhanced(0, 5000000007ULL, sll2);
+    std::vector<ExpectedPacket> ng_expected = {
+        {udp_packet, 1700000000000001000ULL}, {ping6_packet, 1700000000000002000ULL},
+        {tcp_packet, 103500000000ULL}, {udp_packet, 0}, {tcp_packet, 5000000007ULL}};
+
+    // classic pcap, big-endian microseconds, Linux cooked v1
+    CaptureBytes pcap;
+    pcap.big_endian = true;
+    pcap.u32(0xA1B2C3D4); pcap.u16(2); pcap.u16(4); pcap.u32(0); pcap.u32(0); pcap.u32(65535);
+    pcap.u32(PCAP_LINKTYPE_LINUX_SLL);
+    std::vector<ExpectedPacket> pcap_expected;
+    for (const auto* packet : {&udp_packet, &tcp_packet}) {
+        std::vector<uint8_t> sll(16, 0);
+        sll[14] = 0x08;
+        sll.insert(sll.end(), packet->begin(), packet->end());
+        uint32_t usec = static_cast<uint32_t>(pcap_expected.size() * 250000 + 17);
+        pcap.u32(1700000000); pcap.u32(usec); pcap.u32(static_cast<uint32_t>(sll.size()));
+        pcap.u32(static_cast<uint32_t>(sll.size())); pcap.raw(sll);
+        pcap_expected.push_back({*packet, 1700000000ULL * 1000000000 + usec * 1000ULL});
+    }
+
+    std::string ng_path = directory + "/formats.pcapng", pcap_path = directory + "/formats.pcap";
+    size_t ng_mismatches = writeFile(ng_path, ng.bytes) ? compareCapture(ng_path, ng_expected, 1) : 1;
+    size_t pcap_mismatches = writeFile(pcap_path, pcap.bytes) ? compareCapture(pcap_path, pcap_expected, 0) : 1;
+    std::remove(ng_path.c_str());
+    std::remove(pcap_path.c_str());
+    std::printf("  pcapng (2 sections, Ethernet/VLAN/raw/SLL2, tsresol, tsoffset): %zu mismatches, "
+                "big-endian pcap (SLL): %zu mismatches\n", ng_mismatches, pcap_mismatches);
+    return ng_mismatches == 0 && pcap_mismatches == 0;
+}
+
+// the capture's packets a burst at a time into forwardPackets
+static void replay(InternetProtocol& ip, PcapReader& reader, VerdictSink& sink, PcapCaptureSink* capture = nullptr) {
+    PacketView packets[BURST];
+    uint64_t timestamps[BURST];
+    reader.rewind();
+    while (size_t count = reader.read(packets, timestamps, BURST)) {
+        if (capture) {
+            capture->setTimestamps(timestamps);
+        }
+        ip.forwardPackets(packets, count, sink);
+    }
+}
+
+static size_t capturedPackets(const std::string& path) {
+    PcapReader reader;
+    size_t count = 0;
+    PacketView packet;
+    uint64_t timestamp;
+    if (reader.open(path)) {
+        while (reader.next(packet, timestamp)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    InternetProtocol ip;
+    for (const auto& p : benchRandomPrefixes(TABLE_PREFIXES, 42)) {
+        ip.addRoute(benchIpString(p.network) + "/" + std::to_string(p.prefix_len), benchInterface(p.prefix_len));
+    }
+    char directory_template[] = "/tmp/pcap_bench_XXXXXX";
+    if (!mkdtemp(directory_template)) {
+        std::printf("cannot create a scratch directory\n");
+        return 1;
+    }
+    std::string directory = directory_template;
+    std::string trace_path = directory + "/trace.pcap";
+    std::printf("=== pcap replay and capture (%zu packets, %zu FIB prefixes) ===\n", PACKETS, TABLE_PREFIXES);
+
+    // the trace in memory, IMIX with a few unrouted flows so the drop capture has packets too
+    TrafficProfile profile;
+    profile.seed = 7;
+    profile.flows = 50000;
+    profile.unrouted_share = 0.05;
+    TrafficGenerator generator(profile, ip.routePrefixes());
+    std::vector<uint8_t> arena(PACKETS * generator.maxPacketSize());
+    std::vector<PacketView> trace(PACKETS);
+    size_t used = 0;
+    for (auto& view : trace) {
+        size_t length = generator.next(arena.data() + used, arena.size() - used);
+        view = PacketView(arena.data() + used, length);
+        used += length;
+    }
+
+    PcapWriter writer;
+    uint64_t start = benchNowNs();
+    writer.open(trace_path);
+    for (size_t i = 0; i < PACKETS; i++) {
+        writer.write(trace[i], FIRST_TIMESTAMP_NS + i * TIMESTAMP_STEP_NS);
+    }
+    writer.close();
+    uint64_t elapsed = benchNowNs() - start;
+    benchReport("PcapWriter, write + close", PACKETS, elapsed);
+    std::printf("      %.2f GB/s\n", static_cast<double>(writer.bytes()) / elapsed);
+
+    bool ok = true;
+    PcapReader reader;
+    ok &= reader.open(trace_path);
+    size_t mismatches = 0, index = 0;
+    PacketView packet;
+    uint64_t timestamp;
+    while (reader.next(packet, timestamp)) {
+        mismatches += index >= PACKETS || packet.size() != trace[index].size() ||
+                      std::memcmp(packet.data(), trace[index].data(), packet.size()) != 0 ||
+                      timestamp != FIRST_TIMESTAMP_NS + index * TIMESTAMP_STEP_NS;
+        index++;
+    }
+    mismatches += index != PACKETS;
+    std::printf("  written trace read back: %zu packets, %zu mismatches\n", index, mismatches);
+    ok &= mismatches == 0;
+    ok &= checkFormats(directory);
+
+    // the capture sink's files against the counters
+    VerdictCounter counter;
+    PcapCaptureSink capture(ip.adjacencies(), directory);
+    VerdictTee counter_and_capture(counter, capture);
+    replay(ip, reader, counter_and_capture, &capture);
+    capture.flush();
+    size_t capture_mismatches = 0, files = 0;
+    for (size_t id = 0; id < counter.interfaceSlots(); id++) {
+        if (uint64_t forwarded = counter.forwarded(static_cast<uint16_t>(id))) {
+            std::string path = directory + "/" + ip.adjacencies().interfaceName(static_cast<uint32_t>(id)) + ".pcap";
+            capture_mismatches += capturedPackets(path) != forwarded;
+            std::remove(path.c_str());
+            files++;
+        }
+    }
+    std::string no_route_path = directory + "/drop-no-route.pcap";
+    capture_mismatches += capturedPackets(no_route_path) != counter.dropped(DropReason::NO_ROUTE);
+    std::remove(no_route_path.c_str());
+    std::printf("  capture sink: %zu interface files + %llu no-route drops, %zu count mismatches\n", files,
+                static_cast<unsigned long long>(counter.dropped(DropReason::NO_ROUTE)), capture_mismatches);
+    ok &= capture_mismatches == 0 && files > 1 && counter.dropped(DropReason::NO_ROUTE) > 0 &&
+          capture.files() == files + 1;
+
+    // pacing: a fixed rate, then the recorded gaps at twice the speed
+    double expected_ms[2] = {PACED_PACKETS / PACED_RATE * 1e3,
+                             PACED_PACKETS * TIMESTAMP_STEP_NS / 2.0 / 1e6};
+    ReplayPacer pacers[2] = {ReplayPacer(ReplayTiming::FIXED_RATE, PACED_RATE), ReplayPacer(ReplayTiming::RECORDED, 2.0)};
+    const char* pace_names[2] = {"fixed 500k pps", "recorded at 2x"};
+    for (int p = 0; p < 2; p++) {
+        VerdictCounter paced;
+        PacketView packets[BURST];
+        uint64_t timestamps[BURST];
+        size_t sent = 0, pending = 0, first = 0;
+        reader.rewind();
+        start = benchNowNs();
+        while (sent < PACED_PACKETS) {
+            if (first == pending) {
+                pending = reader.read(packets, timestamps, std::min(BURST, PACED_PACKETS - sent));
+                first = 0;
+            }
+            size_t ready = pacers[p].release(timestamps + first, pending - first);
+            ip.forwardPackets(packets + first, ready, paced);
+            first += ready;
+            sent += ready;
+        }
+        // the last packet is due one interval before the run's nominal length
+        double elapsed_ms = (benchNowNs() - start) / 1e6;
+        double due_ms = expected_ms[p] * (PACED_PACKETS - 1) / PACED_PACKETS;
+        bool on_time = elapsed_ms >= due_ms && elapsed_ms < due_ms * 1.2;
+        std::printf("  pacer, %s: %zu packets in %.2f ms (last due at %.2f ms)%s\n", pace_names[p], sent,
+                    elapsed_ms, due_ms, on_time ? "" : " OFF PACE");
+        ok &= on_time;
+    }
+
+    // timings: reading alone, replay into the pipeline, the same packets from memory, replay + capture
+    uint64_t sink = 0;
+    PacketView packets[BURST];
+    uint64_t timestamps[BURST];
+    reader.rewind();
+    start = benchNowNs();
+    while (size_t count = reader.read(packets, timestamps, BURST)) {
+        for (size_t i = 0; i < count; i++) {
+            sink += packets[i].size() + packets[i].data()[0];
+        }
+    }
+    elapsed = benchNowNs() - start;
+    benchReport("PcapReader, read views", PACKETS, elapsed);
+    std::printf("      %.2f GB/s\n", static_cast<double>(reader.stats().bytes) / elapsed);
+
+    VerdictCounter timed;
+    start = benchNowNs();
+    replay(ip, reader, timed);
+    benchReport("replay into forwardPackets", PACKETS, benchNowNs() - start);
+    start = benchNowNs();
+    for (size_t done = 0; done < PACKETS; done += BURST) {
+        ip.forwardPackets(trace.data() + done, std::min(BURST, PACKETS - done), timed);
+    }
+    benchReport("same packets from memory", PACKETS, benchNowNs() - start);
+    PcapCaptureSink timed_capture(ip.adjacencies(), directory);
+    VerdictTee timed_both(timed, timed_capture);
+    start = benchNowNs();
+    replay(ip, reader, timed_both, &timed_capture);
+    timed_capture.flush();
+    benchReport("replay + capture every packet", PACKETS, benchNowNs() - start);
+    std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink + timed.packets()));
+
+    // the timed capture wrote the same files again
+    for (size_t id = 0; id < counter.interfaceSlots(); id++) {
+        std::remove((directory + "/" + ip.adjacencies().interfaceName(static_cast<uint32_t>(id)) + ".pcap").c_str());
+    }
+    std::remove(no_route_path.c_str());
+    reader.close();
+    std::remove(trace_path.c_str());
+    rmdir(directory.c_str());
+    std::printf("captures round-trip, parse and pace: %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
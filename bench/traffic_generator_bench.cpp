@@ -0,0 +1,175 @@
+#include "bench_common.hpp"
+#include "traffic_generator.hpp"
+#include "internet_protocol.hpp"
+#include "checksum.hpp"
+#include "logger.hpp"
+
+/* the traffic generator against a large random FIB: the same seed must give the same
+   packets, the flows and packets must follow the profile (protocol mix, sizes, Zipf
+   popularity, destinations inside FIB prefixes) and every packet must pass the L4
+   checksum check. then the rate of generating alone and of generating into the
+   headless pipeline */
+
+constexpr size_t TABLE_PREFIXES = 900000;
+constexpr size_t CHECKED_PACKETS = 1 << 20;
+constexpr size_t TIMED_PACKETS = 1 << 23;
+constexpr size_t BURST = 32;
+constexpr double TOLERANCE = 0.01;
+
+static uint64_t streamHash(TrafficGenerator& generator, size_t packets) {
+    std::vector<uint8_t> out(generator.maxPacketSize());
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < packets; i++) {
+        size_t length = generator.next(out.data(), out.size());
+        hash = (hash ^ checksumAdd(0, out.data(), length) ^ length) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool near(double measured, double expected) {
+    return std::abs(measured - expected) <= TOLERANCE;
+}
+
+static bool checkProfile(InternetProtocol& ip, const std::vector<RoutePrefix>& prefixes, const TrafficProfile& profile) {
+    bool ok = true;
+
+    TrafficGenerator first(profile, prefixes), second(profile, prefixes);
+    TrafficProfile reseeded = profile;
+    reseeded.seed++;
+    TrafficGenerator other(reseeded, prefixes);
+    uint64_t hash = streamHash(first, 100000);
+    bool same = hash == streamHash(second, 100000);
+    bool differs = hash != streamHash(other, 100000);
+    std::printf("  seed %llu twice: %s, seed %llu: %s\n", static_cast<unsigned long long>(profile.seed),
+                same ? "same packets" : "DIFFERENT PACKETS", static_cast<unsigned long long>(reseeded.seed),
+                differs ? "different packets" : "SAME PACKETS");
+    ok &= same && differs;
+
+    // flows by protocol
+    TrafficGenerator generator(profile, prefixes);
+    size_t tcp = 0, udp = 0;
+    for (size_t i = 0; i < generator.flowCount(); i++) {
+        tcp += generator.flow(i).protocol == PROTOCOL_TCP;
+        udp += generator.flow(i).protocol == PROTOCOL_UDP;
+    }
+    double weights = profile.tcp_weight + profile.udp_weight + profile.icmp_weight;
+    double flows = static_cast<double>(generator.flowCount());
+    std::printf("  %zu flows: %.3f tcp, %.3f udp (profile %.3f, %.3f)\n", generator.flowCount(), tcp / flows,
+                udp / flows, profile.tcp_weight / weights, profile.udp_weight / weights);
+    ok &= near(tcp / flows, profile.tcp_weight / weights) && near(udp / flows, profile.udp_weight / weights);
+
+    /* packets by size and by flow, and every one through the L4 checksum check and the
+       route lookup, the table has no default route */
+    IngressChecks checks;
+    checks.l4_checksum = true;
+    ip.setIngressChecks(checks);
+    VerdictCounter counter;
+    PacketPool pool(4 * BURST + 2 * PACKET_POOL_CACHE_SIZE, PACKET_DEFAULT_HEADROOM + generator.maxPacketSize());
+    PacketHandle burst[BURST];
+    PacketView views[BURST];
+    std::vector<uint64_t> by_size(65536);
+    uint64_t top_flow = 0;
+    const TrafficFlow& most_popular = generator.flow(0);
+    for (size_t done = 0; done < CHECKED_PACKETS; done += BURST) {
+        size_t count = generator.fill(pool, burst, BURST);
+        for (size_t i = 0; i < count; i++) {
+            views[i] = burst[i].view();
+            by_size[views[i].size()]++;
+            IPv4HeaderView header(views[i]);
+            top_flow += header.srcIp() == most_popular.src_ip && header.dstIp() == most_popular.dst_ip;
+        }
+        ip.forwardPackets(views, count, counter);
+        for (size_t i = 0; i < count; i++) {
+            burst[i].reset();
+        }
+    }
+    double size_weights = 0;
+    for (const auto& size : profile.sizes) {
+        size_weights += size.second;
+    }
+    for (const auto& size : profile.sizes) {
+        double share = static_cast<double>(by_size[size.first]) / CHECKED_PACKETS;
+        std::printf("  %u byte packets: %.3f (profile %.3f)\n", size.first, share, size.second / size_weights);
+        ok &= near(share, size.second / size_weights);
+    }
+    double harmonic = 0;
+    for (size_t k = 1; k <= generator.flowCount(); k++) {
+        harmonic += 1.0 / std::pow(static_cast<double>(k), profile.zipf_exponent);
+    }
+    double top_share = static_cast<double>(top_flow) / CHECKED_PACKETS;
+    std::printf("  most popular flow: %.4f of the packets (zipf %.2f expects %.4f)\n", top_share,
+                profile.zipf_exponent, 1.0 / harmonic);
+    ok &= near(top_share, 1.0 / harmonic);
+
+    uint64_t no_route = counter.dropped(DropReason::NO_ROUTE);
+    uint64_t bad = counter.dropped(DropReason::BAD_LENGTH) + counter.dropped(DropReason::BAD_CHECKSUM) +
+                   counter.dropped(DropReason::BAD_L4_CHECKSUM);
+    std::printf("  %zu packets through the pipeline: %llu without a route, %llu failed ingress checks\n",
+                CHECKED_PACKETS, static_cast<unsigned long long>(no_route), static_cast<unsigned long long>(bad));
+    ok &= no_route == 0 && bad == 0;
+    ip.setIngressChecks(IngressChecks());
+    return ok;
+}
+
+static void runTimings(InternetProtocol& ip, const std::vector<RoutePrefix>& prefixes, const TrafficProfile& profile) {
+    TrafficGenerator generator(profile, prefixes);
+    std::vector<uint8_t> out(generator.maxPacketSize());
+    uint64_t sink = 0;
+    uint64_t start = benchNowNs();
+    for (size_t i = 0; i < TIMED_PACKETS; i++) {
+        sink += generator.next(out.data(), out.size());
+    }
+    benchReport("next() into one buffer", TIMED_PACKETS, benchNowNs() - start);
+
+    PacketPool pool(4 * BURST + 2 * PACKET_POOL_CACHE_SIZE, PACKET_DEFAULT_HEADROOM + generator.maxPacketSize());
+    PacketHandle burst[BURST];
+    PacketView views[BURST];
+    start = benchNowNs();
+    for (size_t done = 0; done < TIMED_PACKETS; done += BURST) {
+        size_t count = generator.fill(pool, burst, BURST);
+        for (size_t i = 0; i < count; i++) {
+            sink += burst[i]->size();
+            burst[i].reset();
+        }
+    }
+    benchReport("fill() into pooled buffers", TIMED_PACKETS, benchNowNs() - start);
+
+    VerdictCounter counter;
+    start = benchNowNs();
+    for (size_t done = 0; done < TIMED_PACKETS; done += BURST) {
+        size_t count = generator.fill(pool, burst, BURST);
+        for (size_t i = 0; i < count; i++) {
+            views[i] = burst[i].view();
+        }
+        ip.forwardPackets(views, count, counter);
+        for (size_t i = 0; i < count; i++) {
+            burst[i].reset();
+        }
+    }
+    benchReport("fill() + headless forwarding", TIMED_PACKETS, benchNowNs() - start);
+    std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(sink + counter.packets()));
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    InternetProtocol ip;
+    for (const auto& p : benchRandomPrefixes(TABLE_PREFIXES, 42)) {
+        ip.addRoute(benchIpString(p.network) + "/" + std::to_string(p.prefix_len), benchInterface(p.prefix_len));
+    }
+    std::vector<RoutePrefix> prefixes = ip.routePrefixes();
+    std::printf("=== Traffic generator (%zu FIB prefixes) ===\n", prefixes.size());
+
+    TrafficProfile profile;
+    profile.seed = 42;
+    profile.flows = 100000;
+    profile.zipf_exponent = 1.1;
+    bool ok = checkProfile(ip, prefixes, profile);
+
+    std::printf("--- default IMIX, %zu flows, zipf %.1f ---\n", profile.flows, profile.zipf_exponent);
+    runTimings(ip, prefixes, profile);
+    profile.sizes = {{64, 1}};
+    std::printf("--- 64 byte packets ---\n");
+    runTimings(ip, prefixes, profile);
+    std::printf("generator follows the profile: %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
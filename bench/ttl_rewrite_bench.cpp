@@ -0,0 +1,156 @@
+#include "bench_common.hpp"
+#include "internet_protocol.hpp"
+#include "packet_builders.hpp"
+#include "checksum.hpp"
+#include "logger.hpp"
+
+/* in-place forwarding rewrite: TTL decrement with the IPv4 header checksum patched
+   incrementally (RFC 1624) against decrementing and summing the header again. every
+   patched checksum over a large set of random headers must equal a from-scratch
+   recomputation, including the headers whose new checksum is 0x0000, where the older
+   RFC 1141 update goes wrong. the last part runs the whole forwardBurst stage */
+
+constexpr size_t HEADERS = 1 << 16;
+constexpr size_t CHECKED_HEADERS = 1 << 22;
+constexpr size_t REWRITES = 1 << 24;
+constexpr size_t TABLE_PREFIXES = 900000;
+constexpr size_t PACKETS = 1 << 22;
+constexpr size_t POOL_BUFFERS = 1 << 12;
+
+struct RawHeader {
+    uint8_t bytes[IPv4_HEADER_SIZE];
+};
+
+// random version 4, IHL 5 header with a valid checksum and a TTL in [min_ttl, 255]
+static RawHeader randomHeader(std::mt19937& rng, uint8_t min_ttl) {
+    RawHeader h;
+    for (auto& byte : h.bytes) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    h.bytes[0] = 0x45;
+    h.bytes[offsetof(IPv4Header, ttl)] = static_cast<uint8_t>(min_ttl + rng() % (256 - min_ttl));
+    uint16_t checksum = ipv4HeaderChecksum(h.bytes, IPv4_HEADER_SIZE);
+    h.bytes[10] = static_cast<uint8_t>(checksum >> 8);
+    h.bytes[11] = static_cast<uint8_t>(checksum);
+    return h;
+}
+
+static uint16_t storedChecksum(const RawHeader& h) {
+    return static_cast<uint16_t>((h.bytes[10] << 8) | h.bytes[11]);
+}
+
+static bool checkAgainstRecomputation() {
+    std::mt19937 rng(2024);
+    size_t mismatches = 0, zero_results = 0;
+    for (size_t i = 0; i < CHECKED_HEADERS; i++) {
+        RawHeader h = randomHeader(rng, 2);
+        uint8_t ttl = h.bytes[offsetof(IPv4Header, ttl)];
+        InternetProtocol::decrementTtl(h.bytes);
+        uint16_t patched = storedChecksum(h);
+        bool ok = h.bytes[offsetof(IPv4Header, ttl)] == ttl - 1 &&
+                  patched == ipv4HeaderChecksum(h.bytes, IPv4_HEADER_SIZE) &&
+                  internetChecksum(h.bytes, IPv4_HEADER_SIZE) == 0;
+        mismatches += !ok;
+        zero_results += (patched == 0);
+    }
+    std::printf("  %zu random headers: %zu mismatches against full recomputation (%zu patched to 0x0000)\n",
+                CHECKED_HEADERS, mismatches, zero_results);
+    return mismatches == 0;
+}
+
+static void timeRewrites() {
+    std::mt19937 rng(7);
+    std::vector<RawHeader> headers(HEADERS);
+    for (auto& h : headers) {
+        h = randomHeader(rng, 255);     // room for REWRITES / HEADERS decrements each
+    }
+    std::vector<RawHeader> copy = headers;
+
+    uint64_t start = benchNowNs();
+    for (size_t i = 0; i < REWRITES; i++) {
+        InternetProtocol::decrementTtl(headers[i & (HEADERS - 1)].bytes);
+    }
+    benchReport("incremental (RFC 1624)", REWRITES, benchNowNs() - start);
+
+    start = benchNowNs();
+    for (size_t i = 0; i < REWRITES; i++) {
+        uint8_t* h = copy[i & (HEADERS - 1)].bytes;
+        h[offsetof(IPv4Header, ttl)]--;
+        uint16_t checksum = ipv4HeaderChecksum(h, IPv4_HEADER_SIZE);
+        h[10] = static_cast<uint8_t>(checksum >> 8);
+        h[11] = static_cast<uint8_t>(checksum);
+    }
+    benchReport("full recomputation", REWRITES, benchNowNs() - start);
+
+    size_t differ = 0;
+    for (size_t i = 0; i < HEADERS; i++) {
+        differ += std::memcmp(headers[i].bytes, copy[i].bytes, IPv4_HEADER_SIZE) != 0;
+    }
+    std::printf("      %zu headers differ between the two\n", differ);
+}
+
+static void timeForwardBurst() {
+    InternetProtocol ip;
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    for (const auto& p : prefixes) {
+        ip.addRoute(benchIpString(p.network) + "/" + std::to_string(p.prefix_len), benchInterface(p.prefix_len));
+    }
+
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, 1024, 3);
+    std::vector<std::vector<uint8_t>> templates;
+    for (size_t i = 0; i < dsts.size(); i++) {
+        UDPPacketBuilder builder;
+        builder.ipv4_src_ip = "192.168.1.100";
+        builder.ipv4_dst_ip = benchIpString(dsts[i]);
+        builder.ipv4_ttl = (i % 64 == 0) ? 1 : 64;
+        builder.udp_src_port = static_cast<uint16_t>(1024 + i);
+        builder.udp_dst_port = 53;
+        builder.udp_payload = "query";
+        templates.push_back(builder.build());
+    }
+
+    PacketPool pool(POOL_BUFFERS);
+    PacketHandle burst[IP_MAX_BURST];
+    PacketView views[IP_MAX_BURST];
+    BurstResult result;
+    for (bool rewrite : {false, true}) {
+        uint64_t forwarded = 0, bad = 0;
+        uint64_t start = benchNowNs();
+        for (size_t n = 0; n < PACKETS; n += IP_MAX_BURST) {
+            for (size_t i = 0; i < IP_MAX_BURST; i++) {
+                const std::vector<uint8_t>& bytes = templates[(n + i) % templates.size()];
+                burst[i] = pool.copyIn(bytes.data(), bytes.size());
+                views[i] = burst[i].view();
+            }
+            if (rewrite) {
+                ip.forwardBurst(burst, IP_MAX_BURST, result);
+            } else {
+                ip.processBurst(views, IP_MAX_BURST, result);
+            }
+            forwarded += result.forwarded;
+            for (size_t i = 0; i < result.forwarded; i++) {
+                const PacketHandle& packet = burst[result.order[i]];
+                bad += rewrite && (packet->data()[offsetof(IPv4Header, ttl)] != 63 ||
+                                   internetChecksum(packet->data(), IPv4_HEADER_SIZE) != 0);
+            }
+            for (auto& packet : burst) {
+                packet.reset();
+            }
+        }
+        benchReport(rewrite ? "forwardBurst (decide + rewrite)" : "processBurst (decide only)", PACKETS,
+                    benchNowNs() - start);
+        std::printf("      %llu forwarded, %llu with a wrong TTL or checksum\n",
+                    static_cast<unsigned long long>(forwarded), static_cast<unsigned long long>(bad));
+    }
+}
+
+int main() {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    std::printf("=== TTL decrement and checksum update ===\n");
+    bool ok = checkAgainstRecomputation();
+    timeRewrites();
+    std::printf("=== Forwarding stage (%zu prefixes, bursts of %zu) ===\n", TABLE_PREFIXES, IP_MAX_BURST);
+    timeForwardBurst();
+    std::printf("incremental checksums match recomputation: %s\n", ok ? "ok" : "FAILED");
+    return 0;
+}
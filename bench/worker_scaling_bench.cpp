@@ -0,0 +1,157 @@
+#include "bench_common.hpp"
+#include "forwarding_workers.hpp"
+#include "packet_builders.hpp"
+#include "logger.hpp"
+#include <thread>
+
+/* worker-per-core scaling: one ingress thread copies small UDP/TCP packets of many
+   flows into pooled buffers and shards them over 1..N pinned forwarding workers
+   through SPSC rings. reports packets per second, the speedup over one worker, how
+   evenly the flows spread and how often ingress had to wait for a full ring. every run
+   must reach the same verdicts as forwarding the packets on a single thread */
+
+constexpr size_t TABLE_PREFIXES = 900000;
+constexpr size_t PACKETS = 1 << 22;
+constexpr size_t FLOWS = 1 << 14;
+constexpr size_t POOL_BUFFERS = 1 << 16;
+
+// minimum-size packets of distinct flows, a third TCP and two thirds UDP
+static std::vector<std::vector<uint8_t>> makeFlows(const std::vector<BenchPrefix>& prefixes) {
+    std::vector<uint32_t> dsts = benchDestinations(prefixes, FLOWS, 5);
+    std::mt19937 rng(17);
+    std::vector<std::vector<uint8_t>> flows;
+    for (size_t i = 0; i < FLOWS; i++) {
+        std::string src_ip = benchIpString(0x0A000000 | (rng() & 0xFFFFFF));
+        std::string dst_ip = benchIpString(dsts[i]);
+        if (i % 3 == 0) {
+            TCPPacketBuilder builder;
+            builder.ipv4_src_ip = src_ip;
+            builder.ipv4_dst_ip = dst_ip;
+            builder.tcp_src_port = static_cast<uint16_t>(1024 + rng() % 60000);
+            builder.tcp_dst_port = 443;
+            builder.tcp_flags = TCP_ACK;
+            flows.push_back(builder.build());
+        } else {
+            UDPPacketBuilder builder;
+            builder.ipv4_src_ip = src_ip;
+            builder.ipv4_dst_ip = dst_ip;
+            builder.udp_src_port = static_cast<uint16_t>(1024 + rng() % 60000);
+            builder.udp_dst_port = 53;
+            builder.udp_payload = std::string(18, 'q');
+            flows.push_back(builder.build());
+        }
+    }
+    return flows;
+}
+
+// packet sequence drawn uniformly over the flows
+static std::vector<uint32_t> makeTrace(uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> trace(PACKETS);
+    for (size_t i = 0; i < PACKETS; i++) {
+        trace[i] = rng() % FLOWS;
+    }
+    return trace;
+}
+
+struct RunResult {
+    uint64_t forwarded = 0;
+    uint64_t dropped = 0;
+    double mpps = 0;
+};
+
+static RunResult runSingleThread(InternetProtocol& ip, const std::vector<std::vector<uint8_t>>& flows,
+                                 const std::vector<uint32_t>& trace) {
+    PacketPool pool(POOL_BUFFERS);
+    RunResult result;
+    uint64_t start = benchNowNs();
+    for (uint32_t flow : trace) {
+        PacketHandle packet = pool.copyIn(flows[flow].data(), flows[flow].size());
+        if (ip.forwardPacket(packet.view()).forwarded()) {
+            result.forwarded++;
+        } else {
+            result.dropped++;
+        }
+    }
+    uint64_t elapsed = benchNowNs() - start;
+    result.mpps = PACKETS * 1000.0 / elapsed;
+    benchReport("single thread, no rings", PACKETS, elapsed);
+    return result;
+}
+
+static RunResult runWorkers(InternetProtocol& ip, size_t worker_count, const std::vector<std::vector<uint8_t>>& flows,
+                            const std::vector<uint32_t>& trace) {
+    PacketPool pool(POOL_BUFFERS);
+    WorkerConfig config;
+    config.workers = worker_count;
+    config.first_core = 1;      // core 0 is left to the ingress thread where there are enough cores
+    ForwardingWorkers workers(ip, config);
+    if (!workers.start()) {
+        return {};
+    }
+
+    uint64_t start = benchNowNs();
+    for (uint32_t flow : trace) {
+        PacketHandle packet = pool.copyIn(flows[flow].data(), flows[flow].size());
+        while (!packet) {
+            // every buffer is in flight, wait for the workers to free some
+            std::this_thread::yield();
+            packet = pool.copyIn(flows[flow].data(), flows[flow].size());
+        }
+        workers.dispatch(std::move(packet));
+    }
+    workers.stop();
+    uint64_t elapsed = benchNowNs() - start;
+
+    RunResult result;
+    uint64_t least = UINT64_MAX, most = 0;
+    for (size_t i = 0; i < workers.workerCount(); i++) {
+        const WorkerStats& stats = workers.stats(i);
+        result.forwarded += stats.forwarded;
+        result.dropped += stats.dropped();
+        least = std::min(least, stats.packets);
+        most = std::max(most, stats.packets);
+    }
+    result.mpps = PACKETS * 1000.0 / elapsed;
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "%zu worker%s", worker_count, worker_count == 1 ? "" : "s");
+    benchReport(name, PACKETS, elapsed);
+    std::printf("      %.2f Mpps, busiest worker %.1f%% / idlest %.1f%% of packets, %llu ingress stalls\n",
+                result.mpps, 100.0 * most / PACKETS, 100.0 * least / PACKETS,
+                static_cast<unsigned long long>(workers.ingressStalls()));
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    Logger::getInstance().init("bench_debug.log", LogLevel::WARNING);
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t max_workers = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::max<size_t>(cores - 1, 4);
+    std::printf("=== Worker scaling (%zu packets, %zu flows, %zu prefixes, %zu cores) ===\n",
+                PACKETS, FLOWS, TABLE_PREFIXES, cores);
+    if (max_workers + 1 > cores) {
+        std::printf("note: more threads than cores, workers share cores and cannot scale\n");
+    }
+
+    InternetProtocol ip;
+    std::vector<BenchPrefix> prefixes = benchRandomPrefixes(TABLE_PREFIXES, 42);
+    for (const auto& p : prefixes) {
+        ip.addRoute(benchIpString(p.network) + "/" + std::to_string(p.prefix_len), benchInterface(p.prefix_len));
+    }
+    std::vector<std::vector<uint8_t>> flows = makeFlows(prefixes);
+    std::vector<uint32_t> trace = makeTrace(23);
+
+    RunResult reference = runSingleThread(ip, flows, trace);
+    double one_worker = 0;
+    bool consistent = true;
+    for (size_t n = 1; n <= max_workers; n++) {
+        RunResult result = runWorkers(ip, n, flows, trace);
+        if (n == 1) {
+            one_worker = result.mpps;
+        }
+        std::printf("      speedup over 1 worker: %.2fx\n", result.mpps / one_worker);
+        consistent &= result.forwarded == reference.forwarded && result.dropped == reference.dropped;
+    }
+    std::printf("workers reach the single-thread verdicts: %s\n", consistent ? "ok" : "FAILED");
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include "adjacency_table.hpp"
+#include "logger.hpp"
+#include <algorithm>
+
+AdjacencyTable::AdjacencyTable()
+    : adjacencies(MAX_ADJACENCIES), adjacencies6(MAX_ADJACENCIES), interfaces(MAX_INTERFACES),
+      interface_mtus(MAX_INTERFACES), groups(MAX_NEXTHOP_GROUPS) {}
+
+uint32_t AdjacencyTable::internInterface(const std::string& name) {
+    auto it = interface_ids.find(name);
+    if (it != interface_ids.end()) {
+        return it->second;
+    }
+
+    size_t id = interfaces.append(name);
+    if (id == SIZE_MAX) {
+        log_error("Interface table full, cannot add %s", name.c_str());
+        return MAX_INTERFACES;
+    }
+    // readers only get the id through adjacencies interned later, its MTU is there by then
+    interface_mtus.append(0);
+    interface_ids.emplace(name, static_cast<uint32_t>(id));
+    return static_cast<uint32_t>(id);
+}
+
+bool AdjacencyTable::setInterfaceMtu(uint32_t interface_id, uint32_t mtu) {
+    if (interface_id >= interfaces.size()) {
+        return false;
+    }
+    if (mtu != 0 && mtu < INTERFACE_MIN_MTU) {
+        log_error("MTU %u of %s is below the minimum of %u", mtu, interfaces[interface_id].c_str(), INTERFACE_MIN_MTU);
+        return false;
+    }
+    uint32_t& slot = interface_mtus.element(interface_id);
+    uint32_t old_mtu = __atomic_load_n(&slot, __ATOMIC_RELAXED);
+    if ((old_mtu == 0) != (mtu == 0)) {
+        limited_interfaces.fetch_add(mtu != 0 ? 1 : static_cast<uint32_t>(-1), std::memory_order_relaxed);
+    }
+    __atomic_store_n(&slot, mtu, __ATOMIC_RELAXED);
+    return true;
+}
+
+AdjacencyHandle AdjacencyTable::intern(uint32_t interface_id, uint32_t next_hop) {
+    if (interface_id >= interfaces.size()) {
+        return NO_ADJACENCY;
+    }
+
+    uint64_t key = (static_cast<uint64_t>(interface_id) << 32) | next_hop;
+    auto it = adjacency_ids.find(key);
+    if (it != adjacency_ids.end()) {
+        return it->second;
+    }
+
+    Adjacency adjacency = {next_hop, static_cast<uint16_t>(interface_id), 0};
+    size_t handle = adjacencies.append(adjacency);
+    if (handle == SIZE_MAX) {
+        log_error("Adjacency table full (%u entries)", MAX_ADJACENCIES);
+        return NO_ADJACENCY;
+    }
+    adjacency_ids.emplace(key, static_cast<AdjacencyHandle>(handle));
+    return static_cast<AdjacencyHandle>(handle);
+}
+
+AdjacencyHandle AdjacencyTable::intern(const std::string& interface, uint32_t next_hop) {
+    return intern(internInterface(interface), next_hop);
+}
+
+AdjacencyHandle AdjacencyTable::intern6(uint32_t interface_id, const IPv6Address& next_hop) {
+    if (interface_id >= interfaces.size()) {
+        return NO_ADJACENCY;
+    }
+
+    auto key = std::make_tuple(interface_id, next_hop.high(), next_hop.low());
+    auto it = adjacency6_ids.find(key);
+    if (it != adjacency6_ids.end()) {
+        return it->second;
+    }
+
+    Adjacency6 adjacency = {next_hop, static_cast<uint16_t>(interface_id), 0};
+    size_t handle = adjacencies6.append(adjacency);
+    if (handle == SIZE_MAX) {
+        log_error("IPv6 adjacency table full (%u entries)", MAX_ADJACENCIES);
+        return NO_ADJACENCY;
+    }
+    adjacency6_ids.emplace(key, static_cast<AdjacencyHandle>(handle));
+    return static_cast<AdjacencyHandle>(handle);
+}
+
+AdjacencyHandle AdjacencyTable::internGroup(std::vector<AdjacencyHandle> members) {
+    // the same set in any order is the same group
+    std::sort(members.begin(), members.end());
+    members.erase(std::unique(members.begin(), members.end()), members.end());
+    if (members.empty()) {
+        return NO_ADJACENCY;
+    }
+    if (members.size() > NEXTHOP_GROUP_MAX_MEMBERS) {
+        log_warning("Next-hop group of %zu paths truncated to %u", members.size(), NEXTHOP_GROUP_MAX_MEMBERS);
+        members.resize(NEXTHOP_GROUP_MAX_MEMBERS);
+    }
+    if (members.size() == 1) {
+        return members.front();
+    }
+
+    auto it = group_ids.find(members);
+    if (it != group_ids.end()) {
+        return it->second;
+    }
+
+    NextHopGroup group = {};
+    group.count = static_cast<uint32_t>(members.size());
+    std::copy(members.begin(), members.end(), group.members);
+    size_t index = groups.append(group);
+    if (index == SIZE_MAX) {
+        log_error("Next-hop group table full (%u groups)", MAX_NEXTHOP_GROUPS);
+        return NO_ADJACENCY;
+    }
+
+    AdjacencyHandle handle = static_cast<AdjacencyHandle>(index) | NEXTHOP_GROUP_FLAG;
+    group_ids.emplace(std::move(members), handle);
+    return handle;
+}
+
+std::vector<AdjacencyHandle> AdjacencyTable::members(AdjacencyHandle handle) const {
+    if (!isGroup(handle)) {
+        return {handle};
+    }
+    return groupMembers(groups[handle & ~NEXTHOP_GROUP_FLAG]);
+}
+
+// a count past the member array (a corrupt snapshot record) is cut to the array
+std::vector<AdjacencyHandle> AdjacencyTable::groupMembers(const NextHopGroup& group) {
+    return std::vector<AdjacencyHandle>(group.members, group.members + std::min(group.count, NEXTHOP_GROUP_MAX_MEMBERS));
+}
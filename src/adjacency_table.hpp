@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "chunked_array.hpp"
+#include "lpm_table.hpp"
+#include "ipv6_address.hpp"
+
+/* Interned interfaces and adjacencies.
+   every interface name gets a small integer id, and every distinct (interface, next hop)
+   pair an AdjacencyHandle. The FIB stores handles, so a lookup yields a 32-bit value
+   that indexes an 8-byte Adjacency, and names are only touched when printing.
+
+   Equal-cost multipath routes install a next-hop group instead: a handle with
+   NEXTHOP_GROUP_FLAG set that names a precomputed list of up to NEXTHOP_GROUP_MAX_MEMBERS
+   member adjacencies and their count. select() scales the flow hash to the count,
+   (hash * count) >> 32, so every member takes an even share of the flows for any
+   number of paths, 3 and 7 included, and picking a path is a multiply and one load
+   from the group's first cache line.
+
+   Interning happens on the control plane under the routing table's update lock.
+   Entries are never moved or removed, so readers can resolve a handle without locks.
+   Adjacencies and groups are bounded by the distinct (interface, next hop) pairs and
+   member sets ever installed.
+
+   IPv6 routes have their own adjacencies (Adjacency6, a 128-bit next hop) in a separate
+   handle space resolved with get6(), the interfaces are shared. Groups are shared too:
+   a group only lists member handles, which the family of the route that installed it
+   resolves.
+
+   Every interface also has an MTU, the largest IP packet it sends. 0, the default, is no
+   limit. It can change at any time, readers load it with one relaxed atomic load. */
+
+using AdjacencyHandle = uint32_t;
+constexpr AdjacencyHandle NO_ADJACENCY = LPM_NO_ROUTE;
+constexpr AdjacencyHandle NEXTHOP_GROUP_FLAG = (LPM_MAX_VALUE + 1) >> 1;
+constexpr uint32_t MAX_ADJACENCIES = NEXTHOP_GROUP_FLAG;
+constexpr uint32_t MAX_NEXTHOP_GROUPS = NEXTHOP_GROUP_FLAG;
+constexpr uint32_t MAX_INTERFACES = 1u << 16;
+constexpr uint32_t NEXTHOP_GROUP_MAX_MEMBERS = 16;
+constexpr uint32_t INTERFACE_MIN_MTU = 68;     // every IPv4 host has to take a 68 byte packet unfragmented (RFC 791)
+
+struct Adjacency {
+    uint32_t next_hop;      // 0 for directly connected networks
+    uint16_t interface_id;
+    uint16_t reserved;
+};
+
+struct Adjacency6 {
+    IPv6Address next_hop;   // all zero for directly connected networks
+    uint16_t interface_id;
+    uint16_t reserved;
+};
+
+// members sorted by handle, the slots past count are 0
+struct alignas(64) NextHopGroup {
+    uint32_t count;
+    AdjacencyHandle members[NEXTHOP_GROUP_MAX_MEMBERS];
+};
+
+class AdjacencyTable {
+public:
+    AdjacencyTable();
+
+    // return NO_ADJACENCY / MAX_INTERFACES when the tables are full
+    uint32_t internInterface(const std::string& name);
+    // id of an interned interface, MAX_INTERFACES for an unknown name. control plane, like interning
+    uint32_t findInterface(const std::string& name) const {
+        auto it = interface_ids.find(name);
+        return it == interface_ids.end() ? MAX_INTERFACES : it->second;
+    }
+    AdjacencyHandle intern(uint32_t interface_id, uint32_t next_hop);
+    AdjacencyHandle intern(const std::string& interface, uint32_t next_hop);
+    AdjacencyHandle intern6(uint32_t interface_id, const IPv6Address& next_hop);
+    /* handle for a set of equal-cost adjacencies: the adjacency itself for a single
+       member, otherwise a group. members beyond NEXTHOP_GROUP_MAX_MEMBERS are dropped */
+    AdjacencyHandle internGroup(std::vector<AdjacencyHandle> members);
+
+    // the adjacency a flow with this hash takes, handle must not be NO_ADJACENCY
+    AdjacencyHandle select(AdjacencyHandle handle, uint32_t flow_hash) const {
+        if (!(handle & NEXTHOP_GROUP_FLAG)) {
+            return handle;
+        }
+        const NextHopGroup& group = groups[handle & ~NEXTHOP_GROUP_FLAG];
+        return group.members[(static_cast<uint64_t>(flow_hash) * group.count) >> 32];
+    }
+    static bool isGroup(AdjacencyHandle handle) { return handle != NO_ADJACENCY && (handle & NEXTHOP_GROUP_FLAG); }
+    // member adjacencies of a group handle in handle order, a plain adjacency is its own only member
+    std::vector<AdjacencyHandle> members(AdjacencyHandle handle) const;
+    const NextHopGroup& group(uint32_t index) const { return groups[index]; }
+    static std::vector<AdjacencyHandle> groupMembers(const NextHopGroup& group);
+
+    // plain adjacency handles only, resolve groups with select() first
+    const Adjacency& get(AdjacencyHandle handle) const { return adjacencies[handle]; }
+    const Adjacency6& get6(AdjacencyHandle handle) const { return adjacencies6[handle]; }
+    const std::string& interfaceName(uint32_t interface_id) const { return interfaces[interface_id]; }
+    const std::string& interfaceOf(AdjacencyHandle handle) const { return interfaces[get(handle).interface_id]; }
+
+    /* 0 lifts the limit, anything else below INTERFACE_MIN_MTU is refused (false). the
+       interface must be interned */
+    bool setInterfaceMtu(uint32_t interface_id, uint32_t mtu);
+    uint32_t interfaceMtu(uint32_t interface_id) const {
+        return __atomic_load_n(&interface_mtus[interface_id], __ATOMIC_RELAXED);
+    }
+    // false while no interface has an MTU, the data plane then skips its MTU checks
+    bool mtuLimited() const { return limited_interfaces.load(std::memory_order_relaxed) > 0; }
+
+    size_t size() const { return adjacencies.size(); }
+    size_t size6() const { return adjacencies6.size(); }
+    size_t interfaceCount() const { return interfaces.size(); }
+    size_t groupCount() const { return groups.size(); }
+
+private:
+    ChunkedArray<Adjacency, 10> adjacencies;
+    ChunkedArray<Adjacency6, 10> adjacencies6;
+    ChunkedArray<std::string, 6> interfaces;
+    ChunkedArray<uint32_t, 10> interface_mtus;
+    std::atomic<uint32_t> limited_interfaces{0};
+    ChunkedArray<NextHopGroup, 10> groups;
+    std::unordered_map<std::string, uint32_t> interface_ids;
+    std::unordered_map<uint64_t, AdjacencyHandle> adjacency_ids;
+    std::map<std::tuple<uint32_t, uint64_t, uint64_t>, AdjacencyHandle> adjacency6_ids;
+    std::map<std::vector<AdjacencyHandle>, AdjacencyHandle> group_ids;
+};
@@ -0,0 +1,342 @@
+#include "af_packet_port.hpp"
+#include "internet_protocol.hpp"
+#include "logger.hpp"
+#include <cerrno>
+#include <cstring>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// the frame header a send slot starts with, the Ethernet frame follows it
+constexpr size_t TX_DATA_OFFSET = TPACKET_ALIGN(sizeof(struct tpacket3_hdr));
+constexpr size_t RX_FRAME_SIZE = 2048;
+constexpr size_t TX_BLOCK_SIZE = 1 << 16;
+
+bool AfPacketPort::open(const std::string& interface, const AfPacketConfig& config) {
+    close();
+    unsigned int ifindex = if_nametoindex(interface.c_str());
+    if (ifindex == 0) {
+        log_error("No interface %s: %s", interface.c_str(), std::strerror(errno));
+        return false;
+    }
+    // protocol 0 receives nothing until bind, so no other interface's frames land in the ring
+    socket_fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (socket_fd < 0) {
+        log_error("AF_PACKET socket for %s failed: %s", interface.c_str(), std::strerror(errno));
+        return false;
+    }
+    interface_name = interface;
+
+    int version = TPACKET_V3;
+    int one = 1;
+    if (setsockopt(socket_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+        log_error("TPACKET_V3 not available on %s: %s", interface.c_str(), std::strerror(errno));
+        close();
+        return false;
+    }
+    // a malformed send frame is skipped instead of stopping the ring
+    setsockopt(socket_fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one));
+#ifdef PACKET_IGNORE_OUTGOING
+    // the host's own transmissions on the interface are not traffic for the router
+    setsockopt(socket_fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+    if (config.qdisc_bypass && setsockopt(socket_fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one)) != 0) {
+        log_warning("No qdisc bypass on %s: %s", interface.c_str(), std::strerror(errno));
+    }
+    if (!setupRings(config)) {
+        close();
+        return false;
+    }
+
+    struct ifreq request = {};
+    std::strncpy(request.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+    if (ioctl(socket_fd, SIOCGIFHWADDR, &request) == 0) {
+        std::memcpy(own_mac, request.ifr_hwaddr.sa_data, ETHERNET_ADDRESS_SIZE);
+    }
+    if (ioctl(socket_fd, SIOCGIFMTU, &request) == 0 && request.ifr_mtu > 0) {
+        link_mtu = static_cast<uint32_t>(request.ifr_mtu);
+    }
+
+    struct sockaddr_ll address = {};
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_ALL);
+    address.sll_ifindex = static_cast<int>(ifindex);
+    if (bind(socket_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        log_error("Failed to bind to %s: %s", interface.c_str(), std::strerror(errno));
+        close();
+        return false;
+    }
+    if (config.promiscuous) {
+        struct packet_mreq membership = {};
+        membership.mr_ifindex = static_cast<int>(ifindex);
+        membership.mr_type = PACKET_MR_PROMISC;
+        if (setsockopt(socket_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0) {
+            log_warning("Promiscuous mode failed on %s: %s", interface.c_str(), std::strerror(errno));
+        }
+    }
+    log_info("Port %s open: %zu x %zu byte receive blocks, %zu send frames", interface.c_str(),
+             block_count, block_size, tx_frame_count);
+    return true;
+}
+
+bool AfPacketPort::setupRings(const AfPacketConfig& config) {
+    struct tpacket_req3 rx = {};
+    rx.tp_block_size = static_cast<unsigned int>(config.block_size);
+    rx.tp_block_nr = static_cast<unsigned int>(config.block_count);
+    rx.tp_frame_size = RX_FRAME_SIZE;
+    rx.tp_frame_nr = static_cast<unsigned int>(config.block_size / RX_FRAME_SIZE * config.block_count);
+    rx.tp_retire_blk_tov = config.block_timeout_ms;
+    if (setsockopt(socket_fd, SOL_PACKET, PACKET_RX_RING, &rx, sizeof(rx)) != 0) {
+        log_error("Receive ring for %s failed: %s", interface_name.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    size_t tx_block = std::max(TX_BLOCK_SIZE, config.tx_frame_size);
+    size_t frames_per_block = tx_block / config.tx_frame_size;
+    struct tpacket_req3 tx = {};
+    tx.tp_block_size = static_cast<unsigned int>(tx_block);
+    tx.tp_block_nr = static_cast<unsigned int>((config.tx_frame_count + frames_per_block - 1) / frames_per_block);
+    tx.tp_frame_size = static_cast<unsigned int>(config.tx_frame_size);
+    tx.tp_frame_nr = static_cast<unsigned int>(tx.tp_block_nr * frames_per_block);
+    if (setsockopt(socket_fd, SOL_PACKET, PACKET_TX_RING, &tx, sizeof(tx)) != 0) {
+        log_error("Send ring for %s failed: %s", interface_name.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    // one mapping, the receive ring first
+    size_t rx_size = static_cast<size_t>(rx.tp_block_size) * rx.tp_block_nr;
+    size_t tx_size = static_cast<size_t>(tx.tp_block_size) * tx.tp_block_nr;
+    void* mapped = mmap(nullptr, rx_size + tx_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, socket_fd, 0);
+    if (mapped == MAP_FAILED) {
+        log_error("Mapping the rings of %s failed: %s", interface_name.c_str(), std::strerror(errno));
+        return false;
+    }
+    ring = static_cast<uint8_t*>(mapped);
+    ring_size = rx_size + tx_size;
+    rx_ring = ring;
+    block_size = rx.tp_block_size;
+    block_count = rx.tp_block_nr;
+    tx_ring = ring + rx_size;
+    tx_frame_size = tx.tp_frame_size;
+    tx_frame_count = tx.tp_frame_nr;
+    return true;
+}
+
+void AfPacketPort::close() {
+    if (ring) {
+        munmap(ring, ring_size);
+        ring = rx_ring = tx_ring = nullptr;
+    }
+    if (socket_fd >= 0) {
+        ::close(socket_fd);
+        socket_fd = -1;
+    }
+    block_index = tx_index = tx_pending = 0;
+    block_packets_left = 0;
+    release_pending = false;
+}
+
+void AfPacketPort::setPeerMac(const uint8_t* mac) {
+    std::memcpy(peer_mac, mac, ETHERNET_ADDRESS_SIZE);
+}
+
+void AfPacketPort::releaseBlock() {
+    auto* block = reinterpret_cast<struct tpacket_block_desc*>(rx_ring + block_index * block_size);
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    block_index = (block_index + 1) % block_count;
+    release_pending = false;
+}
+
+size_t AfPacketPort::receive(PacketView* packets, size_t count) {
+    if (!ring) {
+        return 0;
+    }
+    if (release_pending) {
+        releaseBlock();
+    }
+    if (block_packets_left == 0) {
+        auto* block = reinterpret_cast<struct tpacket_block_desc*>(rx_ring + block_index * block_size);
+        if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            return 0;
+        }
+        block_packets_left = block->hdr.bh1.num_pkts;
+        next_frame = reinterpret_cast<uint8_t*>(block) + block->hdr.bh1.offset_to_first_pkt;
+    }
+
+    // the views of one call all come from one block
+    size_t done = 0;
+    while (done < count && block_packets_left > 0) {
+        auto* header = reinterpret_cast<struct tpacket3_hdr*>(next_frame);
+        uint16_t ethertype = 0;
+        PacketView payload = ethernetPayload(PacketView(next_frame + header->tp_mac, header->tp_snaplen), ethertype);
+        PacketView packet = ipPacket(payload, ethertype);
+        next_frame += header->tp_next_offset;
+        block_packets_left--;
+        if (packet.empty()) {
+            counters.rx_non_ip++;
+            continue;
+        }
+        packets[done++] = packet;
+        counters.rx_bytes += packet.size();
+    }
+    counters.rx_packets += done;
+    release_pending = block_packets_left == 0;
+    return done;
+}
+
+uint8_t* AfPacketPort::reserve(size_t length, uint16_t ethertype) {
+    if (!ring) {
+        return nullptr;
+    }
+    if (TX_DATA_OFFSET + ETHERNET_HEADER_SIZE + length > tx_frame_size) {
+        counters.tx_too_big++;
+        return nullptr;
+    }
+    auto* header = reinterpret_cast<struct tpacket3_hdr*>(tx_ring + tx_index * tx_frame_size);
+    uint32_t status = __atomic_load_n(&header->tp_status, __ATOMIC_ACQUIRE);
+    if (status == TP_STATUS_SEND_REQUEST && tx_pending > 0) {
+        // the ring went round on frames not kicked yet
+        flush();
+        status = __atomic_load_n(&header->tp_status, __ATOMIC_ACQUIRE);
+    }
+    if (status == TP_STATUS_WRONG_FORMAT) {
+        counters.tx_errors++;
+    } else if (status != TP_STATUS_AVAILABLE) {
+        counters.tx_ring_full++;
+        return nullptr;
+    }
+
+    uint8_t* frame = tx_ring + tx_index * tx_frame_size + TX_DATA_OFFSET;
+    std::memcpy(frame, peer_mac, ETHERNET_ADDRESS_SIZE);
+    std::memcpy(frame + ETHERNET_ADDRESS_SIZE, own_mac, ETHERNET_ADDRESS_SIZE);
+    frame[12] = static_cast<uint8_t>(ethertype >> 8);
+    frame[13] = static_cast<uint8_t>(ethertype);
+    reserved_length = length;
+    return frame + ETHERNET_HEADER_SIZE;
+}
+
+void AfPacketPort::commit() {
+    auto* header = reinterpret_cast<struct tpacket3_hdr*>(tx_ring + tx_index * tx_frame_size);
+    header->tp_len = static_cast<uint32_t>(ETHERNET_HEADER_SIZE + reserved_length);
+    header->tp_next_offset = 0;
+    __atomic_store_n(&header->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    tx_index = (tx_index + 1) % tx_frame_count;
+    tx_pending++;
+    counters.tx_packets++;
+    counters.tx_bytes += reserved_length;
+}
+
+bool AfPacketPort::send(PacketView packet) {
+    uint16_t ethertype = (packet.u8(0) >> 4) == 6 ? ETHERTYPE_IPV6 : ETHERTYPE_IPV4;
+    uint8_t* out = reserve(packet.size(), ethertype);
+    if (!out) {
+        return false;
+    }
+    std::memcpy(out, packet.data(), packet.size());
+    commit();
+    return true;
+}
+
+size_t AfPacketPort::flush() {
+    size_t kicked = tx_pending;
+    if (kicked == 0) {
+        return 0;
+    }
+    tx_pending = 0;
+    // without waiting, the kernel sends every frame marked SEND_REQUEST
+    if (sendto(socket_fd, nullptr, 0, MSG_DONTWAIT, nullptr, 0) < 0 && errno != EAGAIN && errno != ENOBUFS) {
+        counters.tx_errors++;
+        log_warning("Send on %s failed: %s", interface_name.c_str(), std::strerror(errno));
+    }
+    return kicked;
+}
+
+const AfPacketStats& AfPacketPort::stats() {
+    // the kernel resets its counters on every read
+    struct tpacket_stats_v3 kernel = {};
+    socklen_t length = sizeof(kernel);
+    if (socket_fd >= 0 && getsockopt(socket_fd, SOL_PACKET, PACKET_STATISTICS, &kernel, &length) == 0) {
+        counters.rx_kernel_drops += kernel.tp_drops;
+    }
+    return counters;
+}
+
+AfPacketPort* AfPacketEgress::portFor(uint16_t interface_id) {
+    if (interface_id >= port_of.size()) {
+        port_of.resize(interface_id + 1, -2);
+    }
+    if (port_of[interface_id] == -2) {
+        port_of[interface_id] = -1;
+        const std::string& name = adjacencies.interfaceName(interface_id);
+        for (size_t i = 0; i < ports.size(); i++) {
+            if (ports[i]->name() == name) {
+                port_of[interface_id] = static_cast<int32_t>(i);
+            }
+        }
+    }
+    return port_of[interface_id] < 0 ? nullptr : ports[port_of[interface_id]];
+}
+
+void AfPacketEgress::consume(const VerdictRecord* records, const PacketView* packets, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const ForwardingVerdict& verdict = records[i].verdict;
+        if (!verdict.forwarded()) {
+            continue;
+        }
+        AfPacketPort* port = portFor(verdict.interface_id);
+        if (!port) {
+            unbound_packets++;
+            continue;
+        }
+        // forwarded packets parsed with a TTL above 1, as for forwardBurst
+        PacketView packet = packets[i];
+        if (verdict.flags & VERDICT_FRAGMENT) {
+            sendFragments(*port, packet, adjacencies.interfaceMtu(verdict.interface_id));
+            continue;
+        }
+        bool ipv6 = (packet.u8(0) >> 4) == 6;
+        uint8_t* out = port->reserve(packet.size(), ipv6 ? ETHERTYPE_IPV6 : ETHERTYPE_IPV4);
+        if (!out) {
+            dropped_packets++;
+            continue;
+        }
+        std::memcpy(out, packet.data(), packet.size());
+        if (ipv6) {
+            out[offsetof(IPv6Header, hop_limit)]--;
+        } else {
+            InternetProtocol::decrementTtl(out);
+        }
+        port->commit();
+    }
+}
+
+void AfPacketEgress::sendFragments(AfPacketPort& port, PacketView packet, uint32_t mtu) {
+    if (!fragmenter.start(packet, mtu)) {
+        dropped_packets++;
+        return;
+    }
+    // every fragment is written straight into its send frame, header and payload slice
+    IPv4Fragment fragment;
+    while (fragmenter.next(fragment)) {
+        uint8_t* out = port.reserve(fragment.size(), ETHERTYPE_IPV4);
+        if (!out) {
+            dropped_packets++;
+            return;
+        }
+        fragment.write(out);
+        InternetProtocol::decrementTtl(out);
+        port.commit();
+    }
+    fragmented_packets++;
+    fragments_sent += fragmenter.fragmentCount();
+}
+
+void AfPacketEgress::flush() {
+    for (AfPacketPort* port : ports) {
+        port->flush();
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "adjacency_table.hpp"
+#include "ip_fragmentation.hpp"
+#include "link_layer.hpp"
+#include "packet_view.hpp"
+#include "verdict_sink.hpp"
+
+/* a Linux interface (a veth end, a TAP device, any netdev) as a port of the router,
+   through an AF_PACKET socket with PACKET_MMAP TPACKET_V3 rings. the kernel fills
+   blocks of the receive ring and hands whole blocks over, receive() gives out views of
+   the IP packets inside the frames without copying them. transmit frames are filled in
+   place in the send ring and go to the kernel a batch at a time with flush(). needs
+   CAP_NET_RAW, and CAP_NET_ADMIN for the queueing discipline bypass */
+
+struct AfPacketConfig {
+    size_t block_size = 1 << 20;            // receive ring block, a multiple of the page size
+    size_t block_count = 64;
+    uint32_t block_timeout_ms = 1;          // a block that is not full goes to user space after this
+    size_t tx_frame_size = 2048;            // send slot: frame header, Ethernet header and the packet
+    size_t tx_frame_count = 4096;
+    bool promiscuous = true;
+    bool qdisc_bypass = true;               // frames go straight to the driver, no queueing discipline
+};
+
+struct AfPacketStats {
+    uint64_t rx_packets = 0;
+    uint64_t rx_bytes = 0;                  // IP bytes
+    uint64_t rx_non_ip = 0;                 // ARP, neighbour discovery over other ethertypes and such, skipped
+    uint64_t rx_kernel_drops = 0;           // the ring was full when the kernel had a frame for it
+    uint64_t tx_packets = 0;
+    uint64_t tx_bytes = 0;                  // IP bytes
+    uint64_t tx_ring_full = 0;              // no free send slot, the packet was dropped
+    uint64_t tx_too_big = 0;                // larger than a send slot
+    uint64_t tx_errors = 0;                 // frames the kernel refused, failed kicks
+};
+
+class AfPacketPort {
+public:
+    AfPacketPort() = default;
+    ~AfPacketPort() { close(); }
+    AfPacketPort(const AfPacketPort&) = delete;
+    AfPacketPort& operator=(const AfPacketPort&) = delete;
+
+    bool open(const std::string& interface, const AfPacketConfig& config = AfPacketConfig());
+    void close();
+
+    bool isOpen() const { return socket_fd >= 0; }
+    int fd() const { return socket_fd; }
+    const std::string& name() const { return interface_name; }
+    const uint8_t* mac() const { return own_mac; }
+    // the interface's MTU as the kernel has it, 0 when it could not be read
+    uint32_t mtu() const { return link_mtu; }
+    // destination address of the frames sent, broadcast until set, there is no ARP
+    void setPeerMac(const uint8_t* mac);
+
+    /* up to count received IP packets, the views point into the ring and stay valid until
+       the next receive(). frames without IPv4 or IPv6 are skipped */
+    size_t receive(PacketView* packets, size_t count);
+
+    /* a send slot for an IP packet of length bytes with the Ethernet header in front of it
+       written, where the packet goes. nullptr when it does not fit or no slot is free */
+    uint8_t* reserve(size_t length, uint16_t ethertype);
+    // the reserved frame is complete, it goes out with the next flush()
+    void commit();
+    // reserve + copy + commit
+    bool send(PacketView packet);
+    // hands the committed frames to the kernel, how many there were
+    size_t flush();
+    size_t pendingFrames() const { return tx_pending; }
+
+    // the counters, with the kernel's drop count collected on the way
+    const AfPacketStats& stats();
+
+private:
+    int socket_fd = -1;
+    std::string interface_name;
+    uint8_t own_mac[ETHERNET_ADDRESS_SIZE] = {};
+    uint8_t peer_mac[ETHERNET_ADDRESS_SIZE] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    uint32_t link_mtu = 0;
+    uint8_t* ring = nullptr;
+    size_t ring_size = 0;
+
+    uint8_t* rx_ring = nullptr;
+    size_t block_size = 0;
+    size_t block_count = 0;
+    size_t block_index = 0;
+    uint32_t block_packets_left = 0;
+    uint8_t* next_frame = nullptr;
+    bool release_pending = false;           // the current block is read, back to the kernel on the next receive()
+
+    uint8_t* tx_ring = nullptr;
+    size_t tx_frame_size = 0;
+    size_t tx_frame_count = 0;
+    size_t tx_index = 0;
+    size_t tx_pending = 0;
+    size_t reserved_length = 0;
+
+    AfPacketStats counters;
+
+    void releaseBlock();
+    bool setupRings(const AfPacketConfig& config);
+};
+
+/* sends what the pipeline forwarded out of the port bound to each packet's output
+   interface, the port whose Linux interface name is the routing table's interface name.
+   the packet is copied once, from the receive ring into a send frame, and its TTL or hop
+   limit is decremented there, the IPv4 header checksum patched incrementally. packets
+   the pipeline marked VERDICT_FRAGMENT go out as fragments for the interface's MTU,
+   each one's header and payload slice written into its own send frame (IPv4Fragmenter),
+   which copies the payload no more often than sending the packet whole */
+class AfPacketEgress : public VerdictSink {
+public:
+    explicit AfPacketEgress(const AdjacencyTable& adjacencies) : adjacencies(adjacencies) {}
+
+    void addPort(AfPacketPort& port) { ports.push_back(&port); }
+    void consume(const VerdictRecord* records, const PacketView* packets, size_t count) override;
+    // kicks every port with frames waiting
+    void flush();
+
+    // forwarded to interfaces without a port, or lost to a full send ring
+    uint64_t unbound() const { return unbound_packets; }
+    uint64_t dropped() const { return dropped_packets; }
+    // packets sent as fragments and the fragments that made them up
+    uint64_t fragmented() const { return fragmented_packets; }
+    uint64_t fragments() const { return fragments_sent; }
+
+private:
+    const AdjacencyTable& adjacencies;
+    std::vector<AfPacketPort*> ports;
+    std::vector<int32_t> port_of;           // by interface id: index into ports, -1 none, -2 not looked up yet
+    uint64_t unbound_packets = 0;
+    uint64_t dropped_packets = 0;
+    uint64_t fragmented_packets = 0;
+    uint64_t fragments_sent = 0;
+    IPv4Fragmenter fragmenter;
+
+    AfPacketPort* portFor(uint16_t interface_id);
+    void sendFragments(AfPacketPort& port, PacketView packet, uint32_t mtu);
+};
@@ -0,0 +1,321 @@
+#include "fib_snapshot.hpp"
+#include "mapped_file.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <type_traits>
+#include <unordered_set>
+
+static uint64_t alignUp(uint64_t offset) {
+    return (offset + FIB_SNAPSHOT_ALIGN - 1) & ~(FIB_SNAPSHOT_ALIGN - 1);
+}
+
+static void padTo(std::ofstream& out, uint64_t offset) {
+    static const char zeros[FIB_SNAPSHOT_ALIGN] = {};
+    uint64_t position = static_cast<uint64_t>(out.tellp());
+    if (offset > position) {
+        out.write(zeros, static_cast<std::streamsize>(offset - position));
+    }
+}
+
+// route and adjacency records are written and mapped as raw memory
+static_assert(std::is_trivially_copyable<RouteEntry>::value && sizeof(RouteEntry) == 16, "RouteEntry layout");
+static_assert(std::is_trivially_copyable<Adjacency>::value && sizeof(Adjacency) == 8, "Adjacency layout");
+static_assert(std::is_trivially_copyable<NextHopGroup>::value && sizeof(NextHopGroup) == 128, "NextHopGroup layout");
+
+template <typename T>
+static void writeArray(std::ofstream& out, const T* data, size_t count) {
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+bool FibSnapshot::save(RoutingTable& table, const std::string& path) {
+    std::lock_guard<std::mutex> lock(table.update_mutex);
+    table.ensureRib();
+    const LpmTable& lpm = table.fib;
+    const AdjacencyTable& adjacencies = table.adjacency_table;
+
+    // grouped by prefix in candidate order so the RIB can be rebuilt from the records alone
+    std::vector<RouteEntry> records;
+    records.reserve(table.route_count);
+    for (const auto& [key, candidates] : table.prefix_routes) {
+        records.insert(records.end(), candidates.begin(), candidates.end());
+    }
+
+    std::vector<Adjacency> adjacency_records(adjacencies.size());
+    for (size_t i = 0; i < adjacency_records.size(); i++) {
+        adjacency_records[i] = adjacencies.get(static_cast<AdjacencyHandle>(i));
+    }
+
+    std::vector<NextHopGroup> group_records(adjacencies.groupCount());
+    for (size_t i = 0; i < group_records.size(); i++) {
+        group_records[i] = adjacencies.group(static_cast<uint32_t>(i));
+    }
+
+    std::vector<FibSnapshotInterface> interfaces(adjacencies.interfaceCount());
+    std::string names;
+    for (size_t i = 0; i < interfaces.size(); i++) {
+        const std::string& name = adjacencies.interfaceName(static_cast<uint32_t>(i));
+        interfaces[i] = {static_cast<uint32_t>(names.size()), static_cast<uint32_t>(name.size())};
+        names += name;
+    }
+
+    // groups not referenced from tbl24 (free or waiting on a grace period) are free in the snapshot
+    uint32_t groups = lpm.tbl8_groups_used;
+    std::vector<bool> referenced(groups, false);
+    for (uint32_t i = 0; i < LPM_TBL24_ENTRIES; i++) {
+        if (lpm.tbl24[i] & LPM_ENTRY_EXTENDED) {
+            referenced[lpm.tbl24[i] & LPM_ENTRY_VALUE_MASK] = true;
+        }
+    }
+    std::vector<uint32_t> free_groups;
+    for (uint32_t g = 0; g < groups; g++) {
+        if (!referenced[g]) {
+            free_groups.push_back(g);
+        }
+    }
+
+    FibSnapshotHeader header = {};
+    std::memcpy(header.magic, FIB_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = FIB_SNAPSHOT_VERSION;
+    header.header_size = sizeof(FibSnapshotHeader);
+    header.route_count = static_cast<uint32_t>(records.size());
+    header.tbl8_groups = groups;
+    header.free_group_count = static_cast<uint32_t>(free_groups.size());
+    header.adjacency_count = static_cast<uint32_t>(adjacency_records.size());
+    header.interface_count = static_cast<uint32_t>(interfaces.size());
+    header.group_count = static_cast<uint32_t>(group_records.size());
+    header.tbl24_offset = alignUp(sizeof(FibSnapshotHeader));
+    header.tbl8_offset = alignUp(header.tbl24_offset + uint64_t(LPM_TBL24_ENTRIES) * sizeof(uint32_t));
+    header.free_groups_offset = header.tbl8_offset + uint64_t(groups) * LPM_TBL8_GROUP_ENTRIES * sizeof(uint32_t);
+    header.adjacencies_offset = header.free_groups_offset + free_groups.size() * sizeof(uint32_t);
+    header.groups_offset = header.adjacencies_offset + adjacency_records.size() * sizeof(Adjacency);
+    header.routes_offset = header.groups_offset + group_records.size() * sizeof(NextHopGroup);
+    header.interfaces_offset = header.routes_offset + records.size() * sizeof(RouteEntry);
+    header.strings_offset = header.interfaces_offset + interfaces.size() * sizeof(FibSnapshotInterface);
+    header.strings_size = names.size();
+    header.file_size = header.strings_offset + names.size();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        log_error("Failed to create FIB snapshot %s", path.c_str());
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    padTo(out, header.tbl24_offset);
+    writeArray(out, lpm.tbl24, LPM_TBL24_ENTRIES);
+    padTo(out, header.tbl8_offset);
+    writeArray(out, lpm.tbl8.load(std::memory_order_relaxed), size_t(groups) * LPM_TBL8_GROUP_ENTRIES);
+    writeArray(out, free_groups.data(), free_groups.size());
+    writeArray(out, adjacency_records.data(), adjacency_records.size());
+    writeArray(out, group_records.data(), group_records.size());
+    writeArray(out, records.data(), records.size());
+    writeArray(out, interfaces.data(), interfaces.size());
+    out.write(names.data(), static_cast<std::streamsize>(names.size()));
+    out.close();
+
+    if (!out) {
+        log_error("Failed to write FIB snapshot %s", path.c_str());
+        return false;
+    }
+    log_info("Saved FIB snapshot %s: %u routes, %u adjacencies, %u tbl8 groups",
+             path.c_str(), header.route_count, header.adjacency_count, groups);
+    return true;
+}
+
+// count records of size bytes starting at offset end within the file
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size) {
+    return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+/* everything load() interns or hands to the LPM table, checked before any of it is
+   touched: the records intern to their own ids, groups list their members the way
+   internGroup lays them out, and every FIB entry names a tbl8 group or a handle the
+   snapshot has. groups only the IPv6 table uses have members the snapshot does not
+   carry, so only the groups the FIB refers to must name saved adjacencies */
+static bool checkContents(const FibSnapshotHeader& header, const uint8_t* base, const std::string& path) {
+    const char* names = reinterpret_cast<const char*>(base + header.strings_offset);
+    const auto* interfaces = reinterpret_cast<const FibSnapshotInterface*>(base + header.interfaces_offset);
+    std::unordered_set<std::string> seen_names;
+    for (uint32_t i = 0; i < header.interface_count; i++) {
+        if (uint64_t(interfaces[i].name_offset) + interfaces[i].name_length > header.strings_size ||
+            !seen_names.emplace(names + interfaces[i].name_offset, interfaces[i].name_length).second) {
+            log_error("FIB snapshot %s has a corrupt interface record %u", path.c_str(), i);
+            return false;
+        }
+    }
+
+    const auto* adjacency_records = reinterpret_cast<const Adjacency*>(base + header.adjacencies_offset);
+    std::unordered_set<uint64_t> seen_adjacencies;
+    for (uint32_t i = 0; i < header.adjacency_count; i++) {
+        uint64_t key = (uint64_t(adjacency_records[i].interface_id) << 32) | adjacency_records[i].next_hop;
+        if (adjacency_records[i].interface_id >= header.interface_count || !seen_adjacencies.insert(key).second) {
+            log_error("FIB snapshot %s has a corrupt adjacency record %u", path.c_str(), i);
+            return false;
+        }
+    }
+
+    std::set<std::vector<AdjacencyHandle>> seen_groups;
+    std::vector<AdjacencyHandle> highest_member(header.group_count);
+    for (uint32_t i = 0; i < header.group_count; i++) {
+        // records are not 64-byte aligned in the file
+        NextHopGroup group;
+        std::memcpy(&group, base + header.groups_offset + uint64_t(i) * sizeof(NextHopGroup), sizeof(group));
+        std::vector<AdjacencyHandle> members = AdjacencyTable::groupMembers(group);
+        // internGroup sorts the members, so a group loads back exactly as it was saved
+        bool valid = group.count == members.size() && members.size() > 1 &&
+                     std::is_sorted(members.begin(), members.end()) &&
+                     std::adjacent_find(members.begin(), members.end()) == members.end() &&
+                     members.back() < MAX_ADJACENCIES;
+        highest_member[i] = valid ? members.back() : 0;
+        if (!valid || !seen_groups.insert(std::move(members)).second) {
+            log_error("FIB snapshot %s has a corrupt next-hop group %u", path.c_str(), i);
+            return false;
+        }
+    }
+
+    const auto* records = reinterpret_cast<const RouteEntry*>(base + header.routes_offset);
+    for (uint32_t i = 0; i < header.route_count; i++) {
+        if (records[i].adjacency >= header.adjacency_count) {
+            log_error("FIB snapshot %s has a corrupt route record %u", path.c_str(), i);
+            return false;
+        }
+    }
+
+    auto validHandle = [&](uint32_t handle) {
+        if (handle & NEXTHOP_GROUP_FLAG) {
+            uint32_t index = handle & ~NEXTHOP_GROUP_FLAG;
+            return index < header.group_count && highest_member[index] < header.adjacency_count;
+        }
+        return handle < header.adjacency_count;
+    };
+    // every tbl8 group is either behind exactly one tbl24 entry or on the free list
+    std::vector<bool> tbl8_taken(header.tbl8_groups, false);
+    const auto* tbl24 = reinterpret_cast<const uint32_t*>(base + header.tbl24_offset);
+    for (uint32_t i = 0; i < LPM_TBL24_ENTRIES; i++) {
+        uint32_t entry = tbl24[i];
+        uint32_t value = entry & LPM_ENTRY_VALUE_MASK;
+        bool valid = true;
+        if (entry & LPM_ENTRY_EXTENDED) {
+            valid = value < header.tbl8_groups && !tbl8_taken[value];
+            if (valid) {
+                tbl8_taken[value] = true;
+            }
+        } else if (entry & LPM_ENTRY_VALID) {
+            valid = validHandle(value);
+        }
+        if (!valid) {
+            log_error("FIB snapshot %s has a corrupt tbl24 entry %u", path.c_str(), i);
+            return false;
+        }
+    }
+    const auto* tbl8 = reinterpret_cast<const uint32_t*>(base + header.tbl8_offset);
+    for (uint64_t i = 0; i < uint64_t(header.tbl8_groups) * LPM_TBL8_GROUP_ENTRIES; i++) {
+        uint32_t entry = tbl8[i];
+        if ((entry & LPM_ENTRY_EXTENDED) || ((entry & LPM_ENTRY_VALID) && !validHandle(entry & LPM_ENTRY_VALUE_MASK))) {
+            log_error("FIB snapshot %s has a corrupt entry in tbl8 group %llu", path.c_str(),
+                      static_cast<unsigned long long>(i / LPM_TBL8_GROUP_ENTRIES));
+            return false;
+        }
+    }
+    const auto* free_list = reinterpret_cast<const uint32_t*>(base + header.free_groups_offset);
+    for (uint32_t i = 0; i < header.free_group_count; i++) {
+        if (free_list[i] >= header.tbl8_groups || tbl8_taken[free_list[i]]) {
+            log_error("FIB snapshot %s has a corrupt free tbl8 group %u", path.c_str(), i);
+            return false;
+        }
+        tbl8_taken[free_list[i]] = true;
+    }
+    return true;
+}
+
+bool FibSnapshot::load(RoutingTable& table, const std::string& path) {
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path, MappedFile::Mode::CopyOnWrite)) {
+        return false;
+    }
+
+    FibSnapshotHeader header;
+    uint64_t file_size = file->size();
+    if (file_size < sizeof(header)) {
+        log_error("FIB snapshot %s is truncated", path.c_str());
+        return false;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, FIB_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != FIB_SNAPSHOT_VERSION || header.header_size != sizeof(FibSnapshotHeader)) {
+        log_error("%s is not a compatible FIB snapshot", path.c_str());
+        return false;
+    }
+    if (header.file_size != file_size || header.tbl24_offset < sizeof(FibSnapshotHeader) ||
+        header.tbl24_offset % FIB_SNAPSHOT_ALIGN != 0 || header.tbl8_offset % FIB_SNAPSHOT_ALIGN != 0 ||
+        header.tbl8_offset < header.tbl24_offset + uint64_t(LPM_TBL24_ENTRIES) * sizeof(uint32_t) ||
+        header.adjacency_count > MAX_ADJACENCIES || header.interface_count > MAX_INTERFACES ||
+        header.group_count > MAX_NEXTHOP_GROUPS || header.tbl8_groups > LPM_ENTRY_VALUE_MASK + 1 ||
+        header.free_group_count > header.tbl8_groups ||
+        !sectionFits(header.tbl24_offset, LPM_TBL24_ENTRIES, sizeof(uint32_t), file_size) ||
+        !sectionFits(header.tbl8_offset, uint64_t(header.tbl8_groups) * LPM_TBL8_GROUP_ENTRIES, sizeof(uint32_t),
+                     file_size) ||
+        !sectionFits(header.free_groups_offset, header.free_group_count, sizeof(uint32_t), file_size) ||
+        !sectionFits(header.adjacencies_offset, header.adjacency_count, sizeof(Adjacency), file_size) ||
+        !sectionFits(header.groups_offset, header.group_count, sizeof(NextHopGroup), file_size) ||
+        !sectionFits(header.routes_offset, header.route_count, sizeof(RouteEntry), file_size) ||
+        !sectionFits(header.interfaces_offset, header.interface_count, sizeof(FibSnapshotInterface), file_size) ||
+        !sectionFits(header.strings_offset, header.strings_size, 1, file_size)) {
+        log_error("FIB snapshot %s has an inconsistent layout", path.c_str());
+        return false;
+    }
+    uint8_t* base = file->data();
+    // the check reads every FIB entry, mapping the arrays in one call beats a fault per page
+    uint64_t fib_end = header.tbl8_offset + uint64_t(header.tbl8_groups) * LPM_TBL8_GROUP_ENTRIES * sizeof(uint32_t);
+    file->prefetch(header.tbl24_offset, fib_end - header.tbl24_offset);
+    if (!checkContents(header, base, path)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(table.update_mutex);
+    AdjacencyTable& adjacencies = table.adjacency_table;
+    if (table.route_count != 0 || table.route6_count != 0 ||
+        adjacencies.size() != 0 || adjacencies.groupCount() != 0) {
+        log_error("FIB snapshot can only be loaded into an empty routing table");
+        return false;
+    }
+
+    /* nothing below can fail: the records were checked to intern into the empty table
+       under the same ids the FIB entries refer to, so a corrupt file never leaves
+       interfaces or adjacencies behind that would keep a retry out */
+    const char* names = reinterpret_cast<const char*>(base + header.strings_offset);
+    const auto* interfaces = reinterpret_cast<const FibSnapshotInterface*>(base + header.interfaces_offset);
+    for (uint32_t i = 0; i < header.interface_count; i++) {
+        adjacencies.internInterface(std::string(names + interfaces[i].name_offset, interfaces[i].name_length));
+    }
+    const auto* adjacency_records = reinterpret_cast<const Adjacency*>(base + header.adjacencies_offset);
+    for (uint32_t i = 0; i < header.adjacency_count; i++) {
+        adjacencies.intern(adjacency_records[i].interface_id, adjacency_records[i].next_hop);
+    }
+    for (uint32_t i = 0; i < header.group_count; i++) {
+        NextHopGroup group;
+        std::memcpy(&group, base + header.groups_offset + uint64_t(i) * sizeof(NextHopGroup), sizeof(group));
+        adjacencies.internGroup(AdjacencyTable::groupMembers(group));
+    }
+
+    const auto* records = reinterpret_cast<const RouteEntry*>(base + header.routes_offset);
+    table.unindexed_routes.assign(records, records + header.route_count);
+    table.route_count = header.route_count;
+    table.rib_ready = false;
+
+    const auto* free_list = reinterpret_cast<const uint32_t*>(base + header.free_groups_offset);
+    std::vector<uint32_t> free_groups(free_list, free_list + header.free_group_count);
+    table.fib.attach(file,
+                     reinterpret_cast<uint32_t*>(base + header.tbl24_offset),
+                     reinterpret_cast<uint32_t*>(base + header.tbl8_offset),
+                     header.tbl8_groups, std::move(free_groups));
+    table.fib_generation.fetch_add(1, std::memory_order_release);
+
+    log_info("Loaded FIB snapshot %s: %u routes, %u adjacencies, %u tbl8 groups",
+             path.c_str(), header.route_count, header.adjacency_count, header.tbl8_groups);
+    return true;
+}
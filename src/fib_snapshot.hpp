@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "routing_table.hpp"
+
+/* Compiled FIB snapshot.
+   save() writes the DIR-24-8 arrays exactly as the lookup uses them, followed by
+   the adjacency and next-hop group tables, the route records and the interface
+   names. FIB values are adjacency or group handles, which load() preserves, so the arrays need no rewriting. load()
+   maps the file copy-on-write and points the LPM table straight at the mapped arrays,
+   so startup costs one mmap plus a copy of the route records instead of parsing and
+   expanding every prefix. The table stays fully updatable afterwards: writes touch private
+   copies of the affected pages only, and the RIB is rebuilt on the first update.
+
+   Layout (host byte order, arrays page aligned):
+     FibSnapshotHeader | tbl24 (2^24 entries) | tbl8 groups | free group list |
+     Adjacency records | NextHopGroup records | RouteEntry records |
+     FibSnapshotInterface records | names
+
+   IPv6 routes are not part of the snapshot. Next-hop groups are shared between both
+   families, so the group table is saved whole and an IPv6 group just sits unused
+   after a load until an IPv6 route needs the same member set again.
+*/
+
+constexpr char FIB_SNAPSHOT_MAGIC[8] = {'R', 'S', 'I', 'M', 'F', 'I', 'B', '\0'};
+constexpr uint32_t FIB_SNAPSHOT_VERSION = 4;
+constexpr uint64_t FIB_SNAPSHOT_ALIGN = 4096;
+
+struct FibSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t route_count;
+    uint32_t tbl8_groups;
+    uint32_t free_group_count;
+    uint32_t adjacency_count;
+    uint32_t interface_count;
+    uint32_t group_count;
+    uint64_t tbl24_offset;
+    uint64_t tbl8_offset;
+    uint64_t free_groups_offset;
+    uint64_t adjacencies_offset;
+    uint64_t groups_offset;
+    uint64_t routes_offset;
+    uint64_t interfaces_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t file_size;
+};
+
+// interface name at strings_offset + name_offset, records are in interface id order
+struct FibSnapshotInterface {
+    uint32_t name_offset;
+    uint32_t name_length;
+};
+
+class FibSnapshot {
+public:
+    static bool save(RoutingTable& table, const std::string& path);
+    /* table must be empty, the snapshot replaces its whole contents. the file is checked
+       whole before the table is touched, so a corrupt one leaves it empty for a retry */
+    static bool load(RoutingTable& table, const std::string& path);
+};
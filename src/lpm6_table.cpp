@@ -0,0 +1,498 @@
+#include "lpm6_table.hpp"
+#include "logger.hpp"
+#include "rcu.hpp"
+#include <algorithm>
+#include <cstring>
+
+Lpm6Table::Lpm6Table(RcuDomain* rcu)
+    : rcu(rcu), root(LPM6_ROOT_ENTRIES, 0), root_depths(LPM6_ROOT_ENTRIES, 0) {}
+
+Lpm6Table::~Lpm6Table() {
+    delete[] lines.load(std::memory_order_relaxed);
+}
+
+bool Lpm6Table::add(const IPv6Address& network, uint8_t prefix_len, uint32_t value) {
+    if (prefix_len > 128 || value > LPM6_MAX_VALUE) {
+        log_error("Invalid LPM6 entry: prefix length %u, value %u", prefix_len, value);
+        return false;
+    }
+
+    IPv6Address masked = network.masked(prefix_len);
+    uint32_t index = levelIndex(masked, 0);
+    if (prefix_len <= LPM6_ROOT_BITS) {
+        // every root slot is its own update, published as soon as it is done
+        for (uint32_t i = index; i < index + (1u << (LPM6_ROOT_BITS - prefix_len)); i++) {
+            uint32_t entry = root[i];
+            uint8_t depth = root_depths[i];
+            if (!fillIn(entry, depth, 1, value, prefix_len)) {
+                abort();
+                return false;
+            }
+            commit(i, entry, depth);
+        }
+        return true;
+    }
+
+    uint32_t entry = root[index];
+    uint8_t depth = root_depths[index];
+    if (!addIn(entry, depth, 1, masked, prefix_len, value)) {
+        abort();
+        return false;
+    }
+    commit(index, entry, depth);
+    return true;
+}
+
+bool Lpm6Table::addIn(uint32_t& entry, uint8_t& depth, uint32_t level, const IPv6Address& network,
+                      uint8_t prefix_len, uint32_t value) {
+    Slots slots;
+    if (entry & LPM6_ENTRY_EXTENDED) {
+        if (!expand(entry, slots)) {
+            return false;
+        }
+        replaced.push_back(entry);
+    } else {
+        // a new node inherits whatever shorter route covered the slot before
+        std::fill(slots.entries, slots.entries + LPM6_NODE_SLOTS, entry);
+        std::fill(slots.depths, slots.depths + LPM6_NODE_SLOTS, depth);
+    }
+
+    uint32_t index = levelIndex(network, level);
+    if (prefix_len <= levelBits(level)) {
+        /* the prefix ends inside this level's stride: expand it over every slot it
+           covers, slots pointing into deeper nodes are updated entry by entry */
+        for (uint32_t i = index; i < index + (1u << (levelBits(level) - prefix_len)); i++) {
+            if (!fillIn(slots.entries[i], slots.depths[i], level + 1, value, prefix_len)) {
+                return false;
+            }
+        }
+    } else if (!addIn(slots.entries[index], slots.depths[index], level + 1, network, prefix_len, value)) {
+        return false;
+    }
+
+    uint32_t node = compress(slots, level);
+    if (node == LPM6_NO_NODE) {
+        return false;
+    }
+    entry = node;
+    return true;
+}
+
+bool Lpm6Table::fillIn(uint32_t& entry, uint8_t& depth, uint32_t level, uint32_t value, uint8_t prefix_len) {
+    if (!(entry & LPM6_ENTRY_EXTENDED)) {
+        if (depth <= prefix_len) {
+            depth = prefix_len;
+            entry = LPM6_ENTRY_VALID | value;
+        }
+        return true;
+    }
+
+    Slots slots;
+    if (!expand(entry, slots)) {
+        return false;
+    }
+    bool changed = false;
+    for (uint32_t i = 0; i < LPM6_NODE_SLOTS; i++) {
+        uint32_t old_entry = slots.entries[i];
+        uint8_t old_depth = slots.depths[i];
+        if (!fillIn(slots.entries[i], slots.depths[i], level + 1, value, prefix_len)) {
+            return false;
+        }
+        changed |= slots.entries[i] != old_entry || slots.depths[i] != old_depth;
+    }
+    /* a node whose slots all hold longer prefixes stays as it is. a wide one is rebuilt
+       all the same, its children were just split out of it */
+    if (!changed && !(entry & LPM6_ENTRY_WIDE)) {
+        return true;
+    }
+    uint32_t node = compress(slots, level);
+    if (node == LPM6_NO_NODE) {
+        return false;
+    }
+    replaced.push_back(entry);
+    entry = node;
+    return true;
+}
+
+bool Lpm6Table::remove(const IPv6Address& network, uint8_t prefix_len, uint8_t cover_len, uint32_t cover_value) {
+    if (prefix_len > 128 || (cover_value != LPM_NO_ROUTE && cover_len >= prefix_len)) {
+        log_error("Invalid LPM6 removal: prefix length %u, cover length %u", prefix_len, cover_len);
+        return false;
+    }
+
+    uint32_t cover = (cover_value == LPM_NO_ROUTE) ? 0 : (LPM6_ENTRY_VALID | cover_value);
+    cover_len = cover ? cover_len : 0;
+    IPv6Address masked = network.masked(prefix_len);
+    uint32_t index = levelIndex(masked, 0);
+    if (prefix_len <= LPM6_ROOT_BITS) {
+        for (uint32_t i = index; i < index + (1u << (LPM6_ROOT_BITS - prefix_len)); i++) {
+            uint32_t entry = root[i];
+            uint8_t depth = root_depths[i];
+            if (!clearIn(entry, depth, 1, prefix_len, cover, cover_len)) {
+                abort();
+                return false;
+            }
+            commit(i, entry, depth);
+        }
+        return true;
+    }
+
+    uint32_t entry = root[index];
+    uint8_t depth = root_depths[index];
+    if (!(entry & LPM6_ENTRY_EXTENDED) || !removeIn(entry, depth, 1, masked, prefix_len, cover, cover_len)) {
+        abort();
+        return false;
+    }
+    commit(index, entry, depth);
+    return true;
+}
+
+bool Lpm6Table::removeIn(uint32_t& entry, uint8_t& depth, uint32_t level, const IPv6Address& network,
+                         uint8_t prefix_len, uint32_t cover, uint8_t cover_len) {
+    Slots slots;
+    if (!expand(entry, slots)) {
+        return false;
+    }
+    uint32_t index = levelIndex(network, level);
+    if (prefix_len <= levelBits(level)) {
+        for (uint32_t i = index; i < index + (1u << (levelBits(level) - prefix_len)); i++) {
+            if (!clearIn(slots.entries[i], slots.depths[i], level + 1, prefix_len, cover, cover_len)) {
+                return false;
+            }
+        }
+    } else if (!(slots.entries[index] & LPM6_ENTRY_EXTENDED) ||
+               !removeIn(slots.entries[index], slots.depths[index], level + 1, network, prefix_len, cover, cover_len)) {
+        return false;
+    }
+    replaced.push_back(entry);
+
+    // a node whose slots all come from prefixes covering the whole parent slot folds back into it
+    if (collapsible(slots, level)) {
+        entry = slots.entries[0];
+        depth = slots.depths[0];
+        return true;
+    }
+    uint32_t node = compress(slots, level);
+    if (node == LPM6_NO_NODE) {
+        return false;
+    }
+    entry = node;
+    return true;
+}
+
+bool Lpm6Table::clearIn(uint32_t& entry, uint8_t& depth, uint32_t level, uint8_t prefix_len, uint32_t cover,
+                        uint8_t cover_len) {
+    if (!(entry & LPM6_ENTRY_EXTENDED)) {
+        if ((entry & LPM6_ENTRY_VALID) && depth == prefix_len) {
+            depth = cover_len;
+            entry = cover;
+        }
+        return true;
+    }
+
+    Slots slots;
+    if (!expand(entry, slots)) {
+        return false;
+    }
+    bool changed = false;
+    for (uint32_t i = 0; i < LPM6_NODE_SLOTS; i++) {
+        uint32_t old_entry = slots.entries[i];
+        uint8_t old_depth = slots.depths[i];
+        if (!clearIn(slots.entries[i], slots.depths[i], level + 1, prefix_len, cover, cover_len)) {
+            return false;
+        }
+        changed |= slots.entries[i] != old_entry || slots.depths[i] != old_depth;
+    }
+    if (!changed && !(entry & LPM6_ENTRY_WIDE)) {
+        return true;
+    }
+    uint32_t node = compress(slots, level);
+    if (node == LPM6_NO_NODE) {
+        return false;
+    }
+    replaced.push_back(entry);
+    entry = node;
+    return true;
+}
+
+// true when no slot of the node (at the given level) holds a prefix longer than its parent slot
+bool Lpm6Table::collapsible(const Slots& slots, uint32_t level) {
+    for (uint32_t i = 0; i < LPM6_NODE_SLOTS; i++) {
+        if ((slots.entries[i] & LPM6_ENTRY_EXTENDED) || slots.depths[i] > levelBits(level - 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Lpm6Table::lookupBatch(const IPv6Address* dsts, uint32_t* values, size_t count) const {
+    for (size_t i = 0; i < count; i++) {
+        values[i] = lookup(dsts[i]);
+    }
+}
+
+// root entries and prefix lengths plus the node lines, allocated or not
+size_t Lpm6Table::memoryBytes() const {
+    return size_t(LPM6_ROOT_ENTRIES) * (sizeof(uint32_t) + 1) + size_t(lines_capacity) * sizeof(Line);
+}
+
+bool Lpm6Table::expand(uint32_t entry, Slots& slots) {
+    if (!(entry & LPM6_ENTRY_WIDE)) {
+        expandNarrow(entry, slots);
+        return true;
+    }
+
+    const uint32_t* words = nodeWords(entry & LPM6_ENTRY_NODE_MASK);
+    const uint32_t* entries = words + LPM6_WIDE_HEADER_WORDS;
+    const uint8_t* depths = reinterpret_cast<const uint8_t*>(entries + LPM6_WIDE_RUNS);
+    uint16_t ends[LPM6_WIDE_RUNS];
+    std::memcpy(ends, words, sizeof(uint16_t) * (LPM6_WIDE_RUNS - 1));
+    ends[LPM6_WIDE_RUNS - 1] = LPM6_WIDE_NO_RUN;
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < LPM6_NODE_SLOTS; i++) {
+        uint32_t first = i << 8;
+        uint32_t last = first | 0xFF;
+        while ((ends[run] ^ 0x8000u) < first) {
+            run++;
+        }
+        if ((ends[run] ^ 0x8000u) >= last) {
+            // a single run, never a deeper node: those only ever cover one slot of 65536
+            slots.entries[i] = entries[run];
+            slots.depths[i] = depths[run];
+            continue;
+        }
+        Slots child;
+        for (uint32_t j = 0, child_run = run; j < LPM6_NODE_SLOTS; j++) {
+            while ((ends[child_run] ^ 0x8000u) < (first | j)) {
+                child_run++;
+            }
+            child.entries[j] = entries[child_run];
+            child.depths[j] = depths[child_run];
+        }
+        uint32_t node = compressNarrow(child);
+        if (node == LPM6_NO_NODE) {
+            return false;
+        }
+        slots.entries[i] = node;
+        slots.depths[i] = 0;
+    }
+    return true;
+}
+
+void Lpm6Table::expandNarrow(uint32_t entry, Slots& slots) const {
+    const uint32_t* words = nodeWords(entry & LPM6_ENTRY_NODE_MASK);
+    if (!(entry & LPM6_ENTRY_SPARSE)) {
+        std::memcpy(slots.entries, words, sizeof(slots.entries));
+        std::memcpy(slots.depths, words + LPM6_NODE_SLOTS, sizeof(slots.depths));
+        return;
+    }
+    const uint32_t* entries = words + LPM6_SPARSE_HEADER_WORDS;
+    const uint8_t* depths = reinterpret_cast<const uint8_t*>(entries + LPM6_SPARSE_RUNS);
+    for (uint32_t i = 0; i < LPM6_NODE_SLOTS; i++) {
+        uint32_t run = sparseRun(words, i);
+        slots.entries[i] = entries[run];
+        slots.depths[i] = depths[run];
+    }
+}
+
+uint32_t Lpm6Table::compress(const Slots& slots, uint32_t level) {
+    // the children of an odd level node are at an even level, never wide themselves
+    if (level % 2 == 1) {
+        uint32_t node = compressWide(slots);
+        if (node != LPM6_NO_NODE) {
+            return node;
+        }
+    }
+    return compressNarrow(slots);
+}
+
+// a run ends where the entry or its prefix length changes, every deeper node is a run of its own
+uint32_t Lpm6Table::compressNarrow(const Slots& slots) {
+    uint32_t runs = 1;
+    for (uint32_t i = 1; i < LPM6_NODE_SLOTS; i++) {
+        runs += slots.entries[i] != slots.entries[i - 1] || slots.depths[i] != slots.depths[i - 1];
+    }
+    bool sparse = runs <= LPM6_SPARSE_RUNS;
+    uint32_t node = allocNode(sparse ? LPM6_ENTRY_SPARSE : 0);
+    if (node == LPM6_NO_NODE) {
+        return LPM6_NO_NODE;
+    }
+
+    uint32_t* words = nodeWords(node);
+    if (!sparse) {
+        std::memcpy(words, slots.entries, sizeof(slots.entries));
+        std::memcpy(words + LPM6_NODE_SLOTS, slots.depths, sizeof(slots.depths));
+        built.push_back(LPM6_ENTRY_EXTENDED | node);
+        return built.back();
+    }
+
+    uint64_t starts[2] = {0, 0};
+    uint32_t* entries = words + LPM6_SPARSE_HEADER_WORDS;
+    uint8_t* depths = reinterpret_cast<uint8_t*>(entries + LPM6_SPARSE_RUNS);
+    std::fill(words, words + LPM6_LINE_WORDS, 0);
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < LPM6_NODE_SLOTS; i++) {
+        if (i == 0 || slots.entries[i] != slots.entries[i - 1] || slots.depths[i] != slots.depths[i - 1]) {
+            if (run > 0) {
+                starts[(run - 1) / 4] |= uint64_t(i) << (16 * ((run - 1) % 4));
+            }
+            entries[run] = slots.entries[i];
+            depths[run] = slots.depths[i];
+            run++;
+        }
+    }
+    for (; run < LPM6_SPARSE_RUNS; run++) {
+        starts[(run - 1) / 4] |= uint64_t(LPM6_SPARSE_NO_RUN) << (16 * ((run - 1) % 4));
+    }
+    std::memcpy(words, starts, sizeof(starts));
+    built.push_back(LPM6_ENTRY_EXTENDED | LPM6_ENTRY_SPARSE | node);
+    return built.back();
+}
+
+/* the node and its children flattened into 65536 slots, LPM6_NO_NODE when it has no
+   children, more than LPM6_WIDE_RUNS runs or no lines are left */
+uint32_t Lpm6Table::compressWide(const Slots& slots) {
+    uint32_t entries[LPM6_WIDE_RUNS];
+    uint8_t depths[LPM6_WIDE_RUNS];
+    uint16_t ends[LPM6_WIDE_RUNS - 1];
+    std::fill(ends, ends + LPM6_WIDE_RUNS - 1, static_cast<uint16_t>(LPM6_WIDE_NO_RUN));
+    uint32_t runs = 0;
+    bool children = false;
+    Slots child;
+    for (uint32_t i = 0; i < LPM6_NODE_SLOTS; i++) {
+        const Slots* from = &slots;
+        uint32_t first = i, count = 1;
+        if (slots.entries[i] & LPM6_ENTRY_EXTENDED) {
+            expandNarrow(slots.entries[i], child);
+            from = &child;
+            first = 0;
+            count = LPM6_NODE_SLOTS;
+            children = true;
+        }
+        for (uint32_t j = first; j < first + count; j++) {
+            if (runs > 0 && from->entries[j] == entries[runs - 1] && from->depths[j] == depths[runs - 1]) {
+                continue;
+            }
+            if (runs == LPM6_WIDE_RUNS) {
+                return LPM6_NO_NODE;
+            }
+            if (runs > 0) {
+                // the run before ends on the slot before this one
+                uint32_t slot = (i << 8) | (count == 1 ? 0 : j);
+                ends[runs - 1] = static_cast<uint16_t>((slot - 1) ^ 0x8000);
+            }
+            entries[runs] = from->entries[j];
+            depths[runs] = from->depths[j];
+            runs++;
+        }
+    }
+    if (!children) {
+        return LPM6_NO_NODE;
+    }
+
+    uint32_t node = allocNode(LPM6_ENTRY_WIDE);
+    if (node == LPM6_NO_NODE) {
+        return LPM6_NO_NODE;
+    }
+    uint32_t* words = nodeWords(node);
+    std::fill(words, words + LPM6_WIDE_LINES * LPM6_LINE_WORDS, 0);
+    std::memcpy(words, ends, sizeof(ends));
+    std::memcpy(words + LPM6_WIDE_HEADER_WORDS, entries, sizeof(uint32_t) * runs);
+    std::memcpy(words + LPM6_WIDE_HEADER_WORDS + LPM6_WIDE_RUNS, depths, runs);
+    // the children live on inside it, readers of the old path may still be in them
+    for (uint32_t i = 0; i < LPM6_NODE_SLOTS; i++) {
+        if (slots.entries[i] & LPM6_ENTRY_EXTENDED) {
+            replaced.push_back(slots.entries[i]);
+        }
+    }
+    built.push_back(LPM6_ENTRY_EXTENDED | LPM6_ENTRY_WIDE | node);
+    return built.back();
+}
+
+uint32_t Lpm6Table::allocNode(uint32_t layout) {
+    std::vector<uint32_t>& free_nodes =
+        (layout == LPM6_ENTRY_SPARSE) ? free_sparse : (layout == LPM6_ENTRY_WIDE) ? free_wide : free_dense;
+    uint32_t node_lines = (layout == LPM6_ENTRY_SPARSE) ? 1 : (layout == LPM6_ENTRY_WIDE) ? LPM6_WIDE_LINES : LPM6_DENSE_LINES;
+    uint32_t node;
+    if (!free_nodes.empty()) {
+        node = free_nodes.back();
+        free_nodes.pop_back();
+    } else {
+        if (lines_capacity - lines_used < node_lines && !growLines(node_lines)) {
+            return LPM6_NO_NODE;
+        }
+        node = lines_used;
+        lines_used += node_lines;
+    }
+    nodes_used++;
+    return node;
+}
+
+bool Lpm6Table::growLines(uint32_t needed) {
+    uint64_t new_capacity = lines_capacity ? lines_capacity : LPM6_INITIAL_LINES;
+    while (new_capacity - lines_used < needed) {
+        new_capacity *= 2;
+    }
+    if (new_capacity > LPM6_ENTRY_NODE_MASK + 1) {
+        log_error("LPM6 node lines exhausted (%u in use)", lines_used);
+        return false;
+    }
+
+    // same scheme as the tbl8 array of LpmTable, readers may still walk the old copy
+    Line* old_lines = lines.load(std::memory_order_relaxed);
+    Line* new_lines = new Line[new_capacity];
+    if (old_lines) {
+        std::memcpy(new_lines, old_lines, size_t(lines_used) * sizeof(Line));
+    }
+    lines.store(new_lines, std::memory_order_release);
+    lines_capacity = static_cast<uint32_t>(new_capacity);
+
+    if (old_lines) {
+        if (rcu) {
+            rcu->retire([old_lines]() { delete[] old_lines; });
+        } else {
+            delete[] old_lines;
+        }
+    }
+    return true;
+}
+
+// only for nodes no reader can reach any more
+void Lpm6Table::freeNode(uint32_t entry) {
+    std::vector<uint32_t>& free_nodes =
+        (entry & LPM6_ENTRY_SPARSE) ? free_sparse : (entry & LPM6_ENTRY_WIDE) ? free_wide : free_dense;
+    free_nodes.push_back(entry & LPM6_ENTRY_NODE_MASK);
+    nodes_used--;
+}
+
+void Lpm6Table::commit(uint32_t index, uint32_t entry, uint8_t depth) {
+    // the new nodes (and everything below them) only become reachable once they are filled
+    root_depths[index] = depth;
+    if (root[index] != entry) {
+        storeEntry(&root[index], entry);
+    }
+    built.clear();
+
+    // lookups that loaded the old root entry may still be walking the nodes it replaced
+    if (rcu && !replaced.empty()) {
+        rcu->retire([this, nodes = std::move(replaced)]() {
+            for (uint32_t entry : nodes) {
+                freeNode(entry);
+            }
+        });
+    } else {
+        for (uint32_t entry : replaced) {
+            freeNode(entry);
+        }
+    }
+    replaced.clear();
+}
+
+void Lpm6Table::abort() {
+    // never published, nobody can be reading them
+    for (uint32_t entry : built) {
+        freeNode(entry);
+    }
+    built.clear();
+    replaced.clear();
+}
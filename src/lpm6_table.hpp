@@ -0,0 +1,248 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "ipv6_address.hpp"
+#include "lpm_table.hpp"
+
+class RcuDomain;
+
+/* IPv6 longest prefix match table: a multibit trie with a 16-bit first stride and
+   8-bit strides below it (16-8-8-...-8, up to 15 levels), its nodes run-compressed
+   and sparse pairs of levels merged into one. The root is indexed by the first two
+   bytes of the address. Prefixes up to /16 are expanded straight into it, longer ones
+   turn their slot into a pointer to a node of 256 slots indexed by the next byte, and
+   so on one byte per level. A node is only created where a longer prefix needs it.
+
+   Below the root almost every node is sparse: a /48 under its /32 leaves the /40 node
+   holding the covering route, the site and the covering route again. Such a node is
+   stored as its runs of equal slots, the first slots of the runs as 16-bit lanes
+   compared against the slot all at once (sparseRun()), then one entry per run. Only
+   nodes of more than LPM6_SPARSE_RUNS runs, a few percent, keep all 256 entries.
+
+   A node at an odd level (bytes 2, 4, 6, ... of the address) whose children are few
+   and sparse is stored wide instead: the node and its children flattened into one
+   node of 65536 slots indexed by two bytes, up to LPM6_WIDE_RUNS runs (wideRun()).
+   That is a 16-bit stride wherever the table is thin, so real tables, dominated by
+   /32 allocations and /48 sites, mostly resolve a /32 in two accesses and a /48 in
+   three instead of three and five, and every access is a cache line or two. 200k
+   prefixes take a few tens of MiB.
+
+   Nodes are immutable once published. An update expands the nodes on its path into
+   256-slot scratch arrays (a wide node into the node and children it was made of),
+   edits them like DIR-24-8 does (controlled prefix expansion, the writer's prefix
+   lengths in parallel), compresses them into new nodes bottom up and publishes the
+   new path with one root entry store. The nodes it replaced are retired through the
+   RcuDomain and reused after a grace period. The line array grows like LpmTable's
+   tbl8 array: readers load it once per lookup, the old copy is retired. One writer,
+   lock-free readers.
+
+   Node layouts, in 32-bit words from their first line:
+     sparse, up to LPM6_SPARSE_RUNS runs, one line:
+     [0..3]    eight 16-bit lanes: the first slot of runs 1..8, LPM6_SPARSE_NO_RUN past the last
+     [4..12]   one entry per run
+     [13..15]  one writer-only prefix length byte per run
+     wide, up to LPM6_WIDE_RUNS runs, two lines:
+     [0..7]    sixteen 16-bit lanes: the last slot of runs 0..15 xor 0x8000, 0x7FFF past the last
+     [8..24]   one entry per run
+     [25..29]  one writer-only prefix length byte per run
+     dense, LPM6_DENSE_LINES lines:
+     [0..255]  one entry per slot
+     [256..]   one writer-only prefix length byte per slot
+   The entry pointing at a node says which layout it has, so a lookup knows how to
+   read the node before its line arrives.
+*/
+
+/* entry layout: [31] valid, [30] extended, [29:0] value, or when extended
+   [29] sparse node, [28] wide node, [27:0] first line of the node */
+constexpr uint32_t LPM6_ENTRY_VALID      = 0x80000000;
+constexpr uint32_t LPM6_ENTRY_EXTENDED   = 0x40000000;
+constexpr uint32_t LPM6_ENTRY_VALUE_MASK = 0x3FFFFFFF;
+constexpr uint32_t LPM6_ENTRY_SPARSE     = 0x20000000;
+constexpr uint32_t LPM6_ENTRY_WIDE       = 0x10000000;
+constexpr uint32_t LPM6_ENTRY_NODE_MASK  = 0x0FFFFFFF;
+
+constexpr uint32_t LPM6_ROOT_BITS = 16;
+constexpr uint32_t LPM6_ROOT_ENTRIES = 1u << LPM6_ROOT_BITS;
+constexpr uint32_t LPM6_NODE_SLOTS = 256;
+constexpr uint32_t LPM6_MAX_LEVELS = 1 + (128 - LPM6_ROOT_BITS) / 8;
+constexpr uint32_t LPM6_MAX_VALUE = LPM6_ENTRY_VALUE_MASK;
+
+constexpr uint32_t LPM6_LINE_WORDS = 16;
+constexpr uint32_t LPM6_SPARSE_RUNS = 9;
+constexpr uint32_t LPM6_SPARSE_HEADER_WORDS = 4;
+constexpr uint32_t LPM6_SPARSE_NO_RUN = LPM6_NODE_SLOTS;
+constexpr uint32_t LPM6_WIDE_RUNS = 17;
+constexpr uint32_t LPM6_WIDE_HEADER_WORDS = 8;
+constexpr uint32_t LPM6_WIDE_LINES = 2;
+constexpr uint32_t LPM6_WIDE_NO_RUN = 0x7FFF;
+constexpr uint32_t LPM6_DENSE_LINES = (LPM6_NODE_SLOTS + LPM6_NODE_SLOTS / 4) / LPM6_LINE_WORDS;
+constexpr uint32_t LPM6_INITIAL_LINES = 4096;
+
+class Lpm6Table {
+public:
+    explicit Lpm6Table(RcuDomain* rcu = nullptr);
+    ~Lpm6Table();
+    Lpm6Table(const Lpm6Table&) = delete;
+    Lpm6Table& operator=(const Lpm6Table&) = delete;
+
+    // installs value for network/prefix_len, replacing any value already stored for that exact prefix
+    bool add(const IPv6Address& network, uint8_t prefix_len, uint32_t value);
+    /* removes network/prefix_len, the addresses it owned fall back to cover_len/cover_value
+       (LPM_NO_ROUTE for none). nodes left without longer prefixes fold back into their
+       parent slot, so the trie only keeps levels that still carry information */
+    bool remove(const IPv6Address& network, uint8_t prefix_len, uint8_t cover_len, uint32_t cover_value);
+    // returns the value of the longest matching prefix, or LPM_NO_ROUTE
+    uint32_t lookup(const IPv6Address& dst) const;
+    /* looks up count destinations one after another: with at most two node lines per
+       level the walks are short enough for the cpu to overlap several of them, which
+       beat interleaving them level by level across a burst */
+    void lookupBatch(const IPv6Address* dsts, uint32_t* values, size_t count) const;
+
+    size_t nodesUsed() const { return nodes_used; }
+    size_t memoryBytes() const;
+
+private:
+    struct alignas(64) Line {
+        uint32_t words[LPM6_LINE_WORDS];
+    };
+    // a node expanded for the writer to edit
+    struct Slots {
+        uint32_t entries[LPM6_NODE_SLOTS];
+        uint8_t depths[LPM6_NODE_SLOTS];
+    };
+
+    RcuDomain* rcu;
+    std::vector<uint32_t> root;
+    std::atomic<Line*> lines{nullptr};
+    uint32_t lines_capacity = 0;
+    uint32_t lines_used = 0;
+    size_t nodes_used = 0;
+    // freed nodes of each layout, by their first line
+    std::vector<uint32_t> free_sparse;
+    std::vector<uint32_t> free_wide;
+    std::vector<uint32_t> free_dense;
+
+    // writer-only prefix lengths of the root entries
+    std::vector<uint8_t> root_depths;
+    // entries of the nodes the update in progress built and of the published ones it replaces
+    std::vector<uint32_t> built;
+    std::vector<uint32_t> replaced;
+
+    /* the helpers edit a parent slot (entry and prefix length) in place, the node behind
+       it being at the given level: addIn and removeIn rebuild it along the prefix's
+       path, fillIn and clearIn every node below it. false when a node could not be
+       allocated or, for removeIn, the path does not exist; nothing has been published then */
+    bool addIn(uint32_t& entry, uint8_t& depth, uint32_t level, const IPv6Address& network, uint8_t prefix_len,
+               uint32_t value);
+    bool removeIn(uint32_t& entry, uint8_t& depth, uint32_t level, const IPv6Address& network, uint8_t prefix_len,
+                  uint32_t cover, uint8_t cover_len);
+    bool fillIn(uint32_t& entry, uint8_t& depth, uint32_t level, uint32_t value, uint8_t prefix_len);
+    bool clearIn(uint32_t& entry, uint8_t& depth, uint32_t level, uint8_t prefix_len, uint32_t cover,
+                 uint8_t cover_len);
+    static bool collapsible(const Slots& slots, uint32_t level);
+
+    /* the 256 slots of the node entry points to. a wide node's children are rebuilt as
+       nodes of their own for the writer to edit, false when that runs out of lines */
+    bool expand(uint32_t entry, Slots& slots);
+    void expandNarrow(uint32_t entry, Slots& slots) const;
+    /* builds the node holding slots and returns the entry pointing at it, LPM6_NO_NODE
+       when out of lines. at odd levels a node with children is flattened wide if it fits */
+    uint32_t compress(const Slots& slots, uint32_t level);
+    uint32_t compressNarrow(const Slots& slots);
+    uint32_t compressWide(const Slots& slots);
+    uint32_t allocNode(uint32_t layout);
+    bool growLines(uint32_t needed);
+    void freeNode(uint32_t entry);
+    // stores the root entry the update built and releases what it replaced, or drops what it built
+    void commit(uint32_t index, uint32_t entry, uint8_t depth);
+    void abort();
+
+    static constexpr uint32_t LPM6_NO_NODE = UINT32_MAX;
+    uint32_t* nodeWords(uint32_t node) {
+        return lines.load(std::memory_order_relaxed)[node].words;
+    }
+    const uint32_t* nodeWords(uint32_t node) const {
+        return lines.load(std::memory_order_relaxed)[node].words;
+    }
+
+    // level 0 is the root, level n >= 1 is indexed by address byte n + 1
+    static uint32_t levelBits(uint32_t level) { return LPM6_ROOT_BITS + 8 * level; }
+    static uint32_t levelIndex(const IPv6Address& address, uint32_t level) {
+        return level == 0 ? (uint32_t(address.bytes[0]) << 8) | address.bytes[1] : address.bytes[level + 1];
+    }
+    /* the run of a sparse node slot falls in, the number of lanes starting at or before
+       it. with SSE2 one compare of all eight lanes; without, lane k holds 0x8000 + slot
+       minus the first slot of run k + 1, its top bit survives when the slot is past it */
+    static uint32_t sparseRun(const uint32_t* node, uint32_t slot) {
+#ifdef __SSE2__
+        __m128i starts = _mm_load_si128(reinterpret_cast<const __m128i*>(node));
+        uint32_t later = _mm_movemask_epi8(_mm_cmpgt_epi16(starts, _mm_set1_epi16(static_cast<int16_t>(slot))));
+        return __builtin_ctz(later | 0x10000) >> 1;
+#else
+        constexpr uint64_t LANES = 0x0001000100010001ull;
+        constexpr uint64_t TOPS = 0x8000800080008000ull;
+        uint64_t starts[2];
+        std::memcpy(starts, node, sizeof(starts));
+        uint64_t key = (0x8000u | slot) * LANES;
+        uint64_t passed = (((key - starts[0]) & TOPS) >> 15) + (((key - starts[1]) & TOPS) >> 15);
+        return static_cast<uint32_t>((passed * LANES) >> 48);
+#endif
+    }
+    /* the run of a wide node slot falls in, the number of runs ending before it. the
+       lanes are flipped into signed order for the compare */
+    static uint32_t wideRun(const uint32_t* node, uint32_t slot) {
+        int16_t key = static_cast<int16_t>(slot ^ 0x8000);
+#ifdef __SSE2__
+        __m128i keys = _mm_set1_epi16(key);
+        uint32_t low = _mm_movemask_epi8(_mm_cmpgt_epi16(keys, _mm_load_si128(reinterpret_cast<const __m128i*>(node))));
+        uint32_t high = _mm_movemask_epi8(_mm_cmpgt_epi16(keys, _mm_load_si128(reinterpret_cast<const __m128i*>(node + 4))));
+        return __builtin_ctzll(~(uint64_t(high) << 16 | low)) >> 1;
+#else
+        int16_t ends[LPM6_WIDE_RUNS - 1];
+        std::memcpy(ends, node, sizeof(ends));
+        uint32_t run = 0;
+        while (run < LPM6_WIDE_RUNS - 1 && ends[run] < key) {
+            run++;
+        }
+        return run;
+#endif
+    }
+    // the entry the address bytes at next select in the node entry points to, next moved past them
+    static const uint32_t* nodeEntry(const Line* nodes, uint32_t entry, const uint8_t*& next) {
+        const uint32_t* node = nodes[entry & LPM6_ENTRY_NODE_MASK].words;
+        if (entry & LPM6_ENTRY_WIDE) {
+            // the entries run into the second line, fetched alongside the lanes
+            __builtin_prefetch(node + LPM6_LINE_WORDS);
+            uint32_t slot = (uint32_t(next[0]) << 8) | next[1];
+            next += 2;
+            return &node[LPM6_WIDE_HEADER_WORDS + wideRun(node, slot)];
+        }
+        uint32_t slot = *next++;
+        return (entry & LPM6_ENTRY_SPARSE) ? &node[LPM6_SPARSE_HEADER_WORDS + sparseRun(node, slot)] : &node[slot];
+    }
+    static uint32_t loadEntry(const uint32_t* entry) {
+        return __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+    }
+    static void storeEntry(uint32_t* entry, uint32_t value) {
+        __atomic_store_n(entry, value, __ATOMIC_RELEASE);
+    }
+};
+
+inline uint32_t Lpm6Table::lookup(const IPv6Address& dst) const {
+    uint32_t entry = loadEntry(&root[levelIndex(dst, 0)]);
+    if (entry & LPM6_ENTRY_EXTENDED) {
+        // loaded after the root entry so it is at least as new as the nodes it points to
+        const Line* nodes = lines.load(std::memory_order_acquire);
+        const uint8_t* next = dst.bytes + 2;
+        do {
+            entry = loadEntry(nodeEntry(nodes, entry, next));
+        } while (entry & LPM6_ENTRY_EXTENDED);
+    }
+    return (entry & LPM6_ENTRY_VALID) ? (entry & LPM6_ENTRY_VALUE_MASK) : LPM_NO_ROUTE;
+}
@@ -0,0 +1,212 @@
+#include "lpm_table.hpp"
+#include "logger.hpp"
+#include "rcu.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstring>
+
+LpmTable::LpmTable(RcuDomain* rcu)
+    : rcu(rcu), tbl24_storage(LPM_TBL24_ENTRIES, 0), tbl24(tbl24_storage.data()) {}
+
+LpmTable::~LpmTable() {
+    uint32_t* groups = tbl8.load(std::memory_order_relaxed);
+    if (groups != tbl8_mapped) {
+        delete[] groups;
+    }
+}
+
+void LpmTable::attach(std::shared_ptr<MappedFile> backing, uint32_t* tbl24_entries, uint32_t* tbl8_entries,
+                      uint32_t groups_used, std::vector<uint32_t> free_group_list) {
+    uint32_t* old_groups = tbl8.load(std::memory_order_relaxed);
+    if (old_groups != tbl8_mapped) {
+        delete[] old_groups;
+    }
+
+    mapping = std::move(backing);
+    tbl24 = tbl24_entries;
+    tbl8_mapped = tbl8_entries;
+    tbl8.store(tbl8_entries, std::memory_order_release);
+    tbl8_groups_capacity = groups_used;
+    tbl8_groups_used = groups_used;
+    free_groups = std::move(free_group_list);
+
+    // the heap copy of tbl24 is dead weight from here on
+    std::vector<uint32_t>().swap(tbl24_storage);
+}
+
+bool LpmTable::add(uint32_t network, uint8_t prefix_len, uint32_t value) {
+    if (prefix_len > 32 || value > LPM_MAX_VALUE) {
+        log_error("Invalid LPM entry: prefix length %u, value %u", prefix_len, value);
+        return false;
+    }
+
+    network &= prefixMask(prefix_len);
+    uint32_t entry = makeEntry(prefix_len, value);
+
+    if (prefix_len <= 24) {
+        /* expand the prefix over every tbl24 slot it covers. slots that already point
+           into a tbl8 group are updated entry by entry, so longer prefixes stored in
+           the group survive */
+        uint32_t first = network >> 8;
+        uint32_t count = 1u << (24 - prefix_len);
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t slot = tbl24[i];
+            if (slot & LPM_ENTRY_EXTENDED) {
+                fillRange(&tbl8.load(std::memory_order_relaxed)[(slot & LPM_ENTRY_VALUE_MASK) * LPM_TBL8_GROUP_ENTRIES],
+                          LPM_TBL8_GROUP_ENTRIES, entry, prefix_len);
+            } else if (entryDepth(slot) <= prefix_len) {
+                storeEntry(&tbl24[i], entry);
+            }
+        }
+        return true;
+    }
+
+    // prefix longer than /24: lives in the tbl8 group of its tbl24 slot
+    uint32_t slot_index = network >> 8;
+    uint32_t slot = tbl24[slot_index];
+    bool new_group = !(slot & LPM_ENTRY_EXTENDED);
+    if (new_group) {
+        // inherit whatever shorter route covered this slot before
+        uint32_t group = allocTbl8Group(slot);
+        if (group == LPM_NO_ROUTE) {
+            return false;
+        }
+        slot = LPM_ENTRY_EXTENDED | group;
+    }
+
+    uint32_t group_base = (slot & LPM_ENTRY_VALUE_MASK) * LPM_TBL8_GROUP_ENTRIES;
+    uint32_t first = network & 0xFF;
+    uint32_t count = 1u << (32 - prefix_len);
+    fillRange(&tbl8.load(std::memory_order_relaxed)[group_base + first], count, entry, prefix_len);
+
+    // a fresh group only becomes reachable once it is completely filled
+    if (new_group) {
+        storeEntry(&tbl24[slot_index], slot);
+    }
+    return true;
+}
+
+bool LpmTable::remove(uint32_t network, uint8_t prefix_len, uint8_t cover_len, uint32_t cover_value) {
+    if (prefix_len > 32 || (cover_value != LPM_NO_ROUTE && cover_len >= prefix_len)) {
+        log_error("Invalid LPM removal: prefix length %u, cover length %u", prefix_len, cover_len);
+        return false;
+    }
+
+    network &= prefixMask(prefix_len);
+    uint32_t cover = (cover_value == LPM_NO_ROUTE) ? 0 : makeEntry(cover_len, cover_value);
+
+    if (prefix_len <= 24) {
+        uint32_t first = network >> 8;
+        uint32_t count = 1u << (24 - prefix_len);
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t slot = tbl24[i];
+            if (slot & LPM_ENTRY_EXTENDED) {
+                clearRange(&tbl8.load(std::memory_order_relaxed)[(slot & LPM_ENTRY_VALUE_MASK) * LPM_TBL8_GROUP_ENTRIES],
+                           LPM_TBL8_GROUP_ENTRIES, prefix_len, cover);
+            } else {
+                clearRange(&tbl24[i], 1, prefix_len, cover);
+            }
+        }
+        return true;
+    }
+
+    uint32_t slot_index = network >> 8;
+    uint32_t slot = tbl24[slot_index];
+    if (!(slot & LPM_ENTRY_EXTENDED)) {
+        return false;
+    }
+
+    uint32_t group = slot & LPM_ENTRY_VALUE_MASK;
+    uint32_t* entries = &tbl8.load(std::memory_order_relaxed)[group * LPM_TBL8_GROUP_ENTRIES];
+    clearRange(entries + (network & 0xFF), 1u << (32 - prefix_len), prefix_len, cover);
+
+    /* once no prefix longer than /24 is left, every entry holds the same /24-or-shorter
+       route and the group can fold back into a single tbl24 slot */
+    for (uint32_t i = 0; i < LPM_TBL8_GROUP_ENTRIES; i++) {
+        if (entryDepth(entries[i]) > 24) {
+            return true;
+        }
+    }
+    storeEntry(&tbl24[slot_index], entries[0]);
+    freeTbl8Group(group);
+    return true;
+}
+
+void LpmTable::lookupBatch(const uint32_t* dst_ips, uint32_t* values, size_t count) const {
+    for (size_t i = 0; i < count; i++) {
+        values[i] = lookup(dst_ips[i]);
+    }
+}
+
+size_t LpmTable::memoryBytes() const {
+    return (size_t(LPM_TBL24_ENTRIES) + size_t(tbl8_groups_capacity) * LPM_TBL8_GROUP_ENTRIES) * sizeof(uint32_t);
+}
+
+uint32_t LpmTable::allocTbl8Group(uint32_t fill_entry) {
+    uint32_t group;
+    if (!free_groups.empty()) {
+        group = free_groups.back();
+        free_groups.pop_back();
+    } else {
+        if (tbl8_groups_used == tbl8_groups_capacity && !growTbl8()) {
+            return LPM_NO_ROUTE;
+        }
+        group = tbl8_groups_used++;
+    }
+
+    uint32_t* entries = &tbl8.load(std::memory_order_relaxed)[size_t(group) * LPM_TBL8_GROUP_ENTRIES];
+    std::fill(entries, entries + LPM_TBL8_GROUP_ENTRIES, fill_entry);
+    return group;
+}
+
+bool LpmTable::growTbl8() {
+    uint32_t new_capacity = tbl8_groups_capacity ? tbl8_groups_capacity * 2 : LPM_TBL8_INITIAL_GROUPS;
+    if (new_capacity > LPM_MAX_VALUE + 1) {
+        log_error("LPM tbl8 groups exhausted (%u in use)", tbl8_groups_used);
+        return false;
+    }
+
+    /* readers may still be walking the old array, so copy into a new one, publish
+       it and let the RCU domain free the old one after a grace period */
+    uint32_t* old_groups = tbl8.load(std::memory_order_relaxed);
+    uint32_t* new_groups = new uint32_t[size_t(new_capacity) * LPM_TBL8_GROUP_ENTRIES];
+    if (old_groups) {
+        std::memcpy(new_groups, old_groups, size_t(tbl8_groups_used) * LPM_TBL8_GROUP_ENTRIES * sizeof(uint32_t));
+    }
+    tbl8.store(new_groups, std::memory_order_release);
+    tbl8_groups_capacity = new_capacity;
+
+    if (old_groups && old_groups != tbl8_mapped) {
+        if (rcu) {
+            rcu->retire([old_groups]() { delete[] old_groups; });
+        } else {
+            delete[] old_groups;
+        }
+    }
+    return true;
+}
+
+void LpmTable::freeTbl8Group(uint32_t group) {
+    // lookups that loaded the old tbl24 slot may still be reading the group
+    if (rcu) {
+        rcu->retire([this, group]() { free_groups.push_back(group); });
+    } else {
+        free_groups.push_back(group);
+    }
+}
+
+void LpmTable::fillRange(uint32_t* entries, uint32_t count, uint32_t entry, uint8_t depth) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (entryDepth(entries[i]) <= depth) {
+            storeEntry(&entries[i], entry);
+        }
+    }
+}
+
+void LpmTable::clearRange(uint32_t* entries, uint32_t count, uint8_t depth, uint32_t cover) {
+    for (uint32_t i = 0; i < count; i++) {
+        if ((entries[i] & LPM_ENTRY_VALID) && entryDepth(entries[i]) == depth) {
+            storeEntry(&entries[i], cover);
+        }
+    }
+}
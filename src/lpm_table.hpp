@@ -0,0 +1,120 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class RcuDomain;
+class MappedFile;
+
+/* DIR-24-8 longest prefix match table (Gupta, Lin, McKeown - "Routing Lookups in
+   Hardware at Memory Access Speeds").
+   tbl24 is indexed by the top 24 bits of the destination address. Prefixes up to /24
+   are expanded straight into it, so most lookups are a single memory access.
+   Longer prefixes turn their tbl24 slot into a pointer to a 256-entry tbl8 group
+   indexed by the last octet, which costs one extra access.
+
+   Every entry keeps the depth (prefix length) of the route it was expanded from, so a
+   shorter prefix never overwrites a longer one regardless of insertion order.
+
+   Concurrency: one writer at a time, any number of lock-free readers. Entries are
+   32-bit words written atomically, a new tbl8 group is filled before the tbl24 slot
+   pointing at it is published, so a lookup racing an update returns either the old or
+   the new route, never a torn one. When the tbl8 array grows the old copy is retired
+   through the RcuDomain instead of being freed under the readers, and a tbl8 group
+   released by remove() is only reused after a grace period.
+
+   The arrays can also live in a mapped FIB snapshot (see FibSnapshot), in which case
+   the table references the mapping instead of owning heap copies.
+*/
+
+// entry layout: [31] valid, [30] extended (tbl24 only), [29:24] depth, [23:0] value
+constexpr uint32_t LPM_ENTRY_VALID       = 0x80000000;
+constexpr uint32_t LPM_ENTRY_EXTENDED    = 0x40000000;
+constexpr uint32_t LPM_ENTRY_DEPTH_SHIFT = 24;
+constexpr uint32_t LPM_ENTRY_DEPTH_MASK  = 0x3F;
+constexpr uint32_t LPM_ENTRY_VALUE_MASK  = 0x00FFFFFF;
+
+constexpr uint32_t LPM_TBL24_ENTRIES = 1u << 24;
+constexpr uint32_t LPM_TBL8_GROUP_ENTRIES = 256;
+constexpr uint32_t LPM_TBL8_INITIAL_GROUPS = 256;
+
+constexpr uint32_t LPM_NO_ROUTE = 0xFFFFFFFF;
+constexpr size_t LPM_MAX_BURST = 64;    // destinations per batched lookup
+constexpr uint32_t LPM_MAX_VALUE = LPM_ENTRY_VALUE_MASK;
+
+class LpmTable {
+public:
+    explicit LpmTable(RcuDomain* rcu = nullptr);
+    ~LpmTable();
+    LpmTable(const LpmTable&) = delete;
+    LpmTable& operator=(const LpmTable&) = delete;
+
+    // installs value for network/prefix_len, replacing any value already stored for that exact prefix
+    bool add(uint32_t network, uint8_t prefix_len, uint32_t value);
+    /* removes network/prefix_len. the addresses it owned fall back to the covering prefix
+       the caller passes in (cover_len/cover_value), or to no route when cover_value is
+       LPM_NO_ROUTE. cost is proportional to the address range of the prefix, and a tbl8
+       group left without longer prefixes collapses back into its tbl24 slot */
+    bool remove(uint32_t network, uint8_t prefix_len, uint8_t cover_len, uint32_t cover_value);
+    // returns the value of the longest matching prefix, or LPM_NO_ROUTE
+    uint32_t lookup(uint32_t dst_ip) const;
+    /* looks up count destinations. the lookups do not depend on each other, so run back
+       to back the cpu already keeps their cache misses in flight together: staging them
+       across the burst with prefetches measured slower than this plain loop */
+    void lookupBatch(const uint32_t* dst_ips, uint32_t* values, size_t count) const;
+
+    /* switches an empty table over to arrays inside a mapped snapshot. the mapping
+       must be writable (copy-on-write is fine) and no reader may be running yet */
+    void attach(std::shared_ptr<MappedFile> backing, uint32_t* tbl24_entries, uint32_t* tbl8_entries,
+                uint32_t groups_used, std::vector<uint32_t> free_group_list);
+
+    size_t tbl8GroupsUsed() const { return tbl8_groups_used - free_groups.size(); }
+    size_t memoryBytes() const;
+
+    static uint32_t prefixMask(uint8_t prefix_len) {
+        return (prefix_len == 0) ? 0 : (0xFFFFFFFF << (32 - prefix_len));
+    }
+
+private:
+    friend class FibSnapshot;
+
+    RcuDomain* rcu;
+    std::vector<uint32_t> tbl24_storage;
+    uint32_t* tbl24;
+    std::atomic<uint32_t*> tbl8{nullptr};
+    uint32_t* tbl8_mapped = nullptr;          // tbl8 array owned by the mapping, never deleted
+    std::shared_ptr<MappedFile> mapping;
+    uint32_t tbl8_groups_capacity = 0;
+    uint32_t tbl8_groups_used = 0;
+    std::vector<uint32_t> free_groups;
+
+    uint32_t allocTbl8Group(uint32_t fill_entry);
+    bool growTbl8();
+    void freeTbl8Group(uint32_t group);
+    static void fillRange(uint32_t* entries, uint32_t count, uint32_t entry, uint8_t depth);
+    static void clearRange(uint32_t* entries, uint32_t count, uint8_t depth, uint32_t cover);
+
+    static uint32_t makeEntry(uint8_t depth, uint32_t value) {
+        return LPM_ENTRY_VALID | (static_cast<uint32_t>(depth) << LPM_ENTRY_DEPTH_SHIFT) | value;
+    }
+    static uint8_t entryDepth(uint32_t entry) {
+        return (entry >> LPM_ENTRY_DEPTH_SHIFT) & LPM_ENTRY_DEPTH_MASK;
+    }
+    static uint32_t loadEntry(const uint32_t* entry) {
+        return __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+    }
+    static void storeEntry(uint32_t* entry, uint32_t value) {
+        __atomic_store_n(entry, value, __ATOMIC_RELEASE);
+    }
+};
+
+inline uint32_t LpmTable::lookup(uint32_t dst_ip) const {
+    uint32_t entry = loadEntry(&tbl24[dst_ip >> 8]);
+    if (entry & LPM_ENTRY_EXTENDED) {
+        const uint32_t* groups = tbl8.load(std::memory_order_acquire);
+        entry = loadEntry(&groups[(entry & LPM_ENTRY_VALUE_MASK) * LPM_TBL8_GROUP_ENTRIES + (dst_ip & 0xFF)]);
+    }
+    return (entry & LPM_ENTRY_VALID) ? (entry & LPM_ENTRY_VALUE_MASK) : LPM_NO_ROUTE;
+}
@@ -1,32 +1,658 @@
 #include "internet_protocol.hpp"
 #include "packet_builders.hpp"
-#include <queue>
+#include "route_replay.hpp"
+#include "packet_pool.hpp"
+#include "forwarding_workers.hpp"
+#include "packet_printer.hpp"
+#include "traffic_generator.hpp"
+#include "pcap_file.hpp"
+#include "pcap_capture_sink.hpp"
+#include "af_packet_port.hpp"
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <poll.h>
+#include <arpa/inet.h>
 
 /*
 TODO:
 5. Add readme file explaining what is made.
-6. ??? Add NAT functionality.
 */
 
-void addPacketIfValid(std::queue<std::vector<uint8_t>>& packet_queue,
-                      const std::vector<uint8_t>& packet,
+// buffers in the simulation's packet pool, far more than the demo packets need
+constexpr size_t SIMULATION_POOL_BUFFERS = 256;
+// packets the traffic generator hands to the pipeline at a time
+constexpr size_t GENERATOR_BURST = 32;
+// packets a capture replay reads from the file at a time
+constexpr size_t REPLAY_BURST = 32;
+// packets taken from one port's receive ring at a time
+constexpr size_t PORT_BURST = 32;
+// how long the port loop sleeps in poll() when no port has traffic
+constexpr int PORT_IDLE_POLL_MS = 10;
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+void requestStop(int) {
+    stop_requested = 1;
+}
+
+void addPacketIfValid(std::vector<PacketHandle>& packet_queue,
+                      PacketHandle packet,
                       const std::string& description) {
-    if (!packet.empty()) {
-        packet_queue.push(packet);
+    if (packet) {
+        packet_queue.push_back(std::move(packet));
         log_debug("Queued packet: %s", description.c_str());
     } else {
         log_warning("Skipping invalid packet: %s", description.c_str());
     }
 }
 
-int main() {
-    Logger::getInstance().init("routing_debug.log", LogLevel::DEBUG);
+/* replays a BGP-style announce/withdraw file against the default routing table
+   and reports the sustained update rate */
+int runRouteReplay(const char* path) {
+    RouteReplay replay;
+    if (!replay.load(path) || replay.size() == 0) {
+        std::cerr << "No route updates loaded from " << path << "\n";
+        return 1;
+    }
 
     InternetProtocol ip;
     ip.initRoutingTable();
+    ReplayStats stats = ip.replayRouteUpdates(replay);
+
+    std::cout << "=== Route Update Replay ===\n"
+              << "Announces: " << stats.announces << ", Withdraws: " << stats.withdraws
+              << " (" << stats.unknown_withdraws << " for unknown prefixes)\n"
+              << "Elapsed: " << stats.elapsed_ns / 1e6 << " ms, "
+              << static_cast<uint64_t>(stats.updatesPerSecond()) << " updates/s\n";
+    log_info("Route replay finished: %zu updates at %.0f updates/s",
+             stats.announces + stats.withdraws, stats.updatesPerSecond());
+    return 0;
+}
+
+void printConntrackStats(const ConntrackStats& stats) {
+    std::cout << stats.active << " tracked";
+    for (size_t state = 0; state < CONN_STATE_COUNT; state++) {
+        if (stats.states[state] > 0) {
+            std::cout << ", " << stats.states[state] << " " << connStateName(static_cast<ConnState>(state));
+        }
+    }
+    std::cout << "; " << stats.created << " opened, " << stats.expired << " expired, " << stats.related
+              << " related, " << stats.invalid << " invalid (" << stats.full << " for want of room), "
+              << stats.untracked << " untracked\n";
+}
+
+void printWorkerStats(const ForwardingWorkers& workers) {
+    std::cout << "\n=== Forwarding Workers ===\n";
+    for (size_t i = 0; i < workers.workerCount(); i++) {
+        const WorkerStats& stats = workers.stats(i);
+        std::cout << "Worker " << i << " (core " << stats.core << "): " << stats.packets << " packets, "
+                  << stats.forwarded << " forwarded (" << stats.fragmented << " in fragments), " << stats.no_route
+                  << " no route, " << stats.ttl_expired << " TTL expired, " << stats.malformed << " malformed, "
+                  << stats.bad_length + stats.bad_checksum + stats.bad_l4_checksum << " failed ingress checks, "
+                  << stats.too_big << " over the MTU (" << stats.icmp_errors << " answered with ICMP), "
+                  << stats.no_nat_mapping << " refused by NAT\n";
+        if (const ConntrackStats* connections = workers.conntrackStats(i)) {
+            std::cout << "  connections: ";
+            printConntrackStats(*connections);
+        }
+    }
+}
+
+void printNatStats(const InternetProtocol& ip) {
+    std::shared_ptr<NatTable> nat = ip.natTable();
+    if (!nat) {
+        return;
+    }
+    NatStats stats = nat->stats();
+    std::cout << "NAT: " << stats.created << " sessions created, " << stats.active << " active, " << stats.expired
+              << " expired; " << stats.outbound << " packets translated out, " << stats.inbound << " in; refused "
+              << stats.exhausted << " for want of a port, " << stats.no_mapping << " without a session, "
+              << stats.untranslatable << " untranslatable\n";
+}
+
+/* hands the queued packets to worker threads sharded by flow and reports what each
+   worker did with them */
+int runWorkers(InternetProtocol& ip, std::vector<PacketHandle>& packet_queue, size_t worker_count,
+               size_t flow_cache_entries) {
+    WorkerConfig config;
+    config.workers = worker_count;
+    config.flow_cache_entries = flow_cache_entries;
+    ForwardingWorkers workers(ip, config);
+    if (!workers.start()) {
+        std::cerr << "Failed to start " << worker_count << " forwarding workers\n";
+        return 1;
+    }
+
+    for (PacketHandle& packet : packet_queue) {
+        workers.dispatch(std::move(packet));
+    }
+    workers.stop();
+    printWorkerStats(workers);
+    printNatStats(ip);
+    log_info("Worker simulation completed");
+    return 0;
+}
+
+void printVerdictCounts(const InternetProtocol& ip, const VerdictCounter& counter) {
+    std::cout << "\n=== Verdicts (" << counter.packets() << " packets) ===\n";
+    for (size_t id = 0; id < counter.interfaceSlots(); id++) {
+        if (uint64_t forwarded = counter.forwarded(static_cast<uint16_t>(id))) {
+            std::cout << "Forwarded to " << ip.adjacencies().interfaceName(static_cast<uint32_t>(id))
+                      << ": " << forwarded << "\n";
+        }
+    }
+    if (counter.fragmented() > 0) {
+        std::cout << "Forwarded in fragments: " << counter.fragmented() << "\n";
+    }
+    for (size_t reason_id = 1; reason_id < DROP_REASON_COUNT; reason_id++) {
+        DropReason reason = static_cast<DropReason>(reason_id);
+        std::cout << "Dropped (" << dropReasonName(reason) << "): " << counter.dropped(reason) << "\n";
+    }
+    if (ip.reassembling()) {
+        ReassemblyStats stats = ip.reassemblyStats();
+        std::cout << "Reassembly: " << stats.fragments << " fragments, " << stats.reassembled << " datagrams reassembled, "
+                  << stats.passed << " fragments passed, " << stats.timeouts << " timed out, " << stats.evictions
+                  << " evicted, " << stats.overlaps << " overlapping, " << stats.duplicates << " duplicates, "
+                  << stats.malformed << " malformed, " << stats.datagrams << " in progress ("
+                  << stats.memory << " bytes held)\n";
+    }
+    if (const ConntrackStats* stats = ip.conntrackStats()) {
+        std::cout << "Connections: ";
+        printConntrackStats(*stats);
+    }
+    if (const IcmpErrorStats* stats = ip.icmpErrorStats()) {
+        std::cout << "ICMP fragmentation needed: " << stats->sent << " sent, " << stats->rate_limited
+                  << " rate limited, " << stats->suppressed << " not to be answered\n";
+    }
+}
+
+/* streams packet_count generated packets through the pipeline, headless or sharded
+   over worker threads, and reports the rate. packets are built a burst at a time into
+   pooled buffers that are freed once forwarded, the workload is never queued up */
+int runGenerator(InternetProtocol& ip, const TrafficProfile& profile, uint64_t packet_count,
+                 size_t worker_count, size_t flow_cache_entries, const std::string& capture_dir) {
+    TrafficGenerator generator(profile, ip.routePrefixes());
+    if (!generator.valid()) {
+        std::cerr << "The traffic profile generates no packets\n";
+        return 1;
+    }
+    size_t data_room = std::max(PACKET_DEFAULT_DATA_ROOM, PACKET_DEFAULT_HEADROOM + generator.maxPacketSize());
+
+    std::cout << "=== Traffic Generator ===\n"
+              << "Flows: " << generator.flowCount() << " (seed " << profile.seed << ", zipf "
+              << profile.zipf_exponent << "), packets: " << packet_count << "\n";
+
+    PacketHandle burst[GENERATOR_BURST];
+    uint64_t sent = 0;
+    auto start = std::chrono::steady_clock::now();
+    if (worker_count > 0) {
+        WorkerConfig config;
+        config.workers = worker_count;
+        config.flow_cache_entries = flow_cache_entries;
+        ForwardingWorkers workers(ip, config);
+        if (!workers.start()) {
+            std::cerr << "Failed to start " << worker_count << " forwarding workers\n";
+            return 1;
+        }
+        // every ring full plus what the thread caches hold
+        PacketPool pool((worker_count + 1) * (config.ring_size + WORKER_BURST + 2 * PACKET_POOL_CACHE_SIZE), data_room);
+        while (sent < packet_count) {
+            size_t count = generator.fill(pool, burst, std::min<uint64_t>(GENERATOR_BURST, packet_count - sent));
+            if (count == 0) {
+                // pool dry, the workers still hold the buffers
+                workers.flush();
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < count; i++) {
+                workers.dispatch(std::move(burst[i]));
+            }
+            sent += count;
+        }
+        workers.stop();
+        printWorkerStats(workers);
+        printNatStats(ip);
+    } else {
+        PacketPool pool(GENERATOR_BURST + 2 * PACKET_POOL_CACHE_SIZE, data_room);
+        PacketView views[GENERATOR_BURST];
+        VerdictCounter counter;
+        PcapCaptureSink capture(ip.adjacencies(), capture_dir);
+        VerdictTee counter_and_capture(counter, capture);
+        VerdictSink& sink = capture_dir.empty() ? static_cast<VerdictSink&>(counter) : counter_and_capture;
+        while (sent < packet_count) {
+            size_t count = generator.fill(pool, burst, std::min<uint64_t>(GENERATOR_BURST, packet_count - sent));
+            if (count == 0) {
+                break;
+            }
+            for (size_t i = 0; i < count; i++) {
+                views[i] = burst[i].view();
+            }
+            ip.forwardPackets(views, count, sink);
+            for (size_t i = 0; i < count; i++) {
+                burst[i].reset();
+            }
+            sent += count;
+        }
+        capture.flush();
+        printVerdictCounts(ip, counter);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "\nGenerated " << sent << " packets (" << generator.bytes() << " bytes) in " << seconds * 1e3
+              << " ms: " << sent / seconds / 1e6 << " Mpps, " << generator.bytes() * 8 / seconds / 1e9 << " Gbit/s\n";
+    log_info("Traffic generation completed: %llu packets", static_cast<unsigned long long>(sent));
+    return 0;
+}
+
+/* replays a pcap or pcapng capture through the headless pipeline, the packets are
+   views into the mapped file, and reports the rate. with a capture directory every
+   packet is also written out by verdict, keeping its recorded timestamp */
+int runPcapReplay(InternetProtocol& ip, const std::string& path, const ReplayPacer& pace,
+                  const std::string& capture_dir) {
+    PcapReader reader;
+    if (!reader.open(path)) {
+        std::cerr << "Failed to open capture " << path << "\n";
+        return 1;
+    }
+    std::cout << "=== Capture Replay ===\n"
+              << "Capture: " << path << " (" << (reader.pcapng() ? "pcapng" : "pcap") << ", "
+              << reader.fileSize() << " bytes)\n";
+
+    ReplayPacer pacer = pace;
+    VerdictCounter counter;
+    PcapCaptureSink capture(ip.adjacencies(), capture_dir);
+    VerdictTee counter_and_capture(counter, capture);
+    VerdictSink& sink = capture_dir.empty() ? static_cast<VerdictSink&>(counter) : counter_and_capture;
+    PacketView packets[REPLAY_BURST];
+    uint64_t timestamps[REPLAY_BURST];
+    size_t pending = 0, first = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+        if (first == pending) {
+            pending = reader.read(packets, timestamps, REPLAY_BURST);
+            first = 0;
+            if (pending == 0) {
+                break;
+            }
+        }
+        // the pacer may let only the head of the burst go, the rest waits for its turn
+        size_t ready = pacer.release(timestamps + first, pending - first);
+        // reassembly changes which packets come out, they are stamped when forwarded then
+        capture.setTimestamps(ip.reassembling() ? nullptr : timestamps + first);
+        ip.forwardPackets(packets + first, ready, sink);
+        first += ready;
+    }
+    capture.flush();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printVerdictCounts(ip, counter);
+    const PcapReadStats& stats = reader.stats();
+    if (stats.skipped > 0 || stats.truncated > 0) {
+        std::cout << "Skipped " << stats.skipped << " non-IP frames, " << stats.truncated
+                  << " packets were captured truncated\n";
+    }
+    if (!capture_dir.empty()) {
+        std::cout << "Captured " << capture.packets() << " packets into " << capture.files() << " files in "
+                  << capture_dir;
+        if (capture.fragmented() > 0) {
+            std::cout << ", " << capture.fragmented() << " of them as " << capture.fragments() << " fragments";
+        }
+        std::cout << "\n";
+    }
+    std::cout << "\nReplayed " << stats.packets << " packets (" << stats.bytes << " bytes) in " << seconds * 1e3
+              << " ms: " << stats.packets / seconds / 1e6 << " Mpps, " << stats.bytes * 8 / seconds / 1e9
+              << " Gbit/s\n";
+    log_info("Capture replay completed: %llu packets", static_cast<unsigned long long>(stats.packets));
+    return 0;
+}
+
+/* forwards between Linux interfaces: every port's receive ring is drained a burst at a
+   time into the headless pipeline, forwarded packets leave through the port named like
+   their output interface. runs for the given seconds, or until interrupted when 0 */
+int runPorts(InternetProtocol& ip, const std::vector<std::string>& port_names, double seconds,
+             const std::string& capture_dir) {
+    std::vector<std::unique_ptr<AfPacketPort>> ports;
+    AfPacketEgress egress(ip.adjacencies());
+    std::vector<struct pollfd> poll_fds;
+    for (const std::string& name : port_names) {
+        ports.push_back(std::make_unique<AfPacketPort>());
+        if (!ports.back()->open(name)) {
+            std::cerr << "Failed to open port " << name << " (needs CAP_NET_RAW)\n";
+            return 1;
+        }
+        egress.addPort(*ports.back());
+        poll_fds.push_back({ports.back()->fd(), POLLIN, 0});
+        // the link's own MTU unless --mtu set one
+        uint32_t interface_id = ip.adjacencies().findInterface(name);
+        if (ports.back()->mtu() > 0 && (interface_id == MAX_INTERFACES || ip.adjacencies().interfaceMtu(interface_id) == 0)) {
+            ip.setInterfaceMtu(name, ports.back()->mtu());
+        }
+    }
+    std::cout << "=== Ports ===\n";
+    for (const auto& port : ports) {
+        std::cout << "Forwarding on " << port->name() << " (MTU " << port->mtu() << ")\n";
+    }
+
+    VerdictCounter counter;
+    PcapCaptureSink capture(ip.adjacencies(), capture_dir);
+    VerdictTee counter_and_capture(counter, capture);
+    VerdictTee sink(egress, capture_dir.empty() ? static_cast<VerdictSink&>(counter) : counter_and_capture);
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    PacketView packets[PORT_BURST];
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(seconds));
+    while (!stop_requested && (seconds <= 0 || std::chrono::steady_clock::now() < deadline)) {
+        size_t received = 0;
+        for (auto& port : ports) {
+            size_t count = port->receive(packets, PORT_BURST);
+            ip.forwardPackets(packets, count, sink);
+            received += count;
+        }
+        egress.flush();
+        if (received == 0) {
+            poll(poll_fds.data(), poll_fds.size(), PORT_IDLE_POLL_MS);
+        }
+    }
+    capture.flush();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printVerdictCounts(ip, counter);
+    std::cout << "\n";
+    for (auto& port : ports) {
+        const AfPacketStats& stats = port->stats();
+        std::cout << "Port " << port->name() << ": received " << stats.rx_packets << " (" << stats.rx_non_ip
+                  << " non-IP skipped, " << stats.rx_kernel_drops << " dropped by the kernel), sent "
+                  << stats.tx_packets << " (" << stats.tx_ring_full << " lost to a full ring)\n";
+    }
+    if (egress.unbound() > 0) {
+        std::cout << "Forwarded to interfaces without a port: " << egress.unbound() << "\n";
+    }
+    if (egress.fragmented() > 0) {
+        std::cout << "Sent in fragments: " << egress.fragmented() << " packets as " << egress.fragments()
+                  << " fragments\n";
+    }
+    std::cout << "\nForwarded " << counter.packets() << " packets in " << elapsed << " s: "
+              << counter.packets() / elapsed / 1e6 << " Mpps\n";
+    log_info("Port forwarding stopped after %llu packets", static_cast<unsigned long long>(counter.packets()));
+    return 0;
+}
+
+// fast, recorded, <speed>x for recorded timing sped up, or a rate in packets per second
+bool parsePace(const std::string& text, ReplayPacer& pacer) {
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (text == "fast") {
+        pacer = ReplayPacer();
+    } else if (text == "recorded") {
+        pacer = ReplayPacer(ReplayTiming::RECORDED, 1.0);
+    } else if (end != text.c_str() && value > 0 && std::strcmp(end, "x") == 0) {
+        pacer = ReplayPacer(ReplayTiming::RECORDED, value);
+    } else if (end != text.c_str() && value > 0 && *end == '\0') {
+        pacer = ReplayPacer(ReplayTiming::FIXED_RATE, value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// IF=BYTES[,IF=BYTES...], the MTUs to give interfaces
+bool parseMtus(const std::string& text, std::vector<std::pair<std::string, uint32_t>>& mtus) {
+    for (size_t begin = 0, end; begin <= text.size(); begin = end + 1) {
+        end = std::min(text.find(',', begin), text.size());
+        std::string item = text.substr(begin, end - begin);
+        size_t equals = item.find('=');
+        char* number_end = nullptr;
+        if (equals == std::string::npos || equals == 0 || equals + 1 == item.size()) {
+            return false;
+        }
+        unsigned long mtu = std::strtoul(item.c_str() + equals + 1, &number_end, 10);
+        if (*number_end != '\0' || mtu > UINT32_MAX) {
+            return false;
+        }
+        mtus.emplace_back(item.substr(0, equals), static_cast<uint32_t>(mtu));
+    }
+    return true;
+}
+
+// IF=ADDR[/LEN]: the outside interface and the pool, one address when LEN is left out
+bool parseNat(const std::string& text, std::string& interface, NatConfig& config) {
+    size_t equals = text.find('=');
+    if (equals == std::string::npos || equals == 0) {
+        return false;
+    }
+    std::string pool = text.substr(equals + 1);
+    size_t slash = pool.find('/');
+    unsigned long length = 32;
+    if (slash != std::string::npos) {
+        char* number_end = nullptr;
+        length = std::strtoul(pool.c_str() + slash + 1, &number_end, 10);
+        if (*number_end != '\0' || slash + 1 == pool.size() || length < 24 || length > 32) {
+            return false;
+        }
+        pool.resize(slash);
+    }
+    struct in_addr address;
+    if (inet_pton(AF_INET, pool.c_str(), &address) != 1) {
+        return false;
+    }
+    interface = text.substr(0, equals);
+    uint32_t mask = length == 32 ? UINT32_MAX : ~(UINT32_MAX >> length);
+    config.external_ip = ntohl(address.s_addr) & mask;
+    config.external_count = static_cast<uint32_t>(~mask) + 1;
+    return true;
+}
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --replay FILE     replay announce/withdraw events and report updates/s\n"
+              << "  --routes FILE     bulk load extra routes (<prefix/len> <interface> [next_hop] [metric])\n"
+              << "  --load-fib FILE   start from a compiled FIB snapshot instead of the default table\n"
+              << "  --save-fib FILE   write the FIB as a snapshot once it is built\n"
+              << "  --flow-cache N    cache forwarding verdicts of up to N flows\n"
+              << "  --workers N       forward on N pinned worker threads instead of printing every packet\n"
+              << "  --headless        forward without printing packets, report verdict counts only\n"
+              << "  --no-ingress-checks  skip the length and IPv4 header checksum checks\n"
+              << "  --l4-checksums    also verify TCP, UDP and ICMP checksums on ingress\n"
+              << "  --conntrack N     track up to N connections of what is forwarded headless or by the workers\n"
+              << "                    (N shared out between them, not with --nat), report their states\n"
+              << "  --reassemble MODE reassemble IPv4 fragments before forwarding: full, or first (the first\n"
+              << "                    fragment of a datagram ahead of the rest, nothing copied)\n"
+              << "  --generate N      forward N generated packets instead of the demo packets, report the rate\n"
+              << "  --profile FILE    traffic profile for --generate (flows, protocol mix, sizes, zipf, seed)\n"
+              << "  --pcap FILE       replay a pcap/pcapng capture through the headless pipeline, report the rate\n"
+              << "  --pace MODE       --pcap timing: fast (default), recorded, <speed>x or <packets per second>\n"
+              << "  --capture DIR     write the packets to DIR/<interface>.pcap and DIR/drop-<reason>.pcap\n"
+              << "                    (headless forwarding, --pcap, --ports and --generate without --workers)\n"
+              << "  --ports IF,IF...  forward between Linux interfaces over AF_PACKET rings, routes name the interfaces\n"
+              << "  --duration S      stop --ports after S seconds instead of on Ctrl-C\n"
+              << "  --mtu IF=N[,...]  largest packet interface IF sends: IPv4 packets with DF clear are\n"
+              << "                    fragmented on the way out, the others dropped and answered with ICMP\n"
+              << "                    fragmentation needed (--ports also takes the links' own MTUs)\n"
+              << "  --icmp-source IP  address the router's ICMP errors come from (default 192.168.1.1)\n"
+              << "  --nat IF=ADDR[/LEN]  source NAPT (with --workers): TCP, UDP and ping leaving through IF get a\n"
+              << "                    source from the pool ADDR/LEN (24 to 32), the answers are translated back\n"
+              << "  --nat-sessions N  NAT sessions of all workers together (default 65536)\n";
+}
+
+int main(int argc, char* argv[]) {
+    Logger::getInstance().init("routing_debug.log", LogLevel::DEBUG);
+
+    std::string routes_file, load_fib, save_fib;
+    size_t flow_cache_entries = 0;
+    size_t worker_count = 0;
+    bool headless = false;
+    IngressChecks ingress_checks;
+    bool reassemble = false;
+    ReassemblyConfig reassembly;
+    size_t conntrack_entries = 0;
+    uint64_t generate_packets = 0;
+    TrafficProfile profile;
+    std::string pcap_file, capture_dir;
+    ReplayPacer pacer;
+    std::vector<std::string> port_names;
+    double port_seconds = 0;
+    std::vector<std::pair<std::string, uint32_t>> mtus;
+    IcmpErrorConfig icmp_errors;
+    icmp_errors.source_ip = 0xC0A80101;     // 192.168.1.1
+    std::string nat_interface;
+    NatConfig nat;
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--replay") == 0 && has_value) {
+            return runRouteReplay(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "--routes") == 0 && has_value) {
+            routes_file = argv[++i];
+        } else if (std::strcmp(argv[i], "--load-fib") == 0 && has_value) {
+            load_fib = argv[++i];
+        } else if (std::strcmp(argv[i], "--save-fib") == 0 && has_value) {
+            save_fib = argv[++i];
+        } else if (std::strcmp(argv[i], "--flow-cache") == 0 && has_value) {
+            flow_cache_entries = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (std::strcmp(argv[i], "--no-ingress-checks") == 0) {
+            ingress_checks.lengths = false;
+            ingress_checks.header_checksum = false;
+        } else if (std::strcmp(argv[i], "--l4-checksums") == 0) {
+            ingress_checks.l4_checksum = true;
+        } else if (std::strcmp(argv[i], "--conntrack") == 0 && has_value) {
+            conntrack_entries = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--reassemble") == 0 && has_value) {
+            std::string mode = argv[++i];
+            if (mode != "full" && mode != "first") {
+                std::cerr << "Unknown reassembly mode " << mode << "\n";
+                return 1;
+            }
+            reassemble = true;
+            reassembly.mode = mode == "full" ? ReassemblyMode::FULL : ReassemblyMode::FIRST_FRAGMENT;
+        } else if (std::strcmp(argv[i], "--workers") == 0 && has_value) {
+            worker_count = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--generate") == 0 && has_value) {
+            generate_packets = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--profile") == 0 && has_value) {
+            if (!profile.load(argv[++i])) {
+                std::cerr << "Failed to load traffic profile " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--pcap") == 0 && has_value) {
+            pcap_file = argv[++i];
+        } else if (std::strcmp(argv[i], "--pace") == 0 && has_value) {
+            if (!parsePace(argv[++i], pacer)) {
+                std::cerr << "Unknown replay pace " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--capture") == 0 && has_value) {
+            capture_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--ports") == 0 && has_value) {
+            std::string list = argv[++i];
+            for (size_t begin = 0, end; begin <= list.size(); begin = end + 1) {
+                end = std::min(list.find(',', begin), list.size());
+                if (end > begin) {
+                    port_names.push_back(list.substr(begin, end - begin));
+                }
+            }
+        } else if (std::strcmp(argv[i], "--duration") == 0 && has_value) {
+            port_seconds = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--mtu") == 0 && has_value) {
+            if (!parseMtus(argv[++i], mtus)) {
+                std::cerr << "Bad MTU list " << argv[i] << ", expected IF=BYTES[,IF=BYTES...]\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--icmp-source") == 0 && has_value) {
+            struct in_addr address;
+            if (inet_pton(AF_INET, argv[++i], &address) != 1) {
+                std::cerr << "Bad ICMP source address " << argv[i] << "\n";
+                return 1;
+            }
+            icmp_errors.source_ip = ntohl(address.s_addr);
+        } else if (std::strcmp(argv[i], "--nat") == 0 && has_value) {
+            if (!parseNat(argv[++i], nat_interface, nat)) {
+                std::cerr << "Bad NAT pool " << argv[i] << ", expected IF=ADDR[/LEN]\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--nat-sessions") == 0 && has_value) {
+            nat.max_sessions = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    InternetProtocol ip;
+    if (!load_fib.empty()) {
+        if (!ip.loadFibSnapshot(load_fib)) {
+            std::cerr << "Failed to load FIB snapshot " << load_fib << "\n";
+            return 1;
+        }
+    } else {
+        ip.initRoutingTable();
+    }
+    if (!routes_file.empty()) {
+        std::cout << "Loaded " << ip.loadRoutes(routes_file) << " routes from " << routes_file << "\n";
+    }
+    if (!save_fib.empty() && !ip.saveFibSnapshot(save_fib)) {
+        std::cerr << "Failed to save FIB snapshot " << save_fib << "\n";
+    }
+    ip.setIngressChecks(ingress_checks);
+    if (flow_cache_entries > 0) {
+        ip.enableFlowCache(flow_cache_entries, FlowCacheMode::FIVE_TUPLE, true);
+    }
+    if (reassemble) {
+        ip.enableReassembly(reassembly);
+    }
+    if (conntrack_entries > 0) {
+        ConntrackConfig conntrack;
+        conntrack.max_connections = conntrack_entries;
+        ip.enableConnectionTracking(conntrack);
+    }
+    for (const auto& [interface, mtu] : mtus) {
+        if (!ip.setInterfaceMtu(interface, mtu)) {
+            std::cerr << "Invalid MTU " << mtu << " for " << interface << " (at least " << INTERFACE_MIN_MTU << ")\n";
+            return 1;
+        }
+    }
+    if (!mtus.empty() || !port_names.empty()) {
+        ip.enableIcmpErrors(icmp_errors);
+    }
+    if (!nat_interface.empty()) {
+        // the workers translate, every one as a core of its own
+        uint32_t outside = ip.adjacencies().findInterface(nat_interface);
+        if (worker_count == 0 || outside == MAX_INTERFACES) {
+            std::cerr << "NAT needs --workers and an outside interface with routes, " << nat_interface
+                      << (outside == MAX_INTERFACES ? " has none\n" : "\n");
+            return 1;
+        }
+        if (conntrack_entries > 0) {
+            std::cerr << "NAT and --conntrack cannot be combined, the workers track packets as translated\n";
+            return 1;
+        }
+        nat.outside_interface = static_cast<uint16_t>(outside);
+        nat.cores = worker_count;
+        if (!ip.enableNat(std::make_shared<NatTable>(nat))) {
+            std::cerr << "Cannot share the NAT pool and sessions between " << worker_count << " workers\n";
+            return 1;
+        }
+    }
+
+    if (generate_packets > 0) {
+        return runGenerator(ip, profile, generate_packets, worker_count, flow_cache_entries, capture_dir);
+    }
+    if (!pcap_file.empty()) {
+        return runPcapReplay(ip, pcap_file, pacer, capture_dir);
+    }
+    if (!port_names.empty()) {
+        return runPorts(ip, port_names, port_seconds, capture_dir);
+    }
 
     std::cout << "=== Routing Simulation ===\n";
-    std::queue<std::vector<uint8_t>> packet_queue;
+    PacketPool pool(SIMULATION_POOL_BUFFERS);
+    std::vector<PacketHandle> packet_queue;
 
     /* Packet 1:
        simulating ICMP ping packet sending from one device to another on the same WiFi network
@@ -39,7 +665,7 @@ int main() {
     local_ping.icmp_id = 1234;
     local_ping.icmp_seq = 1;
     local_ping.icmp_payload = "ping";
-    addPacketIfValid(packet_queue, local_ping.build(),
+    addPacketIfValid(packet_queue, local_ping.build(pool),
                      "Local WiFi ping: " + local_ping.ipv4_src_ip + " -> " + local_ping.ipv4_dst_ip);
 
     /* Packet 2:
@@ -52,7 +678,7 @@ int main() {
     google_dns.udp_src_port = 54321;
     google_dns.udp_dst_port = 53;
     google_dns.udp_payload = "DNS_QUERY_google.com_A";
-    addPacketIfValid(packet_queue, google_dns.build(),
+    addPacketIfValid(packet_queue, google_dns.build(pool),
                      "Google DNS query: " + google_dns.ipv4_src_ip + " -> " + google_dns.ipv4_dst_ip);
 
     /* Packet 3:
@@ -65,7 +691,7 @@ int main() {
     cloudflare_dns.udp_src_port = 54322;
     cloudflare_dns.udp_dst_port = 53;
     cloudflare_dns.udp_payload = "DNS_QUERY_cloudflare.com_A";
-    addPacketIfValid(packet_queue, cloudflare_dns.build(),
+    addPacketIfValid(packet_queue, cloudflare_dns.build(pool),
                      "Cloudflare DNS query: " + cloudflare_dns.ipv4_src_ip + " -> " + cloudflare_dns.ipv4_dst_ip);
 
     /* Packet 4:
@@ -79,7 +705,7 @@ int main() {
     localhost.tcp_dst_port = 8080;
     localhost.tcp_flags = TCP_SYN;
     localhost.tcp_payload = "";
-    addPacketIfValid(packet_queue, localhost.build(),
+    addPacketIfValid(packet_queue, localhost.build(pool),
                      "Localhost connection: " + localhost.ipv4_src_ip + " -> " + localhost.ipv4_dst_ip);
 
     /* Packet 5:
@@ -93,7 +719,7 @@ int main() {
     youtube.tcp_dst_port = 443;
     youtube.tcp_flags = TCP_SYN;
     youtube.tcp_payload = "";
-    addPacketIfValid(packet_queue, youtube.build(),
+    addPacketIfValid(packet_queue, youtube.build(pool),
                      "YouTube HTTPS: " + youtube.ipv4_src_ip + " -> " + youtube.ipv4_dst_ip);
 
     /* Packet 6:
@@ -106,18 +732,80 @@ int main() {
     expired_packet.udp_src_port = 12345;
     expired_packet.udp_dst_port = 53;
     expired_packet.udp_payload = "expired_query";
-    addPacketIfValid(packet_queue, expired_packet.build(),
+    addPacketIfValid(packet_queue, expired_packet.build(pool),
                      "Expired packet: " + expired_packet.ipv4_src_ip + " -> " + expired_packet.ipv4_dst_ip + " (TTL=0)");
 
-    size_t packet_count = 0;
-    while (!packet_queue.empty()) {
-        packet_count++;
-        std::cout << "\n--- Processing Packet " << packet_count << " ---\n";
-        ip.parsePacket(packet_queue.front());
-        packet_queue.pop();
+    /* Packet 7:
+       simulating an IPv6 ping to a neighbour on the same WiFi network
+    */
+    ICMPv6PacketBuilder local_ping6;
+    local_ping6.ipv6_src_ip = "2001:db8:1::100";
+    local_ping6.ipv6_dst_ip = "2001:db8:1::50";
+    local_ping6.icmp_id = 4321;
+    local_ping6.icmp_payload = "ping6";
+    addPacketIfValid(packet_queue, local_ping6.build(pool),
+                     "Local WiFi IPv6 ping: " + local_ping6.ipv6_src_ip + " -> " + local_ping6.ipv6_dst_ip);
+
+    /* Packet 8:
+       simulating a HTTPS connection to Cloudflare over IPv6 (default route via router)
+    */
+    TCPv6PacketBuilder cloudflare6;
+    cloudflare6.ipv6_src_ip = "2001:db8:1::100";
+    cloudflare6.ipv6_dst_ip = "2606:4700:4700::1111";
+    cloudflare6.tcp_src_port = 33446;
+    cloudflare6.tcp_dst_port = 443;
+    cloudflare6.tcp_flags = TCP_SYN;
+    addPacketIfValid(packet_queue, cloudflare6.build(pool),
+                     "Cloudflare HTTPS over IPv6: " + cloudflare6.ipv6_src_ip + " -> " + cloudflare6.ipv6_dst_ip);
+
+    /* Packet 9:
+       simulating a UDP packet over IPv6 with an exhausted hop limit (should be dropped)
+    */
+    UDPv6PacketBuilder expired6;
+    expired6.ipv6_src_ip = "2001:db8:1::100";
+    expired6.ipv6_dst_ip = "2001:4860:4860::8888";
+    expired6.ipv6_hop_limit = 0;
+    expired6.udp_src_port = 12346;
+    expired6.udp_dst_port = 53;
+    expired6.udp_payload = "expired_query";
+    addPacketIfValid(packet_queue, expired6.build(pool),
+                     "Expired IPv6 packet: " + expired6.ipv6_src_ip + " -> " + expired6.ipv6_dst_ip + " (hop limit 0)");
+
+    if (worker_count > 0) {
+        return runWorkers(ip, packet_queue, worker_count, flow_cache_entries);
+    }
+
+    // the whole queue goes through the pipeline in bursts, printing is just one consumer of the verdicts
+    std::vector<PacketView> packets;
+    for (const PacketHandle& packet : packet_queue) {
+        packets.push_back(packet.view());
     }
+    PcapCaptureSink capture(ip.adjacencies(), capture_dir);
+    if (headless) {
+        VerdictCounter counter;
+        VerdictTee counter_and_capture(counter, capture);
+        ip.forwardPackets(packets.data(), packets.size(),
+                          capture_dir.empty() ? static_cast<VerdictSink&>(counter) : counter_and_capture);
+        printVerdictCounts(ip, counter);
+    } else {
+        PacketPrinter printer(ip.adjacencies());
+        VerdictTee printer_and_capture(printer, capture);
+        ip.forwardPackets(packets.data(), packets.size(),
+                          capture_dir.empty() ? static_cast<VerdictSink&>(printer) : printer_and_capture);
+    }
+    capture.flush();
+    packet_queue.clear();
 
     ip.printRoutingTable();
+    if (const FlowCacheStats* stats = ip.flowCacheStats()) {
+        std::cout << "Flow cache: " << stats->hits << " hits, " << stats->misses << " misses ("
+                  << stats->stale << " stale), hit rate " << stats->hitRate() * 100 << "%, "
+                  << stats->averageHitNs() << " ns/hit, " << stats->averageMissNs() << " ns/miss\n";
+    }
+    PacketPoolStats pool_stats = pool.stats();
+    std::cout << "Packet pool: " << pool_stats.allocs << " allocs, " << pool_stats.frees << " frees, "
+              << pool_stats.refills << " refills, " << pool_stats.flushes << " flushes, "
+              << pool_stats.inUse() << " in use\n";
     log_info("Routing simulation completed");
     return 0;
 }
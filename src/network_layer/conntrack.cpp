@@ -0,0 +1,443 @@
+#include "conntrack.hpp"
+#include "internet_protocol.hpp"
+#include "packet_builders.hpp"
+#include "fragment_reassembly.hpp"
+#include "icmp.hpp"
+#include "tcp.hpp"
+#include "logger.hpp"
+#include <algorithm>
+
+static_assert(sizeof(Connection) == 48, "a connection is 48 bytes, three to two cache lines");
+
+/* the flag combinations a TCP segment may carry, of SYN, ACK, FIN and RST (the same
+   table as Linux conntrack's). anything else, a FIN without ACK or SYN with FIN or
+   RST, is a scan or an evasion attempt */
+static bool tcpFlagsValid(uint8_t flags) {
+    switch (flags) {
+        case TCP_SYN:
+        case TCP_SYN | TCP_ACK:
+        case TCP_RST:
+        case TCP_RST | TCP_ACK:
+        case TCP_FIN | TCP_ACK:
+        case TCP_ACK:
+            return true;
+    }
+    return false;
+}
+
+static bool icmpError(uint8_t type) {
+    return type == ICMP_DEST_UNREACH || type == ICMP_SOURCE_QUENCH || type == ICMP_REDIRECT ||
+           type == ICMP_TIME_EXCEED || type == ICMP_PARAMETER_PROBLEM;
+}
+
+/* the 5-tuple of the packet an ICMP error quotes: its IPv4 header and at least 8
+   bytes of what followed, enough for the ports or the echo identifier */
+static bool quotedKey(PacketView quoted, FlowKey& key) {
+    IPv4HeaderView header(quoted);
+    size_t header_length = header.headerLength();
+    if (!header.valid() || header.version() != 4 || header_length < IPv4_HEADER_SIZE ||
+        !quoted.has(header_length, 8)) {
+        return false;
+    }
+    PacketView l4 = quoted.from(header_length);
+    key = {header.srcIp(), header.dstIp(), 0, 0, header.protocol()};
+    if (key.protocol == PROTOCOL_TCP || key.protocol == PROTOCOL_UDP) {
+        key.src_port = l4.u16(0);
+        key.dst_port = l4.u16(2);
+    } else if (key.protocol == PROTOCOL_ICMP && l4.u8(0) == ICMP_ECHO_REQUEST) {
+        key.src_port = l4.u16(4);
+    } else if (key.protocol == PROTOCOL_ICMP && l4.u8(0) == ICMP_ECHO_REPLY) {
+        key.dst_port = l4.u16(4);
+    }
+    return true;
+}
+
+// the next TCP state after a segment with valid flags, FINs are noted on the connection
+static ConnState tcpNext(Connection& conn, uint8_t flags, bool reply) {
+    if (flags & TCP_RST) {
+        return ConnState::TCP_CLOSE;
+    }
+    switch (conn.state) {
+        case ConnState::TCP_SYN_SENT:
+            // SYN-ACK, or a SYN of a simultaneous open
+            if (reply && (flags & TCP_SYN)) {
+                return ConnState::TCP_SYN_RECV;
+            }
+            break;
+        case ConnState::TCP_SYN_RECV:
+            if (!reply && !(flags & TCP_SYN)) {
+                return ConnState::TCP_ESTABLISHED;
+            }
+            break;
+        case ConnState::TCP_ESTABLISHED:
+        case ConnState::TCP_FIN_WAIT:
+            if (flags & TCP_FIN) {
+                conn.flags |= reply ? CONN_FIN_REPLY : CONN_FIN_ORIGINAL;
+                bool both = (conn.flags & (CONN_FIN_ORIGINAL | CONN_FIN_REPLY)) == (CONN_FIN_ORIGINAL | CONN_FIN_REPLY);
+                return both ? ConnState::TCP_TIME_WAIT : ConnState::TCP_FIN_WAIT;
+            }
+            break;
+        default:
+            break;
+    }
+    return conn.state;
+}
+
+ConnectionTracker::ConnectionTracker(const ConntrackConfig& config)
+    : settings(config),
+      connections(std::min<size_t>(std::max<size_t>(config.max_connections, 1), NONE - 1)),
+      timers(connections.size(), config.tick_ns) {
+    if (connections.size() != config.max_connections) {
+        log_error("Connection tracking holds 1 to %u connections, %zu asked for", NONE - 1, config.max_connections);
+    }
+    settings.tick_ns = std::max<uint64_t>(settings.tick_ns, 1);
+    // 8 connections a bucket of 10 ways at most
+    size_t bucket_count = 1;
+    while (bucket_count * 8 < connections.size()) {
+        bucket_count <<= 1;
+    }
+    buckets.assign(bucket_count, Bucket());
+    bucket_mask = bucket_count - 1;
+
+    const ConntrackTimeouts& t = settings.timeouts;
+    const uint64_t timeouts[CONN_STATE_COUNT] = {
+        t.tcp_syn_sent_ns, t.tcp_syn_recv_ns, t.tcp_established_ns, t.tcp_fin_wait_ns, t.tcp_time_wait_ns,
+        t.tcp_close_ns, t.udp_unreplied_ns, t.udp_replied_ns, t.icmp_ns, t.icmp_ns, t.other_ns, t.other_ns,
+    };
+    for (size_t state = 0; state < CONN_STATE_COUNT; state++) {
+        uint64_t ticks = (timeouts[state] + settings.tick_ns - 1) / settings.tick_ns;
+        timeout_ticks[state] = static_cast<uint32_t>(
+            std::min<uint64_t>(std::max<uint64_t>(ticks, 1), HierarchicalTimerWheel::HIERARCHY_SPAN - 1));
+    }
+}
+
+size_t ConnectionTracker::memoryBytes() const {
+    return connections.size() * sizeof(Connection) + buckets.size() * sizeof(Bucket) + timers.memoryBytes();
+}
+
+/* IPv4, not a fragment, with the transport header inside the packet's total length.
+   ICMP is tracked for echo, errors are looked at for the packet they quote */
+bool ConnectionTracker::parse(PacketView packet, Tracked& tracked) {
+    IPv4HeaderView header(packet);
+    if (!header.valid() || header.version() != 4) {
+        return false;
+    }
+    size_t header_length = header.headerLength();
+    size_t total_length = header.totalLength();
+    if (header_length < IPv4_HEADER_SIZE || total_length < header_length || total_length > packet.size() ||
+        FragmentReassembler::isFragment(header.flagsFragmentOffset())) {
+        return false;
+    }
+    // the transport header and payload, up to the total length
+    PacketView l4 = PacketView(packet.data(), total_length).from(header_length);
+    FlowKey& key = tracked.key;
+    key = {header.srcIp(), header.dstIp(), 0, 0, header.protocol()};
+    tracked.related = false;
+    tracked.tcp_flags = 0;
+    tracked.icmp_type = 0;
+    tracked.length = static_cast<uint16_t>(total_length);
+    switch (key.protocol) {
+        case PROTOCOL_TCP:
+            if (!l4.has(0, 14)) {
+                return false;
+            }
+            key.src_port = l4.u16(0);
+            key.dst_port = l4.u16(2);
+            tracked.tcp_flags = l4.u8(13) & (TCP_SYN | TCP_ACK | TCP_FIN | TCP_RST);
+            break;
+        case PROTOCOL_UDP:
+            if (!l4.has(0, 8)) {
+                return false;
+            }
+            key.src_port = l4.u16(0);
+            key.dst_port = l4.u16(2);
+            break;
+        case PROTOCOL_ICMP:
+            if (!l4.has(0, 8)) {
+                return false;
+            }
+            tracked.icmp_type = l4.u8(0);
+            if (tracked.icmp_type == ICMP_ECHO_REQUEST) {
+                key.src_port = l4.u16(4);
+            } else if (tracked.icmp_type == ICMP_ECHO_REPLY) {
+                key.dst_port = l4.u16(4);
+            } else if (icmpError(tracked.icmp_type) && quotedKey(l4.from(8), key)) {
+                tracked.related = true;
+            } else {
+                return false;
+            }
+            break;
+        default:
+            break;
+    }
+    tracked.swapped = key.src_ip > key.dst_ip || (key.src_ip == key.dst_ip && key.src_port > key.dst_port);
+    if (tracked.swapped) {
+        std::swap(key.src_ip, key.dst_ip);
+        std::swap(key.src_port, key.dst_port);
+    }
+    tracked.hash = flowHash(key);
+    return true;
+}
+
+uint32_t ConnectionTracker::lookup(const FlowKey& key, uint64_t hash) const {
+    uint16_t tag = tagOf(hash);
+    size_t bucket = hash & bucket_mask;
+    for (size_t probe = 0; probe <= bucket_mask; probe++, bucket = (bucket + 1) & bucket_mask) {
+        const Bucket& b = buckets[bucket];
+        for (size_t way = 0; way < CONNTRACK_WAYS; way++) {
+            if (b.tags[way] != tag) {
+                continue;
+            }
+            const Connection& conn = connections[b.entries[way]];
+            if (conn.ip[0] == key.src_ip && conn.ip[1] == key.dst_ip && conn.port[0] == key.src_port &&
+                conn.port[1] == key.dst_port && conn.protocol == key.protocol) {
+                return b.entries[way];
+            }
+        }
+        if (b.overflow == 0) {
+            break;
+        }
+    }
+    return NONE;
+}
+
+uint32_t ConnectionTracker::find(const FlowKey& key) const {
+    FlowKey ordered = key;
+    if (ordered.src_ip > ordered.dst_ip || (ordered.src_ip == ordered.dst_ip && ordered.src_port > ordered.dst_port)) {
+        std::swap(ordered.src_ip, ordered.dst_ip);
+        std::swap(ordered.src_port, ordered.dst_port);
+    }
+    return lookup(ordered, flowHash(ordered));
+}
+
+// a connection straddles two cache lines two times out of three, both are loaded
+void ConnectionTracker::prefetch(uint64_t hash) const {
+    uint16_t tag = tagOf(hash);
+    const Bucket& b = buckets[hash & bucket_mask];
+    for (size_t way = 0; way < CONNTRACK_WAYS; way++) {
+        if (b.tags[way] == tag) {
+            const char* conn = reinterpret_cast<const char*>(&connections[b.entries[way]]);
+            __builtin_prefetch(conn);
+            __builtin_prefetch(conn + sizeof(Connection) - 1);
+            return;
+        }
+    }
+}
+
+void ConnectionTracker::insert(uint32_t id, uint64_t hash) {
+    uint16_t tag = tagOf(hash);
+    size_t bucket = hash & bucket_mask;
+    // the index never fills, there is always a free way further on
+    while (true) {
+        Bucket& b = buckets[bucket];
+        for (size_t way = 0; way < CONNTRACK_WAYS; way++) {
+            if (b.tags[way] == 0) {
+                b.tags[way] = tag;
+                b.entries[way] = id;
+                return;
+            }
+        }
+        // a saturated count is never decremented again, lookups just keep probing past it
+        if (b.overflow != OVERFLOW_SATURATED) {
+            b.overflow++;
+        }
+        bucket = (bucket + 1) & bucket_mask;
+    }
+}
+
+void ConnectionTracker::erase(uint32_t id) {
+    const Connection& conn = connections[id];
+    FlowKey key = {conn.ip[0], conn.ip[1], conn.port[0], conn.port[1], conn.protocol};
+    size_t bucket = flowHash(key) & bucket_mask;
+    while (true) {
+        Bucket& b = buckets[bucket];
+        for (size_t way = 0; way < CONNTRACK_WAYS; way++) {
+            if (b.tags[way] != 0 && b.entries[way] == id) {
+                b.tags[way] = 0;
+                return;
+            }
+        }
+        if (b.overflow != OVERFLOW_SATURATED) {
+            b.overflow--;
+        }
+        bucket = (bucket + 1) & bucket_mask;
+    }
+}
+
+void ConnectionTracker::track(const PacketView* packets, size_t count, uint64_t now_ns, ConntrackResult* results) {
+    expire(now_ns);
+    uint64_t now = now_ns / settings.tick_ns;
+    Tracked tracked[CONNTRACK_BURST];
+    bool parsed[CONNTRACK_BURST];
+    for (size_t start = 0; start < count; start += CONNTRACK_BURST) {
+        size_t burst = std::min(CONNTRACK_BURST, count - start);
+        /* three passes so the loads of a burst overlap: the buckets, then the connections
+           their tags point at, then the updates */
+        for (size_t i = 0; i < burst; i++) {
+            parsed[i] = parse(packets[start + i], tracked[i]);
+            if (parsed[i]) {
+                __builtin_prefetch(&buckets[tracked[i].hash & bucket_mask]);
+            }
+        }
+        for (size_t i = 0; i < burst; i++) {
+            if (parsed[i]) {
+                prefetch(tracked[i].hash);
+            }
+        }
+        for (size_t i = 0; i < burst; i++) {
+            ConntrackResult result = {NONE, ConnStatus::UNTRACKED, false};
+            if (parsed[i]) {
+                result = update(tracked[i], now);
+            } else {
+                counters.untracked++;
+            }
+            if (results) {
+                results[start + i] = result;
+            }
+        }
+    }
+}
+
+ConntrackResult ConnectionTracker::update(const Tracked& tracked, uint64_t now) {
+    uint32_t id = lookup(tracked.key, tracked.hash);
+    uint8_t protocol = tracked.key.protocol;
+    if (tracked.related) {
+        if (id == NONE) {
+            counters.invalid++;
+            return {NONE, ConnStatus::INVALID, false};
+        }
+        // an error about a packet from the originator travels back to it
+        counters.related++;
+        return {id, ConnStatus::RELATED, (tracked.swapped ? 1u : 0u) == connections[id].originator()};
+    }
+
+    uint8_t flags = tracked.tcp_flags;
+    if (protocol == PROTOCOL_TCP) {
+        if (!tcpFlagsValid(flags)) {
+            counters.invalid++;
+            return {NONE, ConnStatus::INVALID, false};
+        }
+        // a new SYN on a closed connection's ports opens a new one
+        if (id != NONE && flags == TCP_SYN &&
+            (connections[id].state == ConnState::TCP_TIME_WAIT || connections[id].state == ConnState::TCP_CLOSE)) {
+            release(id);
+            id = NONE;
+        }
+        if (id == NONE) {
+            if (flags == TCP_SYN) {
+                id = open(tracked, ConnState::TCP_SYN_SENT, now);
+            } else if (settings.pickup && (flags & TCP_ACK) && !(flags & (TCP_SYN | TCP_RST))) {
+                id = open(tracked, ConnState::TCP_ESTABLISHED, now);
+            } else {
+                counters.invalid++;
+                return {NONE, ConnStatus::INVALID, false};
+            }
+        }
+    } else if (id == NONE) {
+        // an echo reply answers a request that was tracked or it is nothing
+        if (protocol == PROTOCOL_ICMP && tracked.icmp_type == ICMP_ECHO_REPLY) {
+            counters.invalid++;
+            return {NONE, ConnStatus::INVALID, false};
+        }
+        id = open(tracked, protocol == PROTOCOL_UDP ? ConnState::UDP_UNREPLIED :
+                           protocol == PROTOCOL_ICMP ? ConnState::ICMP_UNREPLIED : ConnState::OTHER_UNREPLIED, now);
+    }
+    if (id == NONE) {
+        counters.invalid++;
+        return {NONE, ConnStatus::INVALID, false};
+    }
+
+    Connection& conn = connections[id];
+    bool reply = (tracked.swapped ? 1u : 0u) != conn.originator();
+    ConnState state = conn.state;
+    if (protocol == PROTOCOL_TCP) {
+        state = tcpNext(conn, flags, reply);
+    } else if (reply) {
+        if (protocol == PROTOCOL_UDP) {
+            state = ConnState::UDP_REPLIED;
+        } else if (protocol == PROTOCOL_ICMP) {
+            state = tracked.icmp_type == ICMP_ECHO_REPLY ? ConnState::ICMP_REPLIED : state;
+        } else {
+            state = ConnState::OTHER_REPLIED;
+        }
+    }
+    if (reply) {
+        conn.flags |= CONN_SEEN_REPLY;
+    }
+    conn.last_seen = static_cast<uint32_t>(now);
+    conn.packets[reply]++;
+    conn.bytes[reply] += tracked.length;
+    counters.packets++;
+    if (state != conn.state) {
+        setState(conn, state);
+        arm(id, now);
+    }
+    return {id, (conn.flags & CONN_SEEN_REPLY) ? ConnStatus::ESTABLISHED : ConnStatus::NEW, reply};
+}
+
+uint32_t ConnectionTracker::open(const Tracked& tracked, ConnState state, uint64_t now) {
+    uint32_t id;
+    if (free_head != NONE) {
+        id = free_head;
+        free_head = connections[id].last_seen;
+    } else if (fresh < connections.size()) {
+        id = fresh++;
+    } else {
+        counters.full++;
+        return NONE;
+    }
+    Connection& conn = connections[id];
+    conn = Connection();
+    conn.ip[0] = tracked.key.src_ip;
+    conn.ip[1] = tracked.key.dst_ip;
+    conn.port[0] = tracked.key.src_port;
+    conn.port[1] = tracked.key.dst_port;
+    conn.protocol = tracked.key.protocol;
+    conn.state = state;
+    conn.flags = CONN_IN_USE | (tracked.swapped ? CONN_ORIGINATOR_HIGH : 0);
+    conn.created = conn.last_seen = static_cast<uint32_t>(now);
+    insert(id, tracked.hash);
+    counters.created++;
+    counters.active++;
+    counters.states[static_cast<size_t>(state)]++;
+    arm(id, now);
+    return id;
+}
+
+void ConnectionTracker::release(uint32_t id) {
+    Connection& conn = connections[id];
+    timers.cancel(id);
+    erase(id);
+    counters.active--;
+    counters.states[static_cast<size_t>(conn.state)]--;
+    conn.flags = 0;
+    conn.last_seen = free_head;
+    free_head = id;
+}
+
+void ConnectionTracker::setState(Connection& conn, ConnState state) {
+    counters.states[static_cast<size_t>(conn.state)]--;
+    counters.states[static_cast<size_t>(state)]++;
+    conn.state = state;
+}
+
+void ConnectionTracker::arm(uint32_t id, uint64_t now) {
+    timers.schedule(id, (now + timeout_ticks[static_cast<size_t>(connections[id].state)]) * settings.tick_ns);
+}
+
+/* a timer runs from the last state change. when it fires the connection may have seen
+   packets since, then it goes back on the wheel for what is left of its timeout */
+void ConnectionTracker::expire(uint64_t now_ns) {
+    uint64_t now = now_ns / settings.tick_ns;
+    timers.advance(now_ns, [&](uint32_t id) {
+        const Connection& conn = connections[id];
+        uint32_t idle = static_cast<uint32_t>(now) - conn.last_seen;
+        uint32_t timeout = timeout_ticks[static_cast<size_t>(conn.state)];
+        if (idle < timeout) {
+            timers.schedule(id, (now + timeout - idle) * settings.tick_ns);
+            return;
+        }
+        release(id);
+        counters.expired++;
+    });
+}
@@ -0,0 +1,213 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "forwarding_verdict.hpp"
+#include "packet_view.hpp"
+#include "timer_wheel.hpp"
+
+// packets tracked in one pass, longer runs are cut into these
+constexpr size_t CONNTRACK_BURST = LPM_MAX_BURST;
+
+/* where a connection is. TCP follows its flags through the handshake and the close,
+   the other protocols only tell whether the other side has answered yet */
+enum class ConnState : uint8_t {
+    TCP_SYN_SENT,       // SYN from the originator
+    TCP_SYN_RECV,       // SYN-ACK back
+    TCP_ESTABLISHED,    // the originator's ACK of it, or picked up mid-stream
+    TCP_FIN_WAIT,       // FIN one way
+    TCP_TIME_WAIT,      // FIN both ways
+    TCP_CLOSE,          // RST either way
+    UDP_UNREPLIED,
+    UDP_REPLIED,
+    ICMP_UNREPLIED,     // echo request, the identifier stands in for the ports
+    ICMP_REPLIED,
+    OTHER_UNREPLIED,    // any other protocol, by addresses alone
+    OTHER_REPLIED,
+};
+
+constexpr size_t CONN_STATE_COUNT = static_cast<size_t>(ConnState::OTHER_REPLIED) + 1;
+
+inline const char* connStateName(ConnState state) {
+    switch (state) {
+        case ConnState::TCP_SYN_SENT:    return "SYN sent";
+        case ConnState::TCP_SYN_RECV:    return "SYN received";
+        case ConnState::TCP_ESTABLISHED: return "established";
+        case ConnState::TCP_FIN_WAIT:    return "FIN wait";
+        case ConnState::TCP_TIME_WAIT:   return "time wait";
+        case ConnState::TCP_CLOSE:       return "closed";
+        case ConnState::UDP_UNREPLIED:   return "UDP unreplied";
+        case ConnState::UDP_REPLIED:     return "UDP replied";
+        case ConnState::ICMP_UNREPLIED:  return "ICMP unreplied";
+        case ConnState::ICMP_REPLIED:    return "ICMP replied";
+        case ConnState::OTHER_UNREPLIED: return "other unreplied";
+        case ConnState::OTHER_REPLIED:   return "other replied";
+    }
+    return "unknown";
+}
+
+// what a packet is to the tracker, the classes a stateful filter decides on
+enum class ConnStatus : uint8_t {
+    NEW,            // opens a connection, or the other side has not answered it yet
+    ESTABLISHED,    // of a connection that has seen packets both ways
+    RELATED,        // an ICMP error about a tracked connection
+    INVALID,        // fits no connection and cannot open one, bad TCP flags, or the table is full
+    UNTRACKED,      // not IPv4, a fragment, ICMP other than echo and errors
+};
+
+/* idle time after which a connection is dropped, by state. the defaults are those of
+   Linux conntrack */
+struct ConntrackTimeouts {
+    uint64_t tcp_syn_sent_ns = 120ull * 1000000000;
+    uint64_t tcp_syn_recv_ns = 60ull * 1000000000;
+    uint64_t tcp_established_ns = 432000ull * 1000000000;  // 5 days
+    uint64_t tcp_fin_wait_ns = 120ull * 1000000000;
+    uint64_t tcp_time_wait_ns = 120ull * 1000000000;
+    uint64_t tcp_close_ns = 10ull * 1000000000;
+    uint64_t udp_unreplied_ns = 30ull * 1000000000;
+    uint64_t udp_replied_ns = 120ull * 1000000000;
+    uint64_t icmp_ns = 30ull * 1000000000;
+    uint64_t other_ns = 600ull * 1000000000;
+};
+
+struct ConntrackConfig {
+    size_t max_connections = 1 << 16;   // everything is allocated for this many up front
+    bool pickup = true;                 // TCP packets without SYN open connections (taken to be established)
+    ConntrackTimeouts timeouts;
+    uint64_t tick_ns = 1000000000;      // expiry resolution, a connection goes up to a tick late
+};
+
+struct ConntrackStats {
+    uint64_t packets = 0;           // counted on a connection
+    uint64_t created = 0;           // connections, a SYN reopening a closed one included
+    uint64_t expired = 0;
+    uint64_t related = 0;
+    uint64_t invalid = 0;
+    uint64_t full = 0;              // connections not opened for want of room, counted as invalid too
+    uint64_t untracked = 0;
+    size_t active = 0;              // connections now
+    size_t states[CONN_STATE_COUNT] = {};
+};
+
+// Connection::flags
+constexpr uint8_t CONN_ORIGINATOR_HIGH = 0x01;  // endpoint 1 opened the connection
+constexpr uint8_t CONN_SEEN_REPLY = 0x02;
+constexpr uint8_t CONN_FIN_ORIGINAL = 0x04;
+constexpr uint8_t CONN_FIN_REPLY = 0x08;
+constexpr uint8_t CONN_IN_USE = 0x80;
+
+/* one connection, its two endpoints in a fixed order (the lower address, then the
+   lower port first) so packets either way find it under one key. packets and bytes
+   are counted by direction, 0 the originator's */
+struct Connection {
+    uint32_t ip[2];
+    uint16_t port[2];           // ICMP echo: the identifier on the requester's side, 0 on the other
+    uint8_t protocol;
+    ConnState state;
+    uint8_t flags;              // CONN_*
+    uint8_t reserved;
+    uint32_t created;           // tick
+    uint32_t last_seen;         // tick of the last packet, the next free entry while unused
+    uint32_t packets[2];
+    uint64_t bytes[2];
+
+    size_t originator() const { return flags & CONN_ORIGINATOR_HIGH ? 1 : 0; }
+};
+
+// the tracker's answer for one packet
+struct ConntrackResult {
+    uint32_t connection;        // ConnectionTracker::NONE when there is none
+    ConnStatus status;
+    bool reply;                 // from the side that did not open the connection
+};
+
+/* Stateful connection tracking for IPv4 TCP, UDP, ICMP echo and other protocols.
+   connections live in a table of max_connections entries of 48 bytes, allocated up
+   front, found through an open-addressed index of one-cache-line buckets: 10 ways of a
+   16-bit hash tag and the entry, and a count of the keys that probed on past the bucket,
+   so a lookup stops at the first bucket nothing overflowed from. the index is sized to
+   at most 80% full, a lookup reads one bucket and one entry in the common case. bursts
+   are tracked in three passes that prefetch the buckets, then the entries.
+
+   expiry runs on a hierarchical timer wheel, a timer per connection. packets only stamp
+   their tick on the connection; a timer that fires finds how long the connection has
+   really been idle and is pushed back if it has not timed out, and state changes re-arm
+   it with the new state's timeout. nothing ever scans the table. memory is ~77 bytes a
+   connection all told, about 770 MB for ten million.
+
+   not thread safe, one tracker per forwarding thread, which must see both directions of
+   its connections (the workers shard on symmetricFlowHash, which does) */
+class ConnectionTracker {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    explicit ConnectionTracker(const ConntrackConfig& config = ConntrackConfig());
+
+    /* classifies packets and updates their connections: creates them, moves their
+       state, counts the packets. expires due connections first. results may be nullptr
+       when only the connections and counters are wanted */
+    void track(const PacketView* packets, size_t count, uint64_t now_ns, ConntrackResult* results);
+    ConntrackResult track(PacketView packet, uint64_t now_ns) {
+        ConntrackResult result;
+        track(&packet, 1, now_ns, &result);
+        return result;
+    }
+    // drops the connections idle past their state's timeout by now_ns
+    void expire(uint64_t now_ns);
+
+    // the connection of a 5-tuple, either direction, NONE if untracked
+    uint32_t find(const FlowKey& key) const;
+    const Connection& connection(uint32_t id) const { return connections[id]; }
+
+    const ConntrackConfig& config() const { return settings; }
+    const ConntrackStats& stats() const { return counters; }
+    size_t capacity() const { return connections.size(); }
+    // bytes held, all allocated at construction
+    size_t memoryBytes() const;
+
+private:
+    static constexpr size_t CONNTRACK_WAYS = 10;
+    static constexpr uint16_t OVERFLOW_SATURATED = UINT16_MAX;
+
+    struct alignas(64) Bucket {
+        uint16_t tags[CONNTRACK_WAYS];      // 0 for a free way
+        uint16_t overflow;                  // keys homed at or before this bucket that sit after it
+        uint16_t reserved;
+        uint32_t entries[CONNTRACK_WAYS];
+    };
+
+    // one parsed packet
+    struct Tracked {
+        FlowKey key;                // endpoints in Connection order
+        bool swapped;               // the packet's source is endpoint 1
+        bool related;               // an ICMP error, key is the packet it quotes
+        uint8_t tcp_flags;
+        uint8_t icmp_type;
+        uint16_t length;
+        uint64_t hash;
+    };
+
+    ConntrackConfig settings;
+    std::vector<Connection> connections;
+    std::vector<Bucket> buckets;
+    size_t bucket_mask = 0;
+    HierarchicalTimerWheel timers;
+    uint32_t timeout_ticks[CONN_STATE_COUNT] = {};
+    uint32_t fresh = 0;             // entries never used start here
+    uint32_t free_head = NONE;      // released entries, linked through last_seen
+    ConntrackStats counters;
+
+    static bool parse(PacketView packet, Tracked& tracked);
+    static uint16_t tagOf(uint64_t hash) { return static_cast<uint16_t>(hash >> 48) | 1; }
+    uint32_t lookup(const FlowKey& key, uint64_t hash) const;
+    void prefetch(uint64_t hash) const;
+    void insert(uint32_t id, uint64_t hash);
+    void erase(uint32_t id);
+
+    // now is in ticks from here on
+    ConntrackResult update(const Tracked& tracked, uint64_t now);
+    uint32_t open(const Tracked& tracked, ConnState state, uint64_t now);
+    void release(uint32_t id);
+    void setState(Connection& conn, ConnState state);
+    void arm(uint32_t id, uint64_t now);
+};
@@ -0,0 +1,43 @@
+#include "flow_cache.hpp"
+#include "logger.hpp"
+#include <cstring>
+
+FlowCache::FlowCache(size_t entries, FlowCacheMode mode, bool measure_latency)
+    : key_mode(mode), measure_latency(measure_latency) {
+    // round up to a power of two number of buckets so the hash can be masked
+    size_t bucket_count = 1;
+    while (bucket_count * FLOW_CACHE_WAYS < entries) {
+        bucket_count <<= 1;
+    }
+    buckets.resize(bucket_count);
+    bucket_mask = bucket_count - 1;
+    clear();
+
+    log_debug("Flow cache with %zu entries (%s keys)", capacity(),
+              mode == FlowCacheMode::FIVE_TUPLE ? "5-tuple" : "destination");
+}
+
+void FlowCache::clear() {
+    std::memset(static_cast<void*>(buckets.data()), 0, buckets.size() * sizeof(Bucket));
+}
+
+void FlowCache::insert(Bucket& bucket, const FlowKey& key, uint32_t generation, const ForwardingVerdict& verdict) {
+    // the new entry becomes way 0, an occupied way 0 moves down and evicts way 1
+    if (bucket.ways[0].valid) {
+        if (bucket.ways[1].valid) {
+            cache_stats.evictions++;
+        }
+        bucket.ways[1] = bucket.ways[0];
+    }
+
+    Entry& entry = bucket.ways[0];
+    entry.src_ip = key.src_ip;
+    entry.dst_ip = key.dst_ip;
+    entry.src_port = key.src_port;
+    entry.dst_port = key.dst_port;
+    entry.protocol = key.protocol;
+    entry.valid = 1;
+    entry.reserved = 0;
+    entry.generation = generation;
+    entry.verdict = verdict;
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "forwarding_verdict.hpp"
+
+enum class FlowCacheMode : uint8_t {
+    FIVE_TUPLE,     // one entry per flow
+    DESTINATION,    // one entry per destination address, all flows to it share the first one's ECMP path
+};
+
+struct FlowCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t stale = 0;        // misses on an entry left over from an older routing table generation
+    uint64_t evictions = 0;
+    uint64_t hit_ns = 0;       // only collected when latency measurement is on
+    uint64_t miss_ns = 0;
+
+    double hitRate() const { return (hits + misses) ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+    double averageHitNs() const { return hits ? static_cast<double>(hit_ns) / hits : 0.0; }
+    double averageMissNs() const { return misses ? static_cast<double>(miss_ns) / misses : 0.0; }
+};
+
+/* Microflow verdict cache.
+   remembers the forwarding verdict of recent flows so later packets of a flow skip
+   the route lookup. it is a fixed-size, 2-way set associative table with no locking,
+   every forwarding thread owns its own instance.
+
+   entries are tagged with the routing table generation they were resolved under and
+   a lookup under a newer generation treats them as misses, so route changes
+   invalidate the cache without touching it. tags keep the low 32 bits of the
+   generation, an entry would have to sit unused for 2^32 route updates to alias.
+
+   latency measurement brackets every lookup with a steady_clock read, the reported
+   times include that overhead */
+class FlowCache {
+public:
+    FlowCache(size_t entries, FlowCacheMode mode = FlowCacheMode::FIVE_TUPLE, bool measure_latency = false);
+
+    // returns the cached verdict, or calls resolve() and caches its result
+    template <typename Resolve>
+    ForwardingVerdict lookup(const FlowKey& flow, uint64_t generation, Resolve&& resolve);
+
+    void clear();
+    const FlowCacheStats& stats() const { return cache_stats; }
+    void resetStats() { cache_stats = FlowCacheStats(); }
+    size_t capacity() const { return buckets.size() * FLOW_CACHE_WAYS; }
+    FlowCacheMode mode() const { return key_mode; }
+
+private:
+    static constexpr size_t FLOW_CACHE_WAYS = 2;
+
+    struct alignas(32) Entry {
+        uint32_t src_ip;
+        uint32_t dst_ip;
+        uint16_t src_port;
+        uint16_t dst_port;
+        uint8_t protocol;
+        uint8_t valid;
+        uint16_t reserved;
+        uint32_t generation;
+        ForwardingVerdict verdict;
+    };
+
+    // both ways share one cache line, way 0 holds the most recently used entry
+    struct alignas(64) Bucket {
+        Entry ways[FLOW_CACHE_WAYS];
+    };
+
+    std::vector<Bucket> buckets;
+    size_t bucket_mask;
+    FlowCacheMode key_mode;
+    bool measure_latency;
+    FlowCacheStats cache_stats;
+
+    FlowKey normalize(const FlowKey& flow) const;
+    static bool matches(const Entry& entry, const FlowKey& key);
+    void insert(Bucket& bucket, const FlowKey& key, uint32_t generation, const ForwardingVerdict& verdict);
+
+    static uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+inline FlowKey FlowCache::normalize(const FlowKey& flow) const {
+    if (key_mode == FlowCacheMode::DESTINATION) {
+        return {0, flow.dst_ip, 0, 0, 0};
+    }
+    return flow;
+}
+
+inline bool FlowCache::matches(const Entry& entry, const FlowKey& key) {
+    return entry.valid && entry.dst_ip == key.dst_ip && entry.src_ip == key.src_ip &&
+           entry.src_port == key.src_port && entry.dst_port == key.dst_port && entry.protocol == key.protocol;
+}
+
+template <typename Resolve>
+ForwardingVerdict FlowCache::lookup(const FlowKey& flow, uint64_t generation, Resolve&& resolve) {
+    uint64_t start = measure_latency ? nowNs() : 0;
+    FlowKey key = normalize(flow);
+    uint32_t tag = static_cast<uint32_t>(generation);
+    Bucket& bucket = buckets[flowHash(key) & bucket_mask];
+
+    for (size_t way = 0; way < FLOW_CACHE_WAYS; way++) {
+        Entry& entry = bucket.ways[way];
+        if (!matches(entry, key)) {
+            continue;
+        }
+        if (entry.generation != tag) {
+            // resolved against an older table, drop it and take the miss path
+            entry.valid = 0;
+            cache_stats.stale++;
+            break;
+        }
+        ForwardingVerdict verdict = entry.verdict;
+        if (way != 0) {
+            std::swap(bucket.ways[0], bucket.ways[way]);
+        }
+        cache_stats.hits++;
+        if (measure_latency) {
+            cache_stats.hit_ns += nowNs() - start;
+        }
+        return verdict;
+    }
+
+    ForwardingVerdict verdict = resolve();
+    insert(bucket, key, tag, verdict);
+    cache_stats.misses++;
+    if (measure_latency) {
+        cache_stats.miss_ns += nowNs() - start;
+    }
+    return verdict;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "adjacency_table.hpp"
+
+enum class DropReason : uint8_t {
+    NONE = 0,
+    NO_ROUTE,
+    TTL_EXPIRED,
+    MALFORMED,
+    BAD_LENGTH,         // IHL, total length or payload length disagree with each other or the buffer
+    BAD_CHECKSUM,       // IPv4 header checksum
+    BAD_L4_CHECKSUM,    // TCP, UDP or ICMP checksum, only checked when asked for
+    // larger than the output interface's MTU with DF set, or an IPv6 packet (never fragmented on the way)
+    FRAGMENTATION_NEEDED,
+    // to a NAT pool address no session lets it in to, or leaving through the NAT outside interface without one
+    NO_NAT_MAPPING,
+};
+
+constexpr size_t DROP_REASON_COUNT = static_cast<size_t>(DropReason::NO_NAT_MAPPING) + 1;
+
+inline const char* dropReasonName(DropReason reason) {
+    switch (reason) {
+        case DropReason::NONE:            return "none";
+        case DropReason::NO_ROUTE:        return "no route";
+        case DropReason::TTL_EXPIRED:     return "TTL expired";
+        case DropReason::MALFORMED:       return "malformed";
+        case DropReason::BAD_LENGTH:      return "bad length";
+        case DropReason::BAD_CHECKSUM:    return "bad header checksum";
+        case DropReason::BAD_L4_CHECKSUM: return "bad L4 checksum";
+        case DropReason::FRAGMENTATION_NEEDED: return "fragmentation needed";
+        case DropReason::NO_NAT_MAPPING:  return "no NAT mapping";
+    }
+    return "unknown";
+}
+
+struct FlowKey {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t protocol;
+};
+
+/* stable 5-tuple hash (murmur3 finalizer over the packed tuple). the flow cache indexes
+   with the low bits, ECMP picks a path from the high half so the two stay independent */
+inline uint64_t flowHash(const FlowKey& key) {
+    uint64_t h = (static_cast<uint64_t>(key.src_ip) << 32) | key.dst_ip;
+    h ^= ((static_cast<uint64_t>(key.src_port) << 24) | (static_cast<uint64_t>(key.dst_port) << 8) | key.protocol)
+         * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+/* the same for both directions of a flow: the endpoints are hashed in a fixed order, the
+   lower address (then the lower port) first, so a flow and its replies shard alike */
+inline uint64_t symmetricFlowHash(const FlowKey& key) {
+    bool swap = key.src_ip > key.dst_ip || (key.src_ip == key.dst_ip && key.src_port > key.dst_port);
+    return swap ? flowHash(FlowKey{key.dst_ip, key.src_ip, key.dst_port, key.src_port, key.protocol}) : flowHash(key);
+}
+
+inline uint32_t ecmpHash(const FlowKey& key) {
+    return static_cast<uint32_t>(flowHash(key) >> 32);
+}
+
+// IPv6 addresses enter the 5-tuple hash folded to 32 bits
+inline uint32_t foldIPv6(const IPv6Address& address) {
+    uint64_t folded = address.high() ^ address.low();
+    return static_cast<uint32_t>(folded >> 32) ^ static_cast<uint32_t>(folded);
+}
+
+/* outcome of forwarding one packet: where it leaves (interface id and the next hop
+   to resolve, the destination itself for directly connected networks) or why it was
+   dropped. small and string free so it can be cached and batched. IPv6 verdicts leave
+   next_hop at 0, adjacencies().get6(adjacency) has the 128-bit next hop.
+   FRAGMENTATION_NEEDED drops keep the interface they were too large for, so the MTU to
+   report is adjacencies().interfaceMtu(interface_id) */
+struct ForwardingVerdict {
+    uint32_t next_hop;
+    AdjacencyHandle adjacency;
+    uint16_t interface_id;
+    DropReason drop_reason;
+    uint8_t flags;          // VERDICT_*
+
+    bool forwarded() const { return drop_reason == DropReason::NONE; }
+};
+
+/* a forwarded IPv4 packet larger than its interface's MTU, DF clear: whoever sends it
+   cuts it into fragments first (IPv4Fragmenter). verdicts are cached without flags, the
+   MTU check runs on every packet */
+constexpr uint8_t VERDICT_FRAGMENT = 0x01;
+
+inline ForwardingVerdict dropVerdict(DropReason reason) {
+    return {0, NO_ADJACENCY, 0, reason, 0};
+}
+
+// handle as returned by the FIB, next-hop groups pick a member with the flow's ECMP hash
+inline ForwardingVerdict routeVerdict(const AdjacencyTable& adjacencies, AdjacencyHandle handle,
+                                      uint32_t dst_ip, uint32_t flow_hash) {
+    if (handle == NO_ADJACENCY) {
+        return dropVerdict(DropReason::NO_ROUTE);
+    }
+    handle = adjacencies.select(handle, flow_hash);
+    const Adjacency& adjacency = adjacencies.get(handle);
+    return {adjacency.next_hop ? adjacency.next_hop : dst_ip, handle, adjacency.interface_id, DropReason::NONE, 0};
+}
+
+inline ForwardingVerdict routeVerdict6(const AdjacencyTable& adjacencies, AdjacencyHandle handle, uint32_t flow_hash) {
+    if (handle == NO_ADJACENCY) {
+        return dropVerdict(DropReason::NO_ROUTE);
+    }
+    handle = adjacencies.select(handle, flow_hash);
+    return {0, handle, adjacencies.get6(handle).interface_id, DropReason::NONE, 0};
+}
@@ -0,0 +1,217 @@
+#include "forwarding_workers.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+
+ForwardingWorkers::ForwardingWorkers(InternetProtocol& ip, const WorkerConfig& config)
+    : ip(ip), config(config) {
+    size_t count = std::max<size_t>(1, config.workers);
+    for (size_t i = 0; i < count; i++) {
+        workers.push_back(std::make_unique<Worker>(ip.workerContext(), config.ring_size));
+        if (config.flow_cache_entries > 0) {
+            workers.back()->context.enableFlowCache(config.flow_cache_entries);
+        }
+    }
+    // the router's ICMP error rate is shared out between the workers
+    if (const IcmpErrorConfig* errors = ip.icmpErrorConfig()) {
+        IcmpErrorConfig share = *errors;
+        share.rate = std::max<uint32_t>(1, errors->rate / static_cast<uint32_t>(count));
+        share.burst = std::max<uint32_t>(1, errors->burst / static_cast<uint32_t>(count));
+        for (auto& worker : workers) {
+            worker->context.enableIcmpErrors(share);
+        }
+    }
+    // and so is the router's connection table, every worker tracks the flows sharded to it
+    if (const ConnectionTracker* tracker = ip.connectionTracker()) {
+        ConntrackConfig share = tracker->config();
+        share.max_connections = std::max<size_t>(1, share.max_connections / count);
+        for (auto& worker : workers) {
+            worker->context.enableConnectionTracking(share);
+        }
+    }
+    // worker i translates as core i of the table, start() refuses to run with too few cores
+    nat = ip.natTable();
+    if (nat && nat->config().cores >= workers.size()) {
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i]->context.enableNat(nat, i);
+        }
+    }
+}
+
+ForwardingWorkers::~ForwardingWorkers() {
+    stop();
+}
+
+bool ForwardingWorkers::start() {
+    if (running) {
+        return true;
+    }
+    if (nat && nat->config().cores < workers.size()) {
+        log_error("Cannot start %zu forwarding workers: the NAT table has %zu cores",
+                  workers.size(), nat->config().cores);
+        return false;
+    }
+    for (auto& worker : workers) {
+        worker->rcu_id = ip.rcu().registerReader();
+        if (worker->rcu_id < 0) {
+            log_error("Cannot start %zu forwarding workers: no RCU reader slot left", workers.size());
+            for (auto& registered : workers) {
+                if (registered->rcu_id >= 0) {
+                    ip.rcu().unregisterReader(registered->rcu_id);
+                    registered->rcu_id = -1;
+                }
+            }
+            return false;
+        }
+    }
+
+    stopping.store(false, std::memory_order_relaxed);
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i]->thread = std::thread(&ForwardingWorkers::run, this, std::ref(*workers[i]), i);
+    }
+    running = true;
+    log_info("Started %zu forwarding workers (%s)", workers.size(), config.pin_cores ? "pinned" : "unpinned");
+    return true;
+}
+
+void ForwardingWorkers::stop() {
+    if (!running) {
+        return;
+    }
+    flush();
+    // everything was published before the flag, a worker that sees it and an empty ring is done
+    stopping.store(true, std::memory_order_release);
+    for (auto& worker : workers) {
+        worker->thread.join();
+        ip.rcu().unregisterReader(worker->rcu_id);
+        worker->rcu_id = -1;
+    }
+    running = false;
+}
+
+/* RSS-style sharding on bits 16..31 of the symmetric flow hash, so both directions of a
+   flow reach the same worker: the flow cache indexes with the low bits and ECMP uses the
+   high half, so neither is skewed within a worker. with NAT
+   on, packets to the pool go to the worker owning their port instead, the one that
+   opened their session */
+size_t ForwardingWorkers::workerFor(PacketView packet) const {
+    if (nat) {
+        int owner = nat->ownerOf(packet);
+        if (owner >= 0) {
+            return static_cast<size_t>(owner) % workers.size();
+        }
+    }
+    uint64_t hash = symmetricFlowHash(InternetProtocol::packetFlowKey(packet));
+    return static_cast<size_t>(((hash >> 16) & 0xFFFF) * workers.size() >> 16);
+}
+
+void ForwardingWorkers::dispatch(PacketHandle packet) {
+    Worker& worker = *workers[workerFor(packet.view())];
+    worker.staged[worker.staged_count++] = std::move(packet);
+    if (worker.staged_count == WORKER_BURST) {
+        publish(worker);
+    }
+}
+
+void ForwardingWorkers::flush() {
+    for (auto& worker : workers) {
+        publish(*worker);
+    }
+}
+
+void ForwardingWorkers::publish(Worker& worker) {
+    size_t pushed = 0;
+    while (pushed < worker.staged_count) {
+        size_t n = worker.ring.pushBurst(worker.staged + pushed, worker.staged_count - pushed);
+        if (n == 0) {
+            ingress_stalls++;
+            std::this_thread::yield();
+        }
+        pushed += n;
+    }
+    worker.staged_count = 0;
+}
+
+void ForwardingWorkers::run(Worker& worker, size_t index) {
+    if (config.pin_cores) {
+        size_t cores = std::max(1u, std::thread::hardware_concurrency());
+        size_t core = (config.first_core + index) % cores;
+        if (pinCurrentThread(core)) {
+            worker.stats.core = static_cast<int>(core);
+        } else {
+            log_warning("Could not pin forwarding worker %zu to core %zu", index, core);
+        }
+    }
+
+    RcuDomain& rcu = ip.rcu();
+    WorkerStats& stats = worker.stats;
+    PacketHandle burst[WORKER_BURST];
+    BurstResult result;
+    BurstResult error_result;
+    size_t empty_polls = 0;
+    bool online = true;
+
+    while (true) {
+        bool stop_requested = stopping.load(std::memory_order_acquire);
+        size_t count = worker.ring.popBurst(burst, WORKER_BURST);
+        if (count == 0) {
+            if (stop_requested) {
+                break;
+            }
+            stats.idle_polls++;
+            if (++empty_polls >= WORKER_IDLE_SPINS) {
+                // nothing to do for a while: stop holding up route updates and give the core away
+                if (online) {
+                    rcu.offline(worker.rcu_id);
+                    online = false;
+                }
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        empty_polls = 0;
+        if (!online) {
+            rcu.online(worker.rcu_id);
+            online = true;
+        }
+        worker.context.forwardBurst(burst, count, result);
+        for (size_t i = 0; i < count; i++) {
+            switch (result.verdicts[i].drop_reason) {
+                case DropReason::NONE:
+                    stats.forwarded++;
+                    stats.fragmented += (result.verdicts[i].flags & VERDICT_FRAGMENT) != 0;
+                    break;
+                case DropReason::NO_ROUTE:        stats.no_route++; break;
+                case DropReason::TTL_EXPIRED:     stats.ttl_expired++; break;
+                case DropReason::MALFORMED:       stats.malformed++; break;
+                case DropReason::BAD_LENGTH:      stats.bad_length++; break;
+                case DropReason::BAD_CHECKSUM:    stats.bad_checksum++; break;
+                case DropReason::BAD_L4_CHECKSUM: stats.bad_l4_checksum++; break;
+                case DropReason::FRAGMENTATION_NEEDED: stats.too_big++; break;
+                case DropReason::NO_NAT_MAPPING:  stats.no_nat_mapping++; break;
+            }
+            burst[i].reset();
+        }
+        // fragmentation needed errors go back out through the pipeline, as in forwardPackets
+        if (size_t errors = worker.context.icmpErrorCount()) {
+            worker.context.processBurst(worker.context.icmpErrorOutput(), errors, error_result);
+            stats.icmp_errors += error_result.forwarded;
+        }
+        stats.packets += count;
+        stats.bursts++;
+        rcu.quiescent(worker.rcu_id);
+    }
+
+    if (online) {
+        rcu.offline(worker.rcu_id);
+    }
+}
+
+bool ForwardingWorkers::pinCurrentThread(size_t core) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "internet_protocol.hpp"
+#include "packet_pool.hpp"
+#include "spsc_ring.hpp"
+
+/* Worker-per-core forwarding.
+   One ingress thread hashes every packet's 5-tuple to a worker, RSS style, so all
+   packets of a flow land on the same worker and stay in order. Each worker has its own
+   single-producer/single-consumer ring, its own InternetProtocol context (flow cache,
+   counters) and, optionally, its own core. The FIB is shared read-only: workers are
+   RCU readers that pass a quiescent state after every burst and go offline while idle,
+   so route updates keep running next to them.
+
+   Ingress stages packets per worker and publishes them a burst at a time. A full ring
+   applies backpressure (the ingress thread waits) rather than dropping. Packets are
+   moved as PacketHandles, rewritten in place (TTL, checksum) by the worker and freed
+   once forwarded. With NAT on (InternetProtocol::enableNat), worker i translates as
+   core i of the table. With ICMP errors on (enableIcmpErrors), every worker answers the
+   packets too big for their interface itself, holding to its share of the rate. With
+   connection tracking on (enableConnectionTracking), every worker tracks the flows
+   sharded to it in a table of its share of the connections: the sharding sends both
+   directions of a flow to the same worker. */
+
+constexpr size_t WORKER_RING_SIZE = 1024;
+constexpr size_t WORKER_BURST = 32;
+static_assert(WORKER_BURST <= IP_MAX_BURST, "a worker burst must fit one forwardBurst call");
+constexpr size_t WORKER_IDLE_SPINS = 64;    // empty polls before a worker yields and goes RCU offline
+
+struct WorkerConfig {
+    size_t workers = 1;
+    size_t ring_size = WORKER_RING_SIZE;
+    bool pin_cores = true;
+    size_t first_core = 0;              // worker i runs on core (first_core + i) mod cores
+    size_t flow_cache_entries = 0;      // per worker, 0 for none
+};
+
+// written by the worker only, read once the workers are stopped
+struct alignas(64) WorkerStats {
+    uint64_t packets = 0;
+    uint64_t forwarded = 0;
+    uint64_t fragmented = 0;            // forwarded packets that leave in fragments (VERDICT_FRAGMENT)
+    uint64_t no_route = 0;
+    uint64_t ttl_expired = 0;
+    uint64_t malformed = 0;
+    uint64_t bad_length = 0;            // ingress checks
+    uint64_t bad_checksum = 0;
+    uint64_t bad_l4_checksum = 0;
+    uint64_t too_big = 0;               // over the output interface's MTU and not to be fragmented
+    uint64_t no_nat_mapping = 0;        // refused by NAT
+    uint64_t icmp_errors = 0;           // fragmentation needed errors for the too_big ones, forwarded
+    uint64_t bursts = 0;
+    uint64_t idle_polls = 0;
+    int core = -1;                      // core the worker was pinned to, -1 when not pinned
+
+    uint64_t dropped() const {
+        return no_route + ttl_expired + malformed + bad_length + bad_checksum + bad_l4_checksum + too_big + no_nat_mapping;
+    }
+};
+
+class ForwardingWorkers {
+public:
+    ForwardingWorkers(InternetProtocol& ip, const WorkerConfig& config);
+    ~ForwardingWorkers();
+    ForwardingWorkers(const ForwardingWorkers&) = delete;
+    ForwardingWorkers& operator=(const ForwardingWorkers&) = delete;
+
+    // false when the workers could not all be registered as RCU readers
+    bool start();
+    // ingress side, one thread only
+    void dispatch(PacketHandle packet);
+    // pushes every staged packet to its ring, waiting for room where needed
+    void flush();
+    // flushes, lets the workers drain their rings and joins them
+    void stop();
+
+    // the worker a packet's flow is sharded to
+    size_t workerFor(PacketView packet) const;
+    size_t workerCount() const { return workers.size(); }
+    const WorkerStats& stats(size_t worker) const { return workers[worker]->stats; }
+    const FlowCacheStats* flowCacheStats(size_t worker) const { return workers[worker]->context.flowCacheStats(); }
+    // nullptr when the workers do not translate
+    const NatStats* natStats(size_t worker) const { return workers[worker]->context.natStats(); }
+    // nullptr when the workers do not track connections
+    const ConntrackStats* conntrackStats(size_t worker) const { return workers[worker]->context.conntrackStats(); }
+    // times the ingress thread found a ring full and had to wait
+    uint64_t ingressStalls() const { return ingress_stalls; }
+
+private:
+    struct Worker {
+        explicit Worker(InternetProtocol context, size_t ring_size)
+            : ring(ring_size), context(std::move(context)) {}
+
+        SpscRing<PacketHandle> ring;
+        InternetProtocol context;
+        int rcu_id = -1;
+        WorkerStats stats;
+        std::thread thread;
+        // ingress-only staging, published to the ring a burst at a time
+        PacketHandle staged[WORKER_BURST];
+        size_t staged_count = 0;
+    };
+
+    InternetProtocol& ip;
+    WorkerConfig config;
+    std::shared_ptr<NatTable> nat;      // ip's, shared by the workers
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> stopping{false};
+    bool running = false;
+    uint64_t ingress_stalls = 0;
+
+    void run(Worker& worker, size_t index);
+    void publish(Worker& worker);
+    static bool pinCurrentThread(size_t core);
+};
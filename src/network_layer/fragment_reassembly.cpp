@@ -0,0 +1,353 @@
+#include "fragment_reassembly.hpp"
+#include "internet_protocol.hpp"
+#include "checksum.hpp"
+#include "packet_builders.hpp"
+#include <algorithm>
+#include <cstring>
+
+constexpr uint16_t IPV4_FLAG_DF = 0x4000;
+constexpr uint16_t IPV4_FLAG_MF = 0x2000;
+constexpr uint16_t IPV4_OFFSET_MASK = 0x1FFF;
+
+FragmentReassembler::FragmentReassembler(const ReassemblyConfig& config)
+    : settings(config),
+      pool(std::max<size_t>(config.memory_limit / std::max<size_t>(config.fragment_size, 1), 1),
+           config.fragment_size, 0),
+      fragment_slots(pool.capacity()),
+      datagrams(std::max<size_t>(config.max_datagrams, 1)),
+      timers(datagrams.size(), config.timeout_ns / std::max<uint64_t>(config.tick_ns, 1) + 2, config.tick_ns),
+      out(REASSEMBLY_OUTPUT_BURST + config.max_fragments + 1),
+      output_area(config.mode == ReassemblyMode::FULL ? new uint8_t[REASSEMBLY_OUTPUT_SIZE] : nullptr) {
+    for (size_t i = fragment_slots.size(); i-- > 0;) {
+        fragment_slots[i].next = free_fragments;
+        free_fragments = static_cast<uint32_t>(i);
+    }
+    for (size_t i = datagrams.size(); i-- > 0;) {
+        datagrams[i].hash_next = free_datagrams;
+        free_datagrams = static_cast<uint32_t>(i);
+    }
+    size_t bucket_count = 1;
+    while (bucket_count < 2 * datagrams.size()) {
+        bucket_count <<= 1;
+    }
+    buckets.assign(bucket_count, NONE);
+    bucket_mask = bucket_count - 1;
+    released.reserve(out.size());
+}
+
+ReassemblyStats FragmentReassembler::stats() const {
+    ReassemblyStats result = counters;
+    result.datagrams = active;
+    result.buffers = held;
+    result.memory = held * settings.fragment_size;
+    return result;
+}
+
+size_t FragmentReassembler::reassemble(const PacketView* packets, size_t count, uint64_t now_ns) {
+    // what the last call handed out is the caller's no more
+    for (uint32_t fragment : released) {
+        freeFragment(fragment);
+    }
+    released.clear();
+    out_count = 0;
+    output_used = 0;
+    expire(now_ns);
+
+    size_t consumed = 0;
+    for (; consumed < count; consumed++) {
+        if (out_count >= REASSEMBLY_OUTPUT_BURST || output_used + IPV4_MAX_DATAGRAM > REASSEMBLY_OUTPUT_SIZE) {
+            break;
+        }
+        PacketView packet = packets[consumed];
+        if ((packet.u8(0) >> 4) != 4 || !isFragment(packet.u16(offsetof(IPv4Header, flags_fragment_offset)))) {
+            out[out_count++] = packet;
+            continue;
+        }
+        addFragment(packet, now_ns);
+    }
+    return consumed;
+}
+
+void FragmentReassembler::expire(uint64_t now_ns) {
+    timers.advance(now_ns, [this](uint32_t index) {
+        counters.timeouts++;
+        dropDatagram(index);
+    });
+}
+
+void FragmentReassembler::addFragment(PacketView packet, uint64_t now_ns) {
+    counters.fragments++;
+    IPv4HeaderView header(packet);
+    size_t header_length = header.headerLength();
+    size_t total_length = header.totalLength();
+    if (!header.valid() || header_length < IPv4_HEADER_SIZE || total_length < header_length ||
+        total_length > packet.size()) {
+        counters.malformed++;
+        return;
+    }
+    uint16_t flags = header.flagsFragmentOffset();
+    bool more = flags & IPV4_FLAG_MF;
+    uint32_t offset = static_cast<uint32_t>(flags & IPV4_OFFSET_MASK) * 8;
+    uint32_t length = static_cast<uint32_t>(total_length - header_length);
+    // every fragment but the last carries a multiple of 8 bytes, none reaches past 64 KiB
+    if (length == 0 || (more && length % 8 != 0) || offset + length + IPv4_HEADER_SIZE > IPV4_MAX_DATAGRAM) {
+        counters.malformed++;
+        return;
+    }
+    packet = PacketView(packet.data(), total_length);
+
+    uint32_t src_ip = header.srcIp(), dst_ip = header.dstIp();
+    uint16_t id = header.identification();
+    uint8_t protocol = header.protocol();
+    size_t bucket = bucketOf(src_ip, dst_ip, id, protocol);
+    uint32_t index = findDatagram(src_ip, dst_ip, id, protocol, bucket);
+    if (index == NONE) {
+        index = newDatagram(bucket, now_ns);
+        Datagram& fresh = datagrams[index];
+        fresh.src_ip = src_ip;
+        fresh.dst_ip = dst_ip;
+        fresh.id = id;
+        fresh.protocol = protocol;
+    }
+    Datagram& datagram = datagrams[index];
+
+    // a second last fragment, or pieces past the end, cannot belong to one datagram
+    uint32_t end = offset + length;
+    bool past_end = datagram.total != 0 && (more ? end > datagram.total : end != datagram.total);
+    for (uint32_t fragment = datagram.fragments; !more && fragment != NONE; fragment = fragment_slots[fragment].next) {
+        past_end |= fragment_slots[fragment].offset + fragment_slots[fragment].length > end;
+    }
+    if (past_end) {
+        counters.malformed++;
+        dropDatagram(index);
+        return;
+    }
+    if (!more) {
+        datagram.total = end;
+    }
+
+    if (settings.mode == ReassemblyMode::FIRST_FRAGMENT && (datagram.header_length != 0 || offset == 0)) {
+        // the transport header went out or goes out now, the fragment follows it as it is
+        out[out_count++] = packet;
+        counters.passed++;
+        datagram.received += length;
+        if (offset == 0 && datagram.header_length == 0) {
+            datagram.header_length = static_cast<uint8_t>(header_length);
+            releaseHeld(index);
+        }
+        if (datagram.total != 0 && datagram.received >= datagram.total) {
+            freeDatagram(index);
+        }
+        return;
+    }
+
+    if (total_length > settings.fragment_size || datagram.fragment_count >= settings.max_fragments) {
+        counters.malformed++;
+        dropDatagram(index);
+        return;
+    }
+    uint32_t fragment = holdFragment(packet, index);
+    if (fragment == NONE) {
+        // every other datagram is gone and there is still no buffer
+        counters.evictions++;
+        dropDatagram(index);
+        return;
+    }
+    Fragment& slot = fragment_slots[fragment];
+    slot.offset = offset;
+    slot.length = static_cast<uint16_t>(length);
+    slot.header_length = static_cast<uint16_t>(header_length);
+    bool duplicate = false;
+    if (!insertFragment(datagram, fragment, duplicate)) {
+        freeFragment(fragment);
+        if (duplicate) {
+            counters.duplicates++;
+        } else {
+            counters.overlaps++;
+            dropDatagram(index);
+        }
+        return;
+    }
+    datagram.fragment_count++;
+    datagram.received += length;
+    if (offset == 0) {
+        datagram.header_length = static_cast<uint8_t>(header_length);
+        std::memcpy(datagram.header, packet.data(), header_length);
+    }
+    // the fragments do not overlap, so all the bytes are there once their count is
+    if (datagram.total != 0 && datagram.received == datagram.total && datagram.header_length != 0) {
+        completeDatagram(index);
+    }
+}
+
+size_t FragmentReassembler::bucketOf(uint32_t src_ip, uint32_t dst_ip, uint16_t id, uint8_t protocol) const {
+    return flowHash(FlowKey{src_ip, dst_ip, id, 0, protocol}) & bucket_mask;
+}
+
+uint32_t FragmentReassembler::findDatagram(uint32_t src_ip, uint32_t dst_ip, uint16_t id, uint8_t protocol,
+                                           size_t bucket) const {
+    for (uint32_t index = buckets[bucket]; index != NONE; index = datagrams[index].hash_next) {
+        const Datagram& datagram = datagrams[index];
+        if (datagram.src_ip == src_ip && datagram.dst_ip == dst_ip && datagram.id == id &&
+            datagram.protocol == protocol) {
+            return index;
+        }
+    }
+    return NONE;
+}
+
+uint32_t FragmentReassembler::newDatagram(size_t bucket, uint64_t now_ns) {
+    if (free_datagrams == NONE) {
+        evictOldest(NONE);
+    }
+    uint32_t index = free_datagrams;
+    Datagram& datagram = datagrams[index];
+    free_datagrams = datagram.hash_next;
+    datagram = Datagram();
+    datagram.hash_next = buckets[bucket];
+    buckets[bucket] = index;
+    datagram.deadline_ns = now_ns + settings.timeout_ns;
+    timers.schedule(index, datagram.deadline_ns);
+    active++;
+    return index;
+}
+
+void FragmentReassembler::dropDatagram(uint32_t index) {
+    counters.fragments_dropped += datagrams[index].fragment_count;
+    freeDatagram(index);
+}
+
+void FragmentReassembler::freeDatagram(uint32_t index) {
+    Datagram& datagram = datagrams[index];
+    for (uint32_t fragment = datagram.fragments; fragment != NONE;) {
+        uint32_t next = fragment_slots[fragment].next;
+        freeFragment(fragment);
+        fragment = next;
+    }
+    uint32_t* link = &buckets[bucketOf(datagram.src_ip, datagram.dst_ip, datagram.id, datagram.protocol)];
+    while (*link != index) {
+        link = &datagrams[*link].hash_next;
+    }
+    *link = datagram.hash_next;
+    timers.cancel(index);
+    datagram.fragments = NONE;
+    datagram.fragment_count = 0;
+    datagram.hash_next = free_datagrams;
+    free_datagrams = index;
+    active--;
+}
+
+uint32_t FragmentReassembler::holdFragment(PacketView packet, uint32_t keep) {
+    while (true) {
+        if (free_fragments != NONE) {
+            PacketHandle buffer = pool.copyIn(packet.data(), packet.size());
+            if (buffer) {
+                uint32_t index = free_fragments;
+                Fragment& fragment = fragment_slots[index];
+                free_fragments = fragment.next;
+                fragment.buffer = std::move(buffer);
+                fragment.next = NONE;
+                held++;
+                return index;
+            }
+        }
+        if (!evictOldest(keep)) {
+            return NONE;
+        }
+    }
+}
+
+void FragmentReassembler::freeFragment(uint32_t index) {
+    Fragment& fragment = fragment_slots[index];
+    fragment.buffer.reset();
+    fragment.next = free_fragments;
+    free_fragments = index;
+    held--;
+}
+
+// the datagram due first makes room, keep is left out of the choice
+bool FragmentReassembler::evictOldest(uint32_t keep) {
+    bool parked = keep != NONE && timers.scheduled(keep);
+    if (parked) {
+        timers.cancel(keep);
+    }
+    uint32_t victim = timers.earliest();
+    if (parked) {
+        timers.schedule(keep, datagrams[keep].deadline_ns);
+    }
+    if (victim == NONE) {
+        return false;
+    }
+    counters.evictions++;
+    dropDatagram(victim);
+    return true;
+}
+
+bool FragmentReassembler::insertFragment(Datagram& datagram, uint32_t fragment, bool& duplicate) {
+    Fragment& inserted = fragment_slots[fragment];
+    uint32_t start = inserted.offset, end = inserted.offset + inserted.length;
+    uint32_t previous = NONE, next = datagram.fragments;
+    while (next != NONE && fragment_slots[next].offset < start) {
+        previous = next;
+        next = fragment_slots[next].next;
+    }
+    // the neighbours on either side must end before it starts and start after it ends
+    if (next != NONE) {
+        const Fragment& after = fragment_slots[next];
+        if (after.offset == start && after.length == inserted.length) {
+            duplicate = true;
+            return false;
+        }
+        if (after.offset < end) {
+            return false;
+        }
+    }
+    if (previous != NONE && fragment_slots[previous].offset + fragment_slots[previous].length > start) {
+        return false;
+    }
+    inserted.next = next;
+    (previous == NONE ? datagram.fragments : fragment_slots[previous].next) = fragment;
+    return true;
+}
+
+void FragmentReassembler::completeDatagram(uint32_t index) {
+    Datagram& datagram = datagrams[index];
+    size_t size = datagram.header_length + static_cast<size_t>(datagram.total);
+    if (size > IPV4_MAX_DATAGRAM) {
+        counters.malformed++;
+        dropDatagram(index);
+        return;
+    }
+    // the first fragment's header, options and all, with the fragmentation undone
+    uint8_t* packet = output_area.get() + output_used;
+    std::memcpy(packet, datagram.header, datagram.header_length);
+    uint16_t flags = static_cast<uint16_t>((packet[6] << 8) | packet[7]) & IPV4_FLAG_DF;
+    packet[2] = static_cast<uint8_t>(size >> 8);
+    packet[3] = static_cast<uint8_t>(size);
+    packet[6] = static_cast<uint8_t>(flags >> 8);
+    packet[7] = 0;
+    uint16_t checksum = ipv4HeaderChecksum(packet, datagram.header_length);
+    packet[10] = static_cast<uint8_t>(checksum >> 8);
+    packet[11] = static_cast<uint8_t>(checksum);
+    for (uint32_t fragment = datagram.fragments; fragment != NONE; fragment = fragment_slots[fragment].next) {
+        const Fragment& piece = fragment_slots[fragment];
+        std::memcpy(packet + datagram.header_length + piece.offset, piece.buffer->data() + piece.header_length,
+                    piece.length);
+    }
+    out[out_count++] = PacketView(packet, size);
+    output_used += size;
+    counters.reassembled++;
+    freeDatagram(index);
+}
+
+void FragmentReassembler::releaseHeld(uint32_t index) {
+    Datagram& datagram = datagrams[index];
+    for (uint32_t fragment = datagram.fragments; fragment != NONE; fragment = fragment_slots[fragment].next) {
+        out[out_count++] = fragment_slots[fragment].buffer->view();
+        released.push_back(fragment);
+        counters.passed++;
+    }
+    // the buffers stay allocated until the next call, they are no longer the datagram's
+    datagram.fragments = NONE;
+    datagram.fragment_count = 0;
+}
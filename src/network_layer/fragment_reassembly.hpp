@@ -0,0 +1,150 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "packet_pool.hpp"
+#include "packet_view.hpp"
+#include "timer_wheel.hpp"
+
+constexpr size_t IPV4_MAX_DATAGRAM = 65535;
+// reassembled datagrams of one reassemble() call, at least one of the largest fits
+constexpr size_t REASSEMBLY_OUTPUT_SIZE = 4 * IPV4_MAX_DATAGRAM;
+// packets one reassemble() call hands out before it stops, the pipeline's burst size
+constexpr size_t REASSEMBLY_OUTPUT_BURST = 64;
+
+enum class ReassemblyMode : uint8_t {
+    FULL,               // fragments are held and the whole datagram comes out
+    FIRST_FRAGMENT,     // fragments pass as they are, the first one of a datagram ahead of the rest
+};
+
+/* limits of the reassembler. everything it holds lives in memory_limit bytes of
+   fragment buffers and max_datagrams contexts, both allocated up front: a fragment
+   flood evicts the datagrams closest to timing out and never makes it grow */
+struct ReassemblyConfig {
+    ReassemblyMode mode = ReassemblyMode::FULL;
+    size_t memory_limit = 4 << 20;              // fragment buffers of all datagrams together
+    size_t max_datagrams = 4096;                // in progress at once
+    size_t max_fragments = 64;                  // per datagram, a 64 KiB datagram over a 1500 byte MTU takes 45
+    size_t fragment_size = 2048;                // largest fragment held, header included, larger ones are dropped
+    uint64_t timeout_ns = 2000000000;           // from the first fragment of a datagram to giving up on it
+    uint64_t tick_ns = 10000000;                // timer resolution, expiry is up to a tick late
+};
+
+struct ReassemblyStats {
+    uint64_t fragments = 0;         // fragments that came in
+    uint64_t reassembled = 0;       // datagrams completed (FULL)
+    uint64_t passed = 0;            // fragments handed on as they are (FIRST_FRAGMENT)
+    uint64_t timeouts = 0;          // datagrams given up on when their time ran out
+    uint64_t evictions = 0;         // datagrams dropped to make room, the table or the buffers were full
+    uint64_t overlaps = 0;          // datagrams dropped for fragments overlapping each other
+    uint64_t duplicates = 0;        // fragments seen before, dropped on their own
+    uint64_t malformed = 0;         // bad offsets or lengths, too large, too many fragments
+    uint64_t fragments_dropped = 0; // held fragments freed with their datagram, never handed on
+
+    size_t datagrams = 0;           // in progress now
+    size_t buffers = 0;             // fragment buffers in use now
+    size_t memory = 0;              // their bytes
+};
+
+/* IPv4 fragment reassembly in front of the pipeline.
+   datagrams in progress are found through a chained hash table on (source, destination,
+   identification, protocol) and hold their fragments in pooled buffers, a list sorted
+   by offset. a timer wheel expires every datagram timeout_ns after its first fragment,
+   and when the table or the buffers run out the datagram due first is evicted for the
+   new one. per fragment the work is a hash probe, a walk of at most max_fragments list
+   entries and one copy of the payload, whatever the traffic looks like.
+
+   overlapping fragments drop the whole datagram (the usual evasion trick), exact
+   duplicates are dropped on their own. FIRST_FRAGMENT mode copies nothing in the
+   common, in-order case: it only holds the fragments that arrive before the first one
+   of their datagram and lets them go right behind it, so consumers that only look at
+   the transport header see it before anything else of the datagram. not thread safe,
+   one instance per forwarding thread */
+class FragmentReassembler {
+public:
+    explicit FragmentReassembler(const ReassemblyConfig& config = ReassemblyConfig());
+
+    /* takes the fragments out of a run of packets: packets that are not fragments pass
+       through, fragments are held and a datagram they complete comes out in place of the
+       fragment that completed it. returns how many of the packets were consumed, at least
+       one when count > 0, fewer than count once the output is full. output() holds what
+       came out of them, valid until the next call. expires due datagrams first */
+    size_t reassemble(const PacketView* packets, size_t count, uint64_t now_ns);
+    const PacketView* output() const { return out.data(); }
+    size_t outputCount() const { return out_count; }
+
+    // drops the datagrams whose time is up by now_ns
+    void expire(uint64_t now_ns);
+
+    const ReassemblyConfig& config() const { return settings; }
+    ReassemblyStats stats() const;
+
+    // the fragment bits of the IPv4 flags and fragment offset field
+    static bool isFragment(uint16_t flags_fragment_offset) { return (flags_fragment_offset & 0x3FFF) != 0; }
+
+private:
+    static constexpr uint32_t NONE = TimerWheel::NONE;
+
+    // one held fragment, header and payload, in a pooled buffer, the next one by offset
+    struct Fragment {
+        PacketHandle buffer;
+        uint32_t offset = 0;        // of the payload in the datagram, bytes
+        uint16_t length = 0;        // payload bytes
+        uint16_t header_length = 0;
+        uint32_t next = NONE;
+    };
+
+    struct Datagram {
+        uint32_t src_ip = 0;
+        uint32_t dst_ip = 0;
+        uint16_t id = 0;
+        uint8_t protocol = 0;
+        uint8_t header_length = 0;  // of the first fragment, 0 until it arrived
+        uint32_t hash_next = NONE;  // chain in the hash table, or the free list
+        uint32_t fragments = NONE;  // held fragments by offset
+        uint32_t fragment_count = 0;
+        uint32_t received = 0;      // payload bytes held or passed on
+        uint32_t total = 0;         // payload length, 0 until the last fragment arrived
+        uint64_t deadline_ns = 0;
+        uint8_t header[60];         // the first fragment's header (FULL)
+    };
+
+    ReassemblyConfig settings;
+    PacketPool pool;
+    std::vector<Fragment> fragment_slots;
+    uint32_t free_fragments = NONE;
+    std::vector<Datagram> datagrams;
+    uint32_t free_datagrams = NONE;
+    std::vector<uint32_t> buckets;
+    size_t bucket_mask = 0;
+    TimerWheel timers;
+    size_t active = 0;
+    size_t held = 0;
+    ReassemblyStats counters;
+
+    std::vector<PacketView> out;    // room for a full burst and a datagram's held fragments behind it
+    size_t out_count = 0;
+    std::unique_ptr<uint8_t[]> output_area;
+    size_t output_used = 0;
+    // fragments handed out of the pool last call, freed at the start of the next
+    std::vector<uint32_t> released;
+
+    void addFragment(PacketView packet, uint64_t now_ns);
+    uint32_t findDatagram(uint32_t src_ip, uint32_t dst_ip, uint16_t id, uint8_t protocol, size_t bucket) const;
+    // a fresh context linked into bucket, evicting the datagram due first when the table is full
+    uint32_t newDatagram(size_t bucket, uint64_t now_ns);
+    // frees a datagram that will not be delivered, its held fragments counted as dropped
+    void dropDatagram(uint32_t index);
+    void freeDatagram(uint32_t index);
+    // a fragment slot holding a copy of packet, evicting datagrams other than keep for the buffer
+    uint32_t holdFragment(PacketView packet, uint32_t keep);
+    void freeFragment(uint32_t index);
+    bool evictOldest(uint32_t keep);
+    // links the fragment in by offset, false when it overlaps one already there
+    bool insertFragment(Datagram& datagram, uint32_t fragment, bool& duplicate);
+    void completeDatagram(uint32_t index);
+    // FIRST_FRAGMENT: the held fragments go out behind the first one
+    void releaseHeld(uint32_t index);
+    size_t bucketOf(uint32_t src_ip, uint32_t dst_ip, uint16_t id, uint8_t protocol) const;
+};
@@ -1,25 +1,23 @@
 #include "icmp.hpp"
 #include "logger.hpp"
 #include "packet_builders.hpp"
+#include "checksum.hpp"
+#include "ip_fragmentation.hpp"
 #include <iostream>
+#include <algorithm>
 #include <cstring>
 #include <arpa/inet.h>
 
-ICMPHeader ICMP::parseHeader(const std::vector<uint8_t>& packet, size_t offset) {
-    if (packet.size() < offset + ICMP_HEADER_SIZE) {
+ICMPHeaderView ICMP::parseHeader(PacketView packet, size_t offset) {
+    ICMPHeaderView header(packet, offset);
+    if (!header.valid()) {
         log_error("Packet too short for ICMP header");
         return {};
     }
 
-    ICMPHeader header;
-    std::memcpy(&header, packet.data() + offset, sizeof(ICMPHeader));
-    header.checksum = ntohs(header.checksum);
-    header.identifier = ntohs(header.identifier);
-    header.sequence = ntohs(header.sequence);
-
     log_debug("Parsed ICMP header - Type: %d (%s), Code: %d, ID: %d, Seq: %d",
-              header.type, getTypeName(header.type).c_str(), header.code,
-              header.identifier, header.sequence);
+              header.type(), getTypeName(header.type()).c_str(), header.code(),
+              header.identifier(), header.sequence());
 
     return header;
 }
@@ -38,50 +36,108 @@ ICMPHeader ICMP::createHeader(uint8_t type, uint16_t identifier, uint16_t sequen
 
 std::vector<uint8_t> ICMP::serializeHeader(const ICMPHeader& header) {
     std::vector<uint8_t> icmp_header(ICMP_HEADER_SIZE);
-
-    icmp_header[0] = header.type;
-    icmp_header[1] = header.code;
-    icmp_header[2] = (header.checksum >> 8) & 0xFF;
-    icmp_header[3] = header.checksum & 0xFF;
-    icmp_header[4] = (header.identifier >> 8) & 0xFF;
-    icmp_header[5] = header.identifier & 0xFF;
-    icmp_header[6] = (header.sequence >> 8) & 0xFF;
-    icmp_header[7] = header.sequence & 0xFF;
-
+    writeHeader(icmp_header.data(), header);
     return icmp_header;
 }
 
-uint16_t ICMP::calculateChecksum(const std::vector<uint8_t>& icmp_data) {
+void ICMP::writeHeader(uint8_t* out, const ICMPHeader& header) {
+    out[0] = header.type;
+    out[1] = header.code;
+    out[2] = (header.checksum >> 8) & 0xFF;
+    out[3] = header.checksum & 0xFF;
+    out[4] = (header.identifier >> 8) & 0xFF;
+    out[5] = header.identifier & 0xFF;
+    out[6] = (header.sequence >> 8) & 0xFF;
+    out[7] = header.sequence & 0xFF;
+}
+
+uint16_t ICMP::calculateChecksum(const uint8_t* icmp_data, size_t length) {
     /* Calculate ICMP checksum according to RFC 792 (Internet Control Message Protocol):
        The checksum covers the entire ICMP message (header + data) as 16-bit words.
        For messages with odd length, the last byte is padded with zero.
        The checksum is the one's complement of the sum of all 16-bit words.
     */
-    uint32_t sum = 0;
-
-    for (size_t i = 0; i < icmp_data.size(); i += 2) {
-        if (i + 1 < icmp_data.size()) {
-            sum += (icmp_data[i] << 8) + icmp_data[i + 1];
-        } else {
-            sum += icmp_data[i] << 8;  // pad odd length
-        }
+    return internetChecksum(icmp_data, length);
+}
+
+size_t ICMP::buildError(uint8_t type, uint8_t code, uint32_t rest, PacketView original, uint32_t source_ip,
+                        uint8_t* out, size_t capacity) {
+    IPv4HeaderView original_header(original);
+    if (!original_header.valid()) {
+        return 0;
+    }
+    size_t quote = std::min({original.size(), static_cast<size_t>(original_header.totalLength()),
+                             ICMP_ERROR_MAX_SIZE - IPv4_HEADER_SIZE - ICMP_HEADER_SIZE});
+    size_t length = IPv4_HEADER_SIZE + ICMP_HEADER_SIZE + quote;
+    if (length > capacity) {
+        return 0;
     }
 
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
+    uint8_t* ip = out;
+    uint32_t destination_ip = original_header.srcIp();
+    ip[0] = 0x45;
+    ip[1] = 0xC0;                                   // internetwork control precedence (RFC 1812 4.3.2.5)
+    ip[2] = static_cast<uint8_t>(length >> 8);
+    ip[3] = static_cast<uint8_t>(length);
+    std::memset(ip + 4, 0, 4);                      // identification, flags and offset
+    ip[8] = 64;
+    ip[9] = PROTOCOL_ICMP;
+    for (int i = 0; i < 4; i++) {
+        ip[12 + i] = static_cast<uint8_t>(source_ip >> (24 - 8 * i));
+        ip[16 + i] = static_cast<uint8_t>(destination_ip >> (24 - 8 * i));
     }
+    uint16_t ip_checksum = ipv4HeaderChecksum(ip, IPv4_HEADER_SIZE);
+    ip[10] = static_cast<uint8_t>(ip_checksum >> 8);
+    ip[11] = static_cast<uint8_t>(ip_checksum);
 
-    return ~sum;
+    uint8_t* icmp = out + IPv4_HEADER_SIZE;
+    ICMPHeader header = {type, code, 0, static_cast<uint16_t>(rest >> 16), static_cast<uint16_t>(rest)};
+    writeHeader(icmp, header);
+    std::memcpy(icmp + ICMP_HEADER_SIZE, original.data(), quote);
+    uint16_t checksum = calculateChecksum(icmp, ICMP_HEADER_SIZE + quote);
+    icmp[ICMP_CHECKSUM_OFFSET] = static_cast<uint8_t>(checksum >> 8);
+    icmp[ICMP_CHECKSUM_OFFSET + 1] = static_cast<uint8_t>(checksum);
+    return length;
 }
 
-void ICMP::printHeader(const ICMPHeader& h) {
+bool ICMP::errorAllowed(PacketView original) {
+    IPv4HeaderView header(original);
+    if (!header.valid() || (header.flagsFragmentOffset() & IPV4_FRAGMENT_OFFSET_MASK) != 0) {
+        return false;
+    }
+    // 0.0.0.0/8, loopback, multicast and the class E and broadcast space above it
+    uint32_t source = header.srcIp();
+    uint8_t first_octet = static_cast<uint8_t>(source >> 24);
+    if (first_octet == 0 || first_octet == 127 || first_octet >= 224) {
+        return false;
+    }
+    if (header.protocol() != PROTOCOL_ICMP) {
+        return true;
+    }
+    ICMPHeaderView icmp(original, header.headerLength());
+    if (!icmp.valid()) {
+        return false;
+    }
+    switch (icmp.type()) {
+        case ICMP_DEST_UNREACH:
+        case ICMP_TIME_EXCEED:
+        case ICMP_PARAMETER_PROBLEM:
+        case ICMP_SOURCE_QUENCH:
+        case ICMP_REDIRECT:
+            return false;
+        default:
+            return true;
+    }
+}
+
+void ICMP::printHeader(const ICMPHeaderView& h) {
     std::cout << "ICMP Header:\n"
-              << "  Type: " << static_cast<int>(h.type) 
-              << " (" << getTypeName(h.type) << ")"
-              << ", Code: " << static_cast<int>(h.code) << "\n"
-              << "  Identifier: " << h.identifier
-              << ", Sequence: " << h.sequence 
-              << ", Checksum: 0x" << std::hex << h.checksum << std::dec << "\n";
+              << "  Type: " << static_cast<int>(h.type()) 
+              << " (" << getTypeName(h.type()) << ")"
+              << ", Code: " << static_cast<int>(h.code()) << "\n"
+              << "  Identifier: " << h.identifier()
+              << ", Sequence: " << h.sequence() 
+              << ", Checksum: 0x" << std::hex << h.checksum() << std::dec << "\n";
 }
 
 std::string ICMP::getTypeName(uint8_t type) {
@@ -93,3 +149,24 @@ std::string ICMP::getTypeName(uint8_t type) {
         default:                return "Unknown";
     }
 }
+
+void ICMP::printHeader6(const ICMPHeaderView& h) {
+    std::cout << "ICMPv6 Header:\n"
+              << "  Type: " << static_cast<int>(h.type())
+              << " (" << getTypeName6(h.type()) << ")"
+              << ", Code: " << static_cast<int>(h.code()) << "\n"
+              << "  Identifier: " << h.identifier()
+              << ", Sequence: " << h.sequence()
+              << ", Checksum: 0x" << std::hex << h.checksum() << std::dec << "\n";
+}
+
+std::string ICMP::getTypeName6(uint8_t type) {
+    switch (type) {
+        case ICMPV6_DEST_UNREACH:   return "Destination Unreachable";
+        case ICMPV6_PACKET_TOO_BIG: return "Packet Too Big";
+        case ICMPV6_TIME_EXCEED:    return "Time Exceeded";
+        case ICMPV6_ECHO_REQUEST:   return "Echo Request";
+        case ICMPV6_ECHO_REPLY:     return "Echo Reply";
+        default:                    return "Unknown";
+    }
+}
@@ -1,7 +1,9 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <string>
+#include "packet_view.hpp"
 
 struct __attribute__((packed)) ICMPHeader {
     uint8_t type;
@@ -11,18 +13,66 @@ struct __attribute__((packed)) ICMPHeader {
     uint16_t sequence;
 };
 
+// read access to an ICMP header in place, laid out as ICMPHeader and byte-swapped per field
+class ICMPHeaderView {
+public:
+    ICMPHeaderView() = default;
+    ICMPHeaderView(PacketView packet, size_t offset) : bytes(packet.from(offset)) {}
+
+    bool valid() const { return bytes.has(0, sizeof(ICMPHeader)); }
+    uint8_t type() const { return bytes.u8(offsetof(ICMPHeader, type)); }
+    uint8_t code() const { return bytes.u8(offsetof(ICMPHeader, code)); }
+    uint16_t checksum() const { return bytes.u16(offsetof(ICMPHeader, checksum)); }
+    uint16_t identifier() const { return bytes.u16(offsetof(ICMPHeader, identifier)); }
+    uint16_t sequence() const { return bytes.u16(offsetof(ICMPHeader, sequence)); }
+    PacketView payload() const { return bytes.from(sizeof(ICMPHeader)); }
+
+private:
+    PacketView bytes;
+};
+
 constexpr uint8_t ICMP_ECHO_REPLY   = 0;
 constexpr uint8_t ICMP_DEST_UNREACH = 3;
+constexpr uint8_t ICMP_SOURCE_QUENCH = 4;
+constexpr uint8_t ICMP_REDIRECT     = 5;
 constexpr uint8_t ICMP_ECHO_REQUEST = 8;
 constexpr uint8_t ICMP_TIME_EXCEED  = 11;
+constexpr uint8_t ICMP_PARAMETER_PROBLEM = 12;
+
+// destination unreachable code of a DF packet too large for the next hop, which reports its MTU (RFC 1191)
+constexpr uint8_t ICMP_FRAGMENTATION_NEEDED = 4;
+// ICMP errors quote as much of the packet they answer as fits in this many bytes in all (RFC 1812 4.3.2.3)
+constexpr size_t ICMP_ERROR_MAX_SIZE = 576;
+
+// ICMPv6 (RFC 4443), echo messages share the ICMP header layout
+constexpr uint8_t ICMPV6_DEST_UNREACH   = 1;
+constexpr uint8_t ICMPV6_PACKET_TOO_BIG = 2;
+constexpr uint8_t ICMPV6_TIME_EXCEED    = 3;
+constexpr uint8_t ICMPV6_ECHO_REQUEST   = 128;
+constexpr uint8_t ICMPV6_ECHO_REPLY     = 129;
 
 class ICMP {
   public:
-    static ICMPHeader parseHeader(const std::vector<uint8_t>& packet, size_t offset);
+    static ICMPHeaderView parseHeader(PacketView packet, size_t offset);
     static ICMPHeader createHeader(uint8_t type = ICMP_ECHO_REQUEST, uint16_t identifier = 1234, uint16_t sequence = 1);
     static std::vector<uint8_t> serializeHeader(const ICMPHeader& header);
-    static uint16_t calculateChecksum(const std::vector<uint8_t>& icmp_data);
+    // serializeHeader into the 8 bytes at out, nothing allocated
+    static void writeHeader(uint8_t* out, const ICMPHeader& header);
+    static uint16_t calculateChecksum(const uint8_t* icmp_data, size_t length);
+
+    /* an ICMP error from source_ip (host order) back to the sender of original: the IPv4
+       header, the ICMP header with rest as the word after the checksum (the next-hop MTU
+       for fragmentation needed) and the start of original, up to ICMP_ERROR_MAX_SIZE
+       bytes. returns its length, 0 when capacity is short or original is no IPv4 packet */
+    static size_t buildError(uint8_t type, uint8_t code, uint32_t rest, PacketView original, uint32_t source_ip,
+                             uint8_t* out, size_t capacity);
+    /* whether original may be answered with an error at all (RFC 1122 3.2.2, RFC 1812
+       4.3.2.7): not when it is an ICMP error itself, a fragment other than the first, or
+       comes from an address that does not name a single host */
+    static bool errorAllowed(PacketView original);
 
-    static void printHeader(const ICMPHeader& header);
+    static void printHeader(const ICMPHeaderView& header);
     static std::string getTypeName(uint8_t type);
+    static void printHeader6(const ICMPHeaderView& header);
+    static std::string getTypeName6(uint8_t type);
 };
@@ -0,0 +1,53 @@
+#include "icmp_errors.hpp"
+#include "icmp.hpp"
+#include <algorithm>
+#include <chrono>
+
+IcmpErrorGenerator::IcmpErrorGenerator(const IcmpErrorConfig& config)
+    : settings(config), buffer(ICMP_ERROR_BURST * ICMP_ERROR_MAX_SIZE), tokens(config.burst) {}
+
+bool IcmpErrorGenerator::takeToken(uint64_t now_ns) {
+    if (refilled_ns != 0 && now_ns > refilled_ns) {
+        tokens = std::min<double>(settings.burst, tokens + (now_ns - refilled_ns) * 1e-9 * settings.rate);
+    }
+    refilled_ns = now_ns;
+    if (tokens < 1) {
+        return false;
+    }
+    tokens -= 1;
+    return true;
+}
+
+size_t IcmpErrorGenerator::generate(const VerdictRecord* records, const PacketView* packets, size_t count,
+                                    const AdjacencyTable& adjacencies) {
+    out_count = 0;
+    uint64_t now_ns = 0;
+    count = std::min(count, ICMP_ERROR_BURST);
+    for (size_t i = 0; i < count; i++) {
+        const ForwardingVerdict& verdict = records[i].verdict;
+        if (verdict.drop_reason != DropReason::FRAGMENTATION_NEEDED) {
+            continue;
+        }
+        if ((packets[i].u8(0) >> 4) != 4 || !ICMP::errorAllowed(packets[i])) {
+            counters.suppressed++;
+            continue;
+        }
+        if (now_ns == 0) {
+            now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+        if (!takeToken(now_ns)) {
+            counters.rate_limited++;
+            continue;
+        }
+        uint8_t* error = buffer.data() + out_count * ICMP_ERROR_MAX_SIZE;
+        size_t length = ICMP::buildError(ICMP_DEST_UNREACH, ICMP_FRAGMENTATION_NEEDED,
+                                         adjacencies.interfaceMtu(verdict.interface_id), packets[i],
+                                         settings.source_ip, error, ICMP_ERROR_MAX_SIZE);
+        if (length > 0) {
+            out[out_count++] = PacketView(error, length);
+            counters.sent++;
+        }
+    }
+    return out_count;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "adjacency_table.hpp"
+#include "verdict_sink.hpp"
+#include "packet_view.hpp"
+
+// errors one generate() call can produce, one per packet of a pipeline burst
+constexpr size_t ICMP_ERROR_BURST = LPM_MAX_BURST;
+
+struct IcmpErrorConfig {
+    uint32_t source_ip = 0;         // host order, the router's address the errors come from
+    uint32_t rate = 1000;           // errors per second in the long run (RFC 1812 4.3.2.8)
+    uint32_t burst = 100;           // errors that may go out back to back
+};
+
+struct IcmpErrorStats {
+    uint64_t sent = 0;              // fragmentation needed errors generated
+    uint64_t rate_limited = 0;      // drops left unanswered, the rate was used up
+    uint64_t suppressed = 0;        // drops that are never answered: errors, non-first fragments, IPv6
+};
+
+/* the slow path behind the MTU check: answers FRAGMENTATION_NEEDED drops with ICMP
+   destination unreachable, fragmentation needed (type 3 code 4) carrying the MTU of the
+   interface the packet was too large for, so the sender's path MTU discovery (RFC 1191)
+   learns it. a token bucket holds the errors to config.rate per second. IPv6 drops are
+   counted as suppressed, there is no ICMPv6 packet too big yet.
+
+   the errors are IPv4 packets for the caller to forward, output() holds the ones of the
+   last generate() call until the next one. not thread safe */
+class IcmpErrorGenerator {
+public:
+    explicit IcmpErrorGenerator(const IcmpErrorConfig& config = IcmpErrorConfig());
+
+    /* the errors for a burst's records and packets, how many there are. the bucket is
+       refilled from the steady clock, read only when the burst has something to answer */
+    size_t generate(const VerdictRecord* records, const PacketView* packets, size_t count,
+                    const AdjacencyTable& adjacencies);
+    const PacketView* output() const { return out; }
+    size_t outputCount() const { return out_count; }
+
+    const IcmpErrorConfig& config() const { return settings; }
+    const IcmpErrorStats& stats() const { return counters; }
+
+private:
+    IcmpErrorConfig settings;
+    std::vector<uint8_t> buffer;    // ICMP_ERROR_BURST errors of ICMP_ERROR_MAX_SIZE bytes
+    PacketView out[ICMP_ERROR_BURST];
+    size_t out_count = 0;
+    double tokens;
+    uint64_t refilled_ns = 0;
+    IcmpErrorStats counters;
+
+    bool takeToken(uint64_t now_ns);
+};
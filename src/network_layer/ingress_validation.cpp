@@ -0,0 +1,130 @@
+#include "ingress_validation.hpp"
+#include "internet_protocol.hpp"
+#include "checksum.hpp"
+#include <algorithm>
+
+// packets validated per pass, the stack arrays below are sized for it
+constexpr size_t INGRESS_CHUNK = 64;
+
+static bool isIPv4(PacketView packet) {
+    return (packet.u8(0) >> 4) == 4;
+}
+
+/* ones' complement sum of the pseudo-header and the segment (checksum field included)
+   folds to 0xFFFF when the checksum is right */
+static bool transportChecksumOk(PacketView segment, uint32_t pseudo_sum) {
+    return checksumFold(checksumAdd(pseudo_sum, segment.data(), segment.size())) == 0xFFFF;
+}
+
+static DropReason checkL4Checksum4(PacketView packet) {
+    IPv4HeaderView header(packet);
+    size_t header_length = header.headerLength();
+    size_t total_length = header.totalLength();
+    if (header_length > total_length || total_length > packet.size()) {
+        return DropReason::BAD_LENGTH;
+    }
+    // fragments carry part of a segment, its checksum can only be checked after reassembly
+    if (header.flagsFragmentOffset() & 0x3FFF) {
+        return DropReason::NONE;
+    }
+    PacketView segment(packet.data() + header_length, total_length - header_length);
+    uint32_t pseudo_sum = pseudoHeaderSum(header.srcIp(), header.dstIp(), header.protocol(), segment.size());
+    switch (header.protocol()) {
+        case PROTOCOL_TCP:
+            return transportChecksumOk(segment, pseudo_sum) ? DropReason::NONE : DropReason::BAD_L4_CHECKSUM;
+        case PROTOCOL_UDP:
+            // a zero UDP checksum over IPv4 means the sender did not compute one
+            if (segment.has(0, 8) && segment.u16(6) == 0) {
+                return DropReason::NONE;
+            }
+            return transportChecksumOk(segment, pseudo_sum) ? DropReason::NONE : DropReason::BAD_L4_CHECKSUM;
+        case PROTOCOL_ICMP:
+            return transportChecksumOk(segment, 0) ? DropReason::NONE : DropReason::BAD_L4_CHECKSUM;
+    }
+    return DropReason::NONE;
+}
+
+static DropReason checkL4Checksum6(PacketView packet) {
+    IPv6HeaderView header(packet);
+    size_t end = sizeof(IPv6Header) + header.payloadLength();
+    IPv6Payload payload;
+    if (end > packet.size() || !InternetProtocol::findIPv6Payload(packet, header.nextHeader(), payload) ||
+        payload.offset > end) {
+        return DropReason::BAD_LENGTH;
+    }
+    if (!payload.has_l4_header || (payload.protocol != PROTOCOL_TCP && payload.protocol != PROTOCOL_UDP &&
+                                   payload.protocol != PROTOCOL_ICMPV6)) {
+        return DropReason::NONE;
+    }
+    // the checksum is mandatory for all three over IPv6, ICMPv6 included in the pseudo-header
+    PacketView segment(packet.data() + payload.offset, end - payload.offset);
+    uint32_t pseudo_sum = pseudoHeaderSum6(packet.data() + offsetof(IPv6Header, src_ip),
+                                           packet.data() + offsetof(IPv6Header, dst_ip), payload.protocol, segment.size());
+    return transportChecksumOk(segment, pseudo_sum) ? DropReason::NONE : DropReason::BAD_L4_CHECKSUM;
+}
+
+static void validateChunk(const IngressChecks& checks, const PacketView* packets, size_t count, DropReason* drops) {
+    /* lengths and IPv4 header checksums in one pass over the headers the parser already
+       bounds-checked. IHL 5 headers are gathered for the 20-byte kernel, longer ones
+       (options) are summed one by one, options past the buffer are a length error even
+       with the length checks off. a header and its payload end at the total (payload)
+       length, padding after that is fine */
+    if (checks.lengths || checks.header_checksum) {
+        const uint8_t* headers[INGRESS_CHUNK];
+        uint8_t lanes[INGRESS_CHUNK];
+        uint8_t ok[INGRESS_CHUNK];
+        size_t gathered = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (drops[i] != DropReason::NONE) {
+                continue;
+            }
+            const uint8_t* header = packets[i].data();
+            size_t size = packets[i].size();
+            if ((header[0] >> 4) != 4) {
+                size_t payload_length = (static_cast<size_t>(header[4]) << 8) | header[5];
+                if (checks.lengths && sizeof(IPv6Header) + payload_length > size) {
+                    drops[i] = DropReason::BAD_LENGTH;
+                }
+                continue;
+            }
+            size_t header_length = static_cast<size_t>(header[0] & 0x0F) * 4;
+            size_t total_length = (static_cast<size_t>(header[2]) << 8) | header[3];
+            if ((checks.lengths && (header_length > total_length || total_length > size)) || header_length > size) {
+                drops[i] = DropReason::BAD_LENGTH;
+            } else if (!checks.header_checksum) {
+                continue;
+            } else if (header_length == sizeof(IPv4Header)) {
+                headers[gathered] = header;
+                lanes[gathered++] = static_cast<uint8_t>(i);
+            } else if (internetChecksum(header, header_length) != 0) {
+                drops[i] = DropReason::BAD_CHECKSUM;
+            }
+        }
+        if (gathered > 0) {
+            ipv4Header20ChecksumsOk(headers, gathered, ok);
+            for (size_t j = 0; j < gathered; j++) {
+                if (!ok[j]) {
+                    drops[lanes[j]] = DropReason::BAD_CHECKSUM;
+                }
+            }
+        }
+    }
+
+    if (checks.l4_checksum) {
+        for (size_t i = 0; i < count; i++) {
+            if (drops[i] == DropReason::NONE) {
+                drops[i] = isIPv4(packets[i]) ? checkL4Checksum4(packets[i]) : checkL4Checksum6(packets[i]);
+            }
+        }
+    }
+}
+
+void validateIngress(const IngressChecks& checks, const PacketView* packets, size_t count, DropReason* drops) {
+    if (!checks.any()) {
+        return;
+    }
+    for (size_t done = 0; done < count; done += INGRESS_CHUNK) {
+        size_t chunk = std::min(INGRESS_CHUNK, count - done);
+        validateChunk(checks, packets + done, chunk, drops + done);
+    }
+}
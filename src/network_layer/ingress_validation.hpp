@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "forwarding_verdict.hpp"
+#include "packet_view.hpp"
+
+/* which checks processBurst runs on a burst between parsing and the route lookup. the
+   length and IPv4 header checksum checks cost a few ns per packet and are on by default,
+   the L4 checksums read the whole payload and are opt-in */
+struct IngressChecks {
+    bool lengths = true;            // IHL and total length (IPv6 payload length) against each other and the buffer
+    bool header_checksum = true;    // IPv4 header checksum
+    bool l4_checksum = false;       // TCP, UDP, ICMP and ICMPv6 checksums of unfragmented packets
+
+    bool any() const { return lengths || header_checksum || l4_checksum; }
+    static IngressChecks none() { return {false, false, false}; }
+};
+
+/* ingress stage over a burst of parsed packets. drops[i] already set (the parser's
+   MALFORMED) are skipped, the others get BAD_LENGTH, BAD_CHECKSUM or BAD_L4_CHECKSUM
+   when a check fails and stay NONE otherwise. the checks run stage by stage across the
+   burst, IHL 5 header checksums together through the vectorized 20-byte kernel */
+void validateIngress(const IngressChecks& checks, const PacketView* packets, size_t count, DropReason* drops);
@@ -1,127 +1,536 @@
 #include "internet_protocol.hpp"
-#include "icmp.hpp"
-#include "tcp.hpp"
-#include "udp.hpp"
 #include "packet_builders.hpp"
-#include <iostream>
-#include <arpa/inet.h>
+#include "fib_snapshot.hpp"
+#include "packet_printer.hpp"
+#include "checksum.hpp"
+#include "ip_fragmentation.hpp"
 #include <cstdint>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 
+InternetProtocol::InternetProtocol() : routingTable(std::make_shared<RoutingTable>()) {}
+
+InternetProtocol::InternetProtocol(std::shared_ptr<RoutingTable> table) : routingTable(std::move(table)) {}
+
+InternetProtocol InternetProtocol::workerContext() const {
+    InternetProtocol context(routingTable);
+    context.ingressChecks = ingressChecks;
+    return context;
+}
+
 // example of a dummy hardcoded routing table
 void InternetProtocol::initRoutingTable() {
-    routingTable.addRoute("192.168.1.0/24", "wlan0");                   // home WiFi network
-    routingTable.addRoute("127.0.0.0/8", "lo");                         // loopback (localhost)
-    routingTable.addRoute("8.8.8.8/32", "wlan0", "192.168.1.1", 1);     // google DNS via router
-    routingTable.addRoute("1.1.1.1/32", "wlan0", "192.168.1.1", 1);     // cloudflare DNS via router
-    routingTable.addRoute("0.0.0.0/0", "wlan0", "192.168.1.1", 10);     // everything else via home router
+    routingTable->addRoute("192.168.1.0/24", "wlan0");                   // home WiFi network
+    routingTable->addRoute("127.0.0.0/8", "lo");                         // loopback (localhost)
+    routingTable->addRoute("8.8.8.8/32", "wlan0", "192.168.1.1", 1);     // google DNS via router
+    routingTable->addRoute("1.1.1.1/32", "wlan0", "192.168.1.1", 1);     // cloudflare DNS via router
+    routingTable->addRoute("0.0.0.0/0", "wlan0", "192.168.1.1", 10);     // everything else via home router
+
+    routingTable->addRoute6("2001:db8:1::/64", "wlan0");                 // home WiFi network (IPv6)
+    routingTable->addRoute6("::1/128", "lo");                            // loopback
+    routingTable->addRoute6("::/0", "wlan0", "fe80::1", 10);             // everything else via home router
 }
 
 void InternetProtocol::addRoute(const std::string& network, const std::string& interface,
                       const std::string& next_hop, int metric) {
-    routingTable.addRoute(network, interface, next_hop, metric);
+    routingTable->addRoute(network, interface, next_hop, metric);
+}
+
+void InternetProtocol::addRoute6(const std::string& network, const std::string& interface,
+                                 const std::string& next_hop, int metric) {
+    routingTable->addRoute6(network, interface, next_hop, metric);
+}
+
+void InternetProtocol::replaceRoute(const std::string& network, const std::string& interface,
+                                    const std::string& next_hop, int metric) {
+    routingTable->replaceRoute(network, interface, next_hop, metric);
+}
+
+bool InternetProtocol::removeRoute(const std::string& network) {
+    return routingTable->removeRoute(network);
+}
+
+ReplayStats InternetProtocol::replayRouteUpdates(const RouteReplay& replay) {
+    return replay.run(*routingTable);
+}
+
+size_t InternetProtocol::loadRoutes(const std::string& path) {
+    return routingTable->loadRoutes(path);
+}
+
+bool InternetProtocol::loadFibSnapshot(const std::string& path) {
+    return FibSnapshot::load(*routingTable, path);
+}
+
+bool InternetProtocol::saveFibSnapshot(const std::string& path) {
+    return FibSnapshot::save(*routingTable, path);
 }
 
 void InternetProtocol::printRoutingTable() {
-    routingTable.printTable();
+    routingTable->printTable();
 }
 
-void InternetProtocol::parsePacket(const std::vector<uint8_t>& packet) {
-    log_debug("Starting packet parsing, packet size: %zu bytes", packet.size());
+std::vector<RoutePrefix> InternetProtocol::routePrefixes() {
+    return routingTable->prefixes();
+}
 
-    uint8_t version = (packet[0] >> 4) & 0x0F;
-    if (version != 4) {
-        log_error("Unsupported IP version: %u (expected 4)", version);
-        return;
+void InternetProtocol::enableFlowCache(size_t entries, FlowCacheMode mode, bool measure_latency) {
+    flowCache = std::make_unique<FlowCache>(entries, mode, measure_latency);
+}
+
+void InternetProtocol::enableReassembly(const ReassemblyConfig& config) {
+    reassembler = std::make_unique<FragmentReassembler>(config);
+}
+
+void InternetProtocol::enableIcmpErrors(const IcmpErrorConfig& config) {
+    icmpErrors = std::make_unique<IcmpErrorGenerator>(config);
+}
+
+bool InternetProtocol::enableNat(std::shared_ptr<NatTable> table, size_t core) {
+    if (!table || !table->valid() || core >= table->config().cores) {
+        log_error("No NAT core %zu to translate with", core);
+        return false;
     }
+    nat = std::make_unique<NatTranslator>(std::move(table), core);
+    return true;
+}
+
+void InternetProtocol::enableConnectionTracking(const ConntrackConfig& config) {
+    conntrack = std::make_unique<ConnectionTracker>(config);
+}
 
-    if (packet.size() < IPv4_HEADER_SIZE) {
-        log_error("Packet too short");
+bool InternetProtocol::setInterfaceMtu(const std::string& interface, uint32_t mtu) {
+    return routingTable->setInterfaceMtu(interface, mtu);
+}
+
+void InternetProtocol::parsePacket(PacketView packet) {
+    PacketPrinter printer(routingTable->adjacencies());
+    forwardPackets(&packet, 1, printer);
+}
+
+void InternetProtocol::forwardPackets(const PacketView* packets, size_t count, VerdictSink& sink) {
+    if (!reassembler) {
+        forwardViews(packets, count, sink);
         return;
     }
+    // one clock read per call, the reassembler's timers are ticks of milliseconds
+    uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    while (count > 0) {
+        size_t consumed = reassembler->reassemble(packets, count, now_ns);
+        forwardViews(reassembler->output(), reassembler->outputCount(), sink);
+        packets += consumed;
+        count -= consumed;
+    }
+}
+
+void InternetProtocol::forwardViews(const PacketView* packets, size_t count, VerdictSink& sink) {
+    VerdictRecord records[IP_MAX_BURST];
+    uint64_t now_ns = 0;
+    if (conntrack) {
+        now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    while (count > 0) {
+        size_t burst = std::min(count, IP_MAX_BURST);
+        consumeBurst(packets, burst, records, sink, now_ns);
+        // errors are never answered with errors, the ones of this burst cause no more
+        if (icmpErrors && icmpErrors->generate(records, packets, burst, adjacencies()) > 0) {
+            consumeBurst(icmpErrors->output(), icmpErrors->outputCount(), records, sink, now_ns);
+        }
+        packets += burst;
+        count -= burst;
+    }
+}
+
+void InternetProtocol::consumeBurst(const PacketView* packets, size_t count, VerdictRecord* records,
+                                    VerdictSink& sink, uint64_t now_ns) {
+    BurstResult result;
+    processBurst(packets, count, result);
+    for (size_t i = 0; i < count; i++) {
+        records[i] = {packetSequence++, result.verdicts[i]};
+    }
+    if (conntrack) {
+        // only what is forwarded opens or refreshes connections, drops never get that far
+        PacketView forwarded[IP_MAX_BURST];
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (result.verdicts[i].forwarded()) {
+                forwarded[kept++] = packets[i];
+            }
+        }
+        conntrack->track(forwarded, kept, now_ns, nullptr);
+    }
+    sink.consume(records, packets, count);
+}
 
-    IPv4Header header;
-    std::memcpy(&header, packet.data(), sizeof(IPv4Header));
-    header.total_length = ntohs(header.total_length);
-    header.identification = ntohs(header.identification);
-    header.flags_fragment_offset = ntohs(header.flags_fragment_offset);
-    header.header_checksum = ntohs(header.header_checksum);
-    header.src_ip = ntohl(header.src_ip);
-    header.dst_ip = ntohl(header.dst_ip);
+// hop-by-hop, routing, destination options, fragment and authentication headers
+bool InternetProtocol::findIPv6Payload(PacketView packet, uint8_t next_header, IPv6Payload& payload) {
+    payload = {next_header, IPv6_HEADER_SIZE, true};
+    while (true) {
+        size_t length;
+        switch (payload.protocol) {
+            case IPV6_EXT_HOP_BY_HOP:
+            case IPV6_EXT_ROUTING:
+            case IPV6_EXT_DESTINATION:
+                if (!packet.has(payload.offset, 2)) {
+                    return false;
+                }
+                length = (static_cast<size_t>(packet.u8(payload.offset + 1)) + 1) * 8;
+                break;
+            case IPV6_EXT_AUTH:
+                if (!packet.has(payload.offset, 2)) {
+                    return false;
+                }
+                length = (static_cast<size_t>(packet.u8(payload.offset + 1)) + 2) * 4;
+                break;
+            case IPV6_EXT_FRAGMENT:
+                if (!packet.has(payload.offset, 8)) {
+                    return false;
+                }
+                // only the first fragment (offset 0) carries the upper-layer header
+                if ((packet.u16(payload.offset + 2) & 0xFFF8) != 0) {
+                    payload.has_l4_header = false;
+                }
+                length = 8;
+                break;
+            default:
+                return payload.offset <= packet.size();
+        }
+        payload.protocol = packet.u8(payload.offset);
+        payload.offset += length;
+        if (payload.offset > packet.size()) {
+            return false;
+        }
+    }
+}
+
+/* ports are only part of the key for TCP/UDP packets that are not fragments. the first
+   fragment carries them too, but it has to hash like the rest of its datagram so ECMP
+   and worker sharding keep the fragments together */
+FlowKey InternetProtocol::flowKey(const IPv4HeaderView& h) {
+    uint8_t protocol = h.protocol();
+    FlowKey key = {h.srcIp(), h.dstIp(), 0, 0, protocol};
+    size_t l4_offset = h.headerLength();
+    if ((protocol == PROTOCOL_TCP || protocol == PROTOCOL_UDP) &&
+        !FragmentReassembler::isFragment(h.flagsFragmentOffset()) && h.packet().has(l4_offset, 4)) {
+        key.src_port = h.packet().u16(l4_offset);
+        key.dst_port = h.packet().u16(l4_offset + 2);
+    }
+    return key;
+}
 
-    log_debug("Parsed packet - TTL: %d, Protocol: %d, Total Length: %d",
-                header.ttl, header.protocol, header.total_length);
+// addresses folded to 32 bits, ports as for IPv4 when the upper-layer header is present
+FlowKey InternetProtocol::flowKey6(const IPv6HeaderView& h, const IPv6Payload& payload) {
+    FlowKey key = {foldIPv6(h.srcIp()), foldIPv6(h.dstIp()), 0, 0, payload.protocol};
+    if ((payload.protocol == PROTOCOL_TCP || payload.protocol == PROTOCOL_UDP) &&
+        payload.has_l4_header && h.packet().has(payload.offset, 4)) {
+        key.src_port = h.packet().u16(payload.offset);
+        key.dst_port = h.packet().u16(payload.offset + 2);
+    }
+    return key;
+}
 
-    printIPHeader(header);
-    printTransportLayerHeader(packet, header);
-    simulateForwarding(header);
+FlowKey InternetProtocol::packetFlowKey(PacketView packet) {
+    uint8_t version = packet.u8(0) >> 4;
+    if (version == 4) {
+        IPv4HeaderView header(packet);
+        if (header.valid()) {
+            return flowKey(header);
+        }
+    } else if (version == 6) {
+        IPv6HeaderView header(packet);
+        IPv6Payload payload;
+        if (header.valid() && findIPv6Payload(packet, header.nextHeader(), payload)) {
+            return flowKey6(header, payload);
+        }
+    }
+    return FlowKey{0, 0, 0, 0, 0};
 }
 
-void InternetProtocol::printIPHeader(const IPv4Header& h) {
-    std::cout << "IPv4 Header:\n"
-              << "  Source IP: "      << inet_ntoa({htonl(h.src_ip)}) << "\n"
-              << "  Destination IP: " << inet_ntoa({htonl(h.dst_ip)}) << "\n"
-              << "  TTL: "            << static_cast<int>(h.ttl)      << "\n"
-              << "  Protocol: "       << static_cast<int>(h.protocol) << "\n";
+ForwardingVerdict InternetProtocol::forwardPacket(PacketView packet) {
+    BurstResult result;
+    processBurst(&packet, 1, result);
+    return result.verdicts[0];
 }
 
-void InternetProtocol::simulateForwarding(const IPv4Header& h) {
-    struct in_addr dst_addr;
-    dst_addr.s_addr = htonl(h.dst_ip);
-    std::string dst_ip_str = inet_ntoa(dst_addr);
+void InternetProtocol::processBurst(const PacketView* packets, size_t count, BurstResult& result) {
+    count = std::min(count, IP_MAX_BURST);
+    result.count = count;
+    ForwardingVerdict* verdicts = result.verdicts;
 
-    log_debug("Attempting to forward packet to destination: %s", dst_ip_str.c_str());
+    // parse: family (0 when the headers do not parse), hop count and flow of every packet
+    uint8_t family[IP_MAX_BURST];
+    uint8_t hops[IP_MAX_BURST];
+    FlowKey keys[IP_MAX_BURST];
+    IPv6Address dsts6[IP_MAX_BURST];
+    for (size_t i = 0; i < count; i++) {
+        PacketView packet = packets[i];
+        uint8_t version = packet.u8(0) >> 4;
+        family[i] = 0;
+        if (version == 4) {
+            IPv4HeaderView header(packet);
+            if (header.valid() && header.headerLength() >= IPv4_HEADER_SIZE) {
+                family[i] = 4;
+                hops[i] = header.ttl();
+                keys[i] = flowKey(header);
+            }
+        } else if (version == 6) {
+            IPv6HeaderView header(packet);
+            IPv6Payload payload;
+            if (header.valid() && findIPv6Payload(packet, header.nextHeader(), payload)) {
+                family[i] = 6;
+                hops[i] = header.hopLimit();
+                keys[i] = flowKey6(header, payload);
+                dsts6[i] = header.dstIp();
+            }
+        }
+    }
 
-    if (h.ttl == 0) {
-        log_warning("Packet dropped: TTL expired for destination %s", dst_ip_str.c_str());
-        std::cout << "Packet dropped: TTL expired\n";
-        return;
+    // ingress checks: lengths and checksums of everything that parsed
+    DropReason drops[IP_MAX_BURST];
+    for (size_t i = 0; i < count; i++) {
+        drops[i] = family[i] ? DropReason::NONE : DropReason::MALFORMED;
+    }
+    validateIngress(ingressChecks, packets, count, drops);
+
+    /* validate: drops get their verdict now, the rest queue up for their family's FIB.
+       dsts6 is compacted in place, a lane never moves up */
+    uint32_t dsts4[IP_MAX_BURST];
+    uint8_t lanes4[IP_MAX_BURST], lanes6[IP_MAX_BURST];
+    size_t count4 = 0, count6 = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (drops[i] != DropReason::NONE) {
+            verdicts[i] = dropVerdict(drops[i]);
+        } else if (hops[i] <= 1) {
+            // it would leave with nothing left, the slow path answers with time exceeded
+            verdicts[i] = dropVerdict(DropReason::TTL_EXPIRED);
+        } else if (family[i] == 4) {
+            dsts4[count4] = keys[i].dst_ip;
+            lanes4[count4++] = static_cast<uint8_t>(i);
+        } else {
+            dsts6[count6] = dsts6[i];
+            lanes6[count6++] = static_cast<uint8_t>(i);
+        }
+    }
+
+    /* look up: one batched FIB walk per family. with the flow cache on, IPv4 packets
+       go through it one by one and only its misses reach the FIB */
+    const AdjacencyTable& adjacencies = routingTable->adjacencies();
+    AdjacencyHandle handles[IP_MAX_BURST];
+    if (flowCache) {
+        uint64_t generation = routingTable->generation();
+        for (size_t j = 0; j < count4; j++) {
+            const FlowKey& key = keys[lanes4[j]];
+            verdicts[lanes4[j]] = flowCache->lookup(key, generation, [this, &adjacencies, &key]() {
+                return routeVerdict(adjacencies, routingTable->lookupRoute(key.dst_ip), key.dst_ip, ecmpHash(key));
+            });
+        }
+    } else if (count4 > 0) {
+        routingTable->lookupRoutes(dsts4, handles, count4);
+        for (size_t j = 0; j < count4; j++) {
+            verdicts[lanes4[j]] = routeVerdict(adjacencies, handles[j], dsts4[j], ecmpHash(keys[lanes4[j]]));
+        }
+    }
+    if (count6 > 0) {
+        routingTable->lookupRoutes6(dsts6, handles, count6);
+        for (size_t j = 0; j < count6; j++) {
+            verdicts[lanes6[j]] = routeVerdict6(adjacencies, handles[j], ecmpHash(keys[lanes6[j]]));
+        }
     }
 
-    std::string interface = routingTable.lookupRoute(h.dst_ip);
-    if (!interface.empty()) {
-        log_info("Forwarding packet to interface %s for destination %s", interface.c_str(), dst_ip_str.c_str());
-        std::cout << "Forwarding packet to interface " << interface << "\n";
-    } else {
-        log_warning("No route found for destination %s. Dropping packet", dst_ip_str.c_str());
-        std::cout << "No route found. Dropping packet.\n";
+    // after the lookup, cached verdicts do not know the packet's size
+    if (adjacencies.mtuLimited()) {
+        checkMtu(adjacencies, packets, family, verdicts, count);
     }
+    classifyBurst(result);
 }
 
-void InternetProtocol::printTransportLayerHeader(const std::vector<uint8_t>& packet, const IPv4Header& ip_header) {
-    if (packet.size() < IPv4_HEADER_SIZE) {
-        log_error("Packet too short for stated IP header length");
-        return;
+/* forwarded packets against their output interface's MTU: IPv4 with DF clear gets cut
+   into fragments on the way out, with DF set or over IPv6 (routers never fragment IPv6)
+   it is dropped for the slow path to report the MTU */
+void InternetProtocol::checkMtu(const AdjacencyTable& adjacencies, const PacketView* packets, const uint8_t* family,
+                                ForwardingVerdict* verdicts, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        ForwardingVerdict& verdict = verdicts[i];
+        if (!verdict.forwarded()) {
+            continue;
+        }
+        uint32_t mtu = adjacencies.interfaceMtu(verdict.interface_id);
+        if (mtu == 0) {
+            continue;
+        }
+        if (family[i] == 4) {
+            IPv4HeaderView header(packets[i]);
+            if (header.totalLength() <= mtu) {
+                continue;
+            }
+            if (!(header.flagsFragmentOffset() & IPV4_DONT_FRAGMENT)) {
+                verdict.flags |= VERDICT_FRAGMENT;
+                continue;
+            }
+        } else if (IPv6_HEADER_SIZE + IPv6HeaderView(packets[i]).payloadLength() <= mtu) {
+            continue;
+        }
+        verdict.drop_reason = DropReason::FRAGMENTATION_NEEDED;
+    }
+}
+
+void InternetProtocol::forwardBurst(PacketHandle* packets, size_t count, BurstResult& result) {
+    count = std::min(count, IP_MAX_BURST);
+    uint8_t refused[IP_MAX_BURST] = {};
+    NatInbound inbound[IP_MAX_BURST];
+    uint64_t now_ns = 0;
+    if (nat || conntrack) {
+        // one clock read per burst, session and connection timeouts are ticks of seconds
+        now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    if (nat) {
+        NatPacket translated[IP_MAX_BURST];
+        for (size_t i = 0; i < count; i++) {
+            translated[i] = {packets[i]->data(), packets[i]->size()};
+        }
+        nat->translateInbound(translated, count, now_ns, refused, inbound);
+    }
+    PacketView views[IP_MAX_BURST];
+    for (size_t i = 0; i < count; i++) {
+        views[i] = packets[i].view();
+    }
+    processBurst(views, count, result);
+    if (nat) {
+        translateOutbound(packets, result, now_ns, refused);
+        bool dropped = false;
+        for (size_t i = 0; i < count; i++) {
+            if (refused[i] && result.verdicts[i].forwarded()) {
+                result.verdicts[i] = dropVerdict(DropReason::NO_NAT_MAPPING);
+                dropped = true;
+            }
+        }
+        if (dropped) {
+            classifyBurst(result);
+        }
+        // only inbound packets that survived validation and the lookup count on their sessions
+        for (size_t i = 0; i < count; i++) {
+            if (!result.verdicts[i].forwarded()) {
+                inbound[i].session = NAT_NO_SESSION;
+            }
+        }
+        nat->commitInbound(inbound, count, now_ns);
     }
 
-    log_debug("Parsing Layer 4 header for protocol %d", ip_header.protocol);
+    if (icmpErrors) {
+        VerdictRecord records[IP_MAX_BURST];
+        for (size_t i = 0; i < count; i++) {
+            records[i] = {0, result.verdicts[i]};
+        }
+        icmpErrors->generate(records, views, count, adjacencies());
+    }
+
+    // forwarded packets parsed and had a TTL above 1, so the header is there to rewrite
+    for (size_t i = 0; i < result.forwarded; i++) {
+        uint8_t* header = packets[result.order[i]]->data();
+        if ((header[0] >> 4) == 4) {
+            decrementTtl(header);
+        } else {
+            header[offsetof(IPv6Header, hop_limit)]--;
+        }
+    }
+
+    // as in consumeBurst, only what is forwarded opens or refreshes connections
+    if (conntrack) {
+        PacketView forwarded[IP_MAX_BURST];
+        for (size_t i = 0; i < result.forwarded; i++) {
+            forwarded[i] = views[result.order[i]];
+        }
+        conntrack->track(forwarded, result.forwarded, now_ns, nullptr);
+    }
+}
 
-    switch (ip_header.protocol) {
-        case PROTOCOL_TCP: {
-            TCPHeader tcp_header = TCP::parseHeader(packet, IPv4_HEADER_SIZE);
-            TCP::printHeader(tcp_header);
-            break;
+/* the outside interface's batch is the one translated, less the packets inbound NAT
+   already refused: they are dropped anyway and must not open sessions */
+void InternetProtocol::translateOutbound(PacketHandle* packets, const BurstResult& result, uint64_t now_ns,
+                                         uint8_t* refused) {
+    uint16_t outside = nat->table()->config().outside_interface;
+    for (size_t batch = 0; batch < result.output_count; batch++) {
+        if (result.outputs[batch].interface_id != outside) {
+            continue;
         }
-        case PROTOCOL_UDP: {
-            UDPHeader udp_header = UDP::parseHeader(packet, IPv4_HEADER_SIZE);
-            UDP::printHeader(udp_header);
-            break;
+        NatPacket translated[IP_MAX_BURST];
+        uint8_t lanes[IP_MAX_BURST];
+        uint8_t batch_refused[IP_MAX_BURST] = {};
+        size_t count = 0;
+        for (size_t j = 0; j < result.outputs[batch].count; j++) {
+            uint8_t lane = result.batchPackets(batch)[j];
+            if (!refused[lane]) {
+                translated[count] = {packets[lane]->data(), packets[lane]->size()};
+                lanes[count++] = lane;
+            }
         }
-        case PROTOCOL_ICMP: {
-            ICMPHeader icmp_header = ICMP::parseHeader(packet, IPv4_HEADER_SIZE);
-            ICMP::printHeader(icmp_header);
-            break;
+        nat->translateOutbound(translated, count, now_ns, batch_refused);
+        for (size_t j = 0; j < count; j++) {
+            refused[lanes[j]] = batch_refused[j];
         }
-        default:
-            log_warning("Unknown or unsupported protocol: %d", ip_header.protocol);
-            std::cout << "Unknown or unsupported transport layer protocol: " << (int)ip_header.protocol << "\n";
-            break;
     }
 }
 
-// not used anywhere currently, but could be useful later
-// void InternetProtocol::decrementTTL(IPv4Header& header) {
-//     if (header.ttl > 0) {
-//         header.ttl--;
-//     }
-// }
+// TTL is the high byte of the 16-bit word it shares with the protocol
+void InternetProtocol::decrementTtl(uint8_t* header) {
+    size_t ttl_offset = offsetof(IPv4Header, ttl);
+    size_t checksum_offset = offsetof(IPv4Header, header_checksum);
+    uint16_t old_word = static_cast<uint16_t>((header[ttl_offset] << 8) | header[ttl_offset + 1]);
+    header[ttl_offset]--;
+    uint16_t new_word = static_cast<uint16_t>(old_word - 0x0100);
+    uint16_t checksum = static_cast<uint16_t>((header[checksum_offset] << 8) | header[checksum_offset + 1]);
+    checksum = checksumAdjust(checksum, old_word, new_word);
+    header[checksum_offset] = static_cast<uint8_t>(checksum >> 8);
+    header[checksum_offset + 1] = static_cast<uint8_t>(checksum);
+}
+
+// counting sort of the burst by output interface, drops go last
+void InternetProtocol::classifyBurst(BurstResult& result) {
+    uint8_t batch_of[IP_MAX_BURST];
+    result.output_count = 0;
+    result.forwarded = 0;
+
+    size_t last = 0;
+    for (size_t i = 0; i < result.count; i++) {
+        const ForwardingVerdict& verdict = result.verdicts[i];
+        if (!verdict.forwarded()) {
+            continue;
+        }
+        // a burst reaches few interfaces, usually the same one as the packet before
+        size_t batch = last;
+        if (batch >= result.output_count || result.outputs[batch].interface_id != verdict.interface_id) {
+            for (batch = 0; batch < result.output_count; batch++) {
+                if (result.outputs[batch].interface_id == verdict.interface_id) {
+                    break;
+                }
+            }
+            if (batch == result.output_count) {
+                result.outputs[result.output_count++] = {verdict.interface_id, 0, 0};
+            }
+        }
+        result.outputs[batch].count++;
+        batch_of[i] = static_cast<uint8_t>(batch);
+        last = batch;
+        result.forwarded++;
+    }
+
+    size_t next = 0;
+    for (size_t batch = 0; batch < result.output_count; batch++) {
+        result.outputs[batch].first = static_cast<uint8_t>(next);
+        next += result.outputs[batch].count;
+        result.outputs[batch].count = 0;
+    }
+    size_t next_drop = result.forwarded;
+    for (size_t i = 0; i < result.count; i++) {
+        if (result.verdicts[i].forwarded()) {
+            OutputBatch& batch = result.outputs[batch_of[i]];
+            result.order[batch.first + batch.count++] = static_cast<uint8_t>(i);
+        } else {
+            result.order[next_drop++] = static_cast<uint8_t>(i);
+        }
+    }
+}
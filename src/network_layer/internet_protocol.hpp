@@ -1,14 +1,36 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 #include "routing_table.hpp"
+#include "route_replay.hpp"
+#include "flow_cache.hpp"
+#include "fragment_reassembly.hpp"
+#include "icmp_errors.hpp"
+#include "nat.hpp"
+#include "conntrack.hpp"
+#include "verdict_sink.hpp"
+#include "ingress_validation.hpp"
+#include "packet_view.hpp"
+#include "packet_pool.hpp"
 #include "logger.hpp"
 
 constexpr uint8_t PROTOCOL_ICMP = 1;
 constexpr uint8_t PROTOCOL_TCP  = 6;
 constexpr uint8_t PROTOCOL_UDP  = 17;
+constexpr uint8_t PROTOCOL_ICMPV6 = 58;
 
+// IPv6 extension headers walked to find the upper-layer header
+constexpr uint8_t IPV6_EXT_HOP_BY_HOP   = 0;
+constexpr uint8_t IPV6_EXT_ROUTING      = 43;
+constexpr uint8_t IPV6_EXT_FRAGMENT     = 44;
+constexpr uint8_t IPV6_EXT_AUTH         = 51;
+constexpr uint8_t IPV6_EXT_DESTINATION  = 60;
+constexpr uint8_t IPV6_NO_NEXT_HEADER   = 59;
+
+// wire layouts, packets are read in place through the views below and never copied into these
 struct __attribute__((packed)) IPv4Header {
     uint8_t version_ihl;
     uint8_t tos;
@@ -22,18 +44,224 @@ struct __attribute__((packed)) IPv4Header {
     uint32_t dst_ip;
 };
 
+struct __attribute__((packed)) IPv6Header {
+    uint32_t version_class_flow;    // version (4 bits), traffic class (8 bits), flow label (20 bits)
+    uint16_t payload_length;
+    uint8_t next_header;
+    uint8_t hop_limit;
+    IPv6Address src_ip;             // network byte order, as on the wire
+    IPv6Address dst_ip;
+};
+
+// read access to an IPv4 header in place, fields are byte-swapped as they are read
+class IPv4HeaderView {
+public:
+    explicit IPv4HeaderView(PacketView packet) : bytes(packet) {}
+
+    bool valid() const { return bytes.has(0, sizeof(IPv4Header)); }
+    uint8_t version() const { return bytes.u8(offsetof(IPv4Header, version_ihl)) >> 4; }
+    size_t headerLength() const { return static_cast<size_t>(bytes.u8(offsetof(IPv4Header, version_ihl)) & 0x0F) * 4; }
+    uint8_t tos() const { return bytes.u8(offsetof(IPv4Header, tos)); }
+    uint16_t totalLength() const { return bytes.u16(offsetof(IPv4Header, total_length)); }
+    uint16_t identification() const { return bytes.u16(offsetof(IPv4Header, identification)); }
+    uint16_t flagsFragmentOffset() const { return bytes.u16(offsetof(IPv4Header, flags_fragment_offset)); }
+    uint8_t ttl() const { return bytes.u8(offsetof(IPv4Header, ttl)); }
+    uint8_t protocol() const { return bytes.u8(offsetof(IPv4Header, protocol)); }
+    uint16_t checksum() const { return bytes.u16(offsetof(IPv4Header, header_checksum)); }
+    uint32_t srcIp() const { return bytes.u32(offsetof(IPv4Header, src_ip)); }
+    uint32_t dstIp() const { return bytes.u32(offsetof(IPv4Header, dst_ip)); }
+    // the whole packet, header included
+    PacketView packet() const { return bytes; }
+
+private:
+    PacketView bytes;
+};
+
+class IPv6HeaderView {
+public:
+    explicit IPv6HeaderView(PacketView packet) : bytes(packet) {}
+
+    bool valid() const { return bytes.has(0, sizeof(IPv6Header)); }
+    uint32_t versionClassFlow() const { return bytes.u32(offsetof(IPv6Header, version_class_flow)); }
+    uint16_t payloadLength() const { return bytes.u16(offsetof(IPv6Header, payload_length)); }
+    uint8_t nextHeader() const { return bytes.u8(offsetof(IPv6Header, next_header)); }
+    uint8_t hopLimit() const { return bytes.u8(offsetof(IPv6Header, hop_limit)); }
+    IPv6Address srcIp() const { return address(offsetof(IPv6Header, src_ip)); }
+    IPv6Address dstIp() const { return address(offsetof(IPv6Header, dst_ip)); }
+    PacketView packet() const { return bytes; }
+
+private:
+    PacketView bytes;
+    IPv6Address address(size_t offset) const {
+        IPv6Address result = {};
+        bytes.copy(offset, result.bytes, sizeof(result.bytes));
+        return result;
+    }
+};
+
+// where the upper-layer header of an IPv6 packet starts, after the extension headers
+struct IPv6Payload {
+    uint8_t protocol;
+    size_t offset;
+    bool has_l4_header;     // false for non-first fragments
+};
+
+constexpr size_t IP_MAX_BURST = LPM_MAX_BURST;     // packets per processBurst call
+
+// forwarded packets of a burst that leave through one interface: order[first, first + count)
+struct OutputBatch {
+    uint16_t interface_id;
+    uint8_t first;
+    uint8_t count;
+};
+
+/* outcome of processBurst. verdicts are in input order. order lists the packet indices
+   grouped by output interface (in arrival order within an interface, batches in order
+   of first appearance), followed by the dropped packets */
+struct BurstResult {
+    size_t count = 0;
+    ForwardingVerdict verdicts[IP_MAX_BURST];
+    uint8_t order[IP_MAX_BURST];
+    OutputBatch outputs[IP_MAX_BURST];
+    size_t output_count = 0;
+    size_t forwarded = 0;
+
+    const uint8_t* batchPackets(size_t batch) const { return order + outputs[batch].first; }
+    const uint8_t* dropped() const { return order + forwarded; }
+    size_t droppedCount() const { return count - forwarded; }
+};
+
 class InternetProtocol {
 public:
-    void parsePacket(const std::vector<uint8_t>& packet);
+    InternetProtocol();
+
+    /* a forwarding context for another thread: shares this instance's routing table and
+       gets its own flow cache. lookups are lock-free, but the thread has to register as
+       a reader on rcu() while routes may change */
+    InternetProtocol workerContext() const;
+    RcuDomain& rcu() { return routingTable->rcu(); }
+
+    // forwards one packet and prints its headers and verdict (a PacketPrinter on forwardPackets)
+    void parsePacket(PacketView packet);
+    /* headless fast path: forwards the packets a burst at a time and hands every burst's
+       verdict records to the sink. records are numbered across calls. with reassembly
+       on, IPv4 fragments go through the reassembler first and the sink sees what comes
+       out of it, the reassembled datagrams, instead. with ICMP errors on, the errors
+       answering a burst's drops go through the pipeline and the sink right behind it */
+    void forwardPackets(const PacketView* packets, size_t count, VerdictSink& sink);
+    /* forwarding decisions for up to IP_MAX_BURST packets without any output or logging,
+       for the data plane. every stage runs over the whole burst before the next one:
+       parse the headers, validate them, look all destinations up in the FIB in one
+       batch, check the packets against their output interface's MTU, then sort the
+       verdicts into per-interface output batches. packets that cannot be parsed are
+       dropped as MALFORMED, the ones failing the ingress checks (setIngressChecks) with
+       the check's reason. packets larger than the MTU leave with VERDICT_FRAGMENT when
+       they are IPv4 with DF clear, the rest are FRAGMENTATION_NEEDED drops */
+    void processBurst(const PacketView* packets, size_t count, BurstResult& result);
+    // a burst of one
+    ForwardingVerdict forwardPacket(PacketView packet);
+    /* forwards a burst for real: processBurst decides, then every forwarded packet is
+       rewritten in place, the IPv4 TTL decremented with the header checksum patched
+       incrementally (RFC 1624) or the IPv6 hop limit decremented. packets whose TTL
+       would run out here are TTL_EXPIRED drops left untouched for the slow path (ICMP
+       time exceeded). VERDICT_FRAGMENT packets are rewritten whole, cutting them into
+       fragments is up to whoever sends them. with ICMP errors on, FRAGMENTATION_NEEDED
+       drops are answered as in forwardPackets, the errors are left in icmpErrorOutput()
+       for the caller to forward. with NAT on, packets to the pool are
+       translated back before processBurst and IPv4 packets routed out of the outside
+       interface get their pool source after it, the ones NAT refuses are NO_NAT_MAPPING
+       drops. with connection tracking on, the forwarded packets are tracked last, as they
+       leave. the buffers must not be shared */
+    void forwardBurst(PacketHandle* packets, size_t count, BurstResult& result);
+    // TTL - 1 and the header checksum adjusted to match, without summing the header again
+    static void decrementTtl(uint8_t* ipv4_header);
+    // the 5-tuple forwardPacket hashes for ECMP, all zero for packets it cannot parse
+    static FlowKey packetFlowKey(PacketView packet);
+    /* skips the IPv6 extension headers after the fixed header, false when they are
+       truncated or malformed */
+    static bool findIPv6Payload(PacketView packet, uint8_t next_header, IPv6Payload& payload);
     void initRoutingTable();
     void addRoute(const std::string& network, const std::string& interface,
                   const std::string& next_hop = "", int metric = 1);
+    void addRoute6(const std::string& network, const std::string& interface,
+                   const std::string& next_hop = "", int metric = 1);
+    void replaceRoute(const std::string& network, const std::string& interface,
+                      const std::string& next_hop = "", int metric = 1);
+    bool removeRoute(const std::string& network);
+    ReplayStats replayRouteUpdates(const RouteReplay& replay);
+    size_t loadRoutes(const std::string& path);
+    bool loadFibSnapshot(const std::string& path);
+    bool saveFibSnapshot(const std::string& path);
     void printRoutingTable();
+    std::vector<RoutePrefix> routePrefixes();
+    // interface names and next hops behind the verdicts' ids
+    const AdjacencyTable& adjacencies() const { return routingTable->adjacencies(); }
+    // the largest packet an interface sends, see RoutingTable::setInterfaceMtu
+    bool setInterfaceMtu(const std::string& interface, uint32_t mtu);
+
+    /* puts a microflow verdict cache in front of the route lookup. the cache is not
+       thread safe, each thread forwarding packets needs its own InternetProtocol.
+       IPv6 packets always take the FIB, the cache key is an IPv4 5-tuple */
+    void enableFlowCache(size_t entries, FlowCacheMode mode = FlowCacheMode::FIVE_TUPLE,
+                         bool measure_latency = false);
+    // ingress validation run by processBurst, lengths and IPv4 header checksums by default
+    void setIngressChecks(const IngressChecks& checks) { ingressChecks = checks; }
+    /* puts IPv4 fragment reassembly in front of forwardPackets, timed by the steady
+       clock. like the flow cache it belongs to this instance's thread, forwardBurst and
+       the workers do not reassemble */
+    void enableReassembly(const ReassemblyConfig& config = ReassemblyConfig());
+    /* answers FRAGMENTATION_NEEDED drops in forwardPackets with rate-limited ICMP
+       fragmentation needed errors (IcmpErrorGenerator), forwarded like any other packet.
+       belongs to this instance's thread like the flow cache */
+    void enableIcmpErrors(const IcmpErrorConfig& config);
+    /* source NAPT in forwardBurst as one core of a shared NatTable (NatTranslator), the
+       core's ports and sessions belong to this instance's thread like the flow cache.
+       false for a core the table does not have */
+    bool enableNat(std::shared_ptr<NatTable> table, size_t core = 0);
+    /* tracks the connections of what forwardPackets and forwardBurst forward
+       (ConnectionTracker), after reassembly and the verdicts: dropped packets never reach
+       it. timed by the steady clock, the results only feed its counters. belongs to this
+       instance's thread like the flow cache. forwardBurst tracks packets as NAT left them,
+       so the two are not to be combined */
+    void enableConnectionTracking(const ConntrackConfig& config = ConntrackConfig());
+
+    // nullptr when the flow cache is disabled
+    const FlowCacheStats* flowCacheStats() const { return flowCache ? &flowCache->stats() : nullptr; }
+    // all zero when reassembly is disabled
+    ReassemblyStats reassemblyStats() const { return reassembler ? reassembler->stats() : ReassemblyStats(); }
+    bool reassembling() const { return reassembler != nullptr; }
+    // nullptr when ICMP errors are disabled
+    const IcmpErrorStats* icmpErrorStats() const { return icmpErrors ? &icmpErrors->stats() : nullptr; }
+    const IcmpErrorConfig* icmpErrorConfig() const { return icmpErrors ? &icmpErrors->config() : nullptr; }
+    // the errors of forwardBurst's last burst, valid until the next call
+    const PacketView* icmpErrorOutput() const { return icmpErrors ? icmpErrors->output() : nullptr; }
+    size_t icmpErrorCount() const { return icmpErrors ? icmpErrors->outputCount() : 0; }
+    // this core's NAT counters, nullptr when NAT is disabled
+    const NatStats* natStats() const { return nat ? &nat->stats() : nullptr; }
+    std::shared_ptr<NatTable> natTable() const { return nat ? nat->table() : nullptr; }
+    // nullptr when connection tracking is disabled
+    const ConntrackStats* conntrackStats() const { return conntrack ? &conntrack->stats() : nullptr; }
+    const ConnectionTracker* connectionTracker() const { return conntrack.get(); }
 
 private:
-    RoutingTable routingTable;
-    void simulateForwarding(const IPv4Header& header);
-    void printIPHeader(const IPv4Header& header);
-    void printTransportLayerHeader(const std::vector<uint8_t>& packet, const IPv4Header& ip_header);
-    // void decrementTTL(IPv4Header& header);
+    std::shared_ptr<RoutingTable> routingTable;
+    std::unique_ptr<FlowCache> flowCache;
+    std::unique_ptr<FragmentReassembler> reassembler;
+    std::unique_ptr<IcmpErrorGenerator> icmpErrors;
+    std::unique_ptr<NatTranslator> nat;
+    std::unique_ptr<ConnectionTracker> conntrack;
+    IngressChecks ingressChecks;
+    uint64_t packetSequence = 0;
+    explicit InternetProtocol(std::shared_ptr<RoutingTable> table);
+    void forwardViews(const PacketView* packets, size_t count, VerdictSink& sink);
+    // processBurst and the sink for up to IP_MAX_BURST packets, records numbered on the way
+    void consumeBurst(const PacketView* packets, size_t count, VerdictRecord* records, VerdictSink& sink,
+                      uint64_t now_ns);
+    static void checkMtu(const AdjacencyTable& adjacencies, const PacketView* packets, const uint8_t* family,
+                         ForwardingVerdict* verdicts, size_t count);
+    // source NAT of the burst's packets leaving through the outside interface, refused[i] for the ones it refuses
+    void translateOutbound(PacketHandle* packets, const BurstResult& result, uint64_t now_ns, uint8_t* refused);
+    static FlowKey flowKey(const IPv4HeaderView& header);
+    static FlowKey flowKey6(const IPv6HeaderView& header, const IPv6Payload& payload);
+    static void classifyBurst(BurstResult& result);
 };
@@ -0,0 +1,118 @@
+#include "ip_fragmentation.hpp"
+#include "internet_protocol.hpp"
+#include "packet_builders.hpp"
+#include "checksum.hpp"
+#include <algorithm>
+
+constexpr uint8_t IPV4_OPTION_END = 0;
+constexpr uint8_t IPV4_OPTION_NOP = 1;
+constexpr uint8_t IPV4_OPTION_COPIED = 0x80;
+
+/* the header of the fragments after the first: the fixed part and the options with the
+   copied flag, padded with end-of-options to a multiple of 4 bytes. 0 for options that
+   run past the header */
+static size_t copiedHeader(const uint8_t* header, size_t header_length, uint8_t* out) {
+    std::memcpy(out, header, IPv4_HEADER_SIZE);
+    size_t length = IPv4_HEADER_SIZE;
+    for (size_t at = IPv4_HEADER_SIZE; at < header_length;) {
+        uint8_t type = header[at];
+        if (type == IPV4_OPTION_END) {
+            break;
+        }
+        if (type == IPV4_OPTION_NOP) {
+            at++;
+            continue;
+        }
+        size_t option_length = at + 1 < header_length ? header[at + 1] : 0;
+        if (option_length < 2 || option_length > header_length - at) {
+            return 0;
+        }
+        if (type & IPV4_OPTION_COPIED) {
+            std::memcpy(out + length, header + at, option_length);
+            length += option_length;
+        }
+        at += option_length;
+    }
+    while (length % 4 != 0) {
+        out[length++] = IPV4_OPTION_END;
+    }
+    out[0] = static_cast<uint8_t>(0x40 | (length / 4));
+    return length;
+}
+
+bool IPv4Fragmenter::start(PacketView packet, uint32_t mtu) {
+    count = 0;
+    index = 0;
+    sent = 0;
+    IPv4HeaderView header(packet);
+    if (!header.valid()) {
+        return false;
+    }
+    size_t header_length = header.headerLength();
+    size_t total_length = header.totalLength();
+    uint16_t flags_offset = header.flagsFragmentOffset();
+    if (header_length < IPv4_HEADER_SIZE || total_length < header_length || total_length > packet.size()) {
+        return false;
+    }
+    packet.copy(0, first_header, header_length);
+    first_length = header_length;
+    payload = PacketView(packet.data() + header_length, total_length - header_length);
+    flag_bits = flags_offset & ~(IPV4_MORE_FRAGMENTS | IPV4_FRAGMENT_OFFSET_MASK);
+    base_offset = flags_offset & IPV4_FRAGMENT_OFFSET_MASK;
+    last_more = flags_offset & IPV4_MORE_FRAGMENTS;
+
+    if (total_length <= mtu) {
+        first_chunk = payload.size();
+        count = 1;
+        return true;
+    }
+    if ((flags_offset & IPV4_DONT_FRAGMENT) || mtu < header_length + 8) {
+        return false;
+    }
+    other_length = copiedHeader(first_header, header_length, other_header);
+    if (other_length == 0) {
+        return false;
+    }
+    first_chunk = (mtu - first_length) & ~size_t(7);
+    other_chunk = (mtu - other_length) & ~size_t(7);
+    size_t rest = payload.size() - first_chunk;
+    // the last fragment's offset has to fit the 13-bit field too
+    if (base_offset + (payload.size() - 1) / 8 > IPV4_FRAGMENT_OFFSET_MASK) {
+        return false;
+    }
+    count = 1 + (rest + other_chunk - 1) / other_chunk;
+    return true;
+}
+
+bool IPv4Fragmenter::next(IPv4Fragment& fragment) {
+    if (index == count) {
+        return false;
+    }
+    bool first = index == 0;
+    bool last = ++index == count;
+    size_t header_length = first ? first_length : other_length;
+    size_t chunk = std::min(first ? first_chunk : other_chunk, payload.size() - sent);
+    std::memcpy(fragment.header, first ? first_header : other_header, header_length);
+    fragment.header_length = header_length;
+    fragment.payload = PacketView(payload.data() + sent, chunk);
+
+    uint16_t flags_offset = static_cast<uint16_t>(flag_bits | (base_offset + sent / 8) |
+                                                  (last ? last_more : IPV4_MORE_FRAGMENTS));
+    store16(fragment.header + offsetof(IPv4Header, total_length), static_cast<uint16_t>(header_length + chunk));
+    store16(fragment.header + offsetof(IPv4Header, flags_fragment_offset), flags_offset);
+    store16(fragment.header + offsetof(IPv4Header, header_checksum),
+              ipv4HeaderChecksum(fragment.header, header_length));
+    sent += chunk;
+    return true;
+}
+
+size_t fragmentIPv4(PacketView packet, uint32_t mtu, IPv4Fragment* fragments, size_t capacity) {
+    IPv4Fragmenter fragmenter;
+    if (!fragmenter.start(packet, mtu) || fragmenter.fragmentCount() > capacity) {
+        return 0;
+    }
+    for (size_t i = 0; i < fragmenter.fragmentCount(); i++) {
+        fragmenter.next(fragments[i]);
+    }
+    return fragmenter.fragmentCount();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "packet_view.hpp"
+
+// IPv4 flags and fragment offset word (RFC 791), the offset counts 8-byte units
+constexpr uint16_t IPV4_DONT_FRAGMENT = 0x4000;
+constexpr uint16_t IPV4_MORE_FRAGMENTS = 0x2000;
+constexpr uint16_t IPV4_FRAGMENT_OFFSET_MASK = 0x1FFF;
+constexpr size_t IPV4_MAX_HEADER_SIZE = 60;
+
+/* one fragment of an IPv4 packet on its way out: a header of its own and the slice of
+   the original packet's payload it carries, which stays where it is */
+struct IPv4Fragment {
+    uint8_t header[IPV4_MAX_HEADER_SIZE];
+    size_t header_length;
+    PacketView payload;
+
+    size_t size() const { return header_length + payload.size(); }
+    // the fragment as one packet at out, size() bytes
+    void write(uint8_t* out) const {
+        std::memcpy(out, header, header_length);
+        std::memcpy(out + header_length, payload.data(), payload.size());
+    }
+};
+
+/* egress fragmentation of IPv4 packets (RFC 791 section 3.2).
+   start() builds the two headers the fragments need once: the first fragment's with all
+   of the packet's options, the others' with only the options whose copied flag is set.
+   next() then hands out one fragment at a time, a copy of one of the two headers with
+   its length, MF flag and offset filled in and its checksum computed. the payload is
+   never copied or read, every fragment points at its part of the original buffer, so
+   sending the fragments costs the one copy into the output a packet that fits costs too.
+
+   a packet that already is a fragment is cut into smaller parts of the same datagram:
+   offsets continue from its own and the last part keeps its MF flag. a packet that fits
+   comes out as a single fragment, itself. no allocation, not thread safe */
+class IPv4Fragmenter {
+public:
+    /* prepares the fragments of packet for an interface of this MTU. false when it cannot
+       be fragmented: DF set on a packet that does not fit, a malformed header or options,
+       or an MTU that leaves no room for 8 payload bytes behind the header */
+    bool start(PacketView packet, uint32_t mtu);
+    // the next fragment, false once the whole payload has gone out
+    bool next(IPv4Fragment& fragment);
+    // fragments the packet is cut into, 0 after a failed start()
+    size_t fragmentCount() const { return count; }
+
+private:
+    PacketView payload;
+    size_t sent = 0;                    // payload bytes handed out so far
+    size_t index = 0;                   // fragments handed out so far
+    size_t count = 0;
+    uint8_t first_header[IPV4_MAX_HEADER_SIZE];
+    uint8_t other_header[IPV4_MAX_HEADER_SIZE];
+    size_t first_length = 0;
+    size_t other_length = 0;
+    size_t first_chunk = 0;             // payload bytes of the first fragment, a multiple of 8
+    size_t other_chunk = 0;             // and of every later one but the last
+    uint16_t flag_bits = 0;             // the packet's own flags but MF, DF is clear once it is cut
+    uint16_t base_offset = 0;           // its own fragment offset
+    uint16_t last_more = 0;             // its MF flag, which the last fragment keeps
+};
+
+/* all fragments of the packet at once, see IPv4Fragmenter. returns how many there are,
+   0 when the packet cannot be fragmented or needs more than capacity */
+size_t fragmentIPv4(PacketView packet, uint32_t mtu, IPv4Fragment* fragments, size_t capacity);
@@ -0,0 +1,571 @@
+#include "nat.hpp"
+#include "internet_protocol.hpp"
+#include "packet_builders.hpp"
+#include "checksum.hpp"
+#include "logger.hpp"
+#include <algorithm>
+
+// what a session has seen of its TCP connection
+constexpr uint8_t NAT_TCP_SYN_OUT = 0x01;
+constexpr uint8_t NAT_TCP_SYN_IN = 0x02;
+constexpr uint8_t NAT_TCP_FIN_OUT = 0x04;
+constexpr uint8_t NAT_TCP_FIN_IN = 0x08;
+constexpr uint8_t NAT_TCP_RST = 0x10;
+
+constexpr uint8_t TCP_FLAG_FIN = 0x01;
+constexpr uint8_t TCP_FLAG_SYN = 0x02;
+constexpr uint8_t TCP_FLAG_RST = 0x04;
+
+constexpr uint8_t ICMP_ECHO_REPLY_TYPE = 0;
+constexpr uint8_t ICMP_ECHO_REQUEST_TYPE = 8;
+
+// protocol slots, the inbound array and the port queues have one part per protocol
+constexpr uint8_t NAT_SLOT_TCP = 0;
+constexpr uint8_t NAT_SLOT_UDP = 1;
+constexpr uint8_t NAT_SLOT_ICMP = 2;
+
+// timeout_ticks indexes
+constexpr size_t NAT_TIMEOUT_TCP_ESTABLISHED = 0;
+constexpr size_t NAT_TIMEOUT_TCP_TRANSITORY = 1;
+constexpr size_t NAT_TIMEOUT_TCP_CLOSED = 2;
+constexpr size_t NAT_TIMEOUT_UDP = 3;
+constexpr size_t NAT_TIMEOUT_ICMP = 4;
+
+// what translating a packet needs of it, addresses and ports in host order
+struct NatTuple {
+    uint8_t protocol;
+    uint8_t slot;               // NAT_SLOT_*
+    uint8_t tcp;                // NAT_TCP_* of the packet's flags
+    size_t l4;                  // offset of the transport header
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;          // ICMP echo: the identifier on the inside's side, 0 on the remote's
+    uint16_t dst_port;
+};
+
+static uint64_t remoteWord(uint8_t protocol, uint32_t ip, uint16_t port) {
+    return (static_cast<uint64_t>(protocol) << 48) | (static_cast<uint64_t>(ip) << 16) | port;
+}
+
+static uint64_t endpointWord(uint32_t ip, uint16_t port) {
+    return (static_cast<uint64_t>(ip) << 16) | port;
+}
+
+static bool isIPv4(IPv4HeaderView header) {
+    return header.valid() && header.version() == 4;
+}
+
+/* the tuple of an IPv4 packet the translator handles: TCP, UDP, and ICMP echo requests
+   on the way out or replies on the way back, not fragmented, with the transport header
+   inside the packet's total length. false for anything else */
+static bool parseTuple(PacketView packet, bool outbound, NatTuple& tuple) {
+    IPv4HeaderView header(packet);
+    size_t header_length = header.headerLength();
+    size_t total_length = header.totalLength();
+    if (header_length < IPv4_HEADER_SIZE || total_length < header_length || total_length > packet.size() ||
+        (header.flagsFragmentOffset() & 0x3FFF) != 0) {
+        return false;
+    }
+    tuple.protocol = header.protocol();
+    tuple.l4 = header_length;
+    tuple.src_ip = header.srcIp();
+    tuple.dst_ip = header.dstIp();
+    tuple.tcp = 0;
+    // the transport header and payload, up to the total length
+    PacketView l4 = PacketView(packet.data(), total_length).from(header_length);
+    switch (tuple.protocol) {
+        case PROTOCOL_TCP: {
+            if (!l4.has(0, 20)) {
+                return false;
+            }
+            uint8_t flags = l4.u8(13);
+            tuple.tcp = static_cast<uint8_t>(((flags & TCP_FLAG_SYN) ? (outbound ? NAT_TCP_SYN_OUT : NAT_TCP_SYN_IN) : 0) |
+                                             ((flags & TCP_FLAG_FIN) ? (outbound ? NAT_TCP_FIN_OUT : NAT_TCP_FIN_IN) : 0) |
+                                             ((flags & TCP_FLAG_RST) ? NAT_TCP_RST : 0));
+            tuple.slot = NAT_SLOT_TCP;
+            break;
+        }
+        case PROTOCOL_UDP:
+            if (!l4.has(0, 8)) {
+                return false;
+            }
+            tuple.slot = NAT_SLOT_UDP;
+            break;
+        case PROTOCOL_ICMP:
+            if (!l4.has(0, 8) || l4.u8(0) != (outbound ? ICMP_ECHO_REQUEST_TYPE : ICMP_ECHO_REPLY_TYPE)) {
+                return false;
+            }
+            tuple.slot = NAT_SLOT_ICMP;
+            tuple.src_port = outbound ? l4.u16(4) : 0;
+            tuple.dst_port = outbound ? 0 : l4.u16(4);
+            return true;
+        default:
+            return false;
+    }
+    tuple.src_port = l4.u16(0);
+    tuple.dst_port = l4.u16(2);
+    return true;
+}
+
+/* moves the packet's source (or destination) to ip and port, the ICMP identifier for
+   echo, and patches the header and transport checksums by the difference. a UDP
+   checksum of 0 means none was sent and stays 0, a patched one that comes out 0 is sent
+   as 0xFFFF (RFC 768) */
+static void rewrite(uint8_t* data, const NatTuple& tuple, bool source, uint32_t ip, uint16_t port) {
+    size_t address_offset = source ? offsetof(IPv4Header, src_ip) : offsetof(IPv4Header, dst_ip);
+    size_t header_checksum = offsetof(IPv4Header, header_checksum);
+    uint32_t old_ip = source ? tuple.src_ip : tuple.dst_ip;
+    store32(data + address_offset, ip);
+    store16(data + header_checksum, checksumAdjust32(load16(data + header_checksum), old_ip, ip));
+
+    uint8_t* l4 = data + tuple.l4;
+    if (tuple.slot == NAT_SLOT_ICMP) {
+        // no pseudo-header, only the identifier counts
+        uint16_t old_id = load16(l4 + 4);
+        store16(l4 + 4, port);
+        store16(l4 + 2, checksumAdjust(load16(l4 + 2), old_id, port));
+        return;
+    }
+    uint16_t old_port = source ? tuple.src_port : tuple.dst_port;
+    store16(l4 + (source ? 0 : 2), port);
+    uint8_t* checksum_at = l4 + (tuple.slot == NAT_SLOT_TCP ? 16 : 6);
+    uint16_t checksum = load16(checksum_at);
+    if (tuple.slot == NAT_SLOT_UDP && checksum == 0) {
+        return;
+    }
+    checksum = checksumAdjust(checksumAdjust32(checksum, old_ip, ip), old_port, port);
+    if (tuple.slot == NAT_SLOT_UDP && checksum == 0) {
+        checksum = 0xFFFF;
+    }
+    store16(checksum_at, checksum);
+}
+
+bool NatTable::IndexQueue::pop(uint32_t& index) {
+    if (fresh < limit) {
+        index = fresh++;
+        return true;
+    }
+    if (count == 0) {
+        return false;
+    }
+    index = released[head];
+    head = head + 1 == released.size() ? 0 : head + 1;
+    count--;
+    return true;
+}
+
+void NatTable::IndexQueue::push(uint32_t index) {
+    if (released.empty()) {
+        released.resize(limit);
+    }
+    size_t tail = head + count;
+    released[tail >= released.size() ? tail - released.size() : tail] = index;
+    count++;
+}
+
+NatTable::NatTable(const NatConfig& config) : settings(config) {
+    settings.cores = std::max<size_t>(1, settings.cores);
+    size_t ports = settings.port_max >= settings.port_min ? settings.port_max - settings.port_min + 1u : 0;
+    ports_per_core = ports / settings.cores;
+    sessions_per_core = settings.max_sessions / settings.cores;
+    pool_pairs = static_cast<size_t>(settings.external_count) * ports;
+    if (settings.external_count == 0 || ports_per_core == 0 || sessions_per_core == 0 ||
+        settings.max_sessions >= NONE || NAT_PROTOCOLS * pool_pairs >= NONE || settings.tick_ns == 0) {
+        log_error("NAT pool of %u addresses, ports %u-%u and %zu sessions cannot be shared by %zu cores",
+                  settings.external_count, settings.port_min, settings.port_max, settings.max_sessions,
+                  settings.cores);
+        return;
+    }
+
+    size_t session_count = sessions_per_core * settings.cores;
+    // an outbound key per session, the buckets at most half full
+    size_t bucket_count = 1;
+    while (bucket_count * NAT_BUCKET_WAYS < 2 * session_count) {
+        bucket_count <<= 1;
+    }
+    sessions.reset(new Session[session_count]);
+    buckets.reset(new Bucket[bucket_count]());
+    bucket_mask = bucket_count - 1;
+    by_external.reset(new std::atomic<uint32_t>[NAT_PROTOCOLS * pool_pairs]());
+
+    for (size_t i = 0; i < settings.cores; i++) {
+        auto core = std::make_unique<Core>(sessions_per_core, settings.tick_ns);
+        size_t core_ports = i + 1 == settings.cores ? ports - i * ports_per_core : ports_per_core;
+        core->first_port = static_cast<uint16_t>(settings.port_min + i * ports_per_core);
+        core->sessions.limit = static_cast<uint32_t>(sessions_per_core);
+        for (IndexQueue& pairs : core->pairs) {
+            pairs.limit = static_cast<uint32_t>(core_ports * settings.external_count);
+        }
+        cores.push_back(std::move(core));
+    }
+
+    const NatTimeouts& timeouts = settings.timeouts;
+    const uint64_t timeouts_ns[] = {timeouts.tcp_established_ns, timeouts.tcp_transitory_ns, timeouts.tcp_closed_ns,
+                                    timeouts.udp_ns, timeouts.icmp_ns};
+    for (size_t i = 0; i < 5; i++) {
+        timeout_ticks[i] = static_cast<uint32_t>((timeouts_ns[i] + settings.tick_ns - 1) / settings.tick_ns);
+    }
+    is_valid = true;
+}
+
+size_t NatTable::coreOfPort(uint16_t port) const {
+    return std::min<size_t>((port - settings.port_min) / ports_per_core, settings.cores - 1);
+}
+
+int NatTable::ownerOf(PacketView packet) const {
+    NatTuple tuple;
+    IPv4HeaderView header(packet);
+    if (!is_valid || !isIPv4(header) || !inPool(header.dstIp()) || !parseTuple(packet, false, tuple) ||
+        tuple.dst_port < settings.port_min || tuple.dst_port > settings.port_max) {
+        return -1;
+    }
+    return static_cast<int>(coreOfPort(tuple.dst_port));
+}
+
+NatStats NatTable::stats() const {
+    NatStats total;
+    for (const auto& core : cores) {
+        const NatStats& stats = core->stats;
+        total.outbound += stats.outbound;
+        total.inbound += stats.inbound;
+        total.created += stats.created;
+        total.expired += stats.expired;
+        total.exhausted += stats.exhausted;
+        total.no_mapping += stats.no_mapping;
+        total.untranslatable += stats.untranslatable;
+        total.active += stats.active;
+    }
+    return total;
+}
+
+uint32_t NatTable::timeoutTicks(uint8_t protocol_slot, uint8_t tcp) const {
+    if (protocol_slot == NAT_SLOT_UDP) {
+        return timeout_ticks[NAT_TIMEOUT_UDP];
+    }
+    if (protocol_slot == NAT_SLOT_ICMP) {
+        return timeout_ticks[NAT_TIMEOUT_ICMP];
+    }
+    if (tcp & NAT_TCP_RST) {
+        return timeout_ticks[NAT_TIMEOUT_TCP_CLOSED];
+    }
+    if ((tcp & (NAT_TCP_FIN_OUT | NAT_TCP_FIN_IN)) == (NAT_TCP_FIN_OUT | NAT_TCP_FIN_IN)) {
+        return timeout_ticks[NAT_TIMEOUT_TCP_TRANSITORY];
+    }
+    if ((tcp & (NAT_TCP_SYN_OUT | NAT_TCP_SYN_IN)) == (NAT_TCP_SYN_OUT | NAT_TCP_SYN_IN)) {
+        return timeout_ticks[NAT_TIMEOUT_TCP_ESTABLISHED];
+    }
+    return timeout_ticks[NAT_TIMEOUT_TCP_TRANSITORY];
+}
+
+bool NatTable::readSession(uint32_t session, uint64_t& remote, uint64_t& inside, uint64_t& external) const {
+    const Session& s = sessions[session];
+    uint32_t version = s.version.load(std::memory_order_acquire);
+    if (version & 1) {
+        return false;
+    }
+    remote = s.remote.load(std::memory_order_relaxed);
+    inside = s.inside.load(std::memory_order_relaxed);
+    external = s.external.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return s.version.load(std::memory_order_relaxed) == version;
+}
+
+/* a key sits in the first bucket of its probe sequence that had a free slot when it was
+   inserted. slots never turn empty again, so once a bucket with an empty slot has been
+   searched the key is known not to be further on */
+uint32_t NatTable::findOutbound(uint64_t remote, uint64_t inside, uint64_t hash, uint64_t& external) const {
+    uint32_t tag = static_cast<uint32_t>(hash >> 32);
+    size_t bucket = hash & bucket_mask;
+    for (size_t probe = 0; probe < NAT_MAX_PROBE; probe++, bucket = (bucket + 1) & bucket_mask) {
+        const Bucket& b = buckets[bucket];
+        bool open = false;
+        for (size_t way = 0; way < NAT_BUCKET_WAYS; way++) {
+            uint64_t slot = b.slots[way].load(std::memory_order_acquire);
+            if (slot == SLOT_EMPTY) {
+                open = true;
+                continue;
+            }
+            if (slot == SLOT_DELETED || static_cast<uint32_t>(slot >> 32) != tag) {
+                continue;
+            }
+            uint32_t session = static_cast<uint32_t>(slot) - 1;
+            uint64_t session_remote, session_inside;
+            if (readSession(session, session_remote, session_inside, external) &&
+                session_remote == remote && session_inside == inside) {
+                return session;
+            }
+        }
+        if (open) {
+            break;
+        }
+    }
+    return NONE;
+}
+
+void NatTable::prefetchOutbound(uint64_t hash) const {
+    uint32_t tag = static_cast<uint32_t>(hash >> 32);
+    const Bucket& b = buckets[hash & bucket_mask];
+    for (size_t way = 0; way < NAT_BUCKET_WAYS; way++) {
+        uint64_t slot = b.slots[way].load(std::memory_order_relaxed);
+        if (slot != SLOT_EMPTY && slot != SLOT_DELETED && static_cast<uint32_t>(slot >> 32) == tag) {
+            __builtin_prefetch(&sessions[static_cast<uint32_t>(slot) - 1]);
+            return;
+        }
+    }
+}
+
+bool NatTable::insertOutbound(uint32_t session, uint64_t hash) {
+    uint64_t value = ((hash >> 32) << 32) | (session + 1);
+    size_t bucket = hash & bucket_mask;
+    for (size_t probe = 0; probe < NAT_MAX_PROBE; probe++, bucket = (bucket + 1) & bucket_mask) {
+        Bucket& b = buckets[bucket];
+        for (size_t way = 0; way < NAT_BUCKET_WAYS; way++) {
+            uint64_t slot = b.slots[way].load(std::memory_order_relaxed);
+            // another core may take the slot first, then the next one is tried
+            while ((slot == SLOT_EMPTY || slot == SLOT_DELETED) &&
+                   !b.slots[way].compare_exchange_weak(slot, value, std::memory_order_release,
+                                                       std::memory_order_relaxed)) {
+            }
+            if (slot == SLOT_EMPTY || slot == SLOT_DELETED) {
+                sessions[session].slot = static_cast<uint32_t>(bucket * NAT_BUCKET_WAYS + way);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+NatTranslator::NatTranslator(std::shared_ptr<NatTable> table, size_t core)
+    : nat(std::move(table)), core_id(core), owner(*nat->cores[core]) {}
+
+void NatTranslator::translateOutbound(NatPacket* packets, size_t count, uint64_t now_ns, uint8_t* refused) {
+    expire(now_ns);
+    NatTable& table = *nat;
+    uint32_t now = static_cast<uint32_t>(now_ns / table.settings.tick_ns);
+    NatTuple tuples[NAT_BURST];
+    uint64_t hashes[NAT_BURST];
+    bool translate[NAT_BURST];
+    for (size_t start = 0; start < count; start += NAT_BURST) {
+        size_t burst = std::min(NAT_BURST, count - start);
+        // parse and hash the whole burst first, the buckets it probes load meanwhile
+        for (size_t i = 0; i < burst; i++) {
+            PacketView packet = packets[start + i].view();
+            IPv4HeaderView header(packet);
+            translate[i] = false;
+            if (!isIPv4(header) || table.inPool(header.srcIp())) {
+                continue;
+            }
+            NatTuple& tuple = tuples[i];
+            if (!parseTuple(packet, true, tuple)) {
+                owner.stats.untranslatable++;
+                refused[start + i] = 1;
+                continue;
+            }
+            hashes[i] = flowHash({tuple.src_ip, tuple.dst_ip, tuple.src_port, tuple.dst_port, tuple.protocol});
+            __builtin_prefetch(&table.buckets[hashes[i] & table.bucket_mask]);
+            translate[i] = true;
+        }
+        // then the sessions the buckets point at, the lookups below find both loaded
+        for (size_t i = 0; i < burst; i++) {
+            if (translate[i]) {
+                table.prefetchOutbound(hashes[i]);
+            }
+        }
+
+        for (size_t i = 0; i < burst; i++) {
+            if (!translate[i]) {
+                continue;
+            }
+            const NatTuple& tuple = tuples[i];
+            uint64_t remote = remoteWord(tuple.protocol, tuple.dst_ip, tuple.dst_port);
+            uint64_t inside = endpointWord(tuple.src_ip, tuple.src_port);
+            uint64_t external;
+            uint32_t session = table.findOutbound(remote, inside, hashes[i], external);
+            if (session == NatTable::NONE) {
+                session = createSession(tuple.slot, remote, inside, hashes[i], now);
+                if (session == NatTable::NONE) {
+                    owner.stats.exhausted++;
+                    refused[start + i] = 1;
+                    continue;
+                }
+                external = table.sessions[session].external.load(std::memory_order_relaxed);
+            }
+            rewrite(packets[start + i].data, tuple, true, static_cast<uint32_t>(external >> 16),
+                    static_cast<uint16_t>(external));
+            touch(session, tuple.slot, tuple.tcp, now);
+            owner.stats.outbound++;
+        }
+    }
+}
+
+void NatTranslator::translateInbound(NatPacket* packets, size_t count, uint64_t now_ns, uint8_t* refused,
+                                     NatInbound* inbound) {
+    expire(now_ns);
+    NatTable& table = *nat;
+    const NatConfig& config = table.settings;
+    NatTuple tuples[NAT_BURST];
+    uint32_t found[NAT_BURST];
+    for (size_t start = 0; start < count; start += NAT_BURST) {
+        size_t burst = std::min(NAT_BURST, count - start);
+        /* three passes so the loads of a burst overlap: the inbound array entries, then
+           the sessions they point at, then the rewrite */
+        for (size_t i = 0; i < burst; i++) {
+            PacketView packet = packets[start + i].view();
+            IPv4HeaderView header(packet);
+            found[i] = NatTable::NONE;
+            inbound[start + i] = {NAT_NO_SESSION, 0, 0};
+            if (!isIPv4(header) || !table.inPool(header.dstIp())) {
+                continue;
+            }
+            NatTuple& tuple = tuples[i];
+            if (!parseTuple(packet, false, tuple) ||
+                tuple.dst_port < config.port_min || tuple.dst_port > config.port_max) {
+                owner.stats.no_mapping++;
+                refused[start + i] = 1;
+                continue;
+            }
+            found[i] = static_cast<uint32_t>(tuple.slot * table.pool_pairs +
+                                             static_cast<size_t>(tuple.dst_port - config.port_min) * config.external_count +
+                                             (tuple.dst_ip - config.external_ip));
+            __builtin_prefetch(&table.by_external[found[i]]);
+        }
+        for (size_t i = 0; i < burst; i++) {
+            if (found[i] == NatTable::NONE) {
+                continue;
+            }
+            found[i] = table.by_external[found[i]].load(std::memory_order_acquire) - 1;
+            if (found[i] != NatTable::NONE) {
+                __builtin_prefetch(&table.sessions[found[i]]);
+            } else {
+                owner.stats.no_mapping++;
+                refused[start + i] = 1;
+            }
+        }
+        for (size_t i = 0; i < burst; i++) {
+            uint32_t session = found[i];
+            if (session == NatTable::NONE) {
+                continue;
+            }
+            const NatTuple& tuple = tuples[i];
+            uint64_t remote, inside, external;
+            if (!table.readSession(session, remote, inside, external) ||
+                external != endpointWord(tuple.dst_ip, tuple.dst_port) ||
+                remote != remoteWord(tuple.protocol, tuple.src_ip, tuple.src_port)) {
+                owner.stats.no_mapping++;
+                refused[start + i] = 1;
+                continue;
+            }
+            rewrite(packets[start + i].data, tuple, false, static_cast<uint32_t>(inside >> 16),
+                    static_cast<uint16_t>(inside));
+            inbound[start + i] = {session, tuple.slot, tuple.tcp};
+        }
+    }
+}
+
+void NatTranslator::commitInbound(const NatInbound* inbound, size_t count, uint64_t now_ns) {
+    uint32_t now = static_cast<uint32_t>(now_ns / nat->settings.tick_ns);
+    for (size_t i = 0; i < count; i++) {
+        if (inbound[i].session == NAT_NO_SESSION) {
+            continue;
+        }
+        touch(inbound[i].session, inbound[i].protocol_slot, inbound[i].tcp, now);
+        owner.stats.inbound++;
+    }
+}
+
+uint32_t NatTranslator::createSession(uint8_t protocol_slot, uint64_t remote, uint64_t inside, uint64_t hash,
+                                      uint32_t now) {
+    NatTable& table = *nat;
+    const NatConfig& config = table.settings;
+    uint32_t pair, local;
+    if (!owner.pairs[protocol_slot].pop(pair)) {
+        return NatTable::NONE;
+    }
+    if (!owner.sessions.pop(local)) {
+        owner.pairs[protocol_slot].push(pair);
+        return NatTable::NONE;
+    }
+    uint32_t session = static_cast<uint32_t>(core_id * table.sessions_per_core + local);
+    NatTable::Session& s = table.sessions[session];
+    // this core's pairs run over the pool addresses first, then its ports
+    uint32_t ip = config.external_ip + pair % config.external_count;
+    uint16_t port = static_cast<uint16_t>(owner.first_port + pair / config.external_count);
+    s.pair = static_cast<uint32_t>(protocol_slot * table.pool_pairs +
+                                   static_cast<size_t>(owner.first_port - config.port_min) * config.external_count + pair);
+
+    uint32_t version = s.version.load(std::memory_order_relaxed);
+    s.version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.remote.store(remote, std::memory_order_relaxed);
+    s.inside.store(inside, std::memory_order_relaxed);
+    s.external.store(endpointWord(ip, port), std::memory_order_relaxed);
+    s.tcp.store(0, std::memory_order_relaxed);
+    s.last_seen.store(now, std::memory_order_relaxed);
+    s.version.store(version + 2, std::memory_order_release);
+
+    if (!table.insertOutbound(session, hash)) {
+        owner.pairs[protocol_slot].push(pair);
+        owner.sessions.push(local);
+        return NatTable::NONE;
+    }
+    table.by_external[s.pair].store(session + 1, std::memory_order_release);
+    owner.timers.schedule(local, (static_cast<uint64_t>(now) + table.timeoutTicks(protocol_slot, 0)) * config.tick_ns);
+    owner.stats.created++;
+    owner.stats.active++;
+    return session;
+}
+
+void NatTranslator::releaseSession(uint32_t session) {
+    NatTable& table = *nat;
+    const NatConfig& config = table.settings;
+    NatTable::Session& s = table.sessions[session];
+    table.buckets[s.slot / NatTable::NAT_BUCKET_WAYS].slots[s.slot % NatTable::NAT_BUCKET_WAYS].store(
+        NatTable::SLOT_DELETED, std::memory_order_release);
+    table.by_external[s.pair].store(0, std::memory_order_release);
+    // readers holding on to the session see the count move and drop what they read
+    s.version.store(s.version.load(std::memory_order_relaxed) + 2, std::memory_order_release);
+
+    size_t protocol_slot = s.pair / table.pool_pairs;
+    size_t first_pair = static_cast<size_t>(owner.first_port - config.port_min) * config.external_count;
+    owner.pairs[protocol_slot].push(static_cast<uint32_t>(s.pair - protocol_slot * table.pool_pairs - first_pair));
+    owner.sessions.push(static_cast<uint32_t>(session - core_id * table.sessions_per_core));
+    owner.stats.expired++;
+    owner.stats.active--;
+}
+
+void NatTranslator::touch(uint32_t session, uint8_t protocol_slot, uint8_t tcp, uint32_t now) {
+    NatTable& table = *nat;
+    NatTable::Session& s = table.sessions[session];
+    // a store only once a tick, the line stays shared between the cores reading it
+    if (s.last_seen.load(std::memory_order_relaxed) != now) {
+        s.last_seen.store(now, std::memory_order_relaxed);
+    }
+    if ((s.tcp.load(std::memory_order_relaxed) & tcp) == tcp) {
+        return;
+    }
+    uint8_t seen = static_cast<uint8_t>(s.tcp.fetch_or(tcp, std::memory_order_relaxed) | tcp);
+    // the owner moves the timer to the new state's timeout, other cores leave it to the next check
+    if (session / table.sessions_per_core == core_id) {
+        owner.timers.schedule(static_cast<uint32_t>(session % table.sessions_per_core),
+                              (static_cast<uint64_t>(now) + table.timeoutTicks(protocol_slot, seen)) *
+                                  table.settings.tick_ns);
+    }
+}
+
+void NatTranslator::expire(uint64_t now_ns) {
+    NatTable& table = *nat;
+    uint32_t now = static_cast<uint32_t>(now_ns / table.settings.tick_ns);
+    owner.timers.advance(now_ns, [&](uint32_t local) {
+        uint32_t session = static_cast<uint32_t>(core_id * table.sessions_per_core + local);
+        NatTable::Session& s = table.sessions[session];
+        uint8_t protocol_slot = static_cast<uint8_t>(s.pair / table.pool_pairs);
+        uint32_t deadline = s.last_seen.load(std::memory_order_relaxed) +
+                            table.timeoutTicks(protocol_slot, s.tcp.load(std::memory_order_relaxed));
+        if (deadline > now) {
+            // used since it was scheduled, or its timeout is beyond the wheel
+            owner.timers.schedule(local, static_cast<uint64_t>(deadline) * table.settings.tick_ns);
+        } else {
+            releaseSession(session);
+        }
+    });
+}
@@ -0,0 +1,217 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "forwarding_verdict.hpp"
+#include "packet_view.hpp"
+#include "timer_wheel.hpp"
+
+// packets a translator takes in one pass, longer runs are cut into these
+constexpr size_t NAT_BURST = LPM_MAX_BURST;
+
+/* idle time after which a session is dropped, by protocol and for TCP by what the
+   session has seen so far */
+struct NatTimeouts {
+    uint64_t tcp_established_ns = 7440ull * 1000000000;    // SYN both ways, 2 h 4 min (RFC 5382 REQ-5)
+    uint64_t tcp_transitory_ns = 240ull * 1000000000;      // opening, or closed by FINs both ways
+    uint64_t tcp_closed_ns = 10ull * 1000000000;           // after a RST
+    uint64_t udp_ns = 300ull * 1000000000;                 // RFC 4787 REQ-5
+    uint64_t icmp_ns = 60ull * 1000000000;                 // echo, RFC 5508 REQ-1
+};
+
+struct NatConfig {
+    uint32_t external_ip = 0;           // host order, the first address of the pool
+    uint32_t external_count = 1;        // pool addresses from external_ip on
+    uint16_t port_min = 1024;           // external ports handed out, for every pool address and protocol
+    uint16_t port_max = 65535;
+    uint16_t outside_interface = 0;     // packets routed out of it get a pool source
+    size_t max_sessions = 1 << 16;      // all cores together
+    size_t cores = 1;                   // translators, each with a share of the ports and sessions of its own
+    NatTimeouts timeouts;
+    uint64_t tick_ns = 1000000000;      // expiry resolution, a session goes up to a tick late
+};
+
+struct NatStats {
+    uint64_t outbound = 0;          // packets translated on their way out
+    uint64_t inbound = 0;           // and on their way back in
+    uint64_t created = 0;           // sessions
+    uint64_t expired = 0;
+    uint64_t exhausted = 0;         // outbound packets refused, the core had no port or session left
+    uint64_t no_mapping = 0;        // inbound packets to the pool that no session expects
+    uint64_t untranslatable = 0;    // outbound packets other than TCP, UDP and ICMP echo, fragments, truncated
+    size_t active = 0;              // sessions now
+};
+
+// one packet of a burst for the translator, rewritten in place
+struct NatPacket {
+    uint8_t* data;
+    size_t length;
+
+    PacketView view() const { return PacketView(data, length); }
+};
+
+constexpr uint32_t NAT_NO_SESSION = UINT32_MAX;
+
+/* the session an inbound packet was translated for, recorded on the session (last seen,
+   TCP flags) only once the packet is known to be forwarded */
+struct NatInbound {
+    uint32_t session;           // NAT_NO_SESSION for a packet not translated
+    uint8_t protocol_slot;
+    uint8_t tcp;
+};
+
+/* Source NAPT (RFC 3022) for TCP, UDP and ICMP echo, shared by all forwarding cores.
+   a session maps an inside (address, port) talking to one remote (address, port) to a
+   pool address and port of its own, identifier instead of port for ICMP echo. inbound
+   packets are only let in from the remote their session was opened to (address and
+   port dependent filtering, RFC 4787).
+
+   every core owns a slice of the port range on every pool address and a slice of the
+   sessions, allocates from them and expires them with a timer wheel of its own, so cores
+   never contend for ports or sessions. what is shared are two indexes, both lock-free:
+   - outbound, a hash of (inside, remote) in open-addressed buckets of one cache line,
+     8 slots holding a 32-bit hash tag and the session, claimed with a CAS and probed
+     linearly over at most NAT_MAX_PROBE buckets. removed sessions leave a tombstone
+     that later inserts reuse
+   - inbound, an array indexed by (protocol, pool address, port) straight to the session,
+     the pool is small enough to be mapped whole
+   sessions are a cache line each, written by their owner only under a sequence count
+   (seqlock) that readers on other cores check around their copy of the key, so a
+   session recycled while they look at it is seen as a miss. packets touching a session
+   update its last-seen tick and TCP flags with relaxed atomics, the owner reads them
+   when the timer fires and puts the session back on the wheel if it was used since.
+
+   a flow's outbound packets must always reach the same core (worker sharding by the
+   5-tuple does that), it is the one that creates the session. ownerOf() gives the core
+   for inbound packets, ForwardingWorkers steers them there */
+class NatTable {
+public:
+    explicit NatTable(const NatConfig& config);
+    NatTable(const NatTable&) = delete;
+    NatTable& operator=(const NatTable&) = delete;
+
+    // false when the pool, the ports or the sessions cannot be shared by the cores
+    bool valid() const { return is_valid; }
+    const NatConfig& config() const { return settings; }
+    bool inPool(uint32_t ip) const { return ip - settings.external_ip < settings.external_count; }
+    /* the core whose pool port an inbound packet is addressed to, -1 for packets that
+       are not for the pool */
+    int ownerOf(PacketView packet) const;
+    // every core's counters, exact once none of them is translating
+    NatStats stats() const;
+    // sessions one core can hold
+    size_t coreCapacity() const { return sessions_per_core; }
+
+private:
+    friend class NatTranslator;
+
+    static constexpr size_t NAT_BUCKET_WAYS = 8;
+    static constexpr size_t NAT_MAX_PROBE = 8;
+    static constexpr size_t NAT_PROTOCOLS = 3;             // TCP, UDP, ICMP
+    static constexpr size_t NAT_TIMER_SLOTS = 256;         // ticks ahead, longer timeouts are checked on the way
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr uint64_t SLOT_EMPTY = 0;
+    static constexpr uint64_t SLOT_DELETED = ~0ull;
+
+    struct alignas(64) Bucket {
+        std::atomic<uint64_t> slots[NAT_BUCKET_WAYS];       // hash tag << 32 | session + 1
+    };
+
+    struct alignas(64) Session {
+        std::atomic<uint32_t> version{0};       // odd while the owner rewrites the session
+        std::atomic<uint32_t> last_seen{0};     // tick of the last packet either way
+        std::atomic<uint64_t> remote{0};        // protocol << 48 | remote ip << 16 | remote port
+        std::atomic<uint64_t> inside{0};        // inside ip << 16 | inside port
+        std::atomic<uint64_t> external{0};      // pool ip << 16 | pool port
+        std::atomic<uint8_t> tcp{0};            // NAT_TCP_* seen
+        // the owner's alone
+        uint32_t pair = 0;                      // index into the inbound array
+        uint32_t slot = 0;                      // bucket * NAT_BUCKET_WAYS + way in the outbound index
+    };
+
+    // indexes handed out: never used ones first, then released ones, oldest first
+    struct IndexQueue {
+        uint32_t fresh = 0;
+        uint32_t limit = 0;
+        std::vector<uint32_t> released;     // ring, allocated on the first release
+        size_t head = 0;
+        size_t count = 0;
+
+        bool pop(uint32_t& index);
+        void push(uint32_t index);
+    };
+
+    // everything one core allocates from, touched by that core alone
+    struct alignas(64) Core {
+        Core(size_t sessions, uint64_t tick_ns) : timers(sessions, NAT_TIMER_SLOTS, tick_ns) {}
+
+        IndexQueue sessions;
+        IndexQueue pairs[NAT_PROTOCOLS];
+        uint16_t first_port = 0;
+        TimerWheel timers;
+        NatStats stats;
+    };
+
+    NatConfig settings;
+    bool is_valid = false;
+    size_t ports_per_core = 0;
+    size_t sessions_per_core = 0;
+    size_t pool_pairs = 0;              // pool addresses * ports, per protocol
+    std::unique_ptr<Session[]> sessions;
+    std::unique_ptr<Bucket[]> buckets;
+    size_t bucket_mask = 0;
+    std::unique_ptr<std::atomic<uint32_t>[]> by_external;  // session + 1, 0 for none
+    std::vector<std::unique_ptr<Core>> cores;
+    uint32_t timeout_ticks[5] = {};     // the NatTimeouts, in ticks and their order
+
+    size_t coreOfPort(uint16_t port) const;
+    // the session of an outbound key and its pool address and port, NONE when there is none
+    uint32_t findOutbound(uint64_t remote, uint64_t inside, uint64_t hash, uint64_t& external) const;
+    bool insertOutbound(uint32_t session, uint64_t hash);
+    // starts loading the session a hash's first bucket points at, if any
+    void prefetchOutbound(uint64_t hash) const;
+    // a consistent copy of the session's key, false while it is being rewritten
+    bool readSession(uint32_t session, uint64_t& remote, uint64_t& inside, uint64_t& external) const;
+    uint32_t timeoutTicks(uint8_t protocol_slot, uint8_t tcp) const;
+};
+
+/* one core's side of a NatTable: creates, translates and expires sessions. translation
+   rewrites addresses, ports and ICMP identifiers in place and patches the IPv4 header
+   and TCP/UDP/ICMP checksums incrementally (RFC 1624), nothing is summed again. not
+   thread safe, one translator per core and thread */
+class NatTranslator {
+public:
+    NatTranslator(std::shared_ptr<NatTable> table, size_t core);
+
+    /* destination NAT of packets addressed to the pool, before their route lookup:
+       a session's packets get its inside address and port. refused[i] is set for the
+       ones no session lets in, left alone for everything else. inbound[i] names the
+       session a packet was translated for; nothing is recorded on the sessions until
+       commitInbound, so packets dropped after all (bad checksum, TTL, no route) neither
+       keep a session alive nor move its TCP state */
+    void translateInbound(NatPacket* packets, size_t count, uint64_t now_ns, uint8_t* refused, NatInbound* inbound);
+    // records the forwarded ones of translateInbound's packets on their sessions
+    void commitInbound(const NatInbound* inbound, size_t count, uint64_t now_ns);
+    /* source NAT of packets leaving through the outside interface, creating sessions for
+       new flows. refused[i] is set for packets that cannot be translated or got no
+       session, left alone for the rest. packets with a pool source pass untouched */
+    void translateOutbound(NatPacket* packets, size_t count, uint64_t now_ns, uint8_t* refused);
+    // drops this core's sessions idle past their timeout
+    void expire(uint64_t now_ns);
+
+    size_t core() const { return core_id; }
+    const NatStats& stats() const { return owner.stats; }
+    const std::shared_ptr<NatTable>& table() const { return nat; }
+
+private:
+    std::shared_ptr<NatTable> nat;
+    size_t core_id;
+    NatTable::Core& owner;
+
+    uint32_t createSession(uint8_t protocol_slot, uint64_t remote, uint64_t inside, uint64_t hash, uint32_t now);
+    void releaseSession(uint32_t session);
+    // records a packet on the session, rescheduling its timer when the TCP state changed
+    void touch(uint32_t session, uint8_t protocol_slot, uint8_t tcp, uint32_t now);
+};
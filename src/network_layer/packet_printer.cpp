@@ -0,0 +1,151 @@
+#include "packet_printer.hpp"
+#include "icmp.hpp"
+#include "tcp.hpp"
+#include "udp.hpp"
+#include "logger.hpp"
+#include <iostream>
+#include <arpa/inet.h>
+
+void PacketPrinter::consume(const VerdictRecord* records, const PacketView* packets, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        std::cout << "\n--- Processing Packet " << records[i].sequence + 1 << " ---\n";
+        printPacket(records[i], packets[i]);
+    }
+}
+
+void PacketPrinter::printPacket(const VerdictRecord& record, PacketView packet) {
+    log_debug("Starting packet parsing, packet size: %zu bytes", packet.size());
+
+    if (packet.empty()) {
+        log_error("Packet too short");
+        return;
+    }
+
+    uint8_t version = packet.u8(0) >> 4;
+    if (version == 6) {
+        IPv6HeaderView header(packet);
+        if (!header.valid()) {
+            log_error("Packet too short for IPv6 header");
+            return;
+        }
+
+        IPv6Payload payload;
+        if (!InternetProtocol::findIPv6Payload(packet, header.nextHeader(), payload)) {
+            log_error("Truncated or malformed IPv6 extension headers");
+            return;
+        }
+
+        log_debug("Parsed IPv6 packet - Hop Limit: %d, Next Header: %d, Upper Layer: %d at offset %zu",
+                  header.hopLimit(), header.nextHeader(), payload.protocol, payload.offset);
+
+        printIPv6Header(header);
+        if (payload.has_l4_header) {
+            printTransportLayerHeader(packet, payload.protocol, payload.offset);
+        }
+        printVerdict(record.verdict, header.dstIp().toString(), "hop limit");
+        return;
+    }
+    if (version != 4) {
+        log_error("Unsupported IP version: %u (expected 4 or 6)", version);
+        return;
+    }
+
+    IPv4HeaderView header(packet);
+    if (!header.valid()) {
+        log_error("Packet too short");
+        return;
+    }
+
+    log_debug("Parsed packet - TTL: %d, Protocol: %d, Total Length: %d",
+                header.ttl(), header.protocol(), header.totalLength());
+
+    printIPHeader(header);
+    // only the first fragment carries the transport header, the others start mid-segment
+    uint16_t fragment_offset = header.flagsFragmentOffset() & 0x1FFF;
+    if (fragment_offset == 0) {
+        printTransportLayerHeader(packet, header.protocol(), header.headerLength());
+    } else {
+        log_debug("Fragment at offset %u, no transport header", fragment_offset * 8);
+        std::cout << "Fragment at offset " << fragment_offset * 8 << " (no transport header)\n";
+    }
+    printVerdict(record.verdict, inet_ntoa({htonl(header.dstIp())}), "TTL");
+}
+
+void PacketPrinter::printIPv6Header(const IPv6HeaderView& h) {
+    std::cout << "IPv6 Header:\n"
+              << "  Source IP: "      << h.srcIp().toString() << "\n"
+              << "  Destination IP: " << h.dstIp().toString() << "\n"
+              << "  Hop Limit: "      << static_cast<int>(h.hopLimit()) << "\n"
+              << "  Next Header: "    << static_cast<int>(h.nextHeader()) << "\n";
+}
+
+void PacketPrinter::printIPHeader(const IPv4HeaderView& h) {
+    std::cout << "IPv4 Header:\n"
+              << "  Source IP: "      << inet_ntoa({htonl(h.srcIp())}) << "\n"
+              << "  Destination IP: " << inet_ntoa({htonl(h.dstIp())}) << "\n"
+              << "  TTL: "            << static_cast<int>(h.ttl())      << "\n"
+              << "  Protocol: "       << static_cast<int>(h.protocol()) << "\n";
+}
+
+void PacketPrinter::printVerdict(const ForwardingVerdict& verdict, const std::string& destination,
+                                 const char* ttl_name) {
+    if (verdict.forwarded()) {
+        // names are only resolved here, for the log and console output
+        const std::string& interface = adjacencies.interfaceName(verdict.interface_id);
+        log_info("Forwarding packet to interface %s for destination %s", interface.c_str(), destination.c_str());
+        std::cout << "Forwarding packet to interface " << interface;
+        if (verdict.flags & VERDICT_FRAGMENT) {
+            std::cout << " in fragments (MTU " << adjacencies.interfaceMtu(verdict.interface_id) << ")";
+        }
+        std::cout << "\n";
+    } else if (verdict.drop_reason == DropReason::TTL_EXPIRED) {
+        log_warning("Packet dropped: %s expired for destination %s", ttl_name, destination.c_str());
+        std::cout << "Packet dropped: " << ttl_name << " expired\n";
+    } else if (verdict.drop_reason == DropReason::MALFORMED) {
+        log_warning("Packet dropped: malformed header for destination %s", destination.c_str());
+        std::cout << "Packet dropped: malformed header\n";
+    } else if (verdict.drop_reason == DropReason::NO_ROUTE) {
+        log_warning("No route found for destination %s. Dropping packet", destination.c_str());
+        std::cout << "No route found. Dropping packet.\n";
+    } else {
+        const char* reason = dropReasonName(verdict.drop_reason);
+        log_warning("Packet dropped: %s for destination %s", reason, destination.c_str());
+        std::cout << "Packet dropped: " << reason << "\n";
+    }
+}
+
+void PacketPrinter::printTransportLayerHeader(PacketView packet, uint8_t protocol, size_t offset) {
+    if (packet.size() < offset) {
+        log_error("Packet too short for stated IP header length");
+        return;
+    }
+
+    log_debug("Parsing Layer 4 header for protocol %d", protocol);
+
+    switch (protocol) {
+        case PROTOCOL_TCP: {
+            TCPHeaderView tcp_header = TCP::parseHeader(packet, offset);
+            TCP::printHeader(tcp_header);
+            break;
+        }
+        case PROTOCOL_UDP: {
+            UDPHeaderView udp_header = UDP::parseHeader(packet, offset);
+            UDP::printHeader(udp_header);
+            break;
+        }
+        case PROTOCOL_ICMP: {
+            ICMPHeaderView icmp_header = ICMP::parseHeader(packet, offset);
+            ICMP::printHeader(icmp_header);
+            break;
+        }
+        case PROTOCOL_ICMPV6: {
+            ICMPHeaderView icmp_header = ICMP::parseHeader(packet, offset);
+            ICMP::printHeader6(icmp_header);
+            break;
+        }
+        default:
+            log_warning("Unknown or unsupported protocol: %d", protocol);
+            std::cout << "Unknown or unsupported transport layer protocol: " << (int)protocol << "\n";
+            break;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include "adjacency_table.hpp"
+#include "internet_protocol.hpp"
+#include "verdict_sink.hpp"
+
+/* human-readable consumer of verdict records: decodes each packet's headers again and
+   prints them with the forwarding decision, the way the simulation always has. all the
+   formatting (inet_ntoa, iostream, strings) happens here, after forwarding, so it costs
+   nothing when the pipeline runs headless */
+class PacketPrinter : public VerdictSink {
+public:
+    explicit PacketPrinter(const AdjacencyTable& adjacencies) : adjacencies(adjacencies) {}
+
+    void consume(const VerdictRecord* records, const PacketView* packets, size_t count) override;
+
+private:
+    const AdjacencyTable& adjacencies;
+
+    void printPacket(const VerdictRecord& record, PacketView packet);
+    void printIPHeader(const IPv4HeaderView& header);
+    void printIPv6Header(const IPv6HeaderView& header);
+    void printTransportLayerHeader(PacketView packet, uint8_t protocol, size_t offset);
+    void printVerdict(const ForwardingVerdict& verdict, const std::string& destination, const char* ttl_name);
+};
@@ -0,0 +1,93 @@
+#include "pcap_capture_sink.hpp"
+#include "logger.hpp"
+#include <cctype>
+#include <chrono>
+
+PcapCaptureSink::PcapCaptureSink(const AdjacencyTable& adjacencies, const std::string& directory)
+    : adjacencies(adjacencies), directory(directory) {}
+
+void PcapCaptureSink::consume(const VerdictRecord* records, const PacketView* packets, size_t count) {
+    uint64_t now_ns = 0;
+    if (!timestamps) {
+        now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    for (size_t i = 0; i < count; i++) {
+        const ForwardingVerdict& verdict = records[i].verdict;
+        PcapWriter* writer = writerFor(verdict);
+        if (verdict.forwarded() && (verdict.flags & VERDICT_FRAGMENT)) {
+            writeFragments(*writer, packets[i], adjacencies.interfaceMtu(verdict.interface_id),
+                           timestamps ? timestamps[i] : now_ns);
+            continue;
+        }
+        captured += writer->write(packets[i], timestamps ? timestamps[i] : now_ns);
+    }
+    if (timestamps) {
+        timestamps += count;
+    }
+}
+
+PcapWriter* PcapCaptureSink::writerFor(const ForwardingVerdict& verdict) {
+    if (!verdict.forwarded()) {
+        std::unique_ptr<PcapWriter>& writer = drop_writers[static_cast<size_t>(verdict.drop_reason)];
+        if (!writer) {
+            std::string name = std::string("drop-") + dropReasonName(verdict.drop_reason);
+            for (char& c : name) {
+                c = c == ' ' ? '-' : static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            writer = openWriter(name);
+        }
+        return writer.get();
+    }
+    if (verdict.interface_id >= interface_writers.size()) {
+        interface_writers.resize(verdict.interface_id + 1);
+    }
+    std::unique_ptr<PcapWriter>& writer = interface_writers[verdict.interface_id];
+    if (!writer) {
+        writer = openWriter(adjacencies.interfaceName(verdict.interface_id));
+    }
+    return writer.get();
+}
+
+/* every fragment goes into the buffer, its header and payload slice, then to the file.
+   a packet the fragmenter refuses is not written, AfPacketEgress does not send it either */
+void PcapCaptureSink::writeFragments(PcapWriter& writer, PacketView packet, uint32_t mtu, uint64_t timestamp_ns) {
+    if (!fragmenter.start(packet, mtu)) {
+        return;
+    }
+    fragment_buffer.resize(mtu);
+    IPv4Fragment fragment;
+    bool written = true;
+    while (fragmenter.next(fragment)) {
+        fragment.write(fragment_buffer.data());
+        written &= writer.write(PacketView(fragment_buffer.data(), fragment.size()), timestamp_ns);
+    }
+    captured += written;
+    fragmented_packets++;
+    fragments_written += fragmenter.fragmentCount();
+}
+
+std::unique_ptr<PcapWriter> PcapCaptureSink::openWriter(const std::string& name) {
+    std::string file_name = name;
+    for (char& c : file_name) {
+        c = c == '/' ? '_' : c;
+    }
+    // a writer that failed to open stays in place and refuses its packets
+    auto writer = std::make_unique<PcapWriter>();
+    if (writer->open(directory + "/" + file_name + ".pcap")) {
+        opened_files++;
+        log_info("Capturing %s packets to %s/%s.pcap", name.c_str(), directory.c_str(), file_name.c_str());
+    }
+    return writer;
+}
+
+bool PcapCaptureSink::flush() {
+    bool ok = true;
+    for (auto& writer : interface_writers) {
+        ok &= !writer || !writer->isOpen() || writer->flush();
+    }
+    for (auto& writer : drop_writers) {
+        ok &= !writer || !writer->isOpen() || writer->flush();
+    }
+    return ok;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "adjacency_table.hpp"
+#include "ip_fragmentation.hpp"
+#include "pcap_file.hpp"
+#include "verdict_sink.hpp"
+
+/* consumer of verdict records that writes every packet to a pcap file in a directory:
+   <interface>.pcap for the packets forwarded out of each interface, drop-<reason>.pcap
+   for each drop reason. a file is created with its first packet, and the writers batch
+   so capturing costs a copy into a buffer per packet. the packets are written as they
+   entered the pipeline, raw IP, except that VERDICT_FRAGMENT packets are written as the
+   fragments they leave in, cut for their interface's MTU like AfPacketEgress does */
+class PcapCaptureSink : public VerdictSink {
+public:
+    PcapCaptureSink(const AdjacencyTable& adjacencies, const std::string& directory);
+
+    /* capture timestamps for the packets the next consume calls see, in input order, so
+       replayed packets keep the ones they were recorded with. without them packets are
+       stamped with the time their burst was consumed */
+    void setTimestamps(const uint64_t* timestamps_ns) { timestamps = timestamps_ns; }
+    void consume(const VerdictRecord* records, const PacketView* packets, size_t count) override;
+    // writes out what the writers have buffered, false when a file failed
+    bool flush();
+
+    uint64_t packets() const { return captured; }
+    size_t files() const { return opened_files; }
+    // packets written as fragments and the fragments that made them up
+    uint64_t fragmented() const { return fragmented_packets; }
+    uint64_t fragments() const { return fragments_written; }
+
+private:
+    const AdjacencyTable& adjacencies;
+    std::string directory;
+    const uint64_t* timestamps = nullptr;
+    std::vector<std::unique_ptr<PcapWriter>> interface_writers;
+    std::unique_ptr<PcapWriter> drop_writers[DROP_REASON_COUNT];
+    uint64_t captured = 0;
+    size_t opened_files = 0;
+    uint64_t fragmented_packets = 0;
+    uint64_t fragments_written = 0;
+    IPv4Fragmenter fragmenter;
+    std::vector<uint8_t> fragment_buffer;
+
+    PcapWriter* writerFor(const ForwardingVerdict& verdict);
+    void writeFragments(PcapWriter& writer, PacketView packet, uint32_t mtu, uint64_t timestamp_ns);
+    std::unique_ptr<PcapWriter> openWriter(const std::string& name);
+};
@@ -0,0 +1,17 @@
+#include "verdict_sink.hpp"
+
+void VerdictCounter::consume(const VerdictRecord* records, const PacketView*, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const ForwardingVerdict& verdict = records[i].verdict;
+        if (verdict.forwarded()) {
+            if (verdict.interface_id >= per_interface.size()) {
+                per_interface.resize(verdict.interface_id + 1, 0);
+            }
+            per_interface[verdict.interface_id]++;
+            fragmented_packets += (verdict.flags & VERDICT_FRAGMENT) != 0;
+        } else {
+            drops[static_cast<size_t>(verdict.drop_reason)]++;
+        }
+    }
+    total += count;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "forwarding_verdict.hpp"
+#include "packet_view.hpp"
+
+/* the forwarding pipeline's output: one compact record per packet, the verdict (output
+   interface and next hop, or the drop reason) and the packet's position in the input.
+   nothing on the way to a record formats a string or touches an iostream, consumers
+   decide what to do with the records */
+struct VerdictRecord {
+    uint64_t sequence;
+    ForwardingVerdict verdict;
+};
+
+/* receives the records of every burst in input order together with the packets they
+   belong to. the packets are only valid during the call */
+class VerdictSink {
+public:
+    virtual ~VerdictSink() = default;
+    virtual void consume(const VerdictRecord* records, const PacketView* packets, size_t count) = 0;
+};
+
+// headless consumer: packets per output interface and drops per reason
+class VerdictCounter : public VerdictSink {
+public:
+    void consume(const VerdictRecord* records, const PacketView* packets, size_t count) override;
+
+    uint64_t packets() const { return total; }
+    uint64_t forwarded(uint16_t interface_id) const {
+        return interface_id < per_interface.size() ? per_interface[interface_id] : 0;
+    }
+    uint64_t dropped(DropReason reason) const { return drops[static_cast<size_t>(reason)]; }
+    // forwarded packets that leave in fragments (VERDICT_FRAGMENT), counted once each
+    uint64_t fragmented() const { return fragmented_packets; }
+    // interface ids that forwarded at least one packet are 0..interfaceSlots() - 1
+    size_t interfaceSlots() const { return per_interface.size(); }
+
+private:
+    uint64_t total = 0;
+    uint64_t fragmented_packets = 0;
+    std::vector<uint64_t> per_interface;
+    uint64_t drops[DROP_REASON_COUNT] = {};
+};
+
+// hands every burst to two sinks in turn, a capture next to the counters say
+class VerdictTee : public VerdictSink {
+public:
+    VerdictTee(VerdictSink& first, VerdictSink& second) : first(first), second(second) {}
+
+    void consume(const VerdictRecord* records, const PacketView* packets, size_t count) override {
+        first.consume(records, packets, count);
+        second.consume(records, packets, count);
+    }
+
+private:
+    VerdictSink& first;
+    VerdictSink& second;
+};
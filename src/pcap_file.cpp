@@ -0,0 +1,410 @@
+#include "pcap_file.hpp"
+#include "logger.hpp"
+#include "link_layer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+constexpr uint32_t PCAP_MAGIC_MICROSECONDS = 0xA1B2C3D4;
+constexpr uint32_t PCAP_MAGIC_NANOSECONDS = 0xA1B23C4D;
+constexpr size_t PCAP_FILE_HEADER_SIZE = 24;
+constexpr size_t PCAP_RECORD_HEADER_SIZE = 16;
+
+constexpr uint32_t PCAPNG_SECTION_HEADER = 0x0A0D0D0A;
+constexpr uint32_t PCAPNG_INTERFACE_DESCRIPTION = 1;
+constexpr uint32_t PCAPNG_SIMPLE_PACKET = 3;
+constexpr uint32_t PCAPNG_ENHANCED_PACKET = 6;
+constexpr uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+constexpr uint16_t PCAPNG_OPTION_TSRESOL = 9;
+constexpr uint16_t PCAPNG_OPTION_TSOFFSET = 14;
+
+constexpr uint64_t NS_PER_SECOND = 1000000000;
+
+static uint64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static size_t align4(size_t length) {
+    return (length + 3) & ~static_cast<size_t>(3);
+}
+
+// ---------------------------------------------------------------- reader
+
+bool PcapReader::open(const std::string& path) {
+    ng = false;
+    interfaces.clear();
+    if (!file.open(path)) {
+        return false;
+    }
+    file.adviseSequential();
+
+    uint32_t magic = 0;
+    if (file.size() >= sizeof(magic)) {
+        std::memcpy(&magic, file.data(), sizeof(magic));
+    }
+    if (magic == PCAPNG_SECTION_HEADER) {
+        // the byte order comes with each section header
+        ng = true;
+        start = 0;
+    } else {
+        bool nanoseconds = magic == PCAP_MAGIC_NANOSECONDS || magic == __builtin_bswap32(PCAP_MAGIC_NANOSECONDS);
+        swapped = magic == __builtin_bswap32(PCAP_MAGIC_MICROSECONDS) || magic == __builtin_bswap32(PCAP_MAGIC_NANOSECONDS);
+        if ((!nanoseconds && magic != PCAP_MAGIC_MICROSECONDS && !swapped) || file.size() < PCAP_FILE_HEADER_SIZE) {
+            log_error("%s is not a pcap or pcapng capture", path.c_str());
+            file.close();
+            return false;
+        }
+        interfaces.push_back({load32(20) & 0xFFFF, nanoseconds ? 1u : 1000u, 1, 0});
+        start = PCAP_FILE_HEADER_SIZE;
+    }
+    rewind();
+    log_info("Opened %s capture %s (%zu bytes)", ng ? "pcapng" : "pcap", path.c_str(), file.size());
+    return true;
+}
+
+void PcapReader::rewind() {
+    offset = start;
+    released = 0;
+    prefetched = 0;
+    read_stats = PcapReadStats();
+    if (ng) {
+        interfaces.clear();
+    }
+}
+
+uint16_t PcapReader::load16(size_t at) const {
+    uint16_t value;
+    std::memcpy(&value, file.data() + at, sizeof(value));
+    return swapped ? __builtin_bswap16(value) : value;
+}
+
+uint32_t PcapReader::load32(size_t at) const {
+    uint32_t value;
+    std::memcpy(&value, file.data() + at, sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+size_t PcapReader::read(PacketView* packets, uint64_t* timestamps_ns, size_t count) {
+    size_t done = 0;
+    while (done < count && next(packets[done], timestamps_ns[done])) {
+        done++;
+    }
+    return done;
+}
+
+bool PcapReader::next(PacketView& packet, uint64_t& timestamp_ns) {
+    if (!file.isOpen()) {
+        return false;
+    }
+    while (true) {
+        if (offset >= prefetched) {
+            file.prefetch(offset, PCAP_PREFETCH_CHUNK);
+            prefetched = offset + PCAP_PREFETCH_CHUNK;
+        }
+        PacketView frame;
+        const Interface* interface = nullptr;
+        bool has_packet = true;
+        if (ng ? !nextPcapngBlock(frame, timestamp_ns, interface, has_packet)
+               : !nextPcapRecord(frame, timestamp_ns, interface)) {
+            return false;
+        }
+        // what was read long ago is not coming back, keep the resident set to a window
+        if (offset - released >= 2 * PCAP_RELEASE_CHUNK) {
+            file.release(released, offset - PCAP_RELEASE_CHUNK - released);
+            released = offset - PCAP_RELEASE_CHUNK;
+        }
+        if (!has_packet) {
+            continue;
+        }
+        packet = interface ? networkLayer(frame, interface->link_type) : PacketView();
+        if (packet.empty()) {
+            read_stats.skipped++;
+            continue;
+        }
+        read_stats.packets++;
+        read_stats.bytes += packet.size();
+        return true;
+    }
+}
+
+bool PcapReader::nextPcapRecord(PacketView& frame, uint64_t& timestamp_ns, const Interface*& interface) {
+    if (offset + PCAP_RECORD_HEADER_SIZE > file.size()) {
+        return false;
+    }
+    uint32_t captured = load32(offset + 8);
+    if (offset + PCAP_RECORD_HEADER_SIZE + captured > file.size()) {
+        log_warning("Capture ends inside a packet at offset %zu", offset);
+        offset = file.size();
+        return false;
+    }
+    interface = &interfaces[0];
+    timestamp_ns = load32(offset) * NS_PER_SECOND + static_cast<uint64_t>(load32(offset + 4)) * interface->tick_multiplier;
+    read_stats.truncated += captured < load32(offset + 12);
+    frame = PacketView(file.data() + offset + PCAP_RECORD_HEADER_SIZE, captured);
+    offset += PCAP_RECORD_HEADER_SIZE + captured;
+    return true;
+}
+
+bool PcapReader::nextPcapngBlock(PacketView& frame, uint64_t& timestamp_ns, const Interface*& interface,
+                                 bool& has_packet) {
+    has_packet = false;
+    if (offset + 12 > file.size()) {
+        return false;
+    }
+    uint32_t type;
+    std::memcpy(&type, file.data() + offset, sizeof(type));     // the section header type reads the same either way
+    if (type == PCAPNG_SECTION_HEADER && !readSectionHeader(offset)) {
+        offset = file.size();
+        return false;
+    }
+    type = load32(offset);
+    size_t length = load32(offset + 4);
+    if (length < 12 || length % 4 != 0 || offset + length > file.size()) {
+        log_warning("Capture ends inside a block at offset %zu", offset);
+        offset = file.size();
+        return false;
+    }
+
+    size_t body = offset + 8;
+    size_t body_length = length - 12;
+    if (type == PCAPNG_INTERFACE_DESCRIPTION && body_length >= 8) {
+        readInterface(body, body_length);
+    } else if (type == PCAPNG_ENHANCED_PACKET && body_length >= 20) {
+        uint32_t interface_id = load32(body);
+        uint32_t captured = load32(body + 12);
+        if (20 + static_cast<size_t>(captured) <= body_length) {
+            has_packet = true;
+            interface = interface_id < interfaces.size() ? &interfaces[interface_id] : nullptr;
+            uint64_t ticks = (static_cast<uint64_t>(load32(body + 4)) << 32) | load32(body + 8);
+            timestamp_ns = interface ? static_cast<uint64_t>(static_cast<unsigned __int128>(ticks) *
+                                                             interface->tick_multiplier / interface->tick_divisor) +
+                                           interface->offset_ns : 0;
+            read_stats.truncated += captured < load32(body + 16);
+            frame = PacketView(file.data() + body + 20, captured);
+        }
+    } else if (type == PCAPNG_SIMPLE_PACKET && body_length >= 4) {
+        // no timestamp, and the packet is cut to what fits the block
+        has_packet = true;
+        interface = interfaces.empty() ? nullptr : &interfaces[0];
+        timestamp_ns = 0;
+        size_t captured = std::min<size_t>(load32(body), body_length - 4);
+        read_stats.truncated += captured < load32(body);
+        frame = PacketView(file.data() + body + 4, captured);
+    }
+    offset += length;
+    return true;
+}
+
+bool PcapReader::readSectionHeader(size_t at) {
+    uint32_t byte_order;
+    std::memcpy(&byte_order, file.data() + at + 8, sizeof(byte_order));
+    if (byte_order != PCAPNG_BYTE_ORDER_MAGIC && byte_order != __builtin_bswap32(PCAPNG_BYTE_ORDER_MAGIC)) {
+        log_warning("pcapng section at offset %zu has no byte order magic", at);
+        return false;
+    }
+    swapped = byte_order != PCAPNG_BYTE_ORDER_MAGIC;
+    // interface ids are per section
+    interfaces.clear();
+    return true;
+}
+
+void PcapReader::readInterface(size_t at, size_t block_length) {
+    // microseconds unless the options say otherwise
+    Interface interface = {load16(at), 1000, 1, 0};
+    size_t end = at + block_length;
+    size_t option = at + 8;
+    while (option + 4 <= end) {
+        uint16_t code = load16(option);
+        uint16_t length = load16(option + 2);
+        if (code == 0 || option + 4 + length > end) {
+            break;
+        }
+        if (code == PCAPNG_OPTION_TSRESOL && length >= 1) {
+            uint8_t resolution = file.data()[option + 4];
+            uint8_t exponent = resolution & 0x7F;
+            if (resolution & 0x80) {
+                // 2^-exponent seconds per tick
+                interface.tick_multiplier = NS_PER_SECOND;
+                interface.tick_divisor = exponent < 64 ? 1ull << exponent : 1;
+            } else if (exponent <= 9) {
+                interface.tick_multiplier = 1;
+                for (uint8_t i = exponent; i < 9; i++) {
+                    interface.tick_multiplier *= 10;
+                }
+            } else {
+                interface.tick_multiplier = 1;
+                for (uint8_t i = 9; i < exponent && i < 28; i++) {
+                    interface.tick_divisor *= 10;
+                }
+            }
+        } else if (code == PCAPNG_OPTION_TSOFFSET && length >= 8) {
+            uint64_t seconds;
+            std::memcpy(&seconds, file.data() + option + 4, sizeof(seconds));
+            interface.offset_ns = (swapped ? __builtin_bswap64(seconds) : seconds) * NS_PER_SECOND;
+        }
+        option += 4 + align4(length);
+    }
+    interfaces.push_back(interface);
+}
+
+PacketView PcapReader::networkLayer(PacketView frame, uint32_t link_type) {
+    uint16_t ethertype = 0;
+    switch (link_type) {
+        case PCAP_LINKTYPE_ETHERNET:
+            frame = ethernetPayload(frame, ethertype);
+            break;
+        case PCAP_LINKTYPE_LINUX_SLL:
+            ethertype = frame.u16(14);
+            frame = frame.from(16);
+            break;
+        case PCAP_LINKTYPE_LINUX_SLL2:
+            ethertype = frame.u16(0);
+            frame = frame.from(20);
+            break;
+        case PCAP_LINKTYPE_RAW:
+        case PCAP_LINKTYPE_IPV4:
+        case PCAP_LINKTYPE_IPV6:
+            ethertype = (frame.u8(0) >> 4) == 6 ? ETHERTYPE_IPV6 : ETHERTYPE_IPV4;
+            break;
+        default:
+            return PacketView();
+    }
+    return ipPacket(frame, ethertype);
+}
+
+// ---------------------------------------------------------------- writer
+
+bool PcapWriter::open(const std::string& path, uint32_t link_type, uint32_t snap_length, size_t buffer_size) {
+    close();
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        log_error("Failed to create capture %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    file_path = path;
+    failed = false;
+    snap = snap_length;
+    buffer.resize(std::max(buffer_size, PCAP_FILE_HEADER_SIZE + PCAP_RECORD_HEADER_SIZE));
+    written_packets = written_bytes = 0;
+
+    uint32_t magic = PCAP_MAGIC_NANOSECONDS;
+    uint16_t version[2] = {2, 4};
+    uint32_t rest[4] = {0, 0, snap_length, link_type};     // zone, sigfigs, snap length, link type
+    std::memcpy(buffer.data(), &magic, sizeof(magic));
+    std::memcpy(buffer.data() + 4, version, sizeof(version));
+    std::memcpy(buffer.data() + 8, rest, sizeof(rest));
+    used = PCAP_FILE_HEADER_SIZE;
+    return true;
+}
+
+bool PcapWriter::write(PacketView packet, uint64_t timestamp_ns) {
+    if (fd < 0 || failed) {
+        return false;
+    }
+    size_t captured = std::min<size_t>(packet.size(), snap);
+    if (used + PCAP_RECORD_HEADER_SIZE + captured > buffer.size() && !flush()) {
+        return false;
+    }
+    uint32_t record[4] = {static_cast<uint32_t>(timestamp_ns / NS_PER_SECOND),
+                          static_cast<uint32_t>(timestamp_ns % NS_PER_SECOND),
+                          static_cast<uint32_t>(captured), static_cast<uint32_t>(packet.size())};
+    std::memcpy(buffer.data() + used, record, sizeof(record));
+    used += sizeof(record);
+    if (used + captured <= buffer.size()) {
+        std::memcpy(buffer.data() + used, packet.data(), captured);
+        used += captured;
+    } else if (!flush() || !writeAll(packet.data(), captured)) {
+        // a packet larger than the whole buffer goes straight to the file behind its header
+        return false;
+    }
+    written_packets++;
+    written_bytes += captured;
+    return true;
+}
+
+bool PcapWriter::flush() {
+    if (fd < 0 || failed) {
+        return false;
+    }
+    bool ok = writeAll(buffer.data(), used);
+    used = 0;
+    return ok;
+}
+
+bool PcapWriter::writeAll(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        ssize_t done = ::write(fd, data, length);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("Failed to write capture %s: %s", file_path.c_str(), std::strerror(errno));
+            failed = true;
+            return false;
+        }
+        data += done;
+        length -= static_cast<size_t>(done);
+    }
+    return true;
+}
+
+void PcapWriter::close() {
+    if (fd >= 0) {
+        flush();
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+// ---------------------------------------------------------------- pacing
+
+ReplayPacer::ReplayPacer(ReplayTiming timing, double value) : timing(timing) {
+    if (value <= 0) {
+        this->timing = ReplayTiming::AS_FAST_AS_POSSIBLE;
+    } else if (timing == ReplayTiming::RECORDED) {
+        speed = value;
+    } else if (timing == ReplayTiming::FIXED_RATE) {
+        interval_ns = NS_PER_SECOND / value;
+    }
+}
+
+uint64_t ReplayPacer::dueNs(uint64_t timestamp_ns, uint64_t index) const {
+    if (timing == ReplayTiming::RECORDED) {
+        // out-of-order timestamps before the first packet count as due at the start
+        return timestamp_ns > first_timestamp_ns ? static_cast<uint64_t>((timestamp_ns - first_timestamp_ns) / speed) : 0;
+    }
+    return static_cast<uint64_t>(index * interval_ns);
+}
+
+size_t ReplayPacer::release(const uint64_t* timestamps_ns, size_t count) {
+    if (timing == ReplayTiming::AS_FAST_AS_POSSIBLE || count == 0) {
+        return count;
+    }
+    uint64_t now = steadyNowNs();
+    if (!started) {
+        started = true;
+        start_ns = now;
+        first_timestamp_ns = timestamps_ns[0];
+        released_packets = 0;
+    }
+
+    // sleep through long gaps, spin through the last stretch where the scheduler is too coarse
+    uint64_t due = start_ns + dueNs(timestamps_ns[0], released_packets);
+    while (now < due) {
+        if (due - now > 200000) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - 100000));
+        }
+        now = steadyNowNs();
+    }
+    size_t ready = 1;
+    while (ready < count && start_ns + dueNs(timestamps_ns[ready], released_packets + ready) <= now) {
+        ready++;
+    }
+    released_packets += ready;
+    return ready;
+}
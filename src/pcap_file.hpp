@@ -0,0 +1,144 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mapped_file.hpp"
+#include "packet_view.hpp"
+
+/* packet captures in and out of the simulator.
+   PcapReader maps a pcap or pcapng file and hands out views of the IP packets inside it,
+   nothing is copied or read through a buffer. PcapWriter appends packets to a classic
+   pcap file through a large buffer, so the file sees a handful of big writes instead of
+   two small ones per packet. ReplayPacer releases packets at their recorded timing, at
+   a fixed rate or as fast as the pipeline takes them */
+
+constexpr uint32_t PCAP_LINKTYPE_ETHERNET = 1;
+constexpr uint32_t PCAP_LINKTYPE_RAW = 101;          // IPv4 or IPv6, told apart by the version
+constexpr uint32_t PCAP_LINKTYPE_LINUX_SLL = 113;
+constexpr uint32_t PCAP_LINKTYPE_IPV4 = 228;
+constexpr uint32_t PCAP_LINKTYPE_IPV6 = 229;
+constexpr uint32_t PCAP_LINKTYPE_LINUX_SLL2 = 276;
+
+// how much of the mapping a reader keeps resident behind its position
+constexpr size_t PCAP_RELEASE_CHUNK = 64 << 20;
+// how far ahead of its position a reader maps the file in
+constexpr size_t PCAP_PREFETCH_CHUNK = 4 << 20;
+constexpr size_t PCAP_WRITE_BUFFER = 1 << 20;
+constexpr uint32_t PCAP_SNAP_LENGTH = 262144;
+
+struct PcapReadStats {
+    uint64_t packets = 0;           // IP packets handed out
+    uint64_t bytes = 0;             // their IP bytes
+    uint64_t skipped = 0;           // frames without an IPv4 or IPv6 packet (ARP and such) or on unknown link types
+    uint64_t truncated = 0;         // packets captured shorter than they were on the wire
+};
+
+/* pcap (microsecond or nanosecond, either byte order) and pcapng (section, interface
+   description, enhanced and simple packet blocks, any byte order or timestamp
+   resolution). link layers: Ethernet with 802.1Q/802.1ad tags, raw IP and Linux cooked
+   captures v1 and v2. the link-layer header is skipped and a view ends where its IP
+   packet does, Ethernet pads short frames. views point into the mapping and stay valid
+   until the reader is closed */
+class PcapReader {
+public:
+    bool open(const std::string& path);
+    void close() { file.close(); }
+
+    // up to count packets with their capture timestamps (ns since the epoch), 0 at the end
+    size_t read(PacketView* packets, uint64_t* timestamps_ns, size_t count);
+    bool next(PacketView& packet, uint64_t& timestamp_ns);
+    // back to the first packet, the stats start over
+    void rewind();
+
+    bool pcapng() const { return ng; }
+    size_t fileSize() const { return file.size(); }
+    const PcapReadStats& stats() const { return read_stats; }
+
+private:
+    // a pcapng interface, or the pcap file's one link
+    struct Interface {
+        uint32_t link_type;
+        uint64_t tick_multiplier;   // ns = ticks * tick_multiplier / tick_divisor + offset_ns
+        uint64_t tick_divisor;
+        uint64_t offset_ns;
+    };
+
+    MappedFile file;
+    bool ng = false;
+    bool swapped = false;           // the current file or section is in the other byte order
+    size_t start = 0;               // first record (pcap) or block (pcapng)
+    size_t offset = 0;
+    size_t released = 0;            // the mapping below this was handed back
+    size_t prefetched = 0;          // and up to this it is mapped in
+    std::vector<Interface> interfaces;
+    PcapReadStats read_stats;
+
+    uint16_t load16(size_t at) const;
+    uint32_t load32(size_t at) const;
+    // one record or block, true with frame set when it held a packet, false at the end
+    bool nextPcapRecord(PacketView& frame, uint64_t& timestamp_ns, const Interface*& interface);
+    bool nextPcapngBlock(PacketView& frame, uint64_t& timestamp_ns, const Interface*& interface, bool& has_packet);
+    bool readSectionHeader(size_t at);
+    void readInterface(size_t at, size_t block_length);
+    static PacketView networkLayer(PacketView frame, uint32_t link_type);
+};
+
+/* classic pcap output, nanosecond timestamps in this machine's byte order. packets are
+   gathered in the buffer and go to the file when it fills, on flush() and on close() */
+class PcapWriter {
+public:
+    PcapWriter() = default;
+    ~PcapWriter() { close(); }
+    PcapWriter(const PcapWriter&) = delete;
+    PcapWriter& operator=(const PcapWriter&) = delete;
+
+    bool open(const std::string& path, uint32_t link_type = PCAP_LINKTYPE_RAW,
+              uint32_t snap_length = PCAP_SNAP_LENGTH, size_t buffer_size = PCAP_WRITE_BUFFER);
+    // false once the file could not be written, the packet and the ones after it are lost
+    bool write(PacketView packet, uint64_t timestamp_ns);
+    bool flush();
+    void close();
+
+    bool isOpen() const { return fd >= 0; }
+    uint64_t packets() const { return written_packets; }
+    uint64_t bytes() const { return written_bytes; }
+
+private:
+    int fd = -1;
+    bool failed = false;
+    uint32_t snap = PCAP_SNAP_LENGTH;
+    std::vector<uint8_t> buffer;
+    size_t used = 0;
+    uint64_t written_packets = 0;
+    uint64_t written_bytes = 0;
+    std::string file_path;
+
+    bool writeAll(const uint8_t* data, size_t length);
+};
+
+enum class ReplayTiming { AS_FAST_AS_POSSIBLE, RECORDED, FIXED_RATE };
+
+/* decides when replayed packets may enter the pipeline. RECORDED keeps the gaps between
+   the capture timestamps, divided by speed, FIXED_RATE spaces the packets 1/rate
+   seconds apart. a packet that is late goes at once, the pacer does not try to catch up
+   by bunching the ones behind it any more than they already are */
+class ReplayPacer {
+public:
+    explicit ReplayPacer(ReplayTiming timing = ReplayTiming::AS_FAST_AS_POSSIBLE, double value = 1.0);
+
+    /* waits until the first of the packets is due and returns how many of them are due
+       by then, at least one when count > 0. the rest are for the next call */
+    size_t release(const uint64_t* timestamps_ns, size_t count);
+    void restart() { started = false; }
+
+private:
+    ReplayTiming timing;
+    double speed = 1.0;             // RECORDED
+    double interval_ns = 0;         // FIXED_RATE
+    bool started = false;
+    uint64_t start_ns = 0;
+    uint64_t first_timestamp_ns = 0;
+    uint64_t released_packets = 0;
+
+    uint64_t dueNs(uint64_t timestamp_ns, uint64_t index) const;
+};
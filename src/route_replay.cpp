@@ -0,0 +1,99 @@
+#include "route_replay.hpp"
+#include "logger.hpp"
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+bool RouteReplay::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        log_error("Failed to open route update file: %s", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    size_t line_number = 0;
+    size_t skipped = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        RouteUpdate update;
+        if (parseLine(line, update)) {
+            updates.push_back(update);
+        } else {
+            log_warning("Skipping malformed route update at %s:%zu", path.c_str(), line_number);
+            skipped++;
+        }
+    }
+
+    log_info("Loaded %zu route updates from %s (%zu skipped)", updates.size(), path.c_str(), skipped);
+    return true;
+}
+
+bool RouteReplay::parseLine(const std::string& line, RouteUpdate& update) const {
+    std::istringstream tokens(line);
+    std::string kind, prefix;
+    if (!(tokens >> kind >> prefix)) {
+        return false;
+    }
+
+    if (kind == "A" || kind == "announce") {
+        update.announce = true;
+    } else if (kind == "W" || kind == "withdraw") {
+        update.announce = false;
+    } else {
+        return false;
+    }
+
+    try {
+        auto [network, mask] = RoutingTable::parseCIDR(prefix);
+        update.network = network;
+        update.prefix_len = static_cast<uint8_t>(__builtin_popcount(mask));
+        update.next_hop = 0;
+        update.metric = 1;
+
+        if (update.announce) {
+            std::string next_hop;
+            if (!(tokens >> update.interface)) {
+                return false;
+            }
+            if (tokens >> next_hop) {
+                update.next_hop = RoutingTable::stringToIP(next_hop);
+                tokens >> update.metric;
+            }
+        }
+    } catch (const std::exception& e) {
+        return false;
+    }
+    return true;
+}
+
+ReplayStats RouteReplay::run(RoutingTable& table) const {
+    ReplayStats stats;
+    auto start = std::chrono::steady_clock::now();
+
+    for (const auto& update : updates) {
+        if (update.announce) {
+            table.replaceRoute(update.network, update.prefix_len, update.interface,
+                               update.next_hop, update.metric);
+            stats.announces++;
+        } else {
+            if (!table.removeRoute(update.network, update.prefix_len)) {
+                stats.unknown_withdraws++;
+            }
+            stats.withdraws++;
+        }
+    }
+
+    stats.elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
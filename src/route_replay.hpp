@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "routing_table.hpp"
+
+/* BGP-style route churn replay.
+   the event file has one update per line, '#' starts a comment:
+     A <prefix/len> <interface> [next_hop] [metric]    announce (replaces the prefix's route)
+     W <prefix/len>                                    withdraw
+   "announce"/"withdraw" are accepted instead of A/W. the whole file is parsed up
+   front so the timed run measures only the routing table updates */
+
+struct RouteUpdate {
+    bool announce;
+    uint8_t prefix_len;
+    uint32_t network;
+    uint32_t next_hop;
+    int metric;
+    std::string interface;
+};
+
+struct ReplayStats {
+    size_t announces = 0;
+    size_t withdraws = 0;
+    size_t unknown_withdraws = 0;   // withdraws for prefixes that were not installed
+    uint64_t elapsed_ns = 0;
+
+    double updatesPerSecond() const {
+        return elapsed_ns ? (announces + withdraws) * 1e9 / elapsed_ns : 0.0;
+    }
+};
+
+class RouteReplay {
+public:
+    bool load(const std::string& path);
+    void add(const RouteUpdate& update) { updates.push_back(update); }
+    ReplayStats run(RoutingTable& table) const;
+
+    size_t size() const { return updates.size(); }
+    const std::vector<RouteUpdate>& events() const { return updates; }
+
+private:
+    std::vector<RouteUpdate> updates;
+
+    bool parseLine(const std::string& line, RouteUpdate& update) const;
+};
@@ -1,39 +1,396 @@
 #include "routing_table.hpp"
+#include "logger.hpp"
+#include "mapped_file.hpp"
 #include <arpa/inet.h>
+#include <cstring>
+#include <cstdlib>
 #include <algorithm>
 #include <iomanip>
 
+static bool parseDecimal(const char*& p, const char* end, uint32_t max_value, uint32_t& value) {
+    const char* start = p;
+    uint64_t result = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        result = result * 10 + (*p - '0');
+        if (result > max_value) {
+            return false;
+        }
+        p++;
+    }
+    value = static_cast<uint32_t>(result);
+    return p != start;
+}
+
+// dotted quad in HOST byte order, without going through inet_aton and a std::string
+static bool parseIPv4(const char*& p, const char* end, uint32_t& ip) {
+    ip = 0;
+    for (int i = 0; i < 4; i++) {
+        uint32_t octet;
+        if (!parseDecimal(p, end, 255, octet)) {
+            return false;
+        }
+        ip = (ip << 8) | octet;
+        if (i < 3) {
+            if (p >= end || *p != '.') {
+                return false;
+            }
+            p++;
+        }
+    }
+    return true;
+}
+
+static const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+struct ParsedRoute {
+    uint32_t network;
+    uint32_t next_hop;
+    int metric;
+    uint8_t prefix_len;
+    const char* interface;      // points into the mapped file
+    uint32_t interface_length;
+};
+
+// returns 1 for a route, 0 for a blank or comment line, -1 for a malformed line
+static int parseRouteLine(const char* p, const char* end, ParsedRoute& route) {
+    p = skipSpaces(p, end);
+    if (p == end || *p == '#') {
+        return 0;
+    }
+
+    uint32_t network, len = 32;
+    if (!parseIPv4(p, end, network)) {
+        return -1;
+    }
+    if (p < end && *p == '/') {
+        p++;
+        if (!parseDecimal(p, end, 32, len)) {
+            return -1;
+        }
+    }
+
+    p = skipSpaces(p, end);
+    const char* name = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r') {
+        p++;
+    }
+    if (p == name) {
+        return -1;
+    }
+
+    route.prefix_len = static_cast<uint8_t>(len);
+    route.network = network & LpmTable::prefixMask(route.prefix_len);
+    route.interface = name;
+    route.interface_length = static_cast<uint32_t>(p - name);
+    route.next_hop = 0;
+    route.metric = 1;
+
+    p = skipSpaces(p, end);
+    if (p < end && *p != '#') {
+        if (!parseIPv4(p, end, route.next_hop)) {
+            return -1;
+        }
+        p = skipSpaces(p, end);
+        uint32_t metric;
+        if (p < end && *p != '#') {
+            if (!parseDecimal(p, end, INT32_MAX, metric)) {
+                return -1;
+            }
+            route.metric = static_cast<int>(metric);
+        }
+    }
+    return 1;
+}
+
+// adjacencies of the lowest metric routes, several of them form an ECMP group
+template <typename Route>
+AdjacencyHandle RoutingTable::installedHandle(const std::vector<Route>& candidates) {
+    int32_t best_metric = candidates.front().metric;
+    for (const Route& route : candidates) {
+        best_metric = std::min(best_metric, route.metric);
+    }
+
+    std::vector<AdjacencyHandle> paths;
+    for (const Route& route : candidates) {
+        if (route.metric == best_metric) {
+            paths.push_back(route.adjacency);
+        }
+    }
+    return (paths.size() == 1) ? paths.front() : adjacency_table.internGroup(std::move(paths));
+}
+
+RoutingTable::RoutingTable() : fib(&rcu_domain), fib6(&rcu_domain) {}
+
+RoutingTable::~RoutingTable() {
+    // pending reclaimers point back into the FIB, run them while it is still alive
+    std::lock_guard<std::mutex> lock(update_mutex);
+    rcu_domain.synchronize();
+}
+
 void RoutingTable::addRoute(const std::string& network_cidr, const std::string& interface,
                             const std::string& next_hop, int metric) {
     auto [network, mask] = parseCIDR(network_cidr);
+    uint8_t prefix_len = static_cast<uint8_t>(__builtin_popcount(mask));
+
+    addRoute(network, prefix_len, interface, next_hop.empty() ? 0 : stringToIP(next_hop), metric);
+}
 
+void RoutingTable::addRoute(uint32_t network, uint8_t prefix_len, const std::string& interface,
+                            uint32_t next_hop, int metric) {
+    if (prefix_len > 32) {
+        log_error("Invalid prefix length /%u for interface %s", prefix_len, interface.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(update_mutex);
+
+    ensureRib();
     RouteEntry route;
-    route.network = network;
-    route.subnet_mask = mask;
-    route.interface = interface;
-    route.next_hop = next_hop.empty() ? 0 : stringToIP(next_hop);
-    route.metric = metric;
+    if (!makeRoute(network, prefix_len, adjacency_table.internInterface(interface), next_hop, metric, route)) {
+        return;
+    }
 
-    routes.push_back(route);
+    insertCandidate(route, prefix_len);
+    fib_generation.fetch_add(1, std::memory_order_release);
+}
+
+// duplicate prefixes install their lowest metric routes, equal-cost ones share the traffic
+void RoutingTable::insertCandidate(const RouteEntry& route, uint8_t prefix_len) {
+    std::vector<RouteEntry>& candidates = prefix_routes[prefixKey(route.network, prefix_len)];
+    AdjacencyHandle previous_best = candidates.empty() ? NO_ADJACENCY : installedHandle(candidates);
+    candidates.push_back(route);
+    route_count++;
 
-    /* sort by subnet mask (longest prefix first) for proper longest prefix matching.
-       most specific routes come first */
-    std::sort(routes.begin(), routes.end(),
-              [](const RouteEntry& a, const RouteEntry& b) {
-                  return a.subnet_mask > b.subnet_mask;
-              });
+    AdjacencyHandle best = installedHandle(candidates);
+    if (best != previous_best) {
+        fib.add(route.network, prefix_len, best);
+    }
 }
 
-std::string RoutingTable::lookupRoute(const uint32_t& dst_ip) {
-    for (const auto& route : routes) {
-        if ((dst_ip & route.subnet_mask) == route.network) {
-            return route.interface;
+size_t RoutingTable::loadRoutes(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return 0;
+    }
+    file.adviseSequential();
+
+    const char* p = reinterpret_cast<const char*>(file.data());
+    const char* end = p + file.size();
+    std::vector<ParsedRoute> parsed;
+    parsed.reserve(file.size() / 24);
+    size_t line_number = 0;
+
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!line_end) {
+            line_end = end;
+        }
+        line_number++;
+
+        ParsedRoute route;
+        int result = parseRouteLine(p, line_end, route);
+        if (result > 0) {
+            parsed.push_back(route);
+        } else if (result < 0) {
+            log_warning("Skipping malformed route at %s:%zu", path.c_str(), line_number);
+        }
+        p = line_end + 1;
+    }
+
+    std::lock_guard<std::mutex> lock(update_mutex);
+    ensureRib();
+    prefix_routes.reserve(prefix_routes.size() + parsed.size());
+
+    // route files use a handful of interfaces, only look a name up when it changes
+    std::string interface;
+    uint32_t interface_id = MAX_INTERFACES;
+    size_t loaded = 0;
+    for (const ParsedRoute& parsed_route : parsed) {
+        if (interface_id == MAX_INTERFACES ||
+            interface.compare(0, std::string::npos, parsed_route.interface, parsed_route.interface_length) != 0) {
+            interface.assign(parsed_route.interface, parsed_route.interface_length);
+            interface_id = adjacency_table.internInterface(interface);
+        }
+
+        RouteEntry route;
+        if (!makeRoute(parsed_route.network, parsed_route.prefix_len, interface_id,
+                       parsed_route.next_hop, parsed_route.metric, route)) {
+            break;
         }
+        insertCandidate(route, parsed_route.prefix_len);
+        loaded++;
+    }
+    fib_generation.fetch_add(1, std::memory_order_release);
+
+    log_info("Loaded %zu routes from %s", loaded, path.c_str());
+    return loaded;
+}
+
+void RoutingTable::replaceRoute(const std::string& network_cidr, const std::string& interface,
+                                const std::string& next_hop, int metric) {
+    auto [network, mask] = parseCIDR(network_cidr);
+    uint8_t prefix_len = static_cast<uint8_t>(__builtin_popcount(mask));
+
+    replaceRoute(network, prefix_len, interface, next_hop.empty() ? 0 : stringToIP(next_hop), metric);
+}
+
+void RoutingTable::replaceRoute(uint32_t network, uint8_t prefix_len, const std::string& interface,
+                                uint32_t next_hop, int metric) {
+    if (prefix_len > 32) {
+        log_error("Invalid prefix length /%u for interface %s", prefix_len, interface.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(update_mutex);
+    ensureRib();
+
+    RouteEntry route;
+    if (!makeRoute(network, prefix_len, adjacency_table.internInterface(interface), next_hop, metric, route)) {
+        return;
+    }
+
+    std::vector<RouteEntry>& candidates = prefix_routes[prefixKey(route.network, prefix_len)];
+    route_count = route_count + 1 - candidates.size();
+    candidates.assign(1, route);
+
+    // same prefix length, so the new route simply overwrites the old one's entries
+    fib.add(route.network, prefix_len, route.adjacency);
+    fib_generation.fetch_add(1, std::memory_order_release);
+}
+
+bool RoutingTable::removeRoute(const std::string& network_cidr) {
+    auto [network, mask] = parseCIDR(network_cidr);
+    return removeRoute(network, static_cast<uint8_t>(__builtin_popcount(mask)));
+}
+
+bool RoutingTable::removeRoute(uint32_t network, uint8_t prefix_len) {
+    if (prefix_len > 32) {
+        return false;
+    }
+    network &= LpmTable::prefixMask(prefix_len);
+
+    std::lock_guard<std::mutex> lock(update_mutex);
+    ensureRib();
+
+    auto it = prefix_routes.find(prefixKey(network, prefix_len));
+    if (it == prefix_routes.end()) {
+        return false;
+    }
+    route_count -= it->second.size();
+    prefix_routes.erase(it);
+
+    auto [cover_len, cover_adjacency] = coveringRoute(network, prefix_len);
+    fib.remove(network, prefix_len, cover_len, cover_adjacency);
+    fib_generation.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+void RoutingTable::addRoute6(const std::string& network_cidr, const std::string& interface,
+                             const std::string& next_hop, int metric) {
+    IPv6Address network, gateway = {};
+    uint8_t prefix_len;
+    if (!parseCIDR6(network_cidr, network, prefix_len) ||
+        (!next_hop.empty() && !IPv6Address::parse(next_hop, gateway))) {
+        log_error("Invalid IPv6 route %s via %s", network_cidr.c_str(), next_hop.c_str());
+        return;
+    }
+    addRoute6(network, prefix_len, interface, gateway, metric);
+}
+
+void RoutingTable::addRoute6(const IPv6Address& network, uint8_t prefix_len, const std::string& interface,
+                             const IPv6Address& next_hop, int metric) {
+    std::lock_guard<std::mutex> lock(update_mutex);
+    RouteEntry6 route;
+    if (!makeRoute6(network, prefix_len, interface, next_hop, metric, route)) {
+        return;
+    }
+
+    std::vector<RouteEntry6>& candidates = prefix6_routes[prefix6Key(route.network, prefix_len)];
+    AdjacencyHandle previous_best = candidates.empty() ? NO_ADJACENCY : installedHandle(candidates);
+    candidates.push_back(route);
+    route6_count++;
+
+    AdjacencyHandle best = installedHandle(candidates);
+    if (best != previous_best) {
+        fib6.add(route.network, prefix_len, best);
+    }
+    fib_generation.fetch_add(1, std::memory_order_release);
+}
+
+void RoutingTable::replaceRoute6(const std::string& network_cidr, const std::string& interface,
+                                 const std::string& next_hop, int metric) {
+    IPv6Address network, gateway = {};
+    uint8_t prefix_len;
+    if (!parseCIDR6(network_cidr, network, prefix_len) ||
+        (!next_hop.empty() && !IPv6Address::parse(next_hop, gateway))) {
+        log_error("Invalid IPv6 route %s via %s", network_cidr.c_str(), next_hop.c_str());
+        return;
     }
-    return "";
+    replaceRoute6(network, prefix_len, interface, gateway, metric);
+}
+
+void RoutingTable::replaceRoute6(const IPv6Address& network, uint8_t prefix_len, const std::string& interface,
+                                 const IPv6Address& next_hop, int metric) {
+    std::lock_guard<std::mutex> lock(update_mutex);
+    RouteEntry6 route;
+    if (!makeRoute6(network, prefix_len, interface, next_hop, metric, route)) {
+        return;
+    }
+
+    std::vector<RouteEntry6>& candidates = prefix6_routes[prefix6Key(route.network, prefix_len)];
+    route6_count = route6_count + 1 - candidates.size();
+    candidates.assign(1, route);
+
+    fib6.add(route.network, prefix_len, route.adjacency);
+    fib_generation.fetch_add(1, std::memory_order_release);
+}
+
+bool RoutingTable::removeRoute6(const std::string& network_cidr) {
+    IPv6Address network;
+    uint8_t prefix_len;
+    return parseCIDR6(network_cidr, network, prefix_len) && removeRoute6(network, prefix_len);
+}
+
+bool RoutingTable::removeRoute6(const IPv6Address& address, uint8_t prefix_len) {
+    if (prefix_len > 128) {
+        return false;
+    }
+    IPv6Address network = address.masked(prefix_len);
+
+    std::lock_guard<std::mutex> lock(update_mutex);
+    auto it = prefix6_routes.find(prefix6Key(network, prefix_len));
+    if (it == prefix6_routes.end()) {
+        return false;
+    }
+    route6_count -= it->second.size();
+    prefix6_routes.erase(it);
+
+    auto [cover_len, cover_adjacency] = coveringRoute6(network, prefix_len);
+    fib6.remove(network, prefix_len, cover_len, cover_adjacency);
+    fib_generation.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool RoutingTable::setInterfaceMtu(const std::string& interface, uint32_t mtu) {
+    std::lock_guard<std::mutex> lock(update_mutex);
+    uint32_t interface_id = adjacency_table.internInterface(interface);
+    return interface_id != MAX_INTERFACES && adjacency_table.setInterfaceMtu(interface_id, mtu);
+}
+
+void RoutingTable::reclaim() {
+    std::lock_guard<std::mutex> lock(update_mutex);
+    rcu_domain.reclaim();
 }
 
 void RoutingTable::printTable() {
+    std::lock_guard<std::mutex> lock(update_mutex);
+    ensureRib();
+
     std::cout << "\nRouting Table:\n";
     std::cout << std::left << std::setw(18) << "Network"
               << std::setw(16) << "Mask"
@@ -42,15 +399,142 @@ void RoutingTable::printTable() {
               << "Metric\n";
     std::cout << std::string(70, '-') << "\n";
 
-    for (const auto& route : routes) {
+    /* most specific routes first, same order the lookup resolves them in */
+    std::vector<RouteEntry> sorted;
+    sorted.reserve(route_count);
+    for (const auto& [key, candidates] : prefix_routes) {
+        sorted.insert(sorted.end(), candidates.begin(), candidates.end());
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const RouteEntry& a, const RouteEntry& b) {
+                         if (a.subnet_mask != b.subnet_mask) {
+                             return a.subnet_mask > b.subnet_mask;
+                         }
+                         return a.network < b.network;
+                     });
+
+    for (const RouteEntry& route : sorted) {
+        const Adjacency& adjacency = adjacency_table.get(route.adjacency);
         std::cout << std::left 
                   << std::setw(18) << ipToString(route.network)
                   << std::setw(16) << ipToString(route.subnet_mask)
-                  << std::setw(10) << route.interface
-                  << std::setw(16) << (route.next_hop ? ipToString(route.next_hop) : "Direct")
+                  << std::setw(10) << adjacency_table.interfaceName(adjacency.interface_id)
+                  << std::setw(16) << (adjacency.next_hop ? ipToString(adjacency.next_hop) : "Direct")
                   << route.metric << "\n";
     }
     std::cout << "\n";
+    printTable6();
+}
+
+// IPv6 routes in address order, covering prefixes before the ones they contain
+void RoutingTable::printTable6() {
+    if (route6_count == 0) {
+        return;
+    }
+    std::cout << "IPv6 Routing Table:\n";
+    std::cout << std::left << std::setw(30) << "Network"
+              << std::setw(10) << "Interface"
+              << std::setw(26) << "Next Hop"
+              << "Metric\n";
+    std::cout << std::string(72, '-') << "\n";
+
+    for (const auto& [key, candidates] : prefix6_routes) {
+        for (const RouteEntry6& route : candidates) {
+            const Adjacency6& adjacency = adjacency_table.get6(route.adjacency);
+            std::cout << std::left
+                      << std::setw(30) << (route.network.toString() + "/" + std::to_string(route.prefix_len))
+                      << std::setw(10) << adjacency_table.interfaceName(adjacency.interface_id)
+                      << std::setw(26) << (adjacency.next_hop.isZero() ? "Direct" : adjacency.next_hop.toString())
+                      << route.metric << "\n";
+        }
+    }
+    std::cout << "\n";
+}
+
+/* a table loaded from a snapshot starts without its RIB so startup does not pay for
+   hashing every prefix. the snapshot stores routes grouped by prefix in candidate
+   order, which is all that is needed to rebuild it on the first update */
+std::vector<RoutePrefix> RoutingTable::prefixes() {
+    std::lock_guard<std::mutex> lock(update_mutex);
+    ensureRib();
+
+    std::vector<RoutePrefix> result;
+    result.reserve(prefix_routes.size());
+    for (const auto& [key, candidates] : prefix_routes) {
+        result.push_back({static_cast<uint32_t>(key >> 8), static_cast<uint8_t>(key & 0xFF)});
+    }
+    // the hash map's order depends on its history, callers get a stable one
+    std::sort(result.begin(), result.end(), [](const RoutePrefix& a, const RoutePrefix& b) {
+        return a.network != b.network ? a.network < b.network : a.prefix_len < b.prefix_len;
+    });
+    return result;
+}
+
+void RoutingTable::ensureRib() {
+    if (rib_ready) {
+        return;
+    }
+    prefix_routes.reserve(unindexed_routes.size());
+    for (const RouteEntry& route : unindexed_routes) {
+        uint8_t prefix_len = static_cast<uint8_t>(__builtin_popcount(route.subnet_mask));
+        prefix_routes[prefixKey(route.network, prefix_len)].push_back(route);
+    }
+    std::vector<RouteEntry>().swap(unindexed_routes);
+    rib_ready = true;
+}
+
+// interns the adjacency, fails when the interface or adjacency table is full
+bool RoutingTable::makeRoute(uint32_t network, uint8_t prefix_len, uint32_t interface_id,
+                             uint32_t next_hop, int metric, RouteEntry& route) {
+    route.adjacency = adjacency_table.intern(interface_id, next_hop);
+    if (route.adjacency == NO_ADJACENCY) {
+        log_error("No adjacency for route /%u, dropping it", prefix_len);
+        return false;
+    }
+    route.subnet_mask = LpmTable::prefixMask(prefix_len);
+    route.network = network & route.subnet_mask;
+    route.metric = metric;
+    return true;
+}
+
+bool RoutingTable::makeRoute6(const IPv6Address& network, uint8_t prefix_len, const std::string& interface,
+                              const IPv6Address& next_hop, int metric, RouteEntry6& route) {
+    if (prefix_len > 128) {
+        log_error("Invalid IPv6 prefix length /%u for interface %s", prefix_len, interface.c_str());
+        return false;
+    }
+    route.adjacency = adjacency_table.intern6(adjacency_table.internInterface(interface), next_hop);
+    if (route.adjacency == NO_ADJACENCY) {
+        log_error("No adjacency for IPv6 route /%u, dropping it", prefix_len);
+        return false;
+    }
+    route.network = network.masked(prefix_len);
+    route.prefix_len = prefix_len;
+    route.metric = metric;
+    return true;
+}
+
+std::pair<uint8_t, AdjacencyHandle> RoutingTable::coveringRoute6(const IPv6Address& network, uint8_t prefix_len) {
+    for (int len = prefix_len - 1; len >= 0; len--) {
+        uint8_t cover_len = static_cast<uint8_t>(len);
+        auto it = prefix6_routes.find(prefix6Key(network.masked(cover_len), cover_len));
+        if (it != prefix6_routes.end()) {
+            return {cover_len, installedHandle(it->second)};
+        }
+    }
+    return {0, NO_ADJACENCY};
+}
+
+// longest installed prefix strictly shorter than prefix_len that contains network
+std::pair<uint8_t, AdjacencyHandle> RoutingTable::coveringRoute(uint32_t network, uint8_t prefix_len) {
+    for (int len = prefix_len - 1; len >= 0; len--) {
+        uint8_t cover_len = static_cast<uint8_t>(len);
+        auto it = prefix_routes.find(prefixKey(network & LpmTable::prefixMask(cover_len), cover_len));
+        if (it != prefix_routes.end()) {
+            return {cover_len, installedHandle(it->second)};
+        }
+    }
+    return {0, NO_ADJACENCY};
 }
 
 std::pair<uint32_t, uint32_t> RoutingTable::parseCIDR(const std::string& cidr) {
@@ -70,6 +554,25 @@ std::pair<uint32_t, uint32_t> RoutingTable::parseCIDR(const std::string& cidr) {
     return {network, mask};
 }
 
+bool RoutingTable::parseCIDR6(const std::string& cidr, IPv6Address& network, uint8_t& prefix_len) {
+    size_t slash_pos = cidr.find('/');
+    int len = 128;
+    if (slash_pos != std::string::npos) {
+        const char* p = cidr.c_str() + slash_pos + 1;
+        char* end;
+        len = static_cast<int>(std::strtol(p, &end, 10));
+        if (end == p || *end != '\0' || len < 0 || len > 128) {
+            return false;
+        }
+    }
+    if (!IPv6Address::parse(cidr.substr(0, slash_pos), network)) {
+        return false;
+    }
+    prefix_len = static_cast<uint8_t>(len);
+    network = network.masked(prefix_len);
+    return true;
+}
+
 // returns IP in HOST byte order
 uint32_t RoutingTable::stringToIP(const std::string& ip_str) {
     struct in_addr addr;
@@ -2,26 +2,165 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <map>
+#include <tuple>
 #include <iostream>
+#include <atomic>
+#include <mutex>
+#include "lpm_table.hpp"
+#include "lpm6_table.hpp"
+#include "rcu.hpp"
+#include "adjacency_table.hpp"
 
+// interface and next hop live in the adjacency table, a route only keeps the handle
 struct RouteEntry {
     uint32_t network;
     uint32_t subnet_mask;
-    std::string interface;
-    uint32_t next_hop;
-    int metric;
+    AdjacencyHandle adjacency;
+    int32_t metric;
 };
 
+// IPv6 route, adjacency is a handle into the IPv6 adjacencies (AdjacencyTable::get6)
+struct RouteEntry6 {
+    IPv6Address network;
+    uint8_t prefix_len;
+    AdjacencyHandle adjacency;
+    int32_t metric;
+};
+
+// a prefix with at least one route, as prefixes() lists them
+struct RoutePrefix {
+    uint32_t network;
+    uint8_t prefix_len;
+};
+
+/* route updates and printTable serialize on an update mutex, lookups take no locks.
+   a thread that looks routes up while another thread updates the table registers as a
+   reader on rcu() and calls quiescent() between bursts, so memory the FIB retires is
+   only freed once no lookup can still reference it */
 class RoutingTable {
 public:
-    void addRoute(const std::string& network_cidr, const std::string& interface, 
+    RoutingTable();
+    ~RoutingTable();
+
+    void addRoute(const std::string& network_cidr, const std::string& interface,
                   const std::string& next_hop = "", int metric = 1);
-    std::string lookupRoute(const uint32_t& dst_ip);
+    void addRoute(uint32_t network, uint8_t prefix_len, const std::string& interface,
+                  uint32_t next_hop = 0, int metric = 1);
+    /* replaceRoute installs the route as the only one for its prefix in a single FIB
+       pass (no window without a route), removeRoute withdraws every route of the prefix
+       and falls back to the next covering prefix. both cost O(addresses covered by the
+       prefix), independent of the table size */
+    void replaceRoute(const std::string& network_cidr, const std::string& interface,
+                      const std::string& next_hop = "", int metric = 1);
+    void replaceRoute(uint32_t network, uint8_t prefix_len, const std::string& interface,
+                      uint32_t next_hop = 0, int metric = 1);
+    bool removeRoute(const std::string& network_cidr);
+    bool removeRoute(uint32_t network, uint8_t prefix_len);
+
+    /* bulk loader for large route files, one route per line:
+         <prefix/len> <interface> [next_hop] [metric]
+       the file is mapped and parsed in place and all routes are installed under a single
+       update, returns the number of routes loaded */
+    size_t loadRoutes(const std::string& path);
+
+    /* lookups return the handle stored in the FIB (NO_ADJACENCY without a route), an
+       adjacency or an ECMP next-hop group. adjacencies().select() with the flow's hash
+       picks the path, then get() gives the interface and next hop */
+    AdjacencyHandle lookupRoute(const uint32_t& dst_ip) const { return fib.lookup(dst_ip); }
+    // batch form of lookupRoute for a burst of packets
+    void lookupRoutes(const uint32_t* dst_ips, AdjacencyHandle* results, size_t count) const {
+        fib.lookupBatch(dst_ips, results, count);
+    }
+    const AdjacencyTable& adjacencies() const { return adjacency_table; }
+    /* the largest packet the interface sends, it is interned when new. forwarding picks
+       it up with the next burst, 0 lifts the limit. false below INTERFACE_MIN_MTU */
+    bool setInterfaceMtu(const std::string& interface, uint32_t mtu);
+
+    /* IPv6 routes live in their own RIB and FIB (Lpm6Table) with the same update rules
+       as the IPv4 ones. they share the update lock, the RCU domain, the interfaces and
+       the generation counter. FIB snapshots only cover the IPv4 table */
+    void addRoute6(const std::string& network_cidr, const std::string& interface,
+                   const std::string& next_hop = "", int metric = 1);
+    void addRoute6(const IPv6Address& network, uint8_t prefix_len, const std::string& interface,
+                   const IPv6Address& next_hop = {}, int metric = 1);
+    void replaceRoute6(const std::string& network_cidr, const std::string& interface,
+                       const std::string& next_hop = "", int metric = 1);
+    void replaceRoute6(const IPv6Address& network, uint8_t prefix_len, const std::string& interface,
+                       const IPv6Address& next_hop = {}, int metric = 1);
+    bool removeRoute6(const std::string& network_cidr);
+    bool removeRoute6(const IPv6Address& network, uint8_t prefix_len);
+    // handle into the IPv6 adjacencies (resolve with select() and get6()), or NO_ADJACENCY
+    AdjacencyHandle lookupRoute6(const IPv6Address& dst) const { return fib6.lookup(dst); }
+    void lookupRoutes6(const IPv6Address* dsts, AdjacencyHandle* results, size_t count) const {
+        fib6.lookupBatch(dsts, results, count);
+    }
     void printTable();
-    
+    // every IPv4 prefix with a route, ordered by network and length
+    std::vector<RoutePrefix> prefixes();
+    // runs pending RCU reclamation under the update lock
+    void reclaim();
+
+    size_t size() const { return route_count; }
+    size_t size6() const { return route6_count; }
+    const LpmTable& lpm() const { return fib; }
+    const Lpm6Table& lpm6() const { return fib6; }
+    RcuDomain& rcu() { return rcu_domain; }
+    // bumped after every published change, lets readers notice that cached lookups are stale
+    uint64_t generation() const { return fib_generation.load(std::memory_order_acquire); }
+
+private:
+    friend class FibSnapshot;
+
+    RcuDomain rcu_domain;
+
+    /* prefix_routes maps a prefix to its candidate routes in insertion order. the
+       routes with the lowest metric are installed in the compiled LPM table: their
+       adjacency, or an interned next-hop group when several equal-cost routes lead to
+       different adjacencies (ECMP). readers never touch the RIB, they only
+       follow handles into adjacency_table, whose entries never move */
+    AdjacencyTable adjacency_table;
+    std::unordered_map<uint64_t, std::vector<RouteEntry>> prefix_routes;
+    size_t route_count = 0;
+    // routes of a loaded snapshot, grouped by prefix, until the first update indexes them
+    std::vector<RouteEntry> unindexed_routes;
+    bool rib_ready = true;
+    LpmTable fib;
+
+    // IPv6 RIB keyed by (high half, low half, prefix length), ordered so printTable needs no sort
+    using Prefix6Key = std::tuple<uint64_t, uint64_t, uint8_t>;
+    std::map<Prefix6Key, std::vector<RouteEntry6>> prefix6_routes;
+    size_t route6_count = 0;
+    Lpm6Table fib6;
+
+    std::mutex update_mutex;
+    std::atomic<uint64_t> fib_generation{0};
+
+    void ensureRib();
+    void insertCandidate(const RouteEntry& route, uint8_t prefix_len);
+    bool makeRoute(uint32_t network, uint8_t prefix_len, uint32_t interface_id,
+                   uint32_t next_hop, int metric, RouteEntry& route);
+    template <typename Route>
+    AdjacencyHandle installedHandle(const std::vector<Route>& candidates);
+    std::pair<uint8_t, AdjacencyHandle> coveringRoute(uint32_t network, uint8_t prefix_len);
+    bool makeRoute6(const IPv6Address& network, uint8_t prefix_len, const std::string& interface,
+                    const IPv6Address& next_hop, int metric, RouteEntry6& route);
+    std::pair<uint8_t, AdjacencyHandle> coveringRoute6(const IPv6Address& network, uint8_t prefix_len);
+    void printTable6();
+
+public:
+    static std::pair<uint32_t, uint32_t> parseCIDR(const std::string& cidr);
+    static uint32_t stringToIP(const std::string& ip_str);
+    static std::string ipToString(uint32_t ip);
+    // "<address>/<len>" or a bare address (/128), returns false when malformed
+    static bool parseCIDR6(const std::string& cidr, IPv6Address& network, uint8_t& prefix_len);
+
 private:
-    std::vector<RouteEntry> routes;
-    std::pair<uint32_t, uint32_t> parseCIDR(const std::string& cidr);
-    uint32_t stringToIP(const std::string& ip_str);
-    std::string ipToString(uint32_t ip);
+    static uint64_t prefixKey(uint32_t network, uint8_t prefix_len) {
+        return (static_cast<uint64_t>(network) << 8) | prefix_len;
+    }
+    static Prefix6Key prefix6Key(const IPv6Address& network, uint8_t prefix_len) {
+        return {network.high(), network.low(), prefix_len};
+    }
 };
@@ -0,0 +1,335 @@
+#include "traffic_generator.hpp"
+#include "logger.hpp"
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+static bool parseProfileLine(TrafficProfile& profile, const std::string& line) {
+    std::istringstream tokens(line);
+    std::string key;
+    if (!(tokens >> key)) {
+        return false;
+    }
+
+    if (key == "seed") {
+        return static_cast<bool>(tokens >> profile.seed);
+    } else if (key == "flows") {
+        return (tokens >> profile.flows) && profile.flows > 0;
+    } else if (key == "zipf") {
+        return (tokens >> profile.zipf_exponent) && profile.zipf_exponent >= 0;
+    } else if (key == "unrouted") {
+        return (tokens >> profile.unrouted_share) && profile.unrouted_share >= 0 && profile.unrouted_share <= 1;
+    } else if (key == "destinations") {
+        std::string mode;
+        tokens >> mode;
+        profile.weight_by_address_space = mode == "address-space";
+        return mode == "address-space" || mode == "per-prefix";
+    } else if (key == "sources") {
+        std::string prefix;
+        if (!(tokens >> prefix)) {
+            return false;
+        }
+        try {
+            auto [network, mask] = RoutingTable::parseCIDR(prefix);
+            profile.src_network = network;
+            profile.src_prefix_len = static_cast<uint8_t>(__builtin_popcount(mask));
+        } catch (const std::exception& e) {
+            return false;
+        }
+        return true;
+    } else if (key == "mix") {
+        // protocols the line leaves out get no flows
+        uint32_t tcp = 0, udp = 0, icmp = 0;
+        std::string protocol;
+        uint32_t weight;
+        while (tokens >> protocol >> weight) {
+            if (protocol == "tcp") {
+                tcp = weight;
+            } else if (protocol == "udp") {
+                udp = weight;
+            } else if (protocol == "icmp") {
+                icmp = weight;
+            } else {
+                return false;
+            }
+        }
+        if (tcp + udp + icmp == 0) {
+            return false;
+        }
+        profile.tcp_weight = tcp;
+        profile.udp_weight = udp;
+        profile.icmp_weight = icmp;
+        return true;
+    } else if (key == "sizes") {
+        std::vector<std::pair<uint16_t, uint32_t>> sizes;
+        std::string entry;
+        while (tokens >> entry) {
+            size_t colon = entry.find(':');
+            try {
+                unsigned long bytes = std::stoul(entry.substr(0, colon));
+                unsigned long weight = (colon == std::string::npos) ? 1 : std::stoul(entry.substr(colon + 1));
+                if (bytes > 0xFFFF) {
+                    return false;
+                }
+                sizes.emplace_back(static_cast<uint16_t>(bytes), static_cast<uint32_t>(weight));
+            } catch (const std::exception& e) {
+                return false;
+            }
+        }
+        if (sizes.empty()) {
+            return false;
+        }
+        profile.sizes = sizes;
+        return true;
+    }
+    return false;
+}
+
+bool TrafficProfile::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        log_error("Failed to open traffic profile: %s", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    size_t line_number = 0;
+    size_t skipped = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        if (!parseProfileLine(*this, line)) {
+            log_warning("Skipping malformed traffic profile setting at %s:%zu", path.c_str(), line_number);
+            skipped++;
+        }
+    }
+
+    log_info("Loaded traffic profile %s (%zu settings skipped)", path.c_str(), skipped);
+    return true;
+}
+
+void AliasTable::build(const std::vector<double>& weights) {
+    slots.clear();
+    double total = 0;
+    for (double weight : weights) {
+        total += weight;
+    }
+    if (weights.empty() || !(total > 0)) {
+        return;
+    }
+
+    /* Vose's construction: scale the weights to average 1, then let every slot under 1
+       take the rest of its room from a slot over 1 */
+    size_t n = weights.size();
+    slots.resize(n);
+    std::vector<double> scaled(n);
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < n; i++) {
+        scaled[i] = weights[i] * n / total;
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+    while (!small.empty() && !large.empty()) {
+        uint32_t under = small.back();
+        small.pop_back();
+        uint32_t over = large.back();
+        slots[under] = {static_cast<uint32_t>(scaled[under] * 4294967296.0), over};
+        scaled[over] -= 1.0 - scaled[under];
+        if (scaled[over] < 1.0) {
+            large.pop_back();
+            small.push_back(over);
+        }
+    }
+    // what is left is 1 up to rounding, those slots always keep their own index
+    for (uint32_t i : small) {
+        slots[i] = {UINT32_MAX, i};
+    }
+    for (uint32_t i : large) {
+        slots[i] = {UINT32_MAX, i};
+    }
+}
+
+static uint32_t hostBits(uint8_t prefix_len) {
+    return prefix_len == 0 ? 0xFFFFFFFF : (prefix_len >= 32 ? 0 : 0xFFFFFFFF >> prefix_len);
+}
+
+// uniform in [0, 1) from the top 53 bits, the same on every standard library
+static double unitInterval(uint64_t random) {
+    return static_cast<double>(random >> 11) * 0x1.0p-53;
+}
+
+TrafficGenerator::TrafficGenerator(const TrafficProfile& profile, const std::vector<RoutePrefix>& fib_prefixes)
+    : random_state(profile.seed) {
+    std::vector<uint8_t> protocols = buildTemplates(profile);
+    if (protocols.empty()) {
+        log_error("Traffic profile has no protocols or packet sizes to generate");
+        return;
+    }
+    buildFlows(profile, protocols, fib_prefixes);
+    log_info("Traffic generator ready: %zu flows, %zu packet templates, seed %llu", flows.size(),
+             templates.size(), static_cast<unsigned long long>(profile.seed));
+}
+
+std::vector<uint8_t> TrafficGenerator::buildTemplates(const TrafficProfile& profile) {
+    std::vector<double> size_weights;
+    for (const auto& [bytes, weight] : profile.sizes) {
+        size_weights.push_back(weight);
+    }
+    size_table.build(size_weights);
+    size_count = size_table.size();
+    if (size_count == 0) {
+        return {};
+    }
+
+    // addresses, ports and sequence numbers are zero here, every packet patches its own in
+    std::vector<uint8_t> protocols;
+    std::string filler(0xFFFF, 'x');
+    const std::pair<uint8_t, uint32_t> mix[] = {
+        {PROTOCOL_TCP, profile.tcp_weight}, {PROTOCOL_UDP, profile.udp_weight}, {PROTOCOL_ICMP, profile.icmp_weight}};
+    for (const auto& [protocol, weight] : mix) {
+        if (weight == 0) {
+            continue;
+        }
+        protocols.push_back(protocol);
+        size_t l4_header = protocol == PROTOCOL_TCP ? TCP_HEADER_SIZE
+                                                    : (protocol == PROTOCOL_UDP ? UDP_HEADER_SIZE : ICMP_HEADER_SIZE);
+        for (const auto& size : profile.sizes) {
+            // sizes below the bare headers get the headers alone
+            size_t payload = std::max<size_t>(size.first, IPv4_HEADER_SIZE + l4_header) - IPv4_HEADER_SIZE - l4_header;
+            PacketTemplate tmpl;
+            bool built = false;
+            if (protocol == PROTOCOL_TCP) {
+                TCPPacketBuilder tcp;
+                tcp.ipv4_src_ip = tcp.ipv4_dst_ip = "0.0.0.0";
+                tcp.tcp_src_port = tcp.tcp_dst_port = 0;
+                tcp.tcp_seq = 0;
+                tcp.tcp_flags = TCP_ACK | TCP_PSH;
+                tcp.tcp_payload = filler.substr(0, payload);
+                built = tmpl.assign(tcp);
+            } else if (protocol == PROTOCOL_UDP) {
+                UDPPacketBuilder udp;
+                udp.ipv4_src_ip = udp.ipv4_dst_ip = "0.0.0.0";
+                udp.udp_src_port = udp.udp_dst_port = 0;
+                udp.udp_payload = filler.substr(0, payload);
+                built = tmpl.assign(udp);
+            } else {
+                ICMPPacketBuilder icmp;
+                icmp.ipv4_src_ip = icmp.ipv4_dst_ip = "0.0.0.0";
+                icmp.icmp_id = icmp.icmp_seq = 0;
+                icmp.icmp_payload = filler.substr(0, payload);
+                built = tmpl.assign(icmp);
+            }
+            if (!built) {
+                return {};
+            }
+            max_packet_size = std::max(max_packet_size, tmpl.size());
+            payload_sizes.push_back(static_cast<uint16_t>(payload));
+            templates.push_back(std::move(tmpl));
+        }
+    }
+    return protocols;
+}
+
+void TrafficGenerator::buildFlows(const TrafficProfile& profile, const std::vector<uint8_t>& protocols,
+                                  const std::vector<RoutePrefix>& fib_prefixes) {
+    std::vector<double> protocol_weights;
+    for (uint8_t protocol : protocols) {
+        protocol_weights.push_back(protocol == PROTOCOL_TCP ? profile.tcp_weight
+                                   : protocol == PROTOCOL_UDP ? profile.udp_weight : profile.icmp_weight);
+    }
+    AliasTable protocol_table;
+    protocol_table.build(protocol_weights);
+
+    /* the default route covers every address, drawing from it is what unrouted is for,
+       and in the address-space mode it would take all the weight */
+    std::vector<RoutePrefix> prefixes;
+    std::vector<double> prefix_weights;
+    for (const RoutePrefix& prefix : fib_prefixes) {
+        if (prefix.prefix_len > 0) {
+            prefixes.push_back(prefix);
+            prefix_weights.push_back(std::ldexp(1.0, 32 - prefix.prefix_len));
+        }
+    }
+    AliasTable prefix_table;
+    if (profile.weight_by_address_space) {
+        prefix_table.build(prefix_weights);
+    }
+
+    uint32_t src_host_bits = hostBits(profile.src_prefix_len);
+    flows.resize(profile.flows);
+    for (TrafficFlow& flow : flows) {
+        size_t slot = protocol_table.draw(nextRandom());
+        flow.protocol = protocols[slot];
+        flow.template_base = static_cast<uint32_t>(slot * size_count);
+        flow.src_ip = (profile.src_network & ~src_host_bits) | (static_cast<uint32_t>(nextRandom()) & src_host_bits);
+        if (prefixes.empty() || unitInterval(nextRandom()) < profile.unrouted_share) {
+            flow.dst_ip = static_cast<uint32_t>(nextRandom());
+        } else {
+            const RoutePrefix& prefix = profile.weight_by_address_space ? prefixes[prefix_table.draw(nextRandom())]
+                                                                        : prefixes[nextRandom() % prefixes.size()];
+            flow.dst_ip = prefix.network | (static_cast<uint32_t>(nextRandom()) & hostBits(prefix.prefix_len));
+        }
+        flow.src_port = static_cast<uint16_t>(1024 + nextRandom() % (65536 - 1024));
+        switch (flow.protocol) {
+            case PROTOCOL_TCP:
+                flow.dst_port = (nextRandom() % 4) ? 443 : 80;
+                break;
+            case PROTOCOL_UDP:
+                flow.dst_port = (nextRandom() % 2) ? 53 : 443;
+                break;
+            default:
+                flow.dst_port = 0;
+                break;
+        }
+        flow.seq = static_cast<uint32_t>(nextRandom());
+    }
+
+    // popularity by rank, the flows themselves are in random order already
+    std::vector<double> popularity_weights(flows.size());
+    for (size_t k = 0; k < flows.size(); k++) {
+        popularity_weights[k] = 1.0 / std::pow(static_cast<double>(k + 1), profile.zipf_exponent);
+    }
+    popularity.build(popularity_weights);
+}
+
+size_t TrafficGenerator::next(uint8_t* out, size_t capacity) {
+    if (!valid()) {
+        return 0;
+    }
+    TrafficFlow& flow = flows[popularity.draw(nextRandom())];
+    size_t slot = flow.template_base + size_table.draw(nextRandom());
+    const PacketTemplate& tmpl = templates[slot];
+    PacketFields fields = {identification++, flow.src_ip, flow.dst_ip, flow.src_port, flow.dst_port, flow.seq};
+    size_t length = tmpl.stamp(out, capacity, fields);
+    if (length == 0) {
+        return 0;
+    }
+    // TCP moves on by the payload, ICMP echoes count up
+    flow.seq += flow.protocol == PROTOCOL_TCP ? payload_sizes[slot] : 1;
+    generated_packets++;
+    generated_bytes += length;
+    return length;
+}
+
+size_t TrafficGenerator::fill(PacketPool& pool, PacketHandle* packets, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        PacketHandle buffer = pool.alloc();
+        if (!buffer) {
+            return i;
+        }
+        size_t length = next(buffer->data(), buffer->tailroom());
+        if (length == 0) {
+            log_error("Generated packet does not fit a %zu byte packet buffer", buffer->tailroom());
+            return i;
+        }
+        buffer->append(length);
+        packets[i] = std::move(buffer);
+    }
+    return count;
+}
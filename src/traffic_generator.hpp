@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "packet_builders.hpp"
+#include "packet_pool.hpp"
+#include "routing_table.hpp"
+
+/* synthetic IPv4 traffic for load tests, streamed a packet or a burst at a time.
+   the profile file has one setting per line, '#' starts a comment:
+     seed <n>                         seeds every random choice, the same seed gives the same packets
+     flows <n>                        number of distinct flows
+     mix <protocol> <weight> ...      protocol share of the flows, protocols tcp, udp and icmp
+     sizes <bytes>:<weight> ...       IPv4 packet sizes, drawn per packet
+     zipf <exponent>                  flow popularity, the k-th flow weighs 1/k^exponent, 0 is uniform
+     destinations <per-prefix|address-space>   FIB prefixes weighted equally or by the addresses they cover
+     unrouted <share>                 share of flows towards random addresses instead of FIB prefixes
+     sources <prefix/len>             where the flows' source addresses come from
+   settings the file leaves out keep their defaults below */
+struct TrafficProfile {
+    uint64_t seed = 1;
+    size_t flows = 10000;
+    uint32_t tcp_weight = 60;
+    uint32_t udp_weight = 35;
+    uint32_t icmp_weight = 5;
+    std::vector<std::pair<uint16_t, uint32_t>> sizes = {{64, 7}, {576, 4}, {1500, 1}};   // simple IMIX
+    double zipf_exponent = 1.0;
+    bool weight_by_address_space = false;
+    double unrouted_share = 0.0;
+    uint32_t src_network = 0x0A000000;      // 10.0.0.0/8
+    uint8_t src_prefix_len = 8;
+
+    // applies the file's settings on top of the current ones, false when it cannot be read
+    bool load(const std::string& path);
+};
+
+/* Walker's alias method: draws index i with probability weights[i] / sum(weights) in
+   constant time, one table lookup and one comparison per draw */
+class AliasTable {
+public:
+    void build(const std::vector<double>& weights);
+    // 32 bits of the random value pick a slot, the other 32 the slot's side
+    size_t draw(uint64_t random) const {
+        size_t slot = static_cast<size_t>(((random >> 32) * slots.size()) >> 32);
+        return static_cast<uint32_t>(random) < slots[slot].threshold ? slot : slots[slot].alias;
+    }
+    size_t size() const { return slots.size(); }
+
+private:
+    struct Slot {
+        uint32_t threshold;     // draws below it keep the slot
+        uint32_t alias;
+    };
+    std::vector<Slot> slots;
+};
+
+struct TrafficFlow {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;          // the echo identifier for ICMP
+    uint16_t dst_port;
+    uint32_t seq;               // next TCP sequence number or ICMP echo sequence
+    uint32_t template_base;     // first of the flow's protocol templates, one per size
+    uint8_t protocol;
+};
+
+/* the flows are drawn once from the profile and the loaded FIB's prefixes. each packet
+   then picks a flow by popularity and a size and stamps the PacketTemplate for that
+   protocol and size with the flow's addresses, ports and sequence number, checksums
+   from the template's precomputed sums, so nothing is built or allocated per packet */
+class TrafficGenerator {
+public:
+    TrafficGenerator(const TrafficProfile& profile, const std::vector<RoutePrefix>& fib_prefixes);
+
+    // false when the profile has no flows, protocols or sizes to draw from
+    bool valid() const { return !flows.empty() && !templates.empty(); }
+
+    // the next packet at out, its size or 0 when capacity is short
+    size_t next(uint8_t* out, size_t capacity);
+    // the next count packets in pooled buffers, fewer when the pool runs dry
+    size_t fill(PacketPool& pool, PacketHandle* packets, size_t count);
+
+    size_t flowCount() const { return flows.size(); }
+    const TrafficFlow& flow(size_t index) const { return flows[index]; }
+    // the largest packet the profile produces
+    size_t maxPacketSize() const { return max_packet_size; }
+    uint64_t packets() const { return generated_packets; }
+    uint64_t bytes() const { return generated_bytes; }
+
+private:
+    uint64_t random_state;
+    std::vector<TrafficFlow> flows;
+    AliasTable popularity;
+    AliasTable size_table;
+    std::vector<uint16_t> payload_sizes;        // per template, what a TCP packet adds to the sequence
+    std::vector<PacketTemplate> templates;      // protocol slot * sizes + size slot
+    size_t size_count = 0;
+    size_t max_packet_size = 0;
+    uint16_t identification = 0;
+    uint64_t generated_packets = 0;
+    uint64_t generated_bytes = 0;
+
+    // splitmix64: a few cycles a draw, and the same stream for a seed on every platform
+    uint64_t nextRandom() {
+        uint64_t z = (random_state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    // the protocols with a share of the flows, in template slot order
+    std::vector<uint8_t> buildTemplates(const TrafficProfile& profile);
+    void buildFlows(const TrafficProfile& profile, const std::vector<uint8_t>& protocols,
+                    const std::vector<RoutePrefix>& fib_prefixes);
+};
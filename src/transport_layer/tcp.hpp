@@ -1,7 +1,9 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <string>
+#include "packet_view.hpp"
 
 struct __attribute__((packed)) TCPHeader {
     uint16_t src_port;
@@ -15,6 +17,29 @@ struct __attribute__((packed)) TCPHeader {
     uint16_t urgent_pointer;
 };
 
+// read access to a TCP header in place, laid out as TCPHeader and byte-swapped per field
+class TCPHeaderView {
+public:
+    TCPHeaderView() = default;
+    TCPHeaderView(PacketView packet, size_t offset) : bytes(packet.from(offset)) {}
+
+    bool valid() const { return bytes.has(0, sizeof(TCPHeader)); }
+    uint16_t srcPort() const { return bytes.u16(offsetof(TCPHeader, src_port)); }
+    uint16_t dstPort() const { return bytes.u16(offsetof(TCPHeader, dst_port)); }
+    uint32_t seqNumber() const { return bytes.u32(offsetof(TCPHeader, seq_number)); }
+    uint32_t ackNumber() const { return bytes.u32(offsetof(TCPHeader, ack_number)); }
+    // header length in bytes, options included
+    size_t headerLength() const { return static_cast<size_t>(bytes.u8(offsetof(TCPHeader, data_offset_flags)) >> 4) * 4; }
+    uint8_t flags() const { return bytes.u8(offsetof(TCPHeader, flags)); }
+    uint16_t windowSize() const { return bytes.u16(offsetof(TCPHeader, window_size)); }
+    uint16_t checksum() const { return bytes.u16(offsetof(TCPHeader, checksum)); }
+    uint16_t urgentPointer() const { return bytes.u16(offsetof(TCPHeader, urgent_pointer)); }
+    PacketView payload() const { return bytes.from(headerLength()); }
+
+private:
+    PacketView bytes;
+};
+
 constexpr uint8_t TCP_FIN = 0x01;
 constexpr uint8_t TCP_SYN = 0x02;
 constexpr uint8_t TCP_RST = 0x04;
@@ -26,11 +51,13 @@ constexpr uint8_t TCP_CWR = 0x80;
 
 class TCP {
   public:
-    static TCPHeader parseHeader(const std::vector<uint8_t>& packet, size_t offset);
+    static TCPHeaderView parseHeader(PacketView packet, size_t offset);
 
     static TCPHeader createHeader(uint16_t src_port, uint16_t dst_port, uint8_t flags = TCP_SYN);
     static std::vector<uint8_t> serializeHeader(const TCPHeader& header);
-    static uint16_t calculateChecksum(const uint32_t& src_ip, const uint32_t& dst_ip, const std::vector<uint8_t>& tcp_data);
+    // serializeHeader into the 20 bytes at out, nothing allocated
+    static void writeHeader(uint8_t* out, const TCPHeader& header);
+    static uint16_t calculateChecksum(uint32_t src_ip, uint32_t dst_ip, const uint8_t* tcp_data, size_t length);
 
-    static void printHeader(const TCPHeader& header);
+    static void printHeader(const TCPHeaderView& header);
 };
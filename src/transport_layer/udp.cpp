@@ -2,25 +2,20 @@
 #include "logger.hpp"
 #include "packet_builders.hpp"
 #include "internet_protocol.hpp"
+#include "checksum.hpp"
 #include <iostream>
 #include <arpa/inet.h>
 #include <cstring>
 
-UDPHeader UDP::parseHeader(const std::vector<uint8_t>& packet, size_t offset) {
-    if (packet.size() < offset + UDP_HEADER_SIZE) {
+UDPHeaderView UDP::parseHeader(PacketView packet, size_t offset) {
+    UDPHeaderView header(packet, offset);
+    if (!header.valid()) {
         log_error("Packet too short for UDP header");
         return {};
     }
 
-    UDPHeader header;
-    std::memcpy(&header, packet.data() + offset, sizeof(UDPHeader));
-    header.src_port = ntohs(header.src_port);
-    header.dst_port = ntohs(header.dst_port);
-    header.length = ntohs(header.length);
-    header.checksum = ntohs(header.checksum);
-
     log_debug("Parsed UDP header - Src Port: %d, Dst Port: %d, Length: %d",
-              header.src_port, header.dst_port, header.length);
+              header.srcPort(), header.dstPort(), header.length());
 
     return header;
 }
@@ -38,52 +33,35 @@ UDPHeader UDP::createHeader(uint16_t src_port, uint16_t dst_port, uint16_t data_
 
 std::vector<uint8_t> UDP::serializeHeader(const UDPHeader& header) {
     std::vector<uint8_t> udp_header(UDP_HEADER_SIZE);
-
-    udp_header[0] = (header.src_port >> 8) & 0xFF;
-    udp_header[1] = header.src_port & 0xFF;
-    udp_header[2] = (header.dst_port >> 8) & 0xFF;
-    udp_header[3] = header.dst_port & 0xFF;
-    udp_header[4] = (header.length >> 8) & 0xFF;
-    udp_header[5] = header.length & 0xFF;
-    udp_header[6] = (header.checksum >> 8) & 0xFF;
-    udp_header[7] = header.checksum & 0xFF;
-
+    writeHeader(udp_header.data(), header);
     return udp_header;
 }
 
-uint16_t UDP::calculateChecksum(const uint32_t& src_ip, const uint32_t& dst_ip, const std::vector<uint8_t>& udp_data) {
+void UDP::writeHeader(uint8_t* out, const UDPHeader& header) {
+    out[0] = (header.src_port >> 8) & 0xFF;
+    out[1] = header.src_port & 0xFF;
+    out[2] = (header.dst_port >> 8) & 0xFF;
+    out[3] = header.dst_port & 0xFF;
+    out[4] = (header.length >> 8) & 0xFF;
+    out[5] = header.length & 0xFF;
+    out[6] = (header.checksum >> 8) & 0xFF;
+    out[7] = header.checksum & 0xFF;
+}
+
+uint16_t UDP::calculateChecksum(uint32_t src_ip, uint32_t dst_ip, const uint8_t* udp_data, size_t length) {
     /* Calculate UDP checksum according to RFC 768 (User Datagram Protocol):
        The checksum covers the pseudo-header (source IP, destination IP, protocol, UDP length),
        the UDP header, and the payload data as 16-bit words.
        If the length is odd, the last byte is padded with zero.
        The checksum is the one's complement of the sum of all 16-bit words.
     */
-    uint32_t sum = 0;
-
-    sum += (src_ip >> 16) + (src_ip & 0xFFFF);
-    sum += (dst_ip >> 16) + (dst_ip & 0xFFFF);
-    sum += PROTOCOL_UDP;
-    sum += udp_data.size();
-
-    for (size_t i = 0; i < udp_data.size(); i += 2) {
-        if (i + 1 < udp_data.size()) {
-            sum += (udp_data[i] << 8) + udp_data[i + 1];
-        } else {
-            sum += udp_data[i] << 8;  // pad odd length
-        }
-    }
-
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
-
-    return ~sum;
+    return segmentChecksum(pseudoHeaderSum(src_ip, dst_ip, PROTOCOL_UDP, length), udp_data, length);
 }
 
-void UDP::printHeader(const UDPHeader& h) {
+void UDP::printHeader(const UDPHeaderView& h) {
     std::cout << "UDP Header:\n"
-              << "  Source Port: " << h.src_port
-              << ", Destination Port: " << h.dst_port << "\n"
-              << "  Length: " << h.length << " bytes"
-              << ", Checksum: 0x" << std::hex << h.checksum << std::dec << "\n";
+              << "  Source Port: " << h.srcPort()
+              << ", Destination Port: " << h.dstPort() << "\n"
+              << "  Length: " << h.length() << " bytes"
+              << ", Checksum: 0x" << std::hex << h.checksum() << std::dec << "\n";
 }
@@ -1,7 +1,9 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <string>
+#include "packet_view.hpp"
 
 struct __attribute__((packed)) UDPHeader {
     uint16_t src_port;
@@ -10,13 +12,32 @@ struct __attribute__((packed)) UDPHeader {
     uint16_t checksum;
 };
 
+// read access to a UDP header in place, laid out as UDPHeader and byte-swapped per field
+class UDPHeaderView {
+public:
+    UDPHeaderView() = default;
+    UDPHeaderView(PacketView packet, size_t offset) : bytes(packet.from(offset)) {}
+
+    bool valid() const { return bytes.has(0, sizeof(UDPHeader)); }
+    uint16_t srcPort() const { return bytes.u16(offsetof(UDPHeader, src_port)); }
+    uint16_t dstPort() const { return bytes.u16(offsetof(UDPHeader, dst_port)); }
+    uint16_t length() const { return bytes.u16(offsetof(UDPHeader, length)); }
+    uint16_t checksum() const { return bytes.u16(offsetof(UDPHeader, checksum)); }
+    PacketView payload() const { return bytes.from(sizeof(UDPHeader)); }
+
+private:
+    PacketView bytes;
+};
+
 class UDP {
 public:
-    static UDPHeader parseHeader(const std::vector<uint8_t>& packet, size_t offset);
+    static UDPHeaderView parseHeader(PacketView packet, size_t offset);
 
     static UDPHeader createHeader(uint16_t src_port, uint16_t dst_port, uint16_t data_length);
     static std::vector<uint8_t> serializeHeader(const UDPHeader& header);
-    static uint16_t calculateChecksum(const uint32_t& src_ip, const uint32_t& dst_ip, const std::vector<uint8_t>& udp_data);
+    // serializeHeader into the 8 bytes at out, nothing allocated
+    static void writeHeader(uint8_t* out, const UDPHeader& header);
+    static uint16_t calculateChecksum(uint32_t src_ip, uint32_t dst_ip, const uint8_t* udp_data, size_t length);
 
-    static void printHeader(const UDPHeader& header);
+    static void printHeader(const UDPHeaderView& header);
 };
@@ -0,0 +1,177 @@
+#include "checksum.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_X86 1
+#endif
+
+/* every kernel keeps a 64-bit native-order sum of 32-bit words: the bulk goes through
+   the vector lanes (32-bit words widened to 64-bit lanes, so nothing overflows for any
+   realistic length), what is left after the last full vector through checksumAddNative */
+
+// copies the count < 64 bytes a kernel's vector loop left over, in fixed-size pieces
+template <size_t PIECE>
+static void copyPiece(uint8_t*& dst, const uint8_t*& src, size_t count) {
+    if (count & PIECE) {
+        std::memcpy(dst, src, PIECE);
+        dst += PIECE;
+        src += PIECE;
+    }
+}
+
+static void copyTail(uint8_t* dst, const uint8_t* src, size_t count) {
+    copyPiece<32>(dst, src, count);
+    copyPiece<16>(dst, src, count);
+    copyPiece<8>(dst, src, count);
+    copyPiece<4>(dst, src, count);
+    copyPiece<2>(dst, src, count);
+    copyPiece<1>(dst, src, count);
+}
+
+static uint16_t sumScalar(const uint8_t* data, size_t length) {
+    // four independent sums per 32 bytes so the adds do not wait on each other
+    uint64_t sums[4] = {};
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        uint64_t words[4];
+        std::memcpy(words, data + i, sizeof(words));
+        for (size_t k = 0; k < 4; k++) {
+            sums[k] += (words[k] & 0xFFFFFFFF) + (words[k] >> 32);
+        }
+    }
+    uint64_t sum = checksumAddNative(0, data + i, length - i);
+    for (uint64_t partial : sums) {
+        sum += (partial & 0xFFFFFFFF) + (partial >> 32);
+    }
+    return checksumFoldNative(sum);
+}
+
+static uint16_t copySumScalar(uint8_t* dst, const uint8_t* src, size_t length) {
+    uint64_t sums[4] = {};
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        uint64_t words[4];
+        std::memcpy(words, src + i, sizeof(words));
+        std::memcpy(dst + i, words, sizeof(words));
+        for (size_t k = 0; k < 4; k++) {
+            sums[k] += (words[k] & 0xFFFFFFFF) + (words[k] >> 32);
+        }
+    }
+    copyTail(dst + i, src + i, length - i);
+    uint64_t sum = checksumAddNative(0, src + i, length - i);
+    for (uint64_t partial : sums) {
+        sum += (partial & 0xFFFFFFFF) + (partial >> 32);
+    }
+    return checksumFoldNative(sum);
+}
+
+#if CHECKSUM_X86
+static uint64_t laneSum(__m128i lanes) {
+    uint64_t halves[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(halves), lanes);
+    return (halves[0] & 0xFFFFFFFF) + (halves[0] >> 32) + (halves[1] & 0xFFFFFFFF) + (halves[1] >> 32);
+}
+
+__attribute__((target("sse2")))
+static uint16_t sumSse2(const uint8_t* data, size_t length) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low = zero, high = zero;
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        low = _mm_add_epi64(low, _mm_add_epi64(_mm_unpacklo_epi32(a, zero), _mm_unpacklo_epi32(b, zero)));
+        high = _mm_add_epi64(high, _mm_add_epi64(_mm_unpackhi_epi32(a, zero), _mm_unpackhi_epi32(b, zero)));
+    }
+    return checksumFoldNative(checksumAddNative(laneSum(low) + laneSum(high), data + i, length - i));
+}
+
+__attribute__((target("sse2")))
+static uint16_t copySumSse2(uint8_t* dst, const uint8_t* src, size_t length) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low = zero, high = zero;
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), a);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 16), b);
+        low = _mm_add_epi64(low, _mm_add_epi64(_mm_unpacklo_epi32(a, zero), _mm_unpacklo_epi32(b, zero)));
+        high = _mm_add_epi64(high, _mm_add_epi64(_mm_unpackhi_epi32(a, zero), _mm_unpackhi_epi32(b, zero)));
+    }
+    copyTail(dst + i, src + i, length - i);
+    return checksumFoldNative(checksumAddNative(laneSum(low) + laneSum(high), src + i, length - i));
+}
+
+__attribute__((target("avx2")))
+static uint64_t laneSum256(__m256i lanes) {
+    return laneSum(_mm256_castsi256_si128(lanes)) + laneSum(_mm256_extracti128_si256(lanes, 1));
+}
+
+__attribute__((target("avx2")))
+static uint16_t sumAvx2(const uint8_t* data, size_t length) {
+    // short of one full iteration the ymm setup and zeroupper are pure overhead
+    if (length < 64) {
+        return sumSse2(data, length);
+    }
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i low = zero, high = zero;
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        low = _mm256_add_epi64(low, _mm256_add_epi64(_mm256_unpacklo_epi32(a, zero), _mm256_unpacklo_epi32(b, zero)));
+        high = _mm256_add_epi64(high, _mm256_add_epi64(_mm256_unpackhi_epi32(a, zero), _mm256_unpackhi_epi32(b, zero)));
+    }
+    uint64_t sum = laneSum256(low) + laneSum256(high);
+    // leave the upper halves clean before the scalar tail, mixing in SSE code stalls otherwise
+    _mm256_zeroupper();
+    return checksumFoldNative(checksumAddNative(sum, data + i, length - i));
+}
+
+__attribute__((target("avx2")))
+static uint16_t copySumAvx2(uint8_t* dst, const uint8_t* src, size_t length) {
+    if (length < 64) {
+        return copySumSse2(dst, src, length);
+    }
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i low = zero, high = zero;
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), a);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), b);
+        low = _mm256_add_epi64(low, _mm256_add_epi64(_mm256_unpacklo_epi32(a, zero), _mm256_unpacklo_epi32(b, zero)));
+        high = _mm256_add_epi64(high, _mm256_add_epi64(_mm256_unpackhi_epi32(a, zero), _mm256_unpackhi_epi32(b, zero)));
+    }
+    uint64_t sum = laneSum256(low) + laneSum256(high);
+    _mm256_zeroupper();
+    copyTail(dst + i, src + i, length - i);
+    return checksumFoldNative(checksumAddNative(sum, src + i, length - i));
+}
+#endif
+
+static const ChecksumKernel SCALAR_KERNEL = {"scalar", sumScalar, copySumScalar};
+#if CHECKSUM_X86
+static const ChecksumKernel SSE2_KERNEL = {"sse2", sumSse2, copySumSse2};
+static const ChecksumKernel AVX2_KERNEL = {"avx2", sumAvx2, copySumAvx2};
+#endif
+
+std::vector<const ChecksumKernel*> checksumKernels() {
+    std::vector<const ChecksumKernel*> kernels = {&SCALAR_KERNEL};
+#if CHECKSUM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.push_back(&SSE2_KERNEL);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back(&AVX2_KERNEL);
+    }
+#endif
+    return kernels;
+}
+
+const ChecksumKernel& checksumKernel() {
+    static const ChecksumKernel* selected = checksumKernels().back();
+    return *selected;
+}
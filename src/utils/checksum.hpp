@@ -0,0 +1,191 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Internet checksum (RFC 1071): the ones' complement of the ones' complement sum of
+   the data as big-endian 16-bit words, an odd trailing byte padded with zero.
+   All values here are host order, store them with htons or byte by byte.
+
+   the summation over raw bytes is one engine for every protocol: a 64-bit scalar loop
+   and SSE2/AVX2 kernels, the widest one the CPU runs picked once at first use. the
+   kernels add the words in native byte order, which the ones' complement sum allows,
+   and swap the folded result once at the end */
+struct ChecksumKernel {
+    const char* name;
+    // folded (not complemented) sum of the data's big-endian 16-bit words
+    uint16_t (*sum)(const uint8_t* data, size_t length);
+    // the same sum taken while copying the data to dst, one pass over the bytes
+    uint16_t (*copySum)(uint8_t* dst, const uint8_t* src, size_t length);
+};
+
+const ChecksumKernel& checksumKernel();
+// every kernel this CPU can run, scalar first and the selected one last
+std::vector<const ChecksumKernel*> checksumKernels();
+
+inline uint16_t checksumFold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(sum);
+}
+
+/* native-order accumulation the kernels finish with and short buffers use on their
+   own: 8-byte words as two 32-bit halves into 64 bits, then fixed-size pieces for the
+   last 7 bytes, an odd one landing where RFC 1071 pads it once the sum is swapped */
+inline uint64_t checksumAddNative(uint64_t sum, const uint8_t* data, size_t length) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        sum += (word & 0xFFFFFFFF) + (word >> 32);
+    }
+    if (length & 4) {
+        uint32_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        sum += word;
+        i += 4;
+    }
+    if (length & 2) {
+        uint16_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        sum += word;
+        i += 2;
+    }
+    if (length & 1) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        sum += data[i];
+#else
+        sum += static_cast<uint64_t>(data[i]) << 8;
+#endif
+    }
+    return sum;
+}
+
+// folds a native-order sum to 16 bits and swaps it to the big-endian word sum
+inline uint16_t checksumFoldNative(uint64_t sum) {
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    uint16_t folded = checksumFold(static_cast<uint32_t>(sum));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    folded = static_cast<uint16_t>((folded << 8) | (folded >> 8));
+#endif
+    return folded;
+}
+
+// shorter buffers (headers, addresses) are summed inline, a kernel call costs more than the sum
+constexpr size_t CHECKSUM_INLINE_BYTES = 64;
+
+// adds the bytes' 16-bit words to a running sum without folding it, any length
+inline uint32_t checksumAdd(uint32_t sum, const uint8_t* data, size_t length) {
+    if (length < CHECKSUM_INLINE_BYTES) {
+        return sum + checksumFoldNative(checksumAddNative(0, data, length));
+    }
+    return sum + checksumKernel().sum(data, length);
+}
+
+// copies length bytes to dst and adds them to sum like checksumAdd
+inline uint32_t checksumCopy(uint32_t sum, uint8_t* dst, const uint8_t* src, size_t length) {
+    if (length < CHECKSUM_INLINE_BYTES) {
+        std::memcpy(dst, src, length);
+        return checksumAdd(sum, dst, length);
+    }
+    return sum + checksumKernel().copySum(dst, src, length);
+}
+
+inline uint16_t internetChecksum(const uint8_t* data, size_t length) {
+    return static_cast<uint16_t>(~checksumFold(checksumAdd(0, data, length)));
+}
+
+// checksum of an IPv4 header from scratch, skipping the checksum field it carries
+inline uint16_t ipv4HeaderChecksum(const uint8_t* header, size_t header_length) {
+    uint64_t sum = checksumAddNative(0, header, 10);
+    sum = checksumAddNative(sum, header + 12, header_length - 12);
+    return static_cast<uint16_t>(~checksumFoldNative(sum));
+}
+
+// pseudo-header of a TCP or UDP segment over IPv4 (RFC 793, RFC 768), addresses in host order
+inline uint32_t pseudoHeaderSum(uint32_t src_ip, uint32_t dst_ip, uint8_t protocol, size_t length) {
+    return (src_ip >> 16) + (src_ip & 0xFFFF) + (dst_ip >> 16) + (dst_ip & 0xFFFF) + protocol +
+           static_cast<uint32_t>(length >> 16) + static_cast<uint32_t>(length & 0xFFFF);
+}
+
+// pseudo-header over IPv6 (RFC 8200 section 8.1), addresses as their 16 bytes on the wire
+inline uint32_t pseudoHeaderSum6(const uint8_t* src_ip, const uint8_t* dst_ip, uint8_t next_header, size_t length) {
+    uint32_t sum = checksumAdd(checksumAdd(0, src_ip, 16), dst_ip, 16);
+    return sum + next_header + static_cast<uint32_t>(length >> 16) + static_cast<uint32_t>(length & 0xFFFF);
+}
+
+// checksum of a transport segment (with its checksum field zeroed) behind a pseudo-header sum
+inline uint16_t segmentChecksum(uint32_t pseudo_sum, const uint8_t* segment, size_t length) {
+    return static_cast<uint16_t>(~checksumFold(checksumAdd(pseudo_sum, segment, length)));
+}
+
+/* RFC 1624 incremental update after one 16-bit word of the covered data changed from
+   old_word to new_word, eqn. 3: HC' = ~(~HC + ~m + m'). unlike eqn. 2 of RFC 1141 it
+   never produces 0xFFFF (-0) for a field a full recomputation would set to 0x0000 */
+inline uint16_t checksumAdjust(uint16_t checksum, uint16_t old_word, uint16_t new_word) {
+    uint32_t sum = static_cast<uint16_t>(~checksum);
+    sum += static_cast<uint16_t>(~old_word);
+    sum += new_word;
+    return static_cast<uint16_t>(~checksumFold(sum));
+}
+
+// the same for a 32-bit field (an IPv4 address), both of its words changed at once
+inline uint16_t checksumAdjust32(uint16_t checksum, uint32_t old_value, uint32_t new_value) {
+    uint32_t sum = static_cast<uint16_t>(~checksum);
+    sum += static_cast<uint16_t>(~(old_value >> 16)) + static_cast<uint16_t>(~old_value);
+    sum += (new_value >> 16) + (new_value & 0xFFFF);
+    return static_cast<uint16_t>(~checksumFold(sum));
+}
+
+/* ingress check of an IHL 5 header: summed with its checksum field a valid header
+   gives 0xFFFF. the ones' complement sum does not depend on byte order, so the words
+   are added as loaded, five 32-bit loads into 64 bits and folded once */
+inline bool ipv4Header20ChecksumOk(const uint8_t* header) {
+    uint32_t words[5];
+    std::memcpy(words, header, sizeof(words));
+    uint64_t sum = static_cast<uint64_t>(words[0]) + words[1] + words[2] + words[3] + words[4];
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    return checksumFold(static_cast<uint32_t>((sum & 0xFFFFFFFF) + (sum >> 32))) == 0xFFFF;
+}
+
+/* the same check over a burst of IHL 5 headers, ok[i] = 1 for the valid ones. with
+   SSE2 four headers go through together: each one's first 16 bytes widen to 32-bit
+   lanes, a transpose-add leaves one header sum per lane, the last 4 bytes of each are
+   added and all four sums folded and compared at once */
+inline void ipv4Header20ChecksumsOk(const uint8_t* const* headers, size_t count, uint8_t* ok) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low16 = _mm_set1_epi32(0xFFFF);
+    for (; i + 4 <= count; i += 4) {
+        __m128i sums[4];
+        uint32_t tails[4];
+        for (size_t k = 0; k < 4; k++) {
+            __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(headers[i + k]));
+            sums[k] = _mm_add_epi32(_mm_unpacklo_epi16(words, zero), _mm_unpackhi_epi16(words, zero));
+            std::memcpy(&tails[k], headers[i + k] + 16, sizeof(tails[k]));
+        }
+        __m128i t0 = _mm_add_epi32(_mm_unpacklo_epi32(sums[0], sums[1]), _mm_unpackhi_epi32(sums[0], sums[1]));
+        __m128i t1 = _mm_add_epi32(_mm_unpacklo_epi32(sums[2], sums[3]), _mm_unpackhi_epi32(sums[2], sums[3]));
+        __m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1));
+        __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tails));
+        sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_and_si128(tail, low16), _mm_srli_epi32(tail, 16)));
+        // ten words stay below 2^20, two folds bring every lane into 16 bits
+        sum = _mm_add_epi32(_mm_and_si128(sum, low16), _mm_srli_epi32(sum, 16));
+        sum = _mm_add_epi32(_mm_and_si128(sum, low16), _mm_srli_epi32(sum, 16));
+        int valid = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(sum, low16)));
+        for (size_t k = 0; k < 4; k++) {
+            ok[i + k] = static_cast<uint8_t>((valid >> k) & 1);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        ok[i] = ipv4Header20ChecksumOk(headers[i]);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/* append-only array whose elements never move once written.
+   storage grows in fixed-size chunks hung off a directory that is sized up front, so a
+   single writer can append while readers index published elements without locks.
+   an element is published by handing its index to readers after append() returns */
+template <typename T, unsigned ChunkBits = 12>
+class ChunkedArray {
+public:
+    static constexpr size_t CHUNK_SIZE = size_t(1) << ChunkBits;
+
+    explicit ChunkedArray(size_t max_elements)
+        : directory((max_elements + CHUNK_SIZE - 1) / CHUNK_SIZE) {}
+
+    ~ChunkedArray() {
+        for (auto& chunk : directory) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    ChunkedArray(const ChunkedArray&) = delete;
+    ChunkedArray& operator=(const ChunkedArray&) = delete;
+
+    // returns the new element's index, or SIZE_MAX when the directory is full
+    size_t append(const T& value) {
+        size_t index = count.load(std::memory_order_relaxed);
+        size_t chunk = index >> ChunkBits;
+        if (chunk >= directory.size()) {
+            return SIZE_MAX;
+        }
+        T* storage = directory[chunk].load(std::memory_order_relaxed);
+        if (!storage) {
+            storage = new T[CHUNK_SIZE];
+            directory[chunk].store(storage, std::memory_order_release);
+        }
+        storage[index & (CHUNK_SIZE - 1)] = value;
+        count.store(index + 1, std::memory_order_release);
+        return index;
+    }
+
+    // overwrites an existing element, only for slots no reader can reach any more
+    void assign(size_t index, const T& value) {
+        directory[index >> ChunkBits].load(std::memory_order_relaxed)[index & (CHUNK_SIZE - 1)] = value;
+    }
+
+    /* a published element updated in place, for word-sized values that readers load with
+       the __atomic builtins while the writer stores them the same way */
+    T& element(size_t index) {
+        return directory[index >> ChunkBits].load(std::memory_order_relaxed)[index & (CHUNK_SIZE - 1)];
+    }
+
+    const T& operator[](size_t index) const {
+        return directory[index >> ChunkBits].load(std::memory_order_acquire)[index & (CHUNK_SIZE - 1)];
+    }
+
+    size_t size() const { return count.load(std::memory_order_acquire); }
+    size_t capacity() const { return directory.size() * CHUNK_SIZE; }
+
+private:
+    std::vector<std::atomic<T*>> directory;
+    std::atomic<size_t> count{0};
+};
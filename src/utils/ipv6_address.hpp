@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <arpa/inet.h>
+
+/* 128-bit address in network byte order, the layout it has on the wire.
+   the IPv6 FIB walks it a byte at a time, so no conversion is ever needed */
+struct IPv6Address {
+    uint8_t bytes[16];
+
+    bool operator==(const IPv6Address& other) const { return std::memcmp(bytes, other.bytes, 16) == 0; }
+    bool operator!=(const IPv6Address& other) const { return !(*this == other); }
+    bool isZero() const {
+        static const uint8_t zero[16] = {};
+        return std::memcmp(bytes, zero, 16) == 0;
+    }
+
+    // keeps the first prefix_len bits and clears the rest
+    IPv6Address masked(uint8_t prefix_len) const {
+        IPv6Address result = {};
+        size_t full = prefix_len / 8;
+        std::memcpy(result.bytes, bytes, full);
+        if (full < 16 && (prefix_len % 8) != 0) {
+            result.bytes[full] = bytes[full] & static_cast<uint8_t>(0xFF << (8 - prefix_len % 8));
+        }
+        return result;
+    }
+
+    // the two 64-bit halves in host order, for hashing and ordering
+    uint64_t high() const { return load64(bytes); }
+    uint64_t low() const { return load64(bytes + 8); }
+
+    // returns false for a malformed address
+    static bool parse(const std::string& text, IPv6Address& address) {
+        return inet_pton(AF_INET6, text.c_str(), address.bytes) == 1;
+    }
+
+    std::string toString() const {
+        char buffer[INET6_ADDRSTRLEN];
+        inet_ntop(AF_INET6, bytes, buffer, sizeof(buffer));
+        return buffer;
+    }
+
+private:
+    static uint64_t load64(const uint8_t* p) {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; i++) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+};
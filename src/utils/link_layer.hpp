@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "packet_view.hpp"
+
+/* the link layer around the IP packets the pipeline forwards: where the packet starts
+   in an Ethernet frame and where it ends, whatever padding the frame carries */
+
+constexpr size_t ETHERNET_HEADER_SIZE = 14;
+constexpr size_t ETHERNET_ADDRESS_SIZE = 6;
+constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+constexpr uint16_t ETHERTYPE_IPV6 = 0x86DD;
+constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+constexpr uint16_t ETHERTYPE_QINQ = 0x88A8;
+
+// what follows the Ethernet header and any 802.1Q/802.1ad tags, ethertype says what it is
+inline PacketView ethernetPayload(PacketView frame, uint16_t& ethertype) {
+    size_t header = 2 * ETHERNET_ADDRESS_SIZE;
+    ethertype = frame.u16(header);
+    while (ethertype == ETHERTYPE_VLAN || ethertype == ETHERTYPE_QINQ) {
+        header += 4;
+        ethertype = frame.u16(header);
+    }
+    return frame.from(header + 2);
+}
+
+/* the IPv4 or IPv6 packet at the start of payload when ethertype and version agree,
+   cut to its own length so link-layer padding is not part of it. empty for anything
+   else. a length that does not fit is left for ingress validation to judge */
+inline PacketView ipPacket(PacketView payload, uint16_t ethertype) {
+    uint8_t version = payload.u8(0) >> 4;
+    size_t length = 0;
+    if (ethertype == ETHERTYPE_IPV4 && version == 4) {
+        length = payload.u16(2);
+    } else if (ethertype == ETHERTYPE_IPV6 && version == 6) {
+        length = 40 + static_cast<size_t>(payload.u16(4));
+    } else {
+        return PacketView();
+    }
+    return length >= 20 && length < payload.size() ? PacketView(payload.data(), length) : payload;
+}
@@ -0,0 +1,98 @@
+#include "mapped_file.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : base(other.base), length(other.length) {
+    other.base = nullptr;
+    other.length = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        base = other.base;
+        length = other.length;
+        other.base = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& path, Mode mode) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        log_error("Failed to open %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        log_error("Cannot map %s: empty or unreadable file", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    int prot = (mode == Mode::CopyOnWrite) ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    int flags = (mode == Mode::CopyOnWrite) ? MAP_PRIVATE : MAP_SHARED;
+    void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), prot, flags, fd, 0);
+    ::close(fd);   // the mapping keeps its own reference to the file
+
+    if (mapped == MAP_FAILED) {
+        log_error("mmap of %s failed: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    base = mapped;
+    length = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (base) {
+        munmap(base, length);
+        base = nullptr;
+        length = 0;
+    }
+}
+
+void MappedFile::adviseSequential() const {
+    if (base) {
+        madvise(base, length, MADV_SEQUENTIAL);
+    }
+}
+
+void MappedFile::release(size_t offset, size_t count) const {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t first = (offset + page - 1) / page * page;
+    size_t end = std::min(offset + count, length) / page * page;
+    if (base && first < end) {
+        madvise(data() + first, end - first, MADV_DONTNEED);
+    }
+}
+
+void MappedFile::prefetch(size_t offset, size_t count) const {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t first = offset / page * page;
+    size_t end = std::min(offset + count, length);
+    if (!base || first >= end) {
+        return;
+    }
+#ifdef MADV_POPULATE_READ
+    if (madvise(data() + first, end - first, MADV_POPULATE_READ) == 0) {
+        return;
+    }
+#endif
+    madvise(data() + first, end - first, MADV_WILLNEED);
+}
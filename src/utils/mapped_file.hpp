@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* RAII wrapper around a memory-mapped file.
+   ReadOnly maps the file shared and read-only. CopyOnWrite maps it private and
+   writable: writes land in anonymous copies of the touched pages and never reach
+   the file, so a mapped structure can still be updated in place */
+class MappedFile {
+public:
+    enum class Mode { ReadOnly, CopyOnWrite };
+
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const std::string& path, Mode mode = Mode::ReadOnly);
+    void close();
+
+    bool isOpen() const { return base != nullptr; }
+    uint8_t* data() const { return static_cast<uint8_t*>(base); }
+    size_t size() const { return length; }
+
+    // sequential access hint for streaming readers (pcap replay and such)
+    void adviseSequential() const;
+    /* drops the pages of [offset, offset + count) from this mapping, the whole pages
+       inside the range only. a ReadOnly mapping faults them back in from the page cache
+       if they are read again, so streaming readers keep their resident set bounded */
+    void release(size_t offset, size_t count) const;
+    /* maps [offset, offset + count) in one call ahead of the reader, much cheaper than a
+       page fault per page. only a readahead hint on kernels without MADV_POPULATE_READ */
+    void prefetch(size_t offset, size_t count) const;
+
+private:
+    void* base = nullptr;
+    size_t length = 0;
+};
@@ -3,74 +3,124 @@
 #include "tcp.hpp"
 #include "udp.hpp"
 #include "logger.hpp"
+#include "checksum.hpp"
 #include <stdexcept>
 #include <arpa/inet.h>
 #include <cstring>
 
 std::vector<uint8_t> IPv4PacketBuilder::createIPHeader(uint16_t total_length, uint8_t protocol) const {
     std::vector<uint8_t> ipv4header(IPv4_HEADER_SIZE);
+    writeIPHeader(ipv4header.data(), total_length, protocol, ipStringToInt(ipv4_src_ip), ipStringToInt(ipv4_dst_ip));
+    return ipv4header;
+}
 
-    ipv4header[0] = 0x45;                                        // Version (4) + IHL (5) - 20 byte header
-    ipv4header[1] = ipv4_tos;                                    // Type of Service
-    ipv4header[2] = (total_length >> 8) & 0xFF;                  // Total Length (high byte)
-    ipv4header[3] = total_length & 0xFF;                         // Total Length (low byte)
-    ipv4header[4] = (ipv4_identification >> 8) & 0xFF;           // Identification (high byte)
-    ipv4header[5] = ipv4_identification & 0xFF;                  // Identification (low byte)
-    ipv4header[6] = (ipv4_flags_fragment_offset >> 8) & 0xFF;    // Flags + Fragment Offset (high)
-    ipv4header[7] = ipv4_flags_fragment_offset & 0xFF;           // Fragment Offset (low)
-    ipv4header[8] = ipv4_ttl;                                    // TTL
-    ipv4header[9] = protocol;                                    // Protocol
-    ipv4header[10] = 0x00;                                       // Header Checksum (high byte) - to be calculated
-    ipv4header[11] = 0x00;                                       // Header Checksum (low byte) - to be calculated
+void IPv4PacketBuilder::writeIPHeader(uint8_t* out, uint16_t total_length, uint8_t protocol,
+                                      uint32_t src_ip, uint32_t dst_ip) const {
+    out[0] = 0x45;                                        // Version (4) + IHL (5) - 20 byte header
+    out[1] = ipv4_tos;                                    // Type of Service
+    out[2] = (total_length >> 8) & 0xFF;                  // Total Length (high byte)
+    out[3] = total_length & 0xFF;                         // Total Length (low byte)
+    out[4] = (ipv4_identification >> 8) & 0xFF;           // Identification (high byte)
+    out[5] = ipv4_identification & 0xFF;                  // Identification (low byte)
+    out[6] = (ipv4_flags_fragment_offset >> 8) & 0xFF;    // Flags + Fragment Offset (high)
+    out[7] = ipv4_flags_fragment_offset & 0xFF;           // Fragment Offset (low)
+    out[8] = ipv4_ttl;                                    // TTL
+    out[9] = protocol;                                    // Protocol
+    out[10] = 0x00;                                       // Header Checksum (high byte) - to be calculated
+    out[11] = 0x00;                                       // Header Checksum (low byte) - to be calculated
 
     // convert source/destination IP to network byte order
-    uint32_t src_ip_int = htonl(ipStringToInt(ipv4_src_ip));
-    uint32_t dst_ip_int = htonl(ipStringToInt(ipv4_dst_ip));
+    uint32_t src_ip_int = htonl(src_ip);
+    uint32_t dst_ip_int = htonl(dst_ip);
 
-    std::memcpy(&ipv4header[12], &src_ip_int, sizeof(src_ip_int));
-    std::memcpy(&ipv4header[16], &dst_ip_int, sizeof(dst_ip_int));
+    std::memcpy(&out[12], &src_ip_int, sizeof(src_ip_int));
+    std::memcpy(&out[16], &dst_ip_int, sizeof(dst_ip_int));
 
     // calculate checksum
-    uint32_t sum = 0;
-    for (size_t i = 0; i < IPv4_HEADER_SIZE; i += 2) {
-        sum += (ipv4header[i] << 8) + ipv4header[i + 1];
-    }
+    uint16_t checksum = ipv4HeaderChecksum(out, IPv4_HEADER_SIZE);
+    out[10] = (checksum >> 8) & 0xFF;
+    out[11] = checksum & 0xFF;
+}
 
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
+// dotted quad to a host-order address, no allocation or exception on the way
+static bool parseIPv4(const std::string& ip, uint32_t& address) {
+    struct in_addr parsed;
+    if (inet_pton(AF_INET, ip.c_str(), &parsed) != 1) {
+        return false;
     }
-    sum = ~sum;
+    address = ntohl(parsed.s_addr);
+    return true;
+}
 
-    ipv4header[10] = (sum >> 8) & 0xFF;
-    ipv4header[11] = sum & 0xFF;
+uint32_t IPv4PacketBuilder::ipStringToInt(const std::string& ip) const {
+    uint32_t address;
+    if (!parseIPv4(ip, address)) {
+        throw std::invalid_argument("Invalid IP address format");
+    }
+    return address;
+}
 
-    return ipv4header;
+bool IPv4PacketBuilder::resolveAddresses() {
+    resolved = false;
+    if (!parseIPv4(ipv4_src_ip, resolved_src_ip) || !parseIPv4(ipv4_dst_ip, resolved_dst_ip)) {
+        log_error("Cannot resolve packet addresses (src: %s, dst: %s)", ipv4_src_ip.c_str(), ipv4_dst_ip.c_str());
+        return false;
+    }
+    resolved = true;
+    return true;
 }
 
-uint32_t IPv4PacketBuilder::ipStringToInt(const std::string& ip) const {
-    uint32_t result = 0;
-    size_t start = 0;
-    int shift = 24;
-
-    for (int i = 0; i < 4; i++) {
-        size_t dot = ip.find('.', start);
-        if (dot == std::string::npos && i < 3) {
-            throw std::invalid_argument("Invalid IP address format");
-        }
+bool IPv4PacketBuilder::hostAddresses(uint32_t& src_ip, uint32_t& dst_ip) const {
+    if (resolved) {
+        src_ip = resolved_src_ip;
+        dst_ip = resolved_dst_ip;
+        return true;
+    }
+    if (!parseIPv4(ipv4_src_ip, src_ip) || !parseIPv4(ipv4_dst_ip, dst_ip)) {
+        log_error("Invalid IP address format (src: %s, dst: %s) - dropping packet", ipv4_src_ip.c_str(), ipv4_dst_ip.c_str());
+        return false;
+    }
+    return true;
+}
 
-        std::string part = (i == 3) ? ip.substr(start) : ip.substr(start, dot - start);
-        uint32_t ip_byte = std::stoi(part);
+PacketHandle toPacketBuffer(PacketPool& pool, const std::vector<uint8_t>& packet) {
+    if (packet.empty()) {
+        return PacketHandle();
+    }
+    PacketHandle buffer = pool.copyIn(packet.data(), packet.size());
+    if (!buffer) {
+        log_error("No packet buffer for a %zu byte packet", packet.size());
+    }
+    return buffer;
+}
 
-        if (ip_byte > 255) {
-            throw std::invalid_argument("Invalid IP address: byte value > 255");
-        }
+// buildInto straight into a pooled buffer's data room
+template <typename Builder>
+static PacketHandle buildInPool(PacketPool& pool, const Builder& builder) {
+    PacketHandle buffer = pool.alloc();
+    if (!buffer) {
+        log_error("No packet buffer for a %zu byte packet", builder.size());
+        return PacketHandle();
+    }
+    size_t length = builder.buildInto(buffer->data(), buffer->tailroom());
+    if (length == 0) {
+        return PacketHandle();
+    }
+    buffer->append(length);
+    return buffer;
+}
 
-        result |= (ip_byte << shift);
-        shift -= 8;
-        start = dot + 1;
+// total length field and caller's buffer both have to hold the packet
+static bool packetFits(size_t length, size_t capacity, const char* protocol) {
+    if (length > 0xFFFF || length > capacity) {
+        log_error("No room for a %zu byte %s packet (%zu bytes) - dropping packet", length, protocol, capacity);
+        return false;
     }
+    return true;
+}
 
-    return result;
+static const uint8_t* payloadBytes(const std::string& payload) {
+    return reinterpret_cast<const uint8_t*>(payload.data());
 }
 
 std::vector<uint8_t> ICMPPacketBuilder::build() const {
@@ -88,7 +138,7 @@ std::vector<uint8_t> ICMPPacketBuilder::build() const {
         packet.insert(packet.end(), payload_data.begin(), payload_data.end());
 
         // calculate checksum of ICMP header + payload
-        uint16_t checksum = ICMP::calculateChecksum(std::vector<uint8_t>(IPv4_HEADER_SIZE + packet.begin(), packet.end()));
+        uint16_t checksum = ICMP::calculateChecksum(packet.data() + IPv4_HEADER_SIZE, packet.size() - IPv4_HEADER_SIZE);
         packet[IPv4_HEADER_SIZE + ICMP_CHECKSUM_OFFSET] = (checksum >> 8) & 0xFF;
         packet[IPv4_HEADER_SIZE + ICMP_CHECKSUM_OFFSET + 1] = checksum & 0xFF;
 
@@ -100,10 +150,38 @@ std::vector<uint8_t> ICMPPacketBuilder::build() const {
     }
 }
 
+PacketHandle ICMPPacketBuilder::build(PacketPool& pool) const {
+    return buildInPool(pool, *this);
+}
+
+size_t ICMPPacketBuilder::buildInto(uint8_t* out, size_t capacity) const {
+    size_t length = size();
+    uint32_t src_ip, dst_ip;
+    if (!packetFits(length, capacity, "ICMP") || !hostAddresses(src_ip, dst_ip)) {
+        return 0;
+    }
+    writeIPHeader(out, length, PROTOCOL_ICMP, src_ip, dst_ip);
+
+    // filled here, ICMP::createHeader names the type for its debug line and allocates
+    uint8_t* icmp = out + IPv4_HEADER_SIZE;
+    ICMPHeader header = {};
+    header.type = icmp_type;
+    header.identifier = icmp_id;
+    header.sequence = icmp_seq;
+    ICMP::writeHeader(icmp, header);
+
+    // the payload is summed on its way in, ICMP over IPv4 has no pseudo-header
+    uint32_t sum = checksumAdd(0, icmp, ICMP_HEADER_SIZE);
+    sum = checksumCopy(sum, icmp + ICMP_HEADER_SIZE, payloadBytes(icmp_payload), icmp_payload.size());
+    store16(icmp + ICMP_CHECKSUM_OFFSET, static_cast<uint16_t>(~checksumFold(sum)));
+    return length;
+}
+
 std::vector<uint8_t> TCPPacketBuilder::build() const {
     try {
         // create TCP header
         TCPHeader tcp_header = TCP::createHeader(tcp_src_port, tcp_dst_port, tcp_flags);
+        tcp_header.seq_number = tcp_seq;
         std::vector<uint8_t> tcp_data = TCP::serializeHeader(tcp_header);
 
         // serialize TCP payload
@@ -115,7 +193,8 @@ std::vector<uint8_t> TCPPacketBuilder::build() const {
         packet.insert(packet.end(), payload_data.begin(), payload_data.end());
 
         // calculate checksum of TCP header + payload
-        uint16_t tcp_checksum = TCP::calculateChecksum(ipStringToInt(ipv4_src_ip), ipStringToInt(ipv4_dst_ip), std::vector<uint8_t>(IPv4_HEADER_SIZE + packet.begin(), packet.end()));
+        uint16_t tcp_checksum = TCP::calculateChecksum(ipStringToInt(ipv4_src_ip), ipStringToInt(ipv4_dst_ip),
+                                                       packet.data() + IPv4_HEADER_SIZE, packet.size() - IPv4_HEADER_SIZE);
         packet[IPv4_HEADER_SIZE + TCP_CHECKSUM_OFFSET] = (tcp_checksum >> 8) & 0xFF;
         packet[IPv4_HEADER_SIZE + TCP_CHECKSUM_OFFSET + 1] = tcp_checksum & 0xFF;
 
@@ -127,6 +206,30 @@ std::vector<uint8_t> TCPPacketBuilder::build() const {
     }
 }
 
+PacketHandle TCPPacketBuilder::build(PacketPool& pool) const {
+    return buildInPool(pool, *this);
+}
+
+size_t TCPPacketBuilder::buildInto(uint8_t* out, size_t capacity) const {
+    size_t length = size();
+    uint32_t src_ip, dst_ip;
+    if (!packetFits(length, capacity, "TCP") || !hostAddresses(src_ip, dst_ip)) {
+        return 0;
+    }
+    writeIPHeader(out, length, PROTOCOL_TCP, src_ip, dst_ip);
+
+    uint8_t* tcp = out + IPv4_HEADER_SIZE;
+    TCPHeader header = TCP::createHeader(tcp_src_port, tcp_dst_port, tcp_flags);
+    header.seq_number = tcp_seq;
+    TCP::writeHeader(tcp, header);
+
+    size_t segment_length = length - IPv4_HEADER_SIZE;
+    uint32_t sum = checksumAdd(pseudoHeaderSum(src_ip, dst_ip, PROTOCOL_TCP, segment_length), tcp, TCP_HEADER_SIZE);
+    sum = checksumCopy(sum, tcp + TCP_HEADER_SIZE, payloadBytes(tcp_payload), tcp_payload.size());
+    store16(tcp + TCP_CHECKSUM_OFFSET, static_cast<uint16_t>(~checksumFold(sum)));
+    return length;
+}
+
 std::vector<uint8_t> UDPPacketBuilder::build() const {
     try {
         // serialize UDP payload
@@ -142,7 +245,12 @@ std::vector<uint8_t> UDPPacketBuilder::build() const {
         packet.insert(packet.end(), payload_data.begin(), payload_data.end());
 
         // calculate checksum of UDP header + payload
-        uint16_t udp_checksum = UDP::calculateChecksum(ipStringToInt(ipv4_src_ip), ipStringToInt(ipv4_dst_ip), std::vector<uint8_t>(IPv4_HEADER_SIZE + packet.begin(), packet.end()));
+        uint16_t udp_checksum = UDP::calculateChecksum(ipStringToInt(ipv4_src_ip), ipStringToInt(ipv4_dst_ip),
+                                                       packet.data() + IPv4_HEADER_SIZE, packet.size() - IPv4_HEADER_SIZE);
+        // zero would mean no checksum at all, a computed zero is sent as all ones
+        if (udp_checksum == 0) {
+            udp_checksum = 0xFFFF;
+        }
         packet[IPv4_HEADER_SIZE + UDP_CHECKSUM_OFFSET] = (udp_checksum >> 8) & 0xFF;
         packet[IPv4_HEADER_SIZE + UDP_CHECKSUM_OFFSET + 1] = udp_checksum & 0xFF;
 
@@ -153,3 +261,288 @@ std::vector<uint8_t> UDPPacketBuilder::build() const {
         return {};
     }
 }
+
+PacketHandle UDPPacketBuilder::build(PacketPool& pool) const {
+    return buildInPool(pool, *this);
+}
+
+size_t UDPPacketBuilder::buildInto(uint8_t* out, size_t capacity) const {
+    size_t length = size();
+    uint32_t src_ip, dst_ip;
+    if (!packetFits(length, capacity, "UDP") || !hostAddresses(src_ip, dst_ip)) {
+        return 0;
+    }
+    writeIPHeader(out, length, PROTOCOL_UDP, src_ip, dst_ip);
+
+    uint8_t* udp = out + IPv4_HEADER_SIZE;
+    UDP::writeHeader(udp, UDP::createHeader(udp_src_port, udp_dst_port, udp_payload.size()));
+
+    size_t segment_length = length - IPv4_HEADER_SIZE;
+    uint32_t sum = checksumAdd(pseudoHeaderSum(src_ip, dst_ip, PROTOCOL_UDP, segment_length), udp, UDP_HEADER_SIZE);
+    sum = checksumCopy(sum, udp + UDP_HEADER_SIZE, payloadBytes(udp_payload), udp_payload.size());
+    uint16_t checksum = static_cast<uint16_t>(~checksumFold(sum));
+    store16(udp + UDP_CHECKSUM_OFFSET, checksum == 0 ? 0xFFFF : checksum);
+    return length;
+}
+
+std::vector<uint8_t> IPv6PacketBuilder::createIPv6Header(uint16_t payload_length, uint8_t next_header) const {
+    std::vector<uint8_t> ipv6header(IPv6_HEADER_SIZE);
+
+    uint32_t version_class_flow = (6u << 28) | (static_cast<uint32_t>(ipv6_traffic_class) << 20) |
+                                  (ipv6_flow_label & 0xFFFFF);
+    ipv6header[0] = (version_class_flow >> 24) & 0xFF;          // Version (6) + Traffic Class (high)
+    ipv6header[1] = (version_class_flow >> 16) & 0xFF;          // Traffic Class (low) + Flow Label (high)
+    ipv6header[2] = (version_class_flow >> 8) & 0xFF;           // Flow Label
+    ipv6header[3] = version_class_flow & 0xFF;                  // Flow Label (low byte)
+    ipv6header[4] = (payload_length >> 8) & 0xFF;               // Payload Length (high byte)
+    ipv6header[5] = payload_length & 0xFF;                      // Payload Length (low byte)
+    ipv6header[6] = next_header;                                // Next Header
+    ipv6header[7] = ipv6_hop_limit;                             // Hop Limit
+
+    // addresses are kept in network byte order already, no checksum in the IPv6 header
+    IPv6Address src = parseAddress(ipv6_src_ip);
+    IPv6Address dst = parseAddress(ipv6_dst_ip);
+    std::memcpy(&ipv6header[8], src.bytes, sizeof(src.bytes));
+    std::memcpy(&ipv6header[24], dst.bytes, sizeof(dst.bytes));
+
+    return ipv6header;
+}
+
+uint16_t IPv6PacketBuilder::transportChecksum(const std::vector<uint8_t>& segment, uint8_t next_header) const {
+    IPv6Address src = parseAddress(ipv6_src_ip);
+    IPv6Address dst = parseAddress(ipv6_dst_ip);
+
+    // pseudo-header: source, destination, upper-layer length (32 bits), zeros + next header
+    uint32_t pseudo_sum = pseudoHeaderSum6(src.bytes, dst.bytes, next_header, segment.size());
+    return segmentChecksum(pseudo_sum, segment.data(), segment.size());
+}
+
+IPv6Address IPv6PacketBuilder::parseAddress(const std::string& address) const {
+    IPv6Address result;
+    if (!IPv6Address::parse(address, result)) {
+        throw std::invalid_argument("Invalid IPv6 address format");
+    }
+    return result;
+}
+
+std::vector<uint8_t> ICMPv6PacketBuilder::build() const {
+    try {
+        // echo messages use the same 8-byte header as ICMP
+        ICMPHeader icmp_header_templ = ICMP::createHeader(icmp_type, icmp_id, icmp_seq);
+        std::vector<uint8_t> segment = ICMP::serializeHeader(icmp_header_templ);
+        segment.insert(segment.end(), icmp_payload.begin(), icmp_payload.end());
+
+        // unlike ICMP for IPv4 the checksum covers the pseudo-header as well
+        uint16_t checksum = transportChecksum(segment, PROTOCOL_ICMPV6);
+        segment[ICMP_CHECKSUM_OFFSET] = (checksum >> 8) & 0xFF;
+        segment[ICMP_CHECKSUM_OFFSET + 1] = checksum & 0xFF;
+
+        std::vector<uint8_t> packet = createIPv6Header(segment.size(), PROTOCOL_ICMPV6);
+        packet.insert(packet.end(), segment.begin(), segment.end());
+
+        log_debug("Built ICMPv6 packet: %zu bytes total", packet.size());
+        return packet;
+    } catch (const std::exception& e) {
+        log_error("Failed to build ICMPv6 packet: %s (src: %s, dst: %s) - dropping packet", e.what(), ipv6_src_ip.c_str(), ipv6_dst_ip.c_str());
+        return {};
+    }
+}
+
+std::vector<uint8_t> TCPv6PacketBuilder::build() const {
+    try {
+        TCPHeader tcp_header = TCP::createHeader(tcp_src_port, tcp_dst_port, tcp_flags);
+        std::vector<uint8_t> segment = TCP::serializeHeader(tcp_header);
+        segment.insert(segment.end(), tcp_payload.begin(), tcp_payload.end());
+
+        uint16_t tcp_checksum = transportChecksum(segment, PROTOCOL_TCP);
+        segment[TCP_CHECKSUM_OFFSET] = (tcp_checksum >> 8) & 0xFF;
+        segment[TCP_CHECKSUM_OFFSET + 1] = tcp_checksum & 0xFF;
+
+        std::vector<uint8_t> packet = createIPv6Header(segment.size(), PROTOCOL_TCP);
+        packet.insert(packet.end(), segment.begin(), segment.end());
+
+        log_debug("Built TCPv6 packet: %zu bytes total", packet.size());
+        return packet;
+    } catch (const std::exception& e) {
+        log_error("Failed to build TCPv6 packet: %s (src: %s, dst: %s) - dropping packet", e.what(), ipv6_src_ip.c_str(), ipv6_dst_ip.c_str());
+        return {};
+    }
+}
+
+std::vector<uint8_t> UDPv6PacketBuilder::build() const {
+    try {
+        UDPHeader udp_header = UDP::createHeader(udp_src_port, udp_dst_port, udp_payload.size());
+        std::vector<uint8_t> segment = UDP::serializeHeader(udp_header);
+        segment.insert(segment.end(), udp_payload.begin(), udp_payload.end());
+
+        // the UDP checksum is mandatory over IPv6, a computed zero is sent as all ones
+        uint16_t udp_checksum = transportChecksum(segment, PROTOCOL_UDP);
+        if (udp_checksum == 0) {
+            udp_checksum = 0xFFFF;
+        }
+        segment[UDP_CHECKSUM_OFFSET] = (udp_checksum >> 8) & 0xFF;
+        segment[UDP_CHECKSUM_OFFSET + 1] = udp_checksum & 0xFF;
+
+        std::vector<uint8_t> packet = createIPv6Header(segment.size(), PROTOCOL_UDP);
+        packet.insert(packet.end(), segment.begin(), segment.end());
+
+        log_debug("Built UDPv6 packet: %zu bytes total", packet.size());
+        return packet;
+    } catch (const std::exception& e) {
+        log_error("Failed to build UDPv6 packet: %s (src: %s, dst: %s) - dropping packet", e.what(), ipv6_src_ip.c_str(), ipv6_dst_ip.c_str());
+        return {};
+    }
+}
+
+bool PacketTemplate::load(size_t built) {
+    protocol_number = 0;
+    if (built == 0) {
+        bytes.clear();
+        return false;
+    }
+    protocol_number = bytes[9];
+    switch (protocol_number) {
+        case PROTOCOL_ICMP:
+            l4_checksum_offset = IPv4_HEADER_SIZE + ICMP_CHECKSUM_OFFSET;
+            break;
+        case PROTOCOL_TCP:
+            l4_checksum_offset = IPv4_HEADER_SIZE + TCP_CHECKSUM_OFFSET;
+            break;
+        default:
+            l4_checksum_offset = IPv4_HEADER_SIZE + UDP_CHECKSUM_OFFSET;
+            break;
+    }
+
+    // a copy with the checksums and every PacketFields word zeroed sums to the fixed part
+    std::vector<uint8_t> fixed = bytes;
+    uint8_t* l4 = fixed.data() + IPv4_HEADER_SIZE;
+    size_t segment_length = fixed.size() - IPv4_HEADER_SIZE;
+    std::memset(fixed.data() + 4, 0, 2);
+    std::memset(fixed.data() + 10, 0, 10);
+    std::memset(fixed.data() + l4_checksum_offset, 0, 2);
+    if (protocol_number == PROTOCOL_ICMP) {
+        std::memset(l4 + 4, 0, 4);
+    } else {
+        std::memset(l4, 0, protocol_number == PROTOCOL_UDP ? 4 : 8);
+    }
+    ip_fixed_sum = checksumFold(checksumAdd(0, fixed.data(), IPv4_HEADER_SIZE));
+    uint32_t pseudo_sum = protocol_number == PROTOCOL_ICMP ? 0 : pseudoHeaderSum(0, 0, protocol_number, segment_length);
+    l4_fixed_sum = checksumFold(checksumAdd(pseudo_sum, l4, segment_length));
+    return true;
+}
+
+size_t PacketTemplate::stamp(uint8_t* out, size_t capacity) const {
+    if (bytes.empty() || bytes.size() > capacity) {
+        return 0;
+    }
+    std::memcpy(out, bytes.data(), bytes.size());
+    return bytes.size();
+}
+
+PacketHandle PacketTemplate::stamp(PacketPool& pool) const {
+    return toPacketBuffer(pool, bytes);
+}
+
+size_t PacketTemplate::stamp(uint8_t* out, size_t capacity, const PacketFields& fields) const {
+    size_t length = stamp(out, capacity);
+    if (length == 0) {
+        return 0;
+    }
+    uint16_t src_high = static_cast<uint16_t>(fields.src_ip >> 16), src_low = static_cast<uint16_t>(fields.src_ip);
+    uint16_t dst_high = static_cast<uint16_t>(fields.dst_ip >> 16), dst_low = static_cast<uint16_t>(fields.dst_ip);
+    uint32_t addresses = src_high + src_low + dst_high + dst_low;
+    store16(out + 4, fields.identification);
+    store16(out + 12, src_high);
+    store16(out + 14, src_low);
+    store16(out + 16, dst_high);
+    store16(out + 18, dst_low);
+    store16(out + 10, static_cast<uint16_t>(~checksumFold(ip_fixed_sum + fields.identification + addresses)));
+
+    uint8_t* l4 = out + IPv4_HEADER_SIZE;
+    uint32_t l4_sum = l4_fixed_sum;
+    if (protocol_number == PROTOCOL_ICMP) {
+        uint16_t sequence = static_cast<uint16_t>(fields.seq);
+        store16(l4 + 4, fields.src_port);
+        store16(l4 + 6, sequence);
+        l4_sum += fields.src_port + sequence;
+    } else {
+        store16(l4, fields.src_port);
+        store16(l4 + 2, fields.dst_port);
+        l4_sum += addresses + fields.src_port + fields.dst_port;
+        if (protocol_number == PROTOCOL_TCP) {
+            store16(l4 + 4, static_cast<uint16_t>(fields.seq >> 16));
+            store16(l4 + 6, static_cast<uint16_t>(fields.seq));
+            l4_sum += (fields.seq >> 16) + (fields.seq & 0xFFFF);
+        }
+    }
+    uint16_t checksum = static_cast<uint16_t>(~checksumFold(l4_sum));
+    if (protocol_number == PROTOCOL_UDP && checksum == 0) {
+        checksum = 0xFFFF;
+    }
+    store16(out + l4_checksum_offset, checksum);
+    return length;
+}
+
+void PacketTemplate::setWord(uint8_t* packet, size_t offset, uint16_t value, bool in_ip_header, bool in_l4_checksum) const {
+    if (protocol_number == 0) {
+        return;
+    }
+    uint16_t old_value = load16(packet + offset);
+    store16(packet + offset, value);
+    if (in_ip_header) {
+        store16(packet + 10, checksumAdjust(load16(packet + 10), old_value, value));
+    }
+    if (!in_l4_checksum) {
+        return;
+    }
+    uint8_t* checksum = packet + l4_checksum_offset;
+    uint16_t adjusted = checksumAdjust(load16(checksum), old_value, value);
+    // a UDP checksum of zero reads as none, a computed zero goes out as all ones
+    if (protocol_number == PROTOCOL_UDP && adjusted == 0) {
+        adjusted = 0xFFFF;
+    }
+    store16(checksum, adjusted);
+}
+
+void PacketTemplate::setIdentification(uint8_t* packet, uint16_t identification) const {
+    setWord(packet, 4, identification, true, false);
+}
+
+void PacketTemplate::setSrcIp(uint8_t* packet, uint32_t src_ip) const {
+    // the addresses are in the TCP and UDP pseudo-headers, not in ICMP's checksum
+    bool pseudo_header = protocol_number != PROTOCOL_ICMP;
+    setWord(packet, 12, static_cast<uint16_t>(src_ip >> 16), true, pseudo_header);
+    setWord(packet, 14, static_cast<uint16_t>(src_ip), true, pseudo_header);
+}
+
+void PacketTemplate::setDstIp(uint8_t* packet, uint32_t dst_ip) const {
+    bool pseudo_header = protocol_number != PROTOCOL_ICMP;
+    setWord(packet, 16, static_cast<uint16_t>(dst_ip >> 16), true, pseudo_header);
+    setWord(packet, 18, static_cast<uint16_t>(dst_ip), true, pseudo_header);
+}
+
+void PacketTemplate::setSrcPort(uint8_t* packet, uint16_t port) const {
+    if (protocol_number == PROTOCOL_TCP || protocol_number == PROTOCOL_UDP) {
+        setWord(packet, IPv4_HEADER_SIZE, port, false, true);
+    }
+}
+
+void PacketTemplate::setDstPort(uint8_t* packet, uint16_t port) const {
+    if (protocol_number == PROTOCOL_TCP || protocol_number == PROTOCOL_UDP) {
+        setWord(packet, IPv4_HEADER_SIZE + 2, port, false, true);
+    }
+}
+
+void PacketTemplate::setSequence(uint8_t* packet, uint32_t seq) const {
+    if (protocol_number == PROTOCOL_TCP) {
+        setWord(packet, IPv4_HEADER_SIZE + 4, static_cast<uint16_t>(seq >> 16), false, true);
+        setWord(packet, IPv4_HEADER_SIZE + 6, static_cast<uint16_t>(seq), false, true);
+    }
+}
+
+void PacketTemplate::setEcho(uint8_t* packet, uint16_t identifier, uint16_t sequence) const {
+    if (protocol_number == PROTOCOL_ICMP) {
+        setWord(packet, IPv4_HEADER_SIZE + 4, identifier, false, true);
+        setWord(packet, IPv4_HEADER_SIZE + 6, sequence, false, true);
+    }
+}
@@ -6,8 +6,10 @@
 #include "icmp.hpp"
 #include "tcp.hpp"
 #include "udp.hpp"
+#include "packet_pool.hpp"
 
 constexpr size_t IPv4_HEADER_SIZE = 20;
+constexpr size_t IPv6_HEADER_SIZE = 40;
 constexpr size_t ICMP_HEADER_SIZE = 8;
 constexpr size_t TCP_HEADER_SIZE = 20;
 constexpr size_t UDP_HEADER_SIZE = 8;
@@ -16,6 +18,16 @@ constexpr size_t ICMP_CHECKSUM_OFFSET = 2;
 constexpr size_t TCP_CHECKSUM_OFFSET = 16;
 constexpr size_t UDP_CHECKSUM_OFFSET = 6;
 
+/* every builder also has a build(PacketPool&) that returns the packet in a pooled buffer,
+   an empty handle when building failed or the pool is exhausted */
+PacketHandle toPacketBuffer(PacketPool& pool, const std::vector<uint8_t>& packet);
+
+/* the IPv4 builders have a second, allocation-free mode next to build(): buildInto()
+   serializes the packet straight into a caller's buffer in one pass, headers written in
+   place and the payload copied while it is summed for the L4 checksum. build(PacketPool&)
+   goes through it into the pooled buffer. resolveAddresses() parses the address strings
+   once for it, unresolved builders parse them per packet (without allocating either) */
+
 class IPv4PacketBuilder {
 public:
     std::string ipv4_src_ip = "192.168.1.100";
@@ -25,9 +37,22 @@ public:
     uint8_t ipv4_tos = 0;
     uint16_t ipv4_flags_fragment_offset = 0x4000; // don't fragment flag set
 
+    /* pins ipv4_src_ip and ipv4_dst_ip for buildInto() and build(PacketPool&), call it
+       again after changing them. false, and nothing pinned, when one does not parse */
+    bool resolveAddresses();
+
 protected:
     std::vector<uint8_t> createIPHeader(uint16_t total_length, uint8_t protocol) const;
     uint32_t ipStringToInt(const std::string& ip) const;
+    // host-order addresses, the resolved ones or parsed now; false (logged) when they do not parse
+    bool hostAddresses(uint32_t& src_ip, uint32_t& dst_ip) const;
+    // the 20-byte header with its checksum at out
+    void writeIPHeader(uint8_t* out, uint16_t total_length, uint8_t protocol, uint32_t src_ip, uint32_t dst_ip) const;
+
+private:
+    bool resolved = false;
+    uint32_t resolved_src_ip = 0;
+    uint32_t resolved_dst_ip = 0;
 };
 
 class ICMPPacketBuilder : public IPv4PacketBuilder {
@@ -38,6 +63,11 @@ public:
     std::string icmp_payload = "Hello, ICMP World!";
 
     std::vector<uint8_t> build() const;
+    PacketHandle build(PacketPool& pool) const;
+    // the packet's size, at least what buildInto needs
+    size_t size() const { return IPv4_HEADER_SIZE + ICMP_HEADER_SIZE + icmp_payload.size(); }
+    // the packet at out, its size or 0 when capacity is short or the addresses do not parse
+    size_t buildInto(uint8_t* out, size_t capacity) const;
 };
 
 class TCPPacketBuilder : public IPv4PacketBuilder {
@@ -45,9 +75,15 @@ public:
     uint16_t tcp_src_port = 12345;
     uint16_t tcp_dst_port = 80;
     uint8_t tcp_flags = TCP_SYN;
+    uint32_t tcp_seq = 0x12345678;
     std::string tcp_payload = "";
 
     std::vector<uint8_t> build() const;
+    PacketHandle build(PacketPool& pool) const;
+    // the packet's size, at least what buildInto needs
+    size_t size() const { return IPv4_HEADER_SIZE + TCP_HEADER_SIZE + tcp_payload.size(); }
+    // the packet at out, its size or 0 when capacity is short or the addresses do not parse
+    size_t buildInto(uint8_t* out, size_t capacity) const;
 };
 
 class UDPPacketBuilder : public IPv4PacketBuilder {
@@ -57,4 +93,117 @@ public:
     std::string udp_payload = "Hello, UDP World!";
 
     std::vector<uint8_t> build() const;
+    PacketHandle build(PacketPool& pool) const;
+    // the packet's size, at least what buildInto needs
+    size_t size() const { return IPv4_HEADER_SIZE + UDP_HEADER_SIZE + udp_payload.size(); }
+    // the packet at out, its size or 0 when capacity is short or the addresses do not parse
+    size_t buildInto(uint8_t* out, size_t capacity) const;
+};
+
+class IPv6PacketBuilder {
+public:
+    std::string ipv6_src_ip = "2001:db8:1::100";
+    std::string ipv6_dst_ip = "2001:db8:1::50";
+    uint8_t ipv6_hop_limit = 64;
+    uint8_t ipv6_traffic_class = 0;
+    uint32_t ipv6_flow_label = 0;
+
+protected:
+    std::vector<uint8_t> createIPv6Header(uint16_t payload_length, uint8_t next_header) const;
+    // transport checksum over the IPv6 pseudo-header (RFC 8200 section 8.1) and the segment
+    uint16_t transportChecksum(const std::vector<uint8_t>& segment, uint8_t next_header) const;
+    IPv6Address parseAddress(const std::string& address) const;
+};
+
+class ICMPv6PacketBuilder : public IPv6PacketBuilder {
+public:
+    uint8_t icmp_type = ICMPV6_ECHO_REQUEST;
+    uint16_t icmp_id = 1234;
+    uint16_t icmp_seq = 1;
+    std::string icmp_payload = "Hello, ICMPv6 World!";
+
+    std::vector<uint8_t> build() const;
+    PacketHandle build(PacketPool& pool) const { return toPacketBuffer(pool, build()); }
+};
+
+class TCPv6PacketBuilder : public IPv6PacketBuilder {
+public:
+    uint16_t tcp_src_port = 12345;
+    uint16_t tcp_dst_port = 80;
+    uint8_t tcp_flags = TCP_SYN;
+    std::string tcp_payload = "";
+
+    std::vector<uint8_t> build() const;
+    PacketHandle build(PacketPool& pool) const { return toPacketBuffer(pool, build()); }
+};
+
+class UDPv6PacketBuilder : public IPv6PacketBuilder {
+public:
+    uint16_t udp_src_port = 12345;
+    uint16_t udp_dst_port = 53;
+    std::string udp_payload = "Hello, UDP World!";
+
+    std::vector<uint8_t> build() const;
+    PacketHandle build(PacketPool& pool) const { return toPacketBuffer(pool, build()); }
+};
+
+// the per-packet fields PacketTemplate::stamp can set in one go, host order
+struct PacketFields {
+    uint16_t identification;
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;          // the echo identifier for ICMP
+    uint16_t dst_port;          // not used by ICMP
+    uint32_t seq;               // TCP sequence number, its low half the ICMP echo sequence
+};
+
+/* one built IPv4 ICMP, TCP or UDP packet reused for a stream of packets that differ in a
+   few fields. stamp() copies it out, the setters then rewrite a field of the copy and
+   patch the checksums covering it with RFC 1624 incremental updates (the IPv4 header
+   checksum, the L4 checksum, both for the addresses in the pseudo-header) instead of
+   summing the packet again. values are host order, setters for the wrong protocol do
+   nothing */
+class PacketTemplate {
+public:
+    // builds the template from any IPv4 builder, false when it does not build
+    template <typename Builder>
+    bool assign(const Builder& builder) {
+        bytes.resize(builder.size());
+        return load(builder.buildInto(bytes.data(), bytes.size()));
+    }
+
+    size_t size() const { return bytes.size(); }
+    const uint8_t* data() const { return bytes.data(); }
+    uint8_t protocol() const { return protocol_number; }
+
+    // the template at out, its size or 0 when capacity is short (or no template is loaded)
+    size_t stamp(uint8_t* out, size_t capacity) const;
+    PacketHandle stamp(PacketPool& pool) const;
+    /* stamp() with every per-packet field set at once. both checksums come from sums of
+       the template's fixed words taken at assign() plus the new fields, the payload is
+       never summed again */
+    size_t stamp(uint8_t* out, size_t capacity, const PacketFields& fields) const;
+
+    void setIdentification(uint8_t* packet, uint16_t identification) const;
+    void setSrcIp(uint8_t* packet, uint32_t src_ip) const;
+    void setDstIp(uint8_t* packet, uint32_t dst_ip) const;
+    // TCP and UDP
+    void setSrcPort(uint8_t* packet, uint16_t port) const;
+    void setDstPort(uint8_t* packet, uint16_t port) const;
+    // TCP
+    void setSequence(uint8_t* packet, uint32_t seq) const;
+    // ICMP echo
+    void setEcho(uint8_t* packet, uint16_t identifier, uint16_t sequence) const;
+
+private:
+    bool load(size_t built);
+    // stores value at offset and patches the checksums covering the word
+    void setWord(uint8_t* packet, size_t offset, uint16_t value, bool in_ip_header, bool in_l4_checksum) const;
+
+    std::vector<uint8_t> bytes;
+    uint8_t protocol_number = 0;
+    size_t l4_checksum_offset = 0;
+    // sums of the words PacketFields does not cover, checksum fields left out
+    uint32_t ip_fixed_sum = 0;
+    uint32_t l4_fixed_sum = 0;
 };
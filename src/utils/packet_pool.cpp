@@ -0,0 +1,226 @@
+#include "packet_pool.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/* process-wide cache slot of the calling thread, the same index in every pool. a slot
+   is given back when its thread exits and the next thread takes it over together with
+   whatever buffers are still cached in it */
+std::atomic<bool> slot_taken[PACKET_POOL_MAX_THREADS];
+
+struct ThreadSlot {
+    int index = -1;
+    ThreadSlot() {
+        for (size_t i = 0; i < PACKET_POOL_MAX_THREADS; i++) {
+            bool expected = false;
+            if (slot_taken[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                index = static_cast<int>(i);
+                return;
+            }
+        }
+    }
+    ~ThreadSlot() {
+        if (index >= 0) {
+            slot_taken[index].store(false, std::memory_order_release);
+        }
+    }
+};
+
+}  // namespace
+
+uint8_t* PacketBuffer::append(size_t bytes) {
+    if (bytes > tailroom()) {
+        return nullptr;
+    }
+    uint8_t* tail = data() + length;
+    length += static_cast<uint32_t>(bytes);
+    return tail;
+}
+
+uint8_t* PacketBuffer::prepend(size_t bytes) {
+    if (bytes > offset) {
+        return nullptr;
+    }
+    offset -= static_cast<uint32_t>(bytes);
+    length += static_cast<uint32_t>(bytes);
+    return data();
+}
+
+bool PacketBuffer::trimFront(size_t bytes) {
+    if (bytes > length) {
+        return false;
+    }
+    offset += static_cast<uint32_t>(bytes);
+    length -= static_cast<uint32_t>(bytes);
+    return true;
+}
+
+bool PacketBuffer::trimBack(size_t bytes) {
+    if (bytes > length) {
+        return false;
+    }
+    length -= static_cast<uint32_t>(bytes);
+    return true;
+}
+
+void PacketBuffer::reset() {
+    offset = static_cast<uint32_t>(pool->headroom());
+    length = 0;
+}
+
+bool PacketBuffer::assign(const uint8_t* bytes, size_t count) {
+    reset();
+    uint8_t* out = append(count);
+    if (!out) {
+        return false;
+    }
+    std::memcpy(out, bytes, count);
+    return true;
+}
+
+PacketHandle PacketHandle::share() const {
+    if (!buffer) {
+        return PacketHandle();
+    }
+    buffer->refs.fetch_add(1, std::memory_order_relaxed);
+    return PacketHandle(buffer);
+}
+
+void PacketHandle::reset() {
+    if (!buffer) {
+        return;
+    }
+    // acq_rel so every write through another reference is done before the buffer is reused
+    if (buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        buffer->pool->release(buffer);
+    }
+    buffer = nullptr;
+}
+
+PacketPool::PacketPool(size_t count, size_t data_room, size_t headroom)
+    : data_room(data_room), default_headroom(std::min(headroom, data_room)),
+      arena(new uint8_t[count * data_room]), buffers(count),
+      caches(new ThreadCache[PACKET_POOL_MAX_THREADS]) {
+    shared_free.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        PacketBuffer& buffer = buffers[i];
+        buffer.start = arena.get() + i * data_room;
+        buffer.pool = this;
+        buffer.room = static_cast<uint32_t>(data_room);
+        shared_free.push_back(&buffer);
+    }
+    // hand out low addresses first
+    std::reverse(shared_free.begin(), shared_free.end());
+    log_debug("Packet pool: %zu buffers of %zu bytes (%zu headroom)", count, data_room, default_headroom);
+}
+
+PacketPool::~PacketPool() {
+    PacketPoolStats totals = stats();
+    if (totals.inUse() != 0) {
+        log_warning("Packet pool destroyed with %llu buffers still in use",
+                    static_cast<unsigned long long>(totals.inUse()));
+    }
+}
+
+PacketPool::ThreadCache* PacketPool::localCache(ThreadCache* caches) {
+    static thread_local ThreadSlot slot;
+    return slot.index >= 0 ? &caches[slot.index] : nullptr;
+}
+
+PacketBuffer* PacketPool::take(PacketBuffer* buffer) {
+    buffer->refs.store(1, std::memory_order_relaxed);
+    buffer->offset = static_cast<uint32_t>(default_headroom);
+    buffer->length = 0;
+    return buffer;
+}
+
+PacketHandle PacketPool::alloc() {
+    ThreadCache* cache = localCache(caches.get());
+    if (!cache) {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        if (shared_free.empty()) {
+            bump(shared_stats.exhausted);
+            return PacketHandle();
+        }
+        PacketBuffer* buffer = shared_free.back();
+        shared_free.pop_back();
+        bump(shared_stats.allocs);
+        return PacketHandle(take(buffer));
+    }
+
+    if (cache->count == 0) {
+        // refill half the cache in one trip to the shared list
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        size_t moved = std::min(PACKET_POOL_CACHE_SIZE, shared_free.size());
+        std::copy(shared_free.end() - moved, shared_free.end(), cache->buffers);
+        shared_free.resize(shared_free.size() - moved);
+        cache->count = moved;
+        if (moved > 0) {
+            bump(cache->refills);
+        }
+    }
+    if (cache->count == 0) {
+        bump(cache->exhausted);
+        return PacketHandle();
+    }
+    bump(cache->allocs);
+    return PacketHandle(take(cache->buffers[--cache->count]));
+}
+
+PacketHandle PacketPool::copyIn(const uint8_t* bytes, size_t count) {
+    PacketHandle packet = alloc();
+    if (packet && !packet->assign(bytes, count)) {
+        return PacketHandle();
+    }
+    return packet;
+}
+
+void PacketPool::release(PacketBuffer* buffer) {
+    ThreadCache* cache = localCache(caches.get());
+    if (!cache) {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        shared_free.push_back(buffer);
+        bump(shared_stats.frees);
+        return;
+    }
+
+    if (cache->count == 2 * PACKET_POOL_CACHE_SIZE) {
+        // full: the older half goes back to the shared list, the hot half stays
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        shared_free.insert(shared_free.end(), cache->buffers, cache->buffers + PACKET_POOL_CACHE_SIZE);
+        std::copy(cache->buffers + PACKET_POOL_CACHE_SIZE, cache->buffers + cache->count, cache->buffers);
+        cache->count -= PACKET_POOL_CACHE_SIZE;
+        bump(cache->flushes);
+    }
+    cache->buffers[cache->count++] = buffer;
+    bump(cache->frees);
+}
+
+void PacketPool::flushCache() {
+    ThreadCache* cache = localCache(caches.get());
+    if (!cache || cache->count == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    shared_free.insert(shared_free.end(), cache->buffers, cache->buffers + cache->count);
+    cache->count = 0;
+    bump(cache->flushes);
+}
+
+PacketPoolStats PacketPool::stats() const {
+    PacketPoolStats totals;
+    auto add = [&totals](const ThreadCache& cache) {
+        totals.allocs += cache.allocs.load(std::memory_order_relaxed);
+        totals.frees += cache.frees.load(std::memory_order_relaxed);
+        totals.refills += cache.refills.load(std::memory_order_relaxed);
+        totals.flushes += cache.flushes.load(std::memory_order_relaxed);
+        totals.exhausted += cache.exhausted.load(std::memory_order_relaxed);
+    };
+    add(shared_stats);
+    for (size_t i = 0; i < PACKET_POOL_MAX_THREADS; i++) {
+        add(caches[i]);
+    }
+    return totals;
+}
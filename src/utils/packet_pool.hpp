@@ -0,0 +1,164 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "packet_view.hpp"
+
+/* mbuf-style packet buffers.
+   A PacketPool carves one arena into fixed-size buffers up front and never touches the
+   heap again: allocating and freeing a packet is popping and pushing a pointer. Each
+   buffer keeps headroom in front of the packet, so encapsulation headers are prepended
+   without moving the payload, and tailroom behind it for trailers.
+
+   Buffers are reference counted and handed around as move-only PacketHandles, the last
+   handle to go returns the buffer to its pool. Every thread frees into and allocates
+   from its own cache first and only takes the shared free list's lock to move
+   PACKET_POOL_CACHE_SIZE buffers at a time, the same fixed slot table scheme as the
+   RcuDomain readers. Threads past PACKET_POOL_MAX_THREADS go straight to the shared
+   list. A buffer may be freed on a different thread than the one that allocated it. */
+
+constexpr size_t PACKET_DEFAULT_HEADROOM = 128;
+constexpr size_t PACKET_DEFAULT_DATA_ROOM = 2048;
+constexpr size_t PACKET_POOL_CACHE_SIZE = 64;
+constexpr size_t PACKET_POOL_MAX_THREADS = 64;
+
+class PacketPool;
+
+// allocations and frees count buffers, refills and flushes count trips to the shared list
+struct PacketPoolStats {
+    uint64_t allocs = 0;
+    uint64_t frees = 0;
+    uint64_t refills = 0;
+    uint64_t flushes = 0;
+    uint64_t exhausted = 0;     // alloc() calls that found no free buffer
+
+    uint64_t inUse() const { return allocs - frees; }
+};
+
+class PacketBuffer {
+public:
+    uint8_t* data() { return start + offset; }
+    const uint8_t* data() const { return start + offset; }
+    size_t size() const { return length; }
+    size_t headroom() const { return offset; }
+    size_t tailroom() const { return room - offset - length; }
+    PacketView view() const { return PacketView(data(), length); }
+
+    // grow the packet at the tail or into the headroom, nullptr when there is no room
+    uint8_t* append(size_t bytes);
+    uint8_t* prepend(size_t bytes);
+    // shrink it from either end, false when the packet is shorter than bytes
+    bool trimFront(size_t bytes);
+    bool trimBack(size_t bytes);
+    // empties the packet and restores the pool's headroom
+    void reset();
+    // reset() and copy bytes in, false when they do not fit the data room
+    bool assign(const uint8_t* bytes, size_t count);
+
+    uint32_t refCount() const { return refs.load(std::memory_order_relaxed); }
+
+private:
+    friend class PacketPool;
+    friend class PacketHandle;
+
+    uint8_t* start = nullptr;
+    PacketPool* pool = nullptr;
+    uint32_t room = 0;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    std::atomic<uint32_t> refs{0};
+};
+
+/* owning reference to a pooled buffer, moved between pipeline stages instead of the
+   bytes. share() hands out another reference to the same buffer, e.g. to mirror a
+   packet to a second output; a shared buffer must not be written */
+class PacketHandle {
+public:
+    PacketHandle() = default;
+    ~PacketHandle() { reset(); }
+    PacketHandle(PacketHandle&& other) noexcept : buffer(other.buffer) { other.buffer = nullptr; }
+    PacketHandle& operator=(PacketHandle&& other) noexcept {
+        if (this != &other) {
+            reset();
+            buffer = other.buffer;
+            other.buffer = nullptr;
+        }
+        return *this;
+    }
+    PacketHandle(const PacketHandle&) = delete;
+    PacketHandle& operator=(const PacketHandle&) = delete;
+
+    PacketHandle share() const;
+    // drops this reference, the last one returns the buffer to its pool
+    void reset();
+
+    explicit operator bool() const { return buffer != nullptr; }
+    PacketBuffer* get() const { return buffer; }
+    PacketBuffer* operator->() const { return buffer; }
+    PacketBuffer& operator*() const { return *buffer; }
+    PacketView view() const { return buffer ? buffer->view() : PacketView(); }
+
+private:
+    friend class PacketPool;
+    explicit PacketHandle(PacketBuffer* buffer) : buffer(buffer) {}
+
+    PacketBuffer* buffer = nullptr;
+};
+
+class PacketPool {
+public:
+    explicit PacketPool(size_t buffers, size_t data_room = PACKET_DEFAULT_DATA_ROOM,
+                        size_t headroom = PACKET_DEFAULT_HEADROOM);
+    ~PacketPool();
+    PacketPool(const PacketPool&) = delete;
+    PacketPool& operator=(const PacketPool&) = delete;
+
+    // an empty packet with the default headroom, or an empty handle when the pool is exhausted
+    PacketHandle alloc();
+    // alloc() plus assign(), empty handle when the pool is exhausted or the bytes do not fit
+    PacketHandle copyIn(const uint8_t* bytes, size_t count);
+
+    // returns the calling thread's cached buffers to the shared list, e.g. before it exits
+    void flushCache();
+
+    size_t capacity() const { return buffers.size(); }
+    size_t dataRoom() const { return data_room; }
+    size_t headroom() const { return default_headroom; }
+    // summed over every thread's counters, exact once the threads are quiet
+    PacketPoolStats stats() const;
+
+private:
+    friend class PacketHandle;
+
+    // one thread's free buffers and counters, only that thread writes them
+    struct alignas(64) ThreadCache {
+        PacketBuffer* buffers[2 * PACKET_POOL_CACHE_SIZE];
+        size_t count = 0;
+        std::atomic<uint64_t> allocs{0};
+        std::atomic<uint64_t> frees{0};
+        std::atomic<uint64_t> refills{0};
+        std::atomic<uint64_t> flushes{0};
+        std::atomic<uint64_t> exhausted{0};
+    };
+
+    size_t data_room;
+    size_t default_headroom;
+    std::unique_ptr<uint8_t[]> arena;
+    std::vector<PacketBuffer> buffers;
+
+    std::mutex shared_mutex;
+    std::vector<PacketBuffer*> shared_free;
+    ThreadCache shared_stats;    // counters of threads without a cache slot, updated under shared_mutex
+    std::unique_ptr<ThreadCache[]> caches;
+
+    void release(PacketBuffer* buffer);
+    PacketBuffer* take(PacketBuffer* buffer);
+    static ThreadCache* localCache(ThreadCache* caches);
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+        // single writer per counter, no read-modify-write needed
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+};
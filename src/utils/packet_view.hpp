@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <arpa/inet.h>
+
+/* non-owning view of a packet: a pointer and a length, the bytes are never copied.
+   fields are read on demand, bounds-checked and converted from network byte order at
+   that point, so a parser only pays for the fields it actually looks at. a read that
+   does not fit in the packet returns 0; parsers check has() once per header instead.
+   the bytes must outlive the view, it can sit on a vector, a ring slot or a mapped file */
+class PacketView {
+public:
+    PacketView() = default;
+    PacketView(const uint8_t* data, size_t length) : bytes(data), length(length) {}
+    // implicit, so anything holding a std::vector packet can hand it straight to a parser
+    PacketView(const std::vector<uint8_t>& packet) : bytes(packet.data()), length(packet.size()) {}
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    // true when count bytes starting at offset are all inside the packet
+    bool has(size_t offset, size_t count) const { return offset <= length && count <= length - offset; }
+
+    uint8_t u8(size_t offset) const { return has(offset, 1) ? bytes[offset] : 0; }
+    uint16_t u16(size_t offset) const {
+        uint16_t value = 0;
+        if (has(offset, 2)) {
+            std::memcpy(&value, bytes + offset, 2);
+        }
+        return ntohs(value);
+    }
+    uint32_t u32(size_t offset) const {
+        uint32_t value = 0;
+        if (has(offset, 4)) {
+            std::memcpy(&value, bytes + offset, 4);
+        }
+        return ntohl(value);
+    }
+    // copies count raw bytes (addresses and the like), false and nothing copied when they are not all there
+    bool copy(size_t offset, void* out, size_t count) const {
+        if (!has(offset, count)) {
+            return false;
+        }
+        std::memcpy(out, bytes + offset, count);
+        return true;
+    }
+
+    // the bytes from offset to the end, empty when offset is past it
+    PacketView from(size_t offset) const {
+        return offset <= length ? PacketView(bytes + offset, length - offset) : PacketView();
+    }
+
+private:
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+};
+
+/* big-endian fields of bytes the caller owns, for the code that writes packets in place
+   (translation, fragmentation, builders). whatever only reads a packet goes through
+   PacketView, which checks the bounds these leave to the caller */
+inline uint16_t load16(const uint8_t* at) {
+    return static_cast<uint16_t>((at[0] << 8) | at[1]);
+}
+
+inline uint32_t load32(const uint8_t* at) {
+    return (static_cast<uint32_t>(at[0]) << 24) | (static_cast<uint32_t>(at[1]) << 16) |
+           (static_cast<uint32_t>(at[2]) << 8) | at[3];
+}
+
+inline void store16(uint8_t* at, uint16_t value) {
+    at[0] = static_cast<uint8_t>(value >> 8);
+    at[1] = static_cast<uint8_t>(value);
+}
+
+inline void store32(uint8_t* at, uint32_t value) {
+    store16(at, static_cast<uint16_t>(value >> 16));
+    store16(at + 2, static_cast<uint16_t>(value));
+}
@@ -0,0 +1,101 @@
+#include "rcu.hpp"
+#include "logger.hpp"
+#include <thread>
+
+RcuDomain::~RcuDomain() {
+    // no reader can still be running once the owner is destroyed
+    for (const auto& item : retired) {
+        item.reclaimer();
+    }
+}
+
+int RcuDomain::registerReader() {
+    for (size_t i = 0; i < MAX_READERS; i++) {
+        bool expected = false;
+        if (readers[i].in_use.compare_exchange_strong(expected, true)) {
+            readers[i].epoch.store(global_epoch.load(), std::memory_order_seq_cst);
+            registered.fetch_add(1);
+            return static_cast<int>(i);
+        }
+    }
+    log_error("RCU reader table full (%zu readers)", MAX_READERS);
+    return -1;
+}
+
+void RcuDomain::unregisterReader(int reader_id) {
+    readers[reader_id].epoch.store(READER_OFFLINE, std::memory_order_release);
+    readers[reader_id].in_use.store(false, std::memory_order_release);
+    registered.fetch_sub(1);
+}
+
+void RcuDomain::quiescent(int reader_id) {
+    readers[reader_id].epoch.store(global_epoch.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+void RcuDomain::offline(int reader_id) {
+    readers[reader_id].epoch.store(READER_OFFLINE, std::memory_order_release);
+}
+
+void RcuDomain::online(int reader_id) {
+    /* seq_cst so a writer scanning the slots either sees this reader online, or the
+       reader's following loads see everything the writer unlinked before the scan */
+    readers[reader_id].epoch.store(global_epoch.load(), std::memory_order_seq_cst);
+}
+
+void RcuDomain::retire(Reclaimer reclaimer) {
+    // the memory is unlinked already, readers that report the new epoch cannot see it
+    uint64_t epoch = global_epoch.fetch_add(1) + 1;
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex);
+        retired.push_back({std::move(reclaimer), epoch});
+    }
+    reclaim();
+}
+
+void RcuDomain::reclaim() {
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex);
+        uint64_t safe_epoch = minReaderEpoch();
+        auto keep = retired.begin();
+        for (auto it = retired.begin(); it != retired.end(); ++it) {
+            if (it->epoch <= safe_epoch) {
+                ready.push_back(std::move(*it));
+            } else {
+                *keep++ = std::move(*it);
+            }
+        }
+        retired.erase(keep, retired.end());
+    }
+
+    for (const auto& item : ready) {
+        item.reclaimer();
+    }
+}
+
+void RcuDomain::synchronize() {
+    uint64_t target = global_epoch.fetch_add(1) + 1;
+    while (minReaderEpoch() < target) {
+        std::this_thread::yield();
+    }
+    reclaim();
+}
+
+size_t RcuDomain::pending() const {
+    std::lock_guard<std::mutex> lock(retired_mutex);
+    return retired.size();
+}
+
+uint64_t RcuDomain::minReaderEpoch() const {
+    uint64_t min_epoch = UINT64_MAX;
+    if (registered.load(std::memory_order_seq_cst) == 0) {
+        return min_epoch;
+    }
+    for (const auto& reader : readers) {
+        uint64_t epoch = reader.epoch.load(std::memory_order_seq_cst);
+        if (epoch != READER_OFFLINE && epoch < min_epoch) {
+            min_epoch = epoch;
+        }
+    }
+    return min_epoch;
+}
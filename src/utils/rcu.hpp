@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/* Quiescent-state-based reclamation (QSBR flavour of RCU).
+   Readers never lock or write shared state on the lookup path. Each reader thread
+   registers once and calls quiescent() between bursts, promising it holds no pointers
+   into shared structures at that point. Writers unlink old memory and retire() a
+   callback that frees or recycles it, which runs once every online reader has passed
+   a quiescent state. Callbacks run on the writer side (inside retire, reclaim or
+   synchronize), so they may touch state guarded by the writer's lock.
+
+   Threads that are not registered must not read concurrently with writers. When no
+   readers are registered, retired memory is freed straight away.
+*/
+class RcuDomain {
+public:
+    static constexpr size_t MAX_READERS = 64;
+    using Reclaimer = std::function<void()>;
+
+    RcuDomain() = default;
+    ~RcuDomain();
+    RcuDomain(const RcuDomain&) = delete;
+    RcuDomain& operator=(const RcuDomain&) = delete;
+
+    // reader side, ids are slots in a fixed table. registerReader returns -1 when full
+    int registerReader();
+    void unregisterReader(int reader_id);
+    void quiescent(int reader_id);
+    void offline(int reader_id);   // reader goes idle, writers stop waiting for it
+    void online(int reader_id);
+
+    // writer side
+    void retire(Reclaimer reclaimer);
+    void reclaim();                // frees everything all online readers have moved past
+    void synchronize();            // waits for a grace period, then reclaims
+
+    size_t pending() const;
+    uint64_t epoch() const { return global_epoch.load(std::memory_order_acquire); }
+
+private:
+    static constexpr uint64_t READER_OFFLINE = 0;
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{READER_OFFLINE};
+        std::atomic<bool> in_use{false};
+    };
+
+    struct Retired {
+        Reclaimer reclaimer;
+        uint64_t epoch;
+    };
+
+    ReaderSlot readers[MAX_READERS];
+    std::atomic<uint64_t> global_epoch{1};
+    std::atomic<size_t> registered{0};
+
+    mutable std::mutex retired_mutex;
+    std::vector<Retired> retired;
+
+    uint64_t minReaderEpoch() const;
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/* bounded lock-free ring between exactly one producer thread and one consumer thread.
+   each side owns one index and only reads the other's, with acquire/release pairs, so
+   no read-modify-write or lock is needed. both sides keep a private copy of the other
+   index and only reload it when the ring looks full (or empty), which keeps the two
+   index cache lines from bouncing on every item. the burst calls move a whole batch
+   with a single index publish.
+   capacity is rounded up to a power of two, items are moved in and out */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.reset(new T[size]);
+        mask = size - 1;
+    }
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+    // exact only on the producer or consumer thread while the other side is idle
+    size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+
+    // producer side: moves up to count items in, returns how many fit
+    size_t pushBurst(T* items, size_t count) {
+        size_t write = tail.load(std::memory_order_relaxed);
+        size_t free_slots = capacity() - (write - producer_head);
+        if (free_slots < count) {
+            producer_head = head.load(std::memory_order_acquire);
+            free_slots = capacity() - (write - producer_head);
+        }
+        size_t n = count < free_slots ? count : free_slots;
+        for (size_t i = 0; i < n; i++) {
+            slots[(write + i) & mask] = std::move(items[i]);
+        }
+        tail.store(write + n, std::memory_order_release);
+        return n;
+    }
+    bool push(T&& item) { return pushBurst(&item, 1) == 1; }
+
+    // consumer side: moves up to max items out, returns how many there were
+    size_t popBurst(T* out, size_t max) {
+        size_t read = head.load(std::memory_order_relaxed);
+        size_t available = consumer_tail - read;
+        if (available < max) {
+            consumer_tail = tail.load(std::memory_order_acquire);
+            available = consumer_tail - read;
+        }
+        size_t n = max < available ? max : available;
+        for (size_t i = 0; i < n; i++) {
+            out[i] = std::move(slots[(read + i) & mask]);
+        }
+        head.store(read + n, std::memory_order_release);
+        return n;
+    }
+    bool pop(T& out) { return popBurst(&out, 1) == 1; }
+
+private:
+    std::unique_ptr<T[]> slots;
+    size_t mask = 0;
+
+    // consumer's cache line: its index and its copy of the producer's
+    alignas(64) std::atomic<size_t> head{0};
+    size_t consumer_tail = 0;
+    // producer's cache line
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t producer_head = 0;
+};
@@ -0,0 +1,310 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* single-level timer wheel over a fixed set of entries, numbered 0..entries - 1 by the
+   owner (the slots of its own table). the wheel keeps a ring of slots, tick_ns apart,
+   each the head of an intrusive doubly linked list of the entries due in that tick, so
+   scheduling, cancelling and firing a timer are O(1) and nothing is ever scanned but the
+   slots time has passed. no allocation after construction.
+
+   deadlines are at most slots - 1 ticks ahead of the wheel's time, later ones are
+   clamped to that. within a slot timers fire in the order they were scheduled */
+class TimerWheel {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    TimerWheel(size_t entries, size_t slots, uint64_t tick_ns)
+        : tick(tick_ns ? tick_ns : 1), heads(roundUp(slots), NONE), links(entries) {
+        slot_mask = heads.size() - 1;
+    }
+
+    // (re)arms entry's timer to fire once now_ns has passed deadline_ns
+    void schedule(uint32_t entry, uint64_t deadline_ns) {
+        cancel(entry);
+        uint64_t due = deadline_ns / tick;
+        if (!started) {
+            current = due;
+            started = true;
+        }
+        due = due < current ? current : due;
+        due = due - current > slot_mask ? current + slot_mask : due;
+        size_t slot = due & slot_mask;
+        Link& link = links[entry];
+        uint32_t head = heads[slot];
+        if (head == NONE) {
+            link.next = link.prev = entry;
+            heads[slot] = entry;
+        } else {
+            // appended at the tail, the head's prev
+            link.prev = links[head].prev;
+            link.next = head;
+            links[link.prev].next = entry;
+            links[head].prev = entry;
+        }
+        link.slot = static_cast<uint32_t>(slot);
+        armed++;
+        first_due = due < first_due ? due : first_due;
+    }
+
+    void cancel(uint32_t entry) {
+        Link& link = links[entry];
+        if (link.slot == NONE) {
+            return;
+        }
+        if (link.next == entry) {
+            heads[link.slot] = NONE;
+        } else {
+            links[link.prev].next = link.next;
+            links[link.next].prev = link.prev;
+            if (heads[link.slot] == entry) {
+                heads[link.slot] = link.next;
+            }
+        }
+        link.slot = NONE;
+        armed--;
+    }
+
+    bool scheduled(uint32_t entry) const { return links[entry].slot != NONE; }
+    size_t size() const { return armed; }
+
+    /* moves the wheel's time to now_ns and calls expire(entry) for every timer that
+       came due on the way, earliest tick first. the entry is off the wheel by then, the
+       callback may schedule or cancel any timer */
+    template <typename Expire>
+    void advance(uint64_t now_ns, Expire&& expire) {
+        uint64_t now = now_ns / tick;
+        if (!started) {
+            current = now;
+            started = true;
+            return;
+        }
+        // a slot is due once its tick is over, every slot at most once however far time jumped
+        for (size_t steps = 0; current < now && armed > 0 && steps <= slot_mask; steps++, current++) {
+            size_t slot = current & slot_mask;
+            while (heads[slot] != NONE) {
+                uint32_t entry = heads[slot];
+                cancel(entry);
+                expire(entry);
+            }
+        }
+        if (current < now) {
+            current = now;
+        }
+    }
+
+    /* the entry due first, NONE when nothing is scheduled. the empty slots in front of it
+       are remembered, asking again while the wheel fills up behind it is O(1) */
+    uint32_t earliest() {
+        if (armed == 0) {
+            return NONE;
+        }
+        uint64_t at = first_due > current ? first_due : current;
+        for (uint64_t end = current + slot_mask; at <= end; at++) {
+            uint32_t head = heads[at & slot_mask];
+            if (head != NONE) {
+                first_due = at;
+                return head;
+            }
+        }
+        return NONE;
+    }
+
+private:
+    struct Link {
+        uint32_t next = NONE;
+        uint32_t prev = NONE;
+        uint32_t slot = NONE;       // NONE while not scheduled
+    };
+
+    uint64_t tick;
+    std::vector<uint32_t> heads;
+    std::vector<Link> links;
+    size_t slot_mask = 0;
+    uint64_t current = 0;           // the tick of the next slot to fire
+    uint64_t first_due = 0;         // no timer is due before this tick
+    bool started = false;
+    size_t armed = 0;
+
+    static size_t roundUp(size_t slots) {
+        size_t size = 2;
+        while (size < slots) {
+            size <<= 1;
+        }
+        return size;
+    }
+};
+
+/* hierarchical timer wheel (Varghese and Lauck) over a fixed set of entries, for
+   timeouts that span many orders of the tick: TimerWheel's single ring would need a slot
+   per tick of the longest one. HIERARCHY_LEVELS rings of HIERARCHY_SLOTS slots each,
+   level k a slot per HIERARCHY_SLOTS^k ticks. a timer goes into the lowest level its
+   deadline fits and moves down a level whenever time enters the span of its slot, so
+   scheduling and cancelling are O(1) and every timer is moved at most once per level on
+   its way to firing. no allocation after construction.
+
+   deadlines are at most HIERARCHY_SLOTS^HIERARCHY_LEVELS - 1 ticks ahead, later ones are
+   clamped to that. stretches of time with nothing to fire are skipped a slot of the
+   lowest busy level at a time */
+class HierarchicalTimerWheel {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr size_t HIERARCHY_LEVELS = 4;
+    static constexpr size_t HIERARCHY_BITS = 6;
+    static constexpr size_t HIERARCHY_SLOTS = size_t(1) << HIERARCHY_BITS;
+    static constexpr uint64_t HIERARCHY_SPAN = uint64_t(1) << (HIERARCHY_BITS * HIERARCHY_LEVELS);
+
+    HierarchicalTimerWheel(size_t entries, uint64_t tick_ns)
+        : tick(tick_ns ? tick_ns : 1), heads(HIERARCHY_LEVELS * HIERARCHY_SLOTS, NONE), links(entries) {}
+
+    // (re)arms entry's timer to fire once now_ns has passed deadline_ns
+    void schedule(uint32_t entry, uint64_t deadline_ns) {
+        cancel(entry);
+        uint64_t due = deadline_ns / tick;
+        if (!started) {
+            current = due;
+            started = true;
+        }
+        due = due < current ? current : due;
+        due = due - current >= HIERARCHY_SPAN ? current + HIERARCHY_SPAN - 1 : due;
+        links[entry].due = static_cast<uint32_t>(due);
+        insert(entry, due);
+        armed++;
+    }
+
+    void cancel(uint32_t entry) {
+        if (links[entry].slot == NONE) {
+            return;
+        }
+        unlink(entry);
+        armed--;
+    }
+
+    bool scheduled(uint32_t entry) const { return links[entry].slot != NONE; }
+    size_t size() const { return armed; }
+    // bytes held, all allocated up front
+    size_t memoryBytes() const { return heads.size() * sizeof(uint32_t) + links.size() * sizeof(Link); }
+
+    /* moves the wheel's time to now_ns and calls expire(entry) for every timer that
+       came due on the way, earliest tick first. the entry is off the wheel by then, the
+       callback may schedule or cancel any timer */
+    template <typename Expire>
+    void advance(uint64_t now_ns, Expire&& expire) {
+        uint64_t now = now_ns / tick;
+        if (!started) {
+            current = now;
+            started = true;
+            return;
+        }
+        while (current < now && armed > 0) {
+            cascade();
+            if (counts[0] == 0) {
+                // nothing fires before the next slot of the lowest level holding timers
+                size_t level = 1;
+                while (counts[level] == 0) {
+                    level++;
+                }
+                uint64_t next = ((current >> (HIERARCHY_BITS * level)) + 1) << (HIERARCHY_BITS * level);
+                current = next < now ? next : now;
+                continue;
+            }
+            /* timers (re)armed by the callbacks go into later ticks, one a full turn ahead
+               lands behind this tick's in the same slot */
+            uint32_t* head = &heads[current & (HIERARCHY_SLOTS - 1)];
+            uint32_t firing = static_cast<uint32_t>(current++);
+            while (*head != NONE && links[*head].due == firing) {
+                uint32_t entry = *head;
+                cancel(entry);
+                expire(entry);
+            }
+        }
+        if (current < now) {
+            current = now;
+        }
+    }
+
+private:
+    struct Link {
+        uint32_t next = NONE;
+        uint32_t prev = NONE;
+        uint32_t slot = NONE;       // level * HIERARCHY_SLOTS + slot, NONE while not scheduled
+        uint32_t due = 0;           // low 32 bits of the tick, never more than HIERARCHY_SPAN ahead
+    };
+
+    uint64_t tick;
+    std::vector<uint32_t> heads;
+    std::vector<Link> links;
+    size_t counts[HIERARCHY_LEVELS] = {};
+    uint64_t current = 0;           // the tick of the next slot to fire
+    bool started = false;
+    size_t armed = 0;
+
+    void insert(uint32_t entry, uint64_t due) {
+        uint64_t delta = due - current;
+        size_t level = 0;
+        while (level + 1 < HIERARCHY_LEVELS && delta >= (uint64_t(1) << (HIERARCHY_BITS * (level + 1)))) {
+            level++;
+        }
+        size_t slot = level * HIERARCHY_SLOTS + ((due >> (HIERARCHY_BITS * level)) & (HIERARCHY_SLOTS - 1));
+        Link& link = links[entry];
+        uint32_t head = heads[slot];
+        if (head == NONE) {
+            link.next = link.prev = entry;
+            heads[slot] = entry;
+        } else {
+            // appended at the tail, the head's prev
+            link.prev = links[head].prev;
+            link.next = head;
+            links[link.prev].next = entry;
+            links[head].prev = entry;
+        }
+        link.slot = static_cast<uint32_t>(slot);
+        counts[level]++;
+    }
+
+    void unlink(uint32_t entry) {
+        Link& link = links[entry];
+        if (link.next == entry) {
+            heads[link.slot] = NONE;
+        } else {
+            links[link.prev].next = link.next;
+            links[link.next].prev = link.prev;
+            if (heads[link.slot] == entry) {
+                heads[link.slot] = link.next;
+            }
+        }
+        counts[link.slot / HIERARCHY_SLOTS]--;
+        link.slot = NONE;
+    }
+
+    /* on a level's slot boundary the timers of the slot time just entered move down,
+       the highest level first so they can fall through several levels at once */
+    void cascade() {
+        for (size_t level = HIERARCHY_LEVELS - 1; level > 0; level--) {
+            size_t shift = HIERARCHY_BITS * level;
+            if ((current & ((uint64_t(1) << shift) - 1)) != 0 || counts[level] == 0) {
+                continue;
+            }
+            uint32_t& head = heads[level * HIERARCHY_SLOTS + ((current >> shift) & (HIERARCHY_SLOTS - 1))];
+            // detached first, a timer a full turn ahead goes back into the same slot
+            uint32_t entry = head;
+            if (entry == NONE) {
+                continue;
+            }
+            uint32_t last = links[entry].prev;
+            head = NONE;
+            while (true) {
+                Link& link = links[entry];
+                uint32_t next = link.next;
+                counts[level]--;
+                link.slot = NONE;
+                insert(entry, current + static_cast<uint32_t>(link.due - static_cast<uint32_t>(current)));
+                if (entry == last) {
+                    break;
+                }
+                entry = next;
+            }
+        }
+    }
+};